@@ -7,6 +7,8 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/TextureResidency.h"
+#include "../../Common/TexturePacker.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -47,6 +49,8 @@ struct RenderItem
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
+	BoundingBox Bounds;
+
     // DrawIndexedInstanced parameters.
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
@@ -79,6 +83,8 @@ private:
 	void UpdateMainPassCB(const GameTimer& gt);
 
 	void LoadTextures();
+	bool LoadPackedTextures(const std::vector<std::wstring>& filenames);
+	void StreamTextures();
     void BuildRootSignature();
 	void BuildDescriptorHeaps();
     void BuildShadersAndInputLayout();
@@ -121,6 +127,29 @@ private:
 
 	Camera mCamera;
 
+	// Load only the low mips of each texture, then stream in sharper ones as the
+	// camera gets close, within mTextureResidency's budget.
+	bool mStreamTextures = false;
+	TextureResidency mTextureResidency;
+
+	// A texture that fails to register is loaded whole, so residency indices
+	// can skip SRV heap slots; these map between the two.
+	struct StreamedTexture
+	{
+		std::string Name;
+		UINT SrvHeapIndex;
+	};
+	std::vector<StreamedTexture> mStreamedTextures; // By residency index.
+	std::vector<int> mResidencyIndices;             // By SRV heap index; -1 if not streamed.
+
+	// Pack the textures into arrays at load time, so materials that share a texture
+	// size use one SRV and pick a slice.  Takes precedence over streaming.
+	bool mUsePackedTextures = false;
+	TexturePacker mTexturePacker;
+
+	// Texture names by packed texture index, which is also the SRV heap index.
+	std::vector<std::string> mPackedTextures;
+
     POINT mLastMousePos;
 };
 
@@ -218,6 +247,9 @@ void CameraAndDynamicIndexingApp::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+	if(mStreamTextures && !mUsePackedTextures)
+		StreamTextures();
+
 	AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
 	UpdateMaterialBuffer(gt);
@@ -390,6 +422,7 @@ void CameraAndDynamicIndexingApp::UpdateMaterialBuffer(const GameTimer& gt)
 			matData.Roughness = mat->Roughness;
 			XMStoreFloat4x4(&matData.MatTransform, XMMatrixTranspose(matTransform));
 			matData.DiffuseMapIndex = mat->DiffuseSrvHeapIndex;
+			matData.DiffuseMapSlice = mat->DiffuseSrvSlice;
 
 			currMaterialBuffer->CopyData(mat->MatCBIndex, matData);
 
@@ -436,38 +469,167 @@ void CameraAndDynamicIndexingApp::UpdateMainPassCB(const GameTimer& gt)
 
 void CameraAndDynamicIndexingApp::LoadTextures()
 {
-	auto bricksTex = std::make_unique<Texture>();
-	bricksTex->Name = "bricksTex";
-	bricksTex->Filename = L"../../Textures/bricks.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), bricksTex->Filename.c_str(),
-		bricksTex->Resource, bricksTex->UploadHeap));
-
-	auto stoneTex = std::make_unique<Texture>();
-	stoneTex->Name = "stoneTex";
-	stoneTex->Filename = L"../../Textures/stone.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), stoneTex->Filename.c_str(),
-		stoneTex->Resource, stoneTex->UploadHeap));
-
-	auto tileTex = std::make_unique<Texture>();
-	tileTex->Name = "tileTex";
-	tileTex->Filename = L"../../Textures/tile.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), tileTex->Filename.c_str(),
-		tileTex->Resource, tileTex->UploadHeap));
-
-	auto crateTex = std::make_unique<Texture>();
-	crateTex->Name = "crateTex";
-	crateTex->Filename = L"../../Textures/WoodCrate01.dds";
-	ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
-		mCommandList.Get(), crateTex->Filename.c_str(),
-		crateTex->Resource, crateTex->UploadHeap));
-
-	mTextures[bricksTex->Name] = std::move(bricksTex);
-	mTextures[stoneTex->Name] = std::move(stoneTex);
-	mTextures[tileTex->Name] = std::move(tileTex);
-	mTextures[crateTex->Name] = std::move(crateTex);
+	// In SRV heap order.
+	std::vector<std::string> texNames =
+	{
+		"bricksTex",
+		"stoneTex",
+		"tileTex",
+		"crateTex"
+	};
+
+	std::vector<std::wstring> texFilenames =
+	{
+		L"../../Textures/bricks.dds",
+		L"../../Textures/stone.dds",
+		L"../../Textures/tile.dds",
+		L"../../Textures/WoodCrate01.dds"
+	};
+
+	if(mUsePackedTextures && LoadPackedTextures(texFilenames))
+		return;
+	mUsePackedTextures = false;
+
+	for(int i = 0; i < (int)texNames.size(); ++i)
+	{
+		auto texMap = std::make_unique<Texture>();
+		texMap->Name = texNames[i];
+		texMap->Filename = texFilenames[i];
+
+		// A streamed texture starts with just its low mips.
+		size_t maxsize = 0;
+		if(mStreamTextures)
+		{
+			int index = mTextureResidency.Register(texMap->Filename);
+			if(index >= 0)
+			{
+				mStreamedTextures.push_back({ texMap->Name, (UINT)i });
+				maxsize = mTextureResidency.GetMaxSize(index);
+			}
+			mResidencyIndices.push_back(index);
+		}
+
+		ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+			mCommandList.Get(), texMap->Filename.c_str(),
+			texMap->Resource, texMap->UploadHeap, maxsize));
+
+		mTextures[texMap->Name] = std::move(texMap);
+	}
+}
+
+bool CameraAndDynamicIndexingApp::LoadPackedTextures(const std::vector<std::wstring>& filenames)
+{
+	// Source indices follow the file order, which is the SRV heap order the
+	// materials are written against.
+	for(const std::wstring& filename : filenames)
+	{
+		if(mTexturePacker.Add(filename) < 0)
+			return false;
+	}
+
+	// The grid tiles its texture through TexTransform, which an atlas cannot do.
+	TexturePackerOptions options;
+	options.AllowAtlas = false;
+	if(!mTexturePacker.Pack(options))
+		return false;
+
+	const std::vector<PackedTexture>& packed = mTexturePacker.GetTextures();
+	if(packed.size() > filenames.size())
+		return false;
+
+	for(size_t i = 0; i < packed.size(); ++i)
+	{
+		auto texMap = std::make_unique<Texture>();
+		texMap->Name = "packedTex" + std::to_string(i);
+
+		ThrowIfFailed(DirectX::CreateDDSTextureFromMemory12(md3dDevice.Get(),
+			mCommandList.Get(), packed[i].DDSData.data(), packed[i].DDSData.size(),
+			texMap->Resource, texMap->UploadHeap));
+
+		mPackedTextures.push_back(texMap->Name);
+		mTextures[texMap->Name] = std::move(texMap);
+	}
+
+	TexturePacker::Stats stats = mTexturePacker.GetStats();
+	std::string msg = "packed " + std::to_string(stats.SourceTextures) + " textures into " +
+		std::to_string(stats.PackedTextures) + " (" + std::to_string(stats.Arrays) + " arrays), " +
+		std::to_string(stats.Ms) + " ms\n";
+	::OutputDebugStringA(msg.c_str());
+
+	return true;
+}
+
+void CameraAndDynamicIndexingApp::StreamTextures()
+{
+	// Ask for the mip that puts about one texel on each pixel where the item is
+	// nearest the camera.  The texture repeats TexTransform-scale times across it.
+	const XMVECTOR eyePos = mCamera.GetPosition();
+	const float pixelsPerUnitAtOne = mClientHeight / (2.0f*tanf(0.5f*mCamera.GetFovY()));
+	for(auto& e : mOpaqueRitems)
+	{
+		BoundingBox bounds;
+		e->Bounds.Transform(bounds, XMLoadFloat4x4(&e->World));
+
+		const float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Extents)));
+		const float dist = XMVectorGetX(XMVector3Length(XMLoadFloat3(&bounds.Center) - eyePos)) - radius;
+		const float pixels = 2.0f*radius*pixelsPerUnitAtOne / (std::max)(dist, mCamera.GetNearZ());
+		const float repeats = (std::max)(e->TexTransform(0, 0), 1.0f);
+
+		// Textures that are not streamed were loaded with all their mips.
+		const int index = mResidencyIndices[e->Mat->DiffuseSrvHeapIndex];
+		if(index < 0)
+			continue;
+
+		const UINT texture = (UINT)index;
+		mTextureResidency.Request(texture, mTextureResidency.MipForCoverage(texture, pixels / repeats));
+	}
+
+	const std::vector<ResidencyChange>& changes = mTextureResidency.Update();
+	if(changes.empty())
+		return;
+
+	std::vector<UINT> changed;
+	for(const ResidencyChange& c : changes)
+	{
+		if(std::find(changed.begin(), changed.end(), c.Texture) == changed.end())
+			changed.push_back(c.Texture);
+	}
+
+	// Frames in flight may still sample the old textures through the descriptors
+	// about to be rewritten, so let the GPU catch up first.  Changes come a few mips
+	// at a time, so this is rare.
+	FlushCommandQueue();
+	ThrowIfFailed(mDirectCmdListAlloc->Reset());
+	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
+
+	for(UINT texture : changed)
+	{
+		Texture* tex = mTextures[mStreamedTextures[texture].Name].get();
+		ThrowIfFailed(DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
+			mCommandList.Get(), tex->Filename.c_str(),
+			tex->Resource, tex->UploadHeap, mTextureResidency.GetMaxSize(texture)));
+
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.Format = tex->Resource->GetDesc().Format;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.MipLevels = tex->Resource->GetDesc().MipLevels;
+		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+		hDescriptor.Offset(mStreamedTextures[texture].SrvHeapIndex, mCbvSrvDescriptorSize);
+		md3dDevice->CreateShaderResourceView(tex->Resource.Get(), &srvDesc, hDescriptor);
+	}
+
+	ThrowIfFailed(mCommandList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	FlushCommandQueue();
+
+	// The copies are done, so the upload heaps can go.
+	for(UINT texture : changed)
+		mTextures[mStreamedTextures[texture].Name]->UploadHeap = nullptr;
 }
 
 void CameraAndDynamicIndexingApp::BuildRootSignature()
@@ -527,6 +689,37 @@ void CameraAndDynamicIndexingApp::BuildDescriptorHeaps()
 	//
 	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 
+	if(mUsePackedTextures)
+	{
+		// One array view per packed texture.  The rest of the table gets null views.
+		for(UINT i = 0; i < srvHeapDesc.NumDescriptors; ++i)
+		{
+			D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+			srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+			srvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+			srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2DARRAY;
+			srvDesc.Texture2DArray.MostDetailedMip = 0;
+			srvDesc.Texture2DArray.MipLevels = 1;
+			srvDesc.Texture2DArray.FirstArraySlice = 0;
+			srvDesc.Texture2DArray.ArraySize = 1;
+			srvDesc.Texture2DArray.ResourceMinLODClamp = 0.0f;
+
+			ID3D12Resource* resource = nullptr;
+			if(i < mPackedTextures.size())
+			{
+				resource = mTextures[mPackedTextures[i]]->Resource.Get();
+				srvDesc.Format = resource->GetDesc().Format;
+				srvDesc.Texture2DArray.MipLevels = resource->GetDesc().MipLevels;
+				srvDesc.Texture2DArray.ArraySize = resource->GetDesc().DepthOrArraySize;
+			}
+			md3dDevice->CreateShaderResourceView(resource, &srvDesc, hDescriptor);
+
+			// next descriptor
+			hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+		}
+		return;
+	}
+
 	auto bricksTex = mTextures["bricksTex"]->Resource;
 	auto stoneTex = mTextures["stoneTex"]->Resource;
 	auto tileTex = mTextures["tileTex"]->Resource;
@@ -571,8 +764,15 @@ void CameraAndDynamicIndexingApp::BuildShadersAndInputLayout()
 		NULL, NULL
 	};
 
+	const D3D_SHADER_MACRO packedDefines[] =
+	{
+		"PACKED_TEXTURES", "1",
+		NULL, NULL
+	};
+
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
-	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1");
+	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl",
+		mUsePackedTextures ? packedDefines : nullptr, "PS", "ps_5_1");
 	
     mInputLayout =
     {
@@ -627,6 +827,16 @@ void CameraAndDynamicIndexingApp::BuildShapeGeometry()
 	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
 	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
 
+	// Texture streaming picks mips by how large each item is on screen.
+	BoundingBox::CreateFromPoints(boxSubmesh.Bounds, box.Vertices.size(),
+		&box.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+	BoundingBox::CreateFromPoints(gridSubmesh.Bounds, grid.Vertices.size(),
+		&grid.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+	BoundingBox::CreateFromPoints(sphereSubmesh.Bounds, sphere.Vertices.size(),
+		&sphere.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+	BoundingBox::CreateFromPoints(cylinderSubmesh.Bounds, cylinder.Vertices.size(),
+		&cylinder.Vertices[0].Position, sizeof(GeometryGenerator::Vertex));
+
 	//
 	// Extract the vertex elements we are interested in and pack the
 	// vertices of all the meshes into one vertex buffer.
@@ -786,6 +996,20 @@ void CameraAndDynamicIndexingApp::BuildMaterials()
 	mMaterials["stone0"] = std::move(stone0);
 	mMaterials["tile0"] = std::move(tile0);
 	mMaterials["crate0"] = std::move(crate0);
+
+	if(mUsePackedTextures)
+	{
+		// The indices above are source indices into the packer; point each material
+		// at the texture and slice its source ended up in.
+		for(auto& e : mMaterials)
+		{
+			Material* mat = e.second.get();
+			const PackedTextureRef& ref = mTexturePacker.GetRef((UINT)mat->DiffuseSrvHeapIndex);
+			mat->DiffuseSrvHeapIndex = (int)ref.Texture;
+			mat->DiffuseSrvSlice = (int)ref.Slice;
+			mat->MatTransform = TexturePacker::RemapTransform(mat->MatTransform, ref);
+		}
+	}
 }
 
 void CameraAndDynamicIndexingApp::BuildRenderItems()
@@ -800,6 +1024,7 @@ void CameraAndDynamicIndexingApp::BuildRenderItems()
 	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
 	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
 	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	boxRitem->Bounds = boxRitem->Geo->DrawArgs["box"].Bounds;
 	mAllRitems.push_back(std::move(boxRitem));
 
     auto gridRitem = std::make_unique<RenderItem>();
@@ -812,6 +1037,7 @@ void CameraAndDynamicIndexingApp::BuildRenderItems()
     gridRitem->IndexCount = gridRitem->Geo->DrawArgs["grid"].IndexCount;
     gridRitem->StartIndexLocation = gridRitem->Geo->DrawArgs["grid"].StartIndexLocation;
     gridRitem->BaseVertexLocation = gridRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+    gridRitem->Bounds = gridRitem->Geo->DrawArgs["grid"].Bounds;
 	mAllRitems.push_back(std::move(gridRitem));
 
 	XMMATRIX brickTexTransform = XMMatrixScaling(1.0f, 1.0f, 1.0f);
@@ -838,6 +1064,7 @@ void CameraAndDynamicIndexingApp::BuildRenderItems()
 		leftCylRitem->IndexCount = leftCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 		leftCylRitem->StartIndexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 		leftCylRitem->BaseVertexLocation = leftCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+		leftCylRitem->Bounds = leftCylRitem->Geo->DrawArgs["cylinder"].Bounds;
 
 		XMStoreFloat4x4(&rightCylRitem->World, leftCylWorld);
 		XMStoreFloat4x4(&rightCylRitem->TexTransform, brickTexTransform);
@@ -848,6 +1075,7 @@ void CameraAndDynamicIndexingApp::BuildRenderItems()
 		rightCylRitem->IndexCount = rightCylRitem->Geo->DrawArgs["cylinder"].IndexCount;
 		rightCylRitem->StartIndexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].StartIndexLocation;
 		rightCylRitem->BaseVertexLocation = rightCylRitem->Geo->DrawArgs["cylinder"].BaseVertexLocation;
+		rightCylRitem->Bounds = rightCylRitem->Geo->DrawArgs["cylinder"].Bounds;
 
 		XMStoreFloat4x4(&leftSphereRitem->World, leftSphereWorld);
 		leftSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -858,6 +1086,7 @@ void CameraAndDynamicIndexingApp::BuildRenderItems()
 		leftSphereRitem->IndexCount = leftSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		leftSphereRitem->StartIndexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		leftSphereRitem->BaseVertexLocation = leftSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		leftSphereRitem->Bounds = leftSphereRitem->Geo->DrawArgs["sphere"].Bounds;
 
 		XMStoreFloat4x4(&rightSphereRitem->World, rightSphereWorld);
 		rightSphereRitem->TexTransform = MathHelper::Identity4x4();
@@ -868,6 +1097,7 @@ void CameraAndDynamicIndexingApp::BuildRenderItems()
 		rightSphereRitem->IndexCount = rightSphereRitem->Geo->DrawArgs["sphere"].IndexCount;
 		rightSphereRitem->StartIndexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].StartIndexLocation;
 		rightSphereRitem->BaseVertexLocation = rightSphereRitem->Geo->DrawArgs["sphere"].BaseVertexLocation;
+		rightSphereRitem->Bounds = rightSphereRitem->Geo->DrawArgs["sphere"].Bounds;
 
 		mAllRitems.push_back(std::move(leftCylRitem));
 		mAllRitems.push_back(std::move(rightCylRitem));
@@ -25,7 +25,7 @@ struct MaterialData
 	float    Roughness;
 	float4x4 MatTransform;
 	uint     DiffuseMapIndex;
-	uint     MatPad0;
+	uint     DiffuseMapSlice;
 	uint     MatPad1;
 	uint     MatPad2;
 };
@@ -33,7 +33,12 @@ struct MaterialData
 
 // An array of textures, which is only supported in shader model 5.1+.  Unlike Texture2DArray, the textures
 // in this array can be different sizes and formats, making it more flexible than texture arrays.
+#ifdef PACKED_TEXTURES
+// Textures packed offline (see TexturePacker) into arrays of same-sized textures.
+Texture2DArray gDiffuseMap[4] : register(t0);
+#else
 Texture2D gDiffuseMap[4] : register(t0);
+#endif
 
 // Put in space1, so the texture array does not overlap with these resources.  
 // The texture array will occupy registers t0, t1, ..., t3 in space0. 
@@ -133,7 +138,11 @@ float4 PS(VertexOut pin) : SV_Target
 	uint diffuseTexIndex = matData.DiffuseMapIndex;
 
 	// Dynamically look up the texture in the array.
+#ifdef PACKED_TEXTURES
+	diffuseAlbedo *= gDiffuseMap[diffuseTexIndex].Sample(gsamLinearWrap, float3(pin.TexC, matData.DiffuseMapSlice));
+#else
 	diffuseAlbedo *= gDiffuseMap[diffuseTexIndex].Sample(gsamLinearWrap, pin.TexC);
+#endif
 	
     // Interpolating normal can unnormalize it, so renormalize it.
     pin.NormalW = normalize(pin.NormalW);
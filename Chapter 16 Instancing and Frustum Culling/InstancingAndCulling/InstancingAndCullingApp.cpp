@@ -7,6 +7,12 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/ModelLibrary.h"
+#include "../../Common/FrustumCuller.h"
+#include "../../Common/SceneBVH.h"
+#include "../../Common/OcclusionCuller.h"
+#include "../../Common/VisibilityCache.h"
+#include "../../Common/LodSelector.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -50,6 +56,33 @@ struct RenderItem
 	BoundingBox Bounds;
 	std::vector<InstanceData> Instances;
 
+	// The world-space bounds of every instance, and the instances with their
+	// matrices transposed for the shader, built once in BuildRenderItems.
+	FrustumCuller Culler;
+	std::vector<BoundingBox> WorldBounds;
+	std::vector<BoundingSphere> WorldSpheres;
+	std::vector<InstanceData> GpuInstances;
+
+	// The same bounds in a BVH; instance i is user value i.  Instances that move
+	// less than the margin only refit their leaf.
+	SceneBVH InstanceTree{ 1.0f };
+	std::vector<int> InstanceProxies;
+
+	// Instances whose World or TexTransform changed since their entries above were
+	// built, listed once each; see MarkInstanceDirty.  UpdateInstanceBounds moves
+	// them to MovedInstances once it has rebuilt them.
+	std::vector<UINT> DirtyInstances;
+	std::vector<bool> InstanceDirty;
+	std::vector<UINT> MovedInstances;
+
+	// Last frame's visible instances, for culling with mCullCoherently.
+	VisibilityCache Visibility;
+
+	// With mLodSelectionEnabled, the visible instances are uploaded level by level,
+	// and level l is the run of LodInstanceCount[l] instances from LodInstanceStart[l].
+	std::vector<UINT> LodInstanceStart;
+	std::vector<UINT> LodInstanceCount;
+
     // DrawIndexedInstanced parameters.
     UINT IndexCount = 0;
 	UINT InstanceCount = 0;
@@ -78,6 +111,7 @@ private:
 
     void OnKeyboardInput(const GameTimer& gt);
 	void AnimateMaterials(const GameTimer& gt);
+	void AnimateInstances(const GameTimer& gt);
 	void UpdateInstanceData(const GameTimer& gt);
 	void UpdateMaterialBuffer(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
@@ -91,6 +125,13 @@ private:
     void BuildFrameResources();
     void BuildMaterials();
     void BuildRenderItems();
+	void BuildInstanceCulling(RenderItem* ritem);
+	void BuildInstance(RenderItem* ritem, UINT instance, BoundingBox& worldBounds);
+	void MarkInstanceDirty(RenderItem* ritem, UINT instance);
+	void UpdateInstanceBounds(RenderItem* ritem);
+	void BuildOccluders();
+	void CullOccludedInstances(RenderItem* ritem, FXMMATRIX viewProj);
+	void SelectInstanceLods(RenderItem* ritem);
     void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
@@ -125,7 +166,45 @@ private:
 
 	bool mFrustumCullingEnabled = true;
 
-	BoundingFrustum mCamFrustum;
+	// Bob every tenth skull up and down, so its cached bounds are rebuilt each frame.
+	bool mAnimateInstances = false;
+
+	// Query each render item's InstanceTree instead of testing every instance.
+	// It pays off once most of a large scene is outside the frustum.
+	bool mCullWithBVH = false;
+
+	// After frustum culling, rasterize boxes inside the nearest visible skulls on
+	// the CPU and drop the instances hidden behind them.  An approximation: the
+	// skull mesh has openings, so a skull seen through them can be dropped too.
+	bool mOcclusionCullingEnabled = false;
+	static const UINT MaxOccluders = 16;
+	OcclusionCuller mOcclusionCuller;
+	UINT mOccluderBox = 0;
+	XMFLOAT4X4 mOccluderLocal = MathHelper::Identity4x4();
+	std::vector<std::pair<float, UINT>> mOccluderCandidates;
+	std::vector<UINT> mUnoccludedInstances;
+
+	// Drop visible instances under two pixels across and sort the rest into levels
+	// of detail by their size on screen.  The skull has one mesh, so every level
+	// is drawn with it; a mesh per level would draw each level's run on its own.
+	bool mLodSelectionEnabled = false;
+	LodSelector mLodSelector;
+
+	// Keep each render item's visible set from frame to frame and retest only the
+	// instances the camera's motion may have brought in or out of view, and the
+	// ones that moved.  Takes precedence over mCullWithBVH.
+	bool mCullCoherently = false;
+
+	// Indices of the visible instances, and their data gathered for the upload.
+	std::vector<UINT> mVisibleInstances;
+	std::vector<InstanceData> mVisibleInstanceData;
+
+	// Cull a million random boxes with FrustumCuller one box at a time, four at a
+	// time and on all threads, and the old way with a matrix inversion per box, then
+	// time SceneBVH queries from 1k to 1M objects, OcclusionCuller on 100k,
+	// VisibilityCache along a camera path through 1M and LodSelector on 1M, and
+	// print the timings to the debugger.
+	bool mBenchmarkCulling = false;
 
     PassConstants mMainPassCB;
 
@@ -189,6 +268,10 @@ bool InstancingAndCullingApp::Initialize()
 	BuildSkullGeometry();
 	BuildMaterials();
     BuildRenderItems();
+	BuildOccluders();
+
+	// Level 0 down to 64 pixels across, level 1 down to 16, level 2 down to 2.
+	mLodSelector.SetLevels({ 64.0f, 16.0f, 2.0f });
     BuildFrameResources();
     BuildPSOs();
 
@@ -200,6 +283,75 @@ bool InstancingAndCullingApp::Initialize()
     // Wait until initialization is complete.
     FlushCommandQueue();
 
+	if(mBenchmarkCulling)
+	{
+		FrustumCuller::BenchmarkResult result;
+		FrustumCuller::Benchmark(1000000, 10, result);
+
+		std::string msg = "FrustumCuller: " + std::to_string(result.Visible) + " of " +
+			std::to_string(result.Boxes) + " boxes visible, " +
+			std::to_string(result.ScalarMs) + " ms scalar, " +
+			std::to_string(result.SimdMs) + " ms SIMD, " +
+			std::to_string(result.ThreadedMs) + " ms SIMD on all threads, " +
+			std::to_string(result.CompactMs) + " ms compacting, " +
+			std::to_string(result.LocalSpaceMs) + " ms in local space (" +
+			std::to_string(result.LocalSpaceVisible) + " visible), " +
+			std::to_string(result.RebuildBoundsMs) + " ms rebuilding every world box" +
+			(result.Matches ? "\n" : ", results differ\n");
+		::OutputDebugStringA(msg.c_str());
+
+		for(UINT objectCount = 1000; objectCount <= 1000000; objectCount *= 10)
+		{
+			SceneBVH::BenchmarkResult bvhResult;
+			SceneBVH::Benchmark(objectCount, 10, bvhResult);
+
+			msg = "SceneBVH: " + std::to_string(bvhResult.Objects) + " objects, height " +
+				std::to_string(bvhResult.Height) + ", built in " + std::to_string(bvhResult.BuildMs) + " ms, frustum " +
+				std::to_string(bvhResult.FrustumMs) + " ms (" + std::to_string(bvhResult.LinearFrustumMs) + " linear), ray " +
+				std::to_string(bvhResult.RayUs) + " us (" + std::to_string(bvhResult.LinearRayUs) + " linear)" +
+				(bvhResult.Matches ? "\n" : ", results differ\n");
+			::OutputDebugStringA(msg.c_str());
+		}
+
+		OcclusionCuller::BenchmarkResult occlusionResult;
+		bool conservative = OcclusionCuller::Benchmark(100000, 10, occlusionResult);
+
+		msg = "OcclusionCuller: " + std::to_string(occlusionResult.Culled) + " of " +
+			std::to_string(occlusionResult.FrustumVisible) + " objects in the frustum culled (" +
+			std::to_string(occlusionResult.Hidden) + " hidden), " +
+			std::to_string(occlusionResult.RasterizeMs) + " ms rasterizing (" +
+			std::to_string(occlusionResult.SingleThreadRasterizeMs) + " on one thread), " +
+			std::to_string(occlusionResult.TestMs) + " ms testing" +
+			(conservative ? "\n" : ", " + std::to_string(occlusionResult.FalseCulls) + " visible objects culled\n");
+		::OutputDebugStringA(msg.c_str());
+
+		VisibilityCache::BenchmarkResult cacheResult;
+		VisibilityCache::Benchmark(1000000, 300, cacheResult);
+
+		msg = "VisibilityCache: " + std::to_string(cacheResult.AverageVisible) + " of " +
+			std::to_string(cacheResult.Objects) + " objects visible, " +
+			std::to_string(cacheResult.AverageRetested) + " retested and " +
+			std::to_string(cacheResult.AverageChanged) + " changed a frame, " +
+			std::to_string(cacheResult.CachedMs) + " ms a frame (" +
+			std::to_string(cacheResult.LinearMs) + " testing every box, " +
+			std::to_string(cacheResult.FullUpdateMs) + " refilling the cache)" +
+			(cacheResult.Matches ? "\n" : ", results differ\n");
+		::OutputDebugStringA(msg.c_str());
+
+		LodSelector::BenchmarkResult lodResult;
+		LodSelector::Benchmark(1000000, 10, lodResult);
+
+		msg = "LodSelector: " + std::to_string(lodResult.FrustumVisible) + " of " +
+			std::to_string(lodResult.Objects) + " objects in the frustum, " +
+			std::to_string(lodResult.Dropped) + " too small, levels";
+		for(UINT count : lodResult.LevelCounts)
+			msg += " " + std::to_string(count);
+		msg += ", " + std::to_string(lodResult.SingleThreadMs) + " ms on one thread, " +
+			std::to_string(lodResult.ThreadedMs) + " ms on all" +
+			(lodResult.Matches ? "\n" : ", results differ\n");
+		::OutputDebugStringA(msg.c_str());
+	}
+
     return true;
 }
  
@@ -208,8 +360,6 @@ void InstancingAndCullingApp::OnResize()
     D3DApp::OnResize();
 
 	mCamera.SetLens(0.25f*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
-
-	BoundingFrustum::CreateFromMatrix(mCamFrustum, mCamera.GetProj());
 }
 
 void InstancingAndCullingApp::Update(const GameTimer& gt)
@@ -231,6 +381,7 @@ void InstancingAndCullingApp::Update(const GameTimer& gt)
     }
 
 	AnimateMaterials(gt);
+	AnimateInstances(gt);
 	UpdateInstanceData(gt);
 	UpdateMaterialBuffer(gt);
 	UpdateMainPassCB(gt);
@@ -363,45 +514,88 @@ void InstancingAndCullingApp::AnimateMaterials(const GameTimer& gt)
 	
 }
 
+void InstancingAndCullingApp::AnimateInstances(const GameTimer& gt)
+{
+	if(!mAnimateInstances)
+		return;
+
+	const float t = gt.TotalTime();
+	const float dt = gt.DeltaTime();
+	for(auto& e : mAllRitems)
+	{
+		for(UINT i = 0; i < (UINT)e->Instances.size(); i += 10)
+		{
+			// Move by the change in offset since last frame, so the grid is kept.
+			float dy = 2.0f*(sinf(t + i) - sinf(t - dt + i));
+			e->Instances[i].World._42 += dy;
+			MarkInstanceDirty(e.get(), i);
+		}
+	}
+}
+
 void InstancingAndCullingApp::UpdateInstanceData(const GameTimer& gt)
 {
-	XMMATRIX view = mCamera.GetView();
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
+	// The culler works on world-space boxes, so the frustum planes come straight
+	// from viewProj; nothing is transformed per instance.
+	XMMATRIX viewProj = XMMatrixMultiply(mCamera.GetView(), mCamera.GetProj());
 
 	auto currInstanceBuffer = mCurrFrameResource->InstanceBuffer.get();
 	for(auto& e : mAllRitems)
 	{
-		const auto& instanceData = e->Instances;
-
-		int visibleInstanceCount = 0;
+		UpdateInstanceBounds(e.get());
 
-		for(UINT i = 0; i < (UINT)instanceData.size(); ++i)
-		{
-			XMMATRIX world = XMLoadFloat4x4(&instanceData[i].World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&instanceData[i].TexTransform);
+		// Frames culled another way leave the cache behind.
+		if(!mFrustumCullingEnabled || !mCullCoherently)
+			e->Visibility.Invalidate();
 
-			XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(world), world);
+		const InstanceData* visibleData = e->GpuInstances.data();
+		UINT visibleInstanceCount = (UINT)e->GpuInstances.size();
 
-			// View space to the object's local space.
-			XMMATRIX viewToLocal = XMMatrixMultiply(invView, invWorld);
- 
-			// Transform the camera frustum from view space to the object's local space.
-			BoundingFrustum localSpaceFrustum;
-			mCamFrustum.Transform(localSpaceFrustum, viewToLocal);
+		if(mFrustumCullingEnabled)
+		{
+			if(mCullCoherently)
+			{
+				// In no particular order, like the tree's; sorted for the same reason.
+				e->Visibility.Update(e->WorldBounds.data(), viewProj, e->MovedInstances);
+				mVisibleInstances = e->Visibility.GetVisible();
+				std::sort(mVisibleInstances.begin(), mVisibleInstances.end());
+				visibleInstanceCount = (UINT)mVisibleInstances.size();
+			}
+			else if(mCullWithBVH)
+			{
+				// The tree returns instances in no particular order; sorting them keeps
+				// the gather below walking forward through memory.
+				mVisibleInstances.clear();
+				e->InstanceTree.QueryFrustum(viewProj, mVisibleInstances);
+				std::sort(mVisibleInstances.begin(), mVisibleInstances.end());
+				visibleInstanceCount = (UINT)mVisibleInstances.size();
+			}
+			else
+			{
+				visibleInstanceCount = e->Culler.Cull(viewProj, mVisibleInstances);
+			}
 
-			// Perform the box/frustum intersection test in local space.
-			if((localSpaceFrustum.Contains(e->Bounds) != DirectX::DISJOINT) || (mFrustumCullingEnabled==false))
+			if(mOcclusionCullingEnabled)
 			{
-				InstanceData data;
-				XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
-				XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
-				data.MaterialIndex = instanceData[i].MaterialIndex;
+				CullOccludedInstances(e.get(), viewProj);
+				visibleInstanceCount = (UINT)mVisibleInstances.size();
+			}
 
-				// Write the instance data to structured buffer for the visible objects.
-				currInstanceBuffer->CopyData(visibleInstanceCount++, data);
+			if(mLodSelectionEnabled)
+			{
+				SelectInstanceLods(e.get());
+				visibleInstanceCount = (UINT)mVisibleInstances.size();
 			}
+
+			mVisibleInstanceData.resize(visibleInstanceCount);
+			FrustumCuller::Compact(e->GpuInstances.data(), mVisibleInstances, mVisibleInstanceData.data());
+			visibleData = mVisibleInstanceData.data();
 		}
 
+		// Write the visible objects to the structured buffer in one contiguous run.
+		if(visibleInstanceCount > 0)
+			currInstanceBuffer->CopyData(0, visibleData, visibleInstanceCount);
+
 		e->InstanceCount = visibleInstanceCount;
 
 		std::wostringstream outs;
@@ -409,6 +603,17 @@ void InstancingAndCullingApp::UpdateInstanceData(const GameTimer& gt)
 		outs << L"Instancing and Culling Demo" <<
 			L"    " << e->InstanceCount <<
 			L" objects visible out of " << e->Instances.size();
+		if(mFrustumCullingEnabled && mOcclusionCullingEnabled)
+		{
+			const OcclusionCuller::Stats& stats = mOcclusionCuller.GetStats();
+			outs << L", " << stats.Culled << L" occluded (" << stats.RasterizeMs << L" ms rasterizing)";
+		}
+		if(mFrustumCullingEnabled && mLodSelectionEnabled)
+		{
+			outs << L", " << mLodSelector.GetDropped() << L" too small, levels";
+			for(UINT count : e->LodInstanceCount)
+				outs << L" " << count;
+		}
 		mMainWndCaption = outs.str();
 	}
 }
@@ -672,33 +877,21 @@ void InstancingAndCullingApp::BuildShadersAndInputLayout()
 
 void InstancingAndCullingApp::BuildSkullGeometry()
 {
-	std::ifstream fin("Models/skull.txt");
+	const ModelMesh* skull = ModelLibrary::Get().Load("Models/skull.txt");
 
-	if(!fin)
+	if(skull == nullptr)
 	{
 		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
 		return;
 	}
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
-
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
-
-	XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
-	XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
-
-	XMVECTOR vMin = XMLoadFloat3(&vMinf3);
-	XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+	UINT vcount = (UINT)skull->Positions.size();
 
 	std::vector<Vertex> vertices(vcount);
 	for(UINT i = 0; i < vcount; ++i)
 	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+		vertices[i].Pos = skull->Positions[i];
+		vertices[i].Normal = skull->Normals[i];
 
 		XMVECTOR P = XMLoadFloat3(&vertices[i].Pos);
 
@@ -718,26 +911,11 @@ void InstancingAndCullingApp::BuildSkullGeometry()
 		float v = phi / XM_PI;
 
 		vertices[i].TexC = { u, v };
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
 	}
 
-	BoundingBox bounds;
-	XMStoreFloat3(&bounds.Center, 0.5f*(vMin + vMax));
-	XMStoreFloat3(&bounds.Extents, 0.5f*(vMax - vMin));
+	BoundingBox bounds = skull->Bounds;
 
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
-
-	std::vector<std::int32_t> indices(3 * tcount);
-	for(UINT i = 0; i < tcount; ++i)
-	{
-		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
-	}
-
-	fin.close();
+	const std::vector<std::int32_t>& indices = skull->Indices;
 
 	//
 	// Pack the indices of all the meshes into one index buffer.
@@ -939,6 +1117,8 @@ void InstancingAndCullingApp::BuildRenderItems()
 	}
 
 
+	BuildInstanceCulling(skullRitem.get());
+
 	mAllRitems.push_back(std::move(skullRitem));
 	
 	// All the render items are opaque.
@@ -946,6 +1126,179 @@ void InstancingAndCullingApp::BuildRenderItems()
 		mOpaqueRitems.push_back(e.get());
 }
 
+void InstancingAndCullingApp::BuildInstanceCulling(RenderItem* ritem)
+{
+	const size_t count = ritem->Instances.size();
+
+	ritem->WorldBounds.resize(count);
+	ritem->WorldSpheres.resize(count);
+	ritem->GpuInstances.resize(count);
+	for(UINT i = 0; i < (UINT)count; ++i)
+		BuildInstance(ritem, i, ritem->WorldBounds[i]);
+
+	ritem->Culler.SetBoxes(ritem->WorldBounds);
+	ritem->InstanceTree.Build(ritem->WorldBounds, ritem->InstanceProxies);
+
+	ritem->DirtyInstances.clear();
+	ritem->InstanceDirty.assign(count, false);
+	ritem->MovedInstances.clear();
+
+	ritem->Visibility.Reset((UINT)count);
+}
+
+void InstancingAndCullingApp::BuildInstance(RenderItem* ritem, UINT instance, BoundingBox& worldBounds)
+{
+	const InstanceData& source = ritem->Instances[instance];
+	XMMATRIX world = XMLoadFloat4x4(&source.World);
+	XMMATRIX texTransform = XMLoadFloat4x4(&source.TexTransform);
+
+	// The box around the transformed local box, so it stays conservative for
+	// rotated instances.  Culling tests it as is, so no instance needs its world
+	// matrix inverted.
+	FrustumCuller::TransformBox(ritem->Bounds, world, worldBounds);
+
+	// The sphere around the local box, for measuring the instance on screen.
+	BoundingSphere localSphere;
+	BoundingSphere::CreateFromBoundingBox(localSphere, ritem->Bounds);
+	localSphere.Transform(ritem->WorldSpheres[instance], world);
+
+	InstanceData& data = ritem->GpuInstances[instance];
+	XMStoreFloat4x4(&data.World, XMMatrixTranspose(world));
+	XMStoreFloat4x4(&data.TexTransform, XMMatrixTranspose(texTransform));
+	data.MaterialIndex = source.MaterialIndex;
+}
+
+void InstancingAndCullingApp::MarkInstanceDirty(RenderItem* ritem, UINT instance)
+{
+	if(!ritem->InstanceDirty[instance])
+	{
+		ritem->InstanceDirty[instance] = true;
+		ritem->DirtyInstances.push_back(instance);
+	}
+}
+
+void InstancingAndCullingApp::UpdateInstanceBounds(RenderItem* ritem)
+{
+	// Only the instances that changed are rebuilt; the rest keep last frame's bounds.
+	for(UINT i : ritem->DirtyInstances)
+	{
+		BoundingBox& worldBounds = ritem->WorldBounds[i];
+		BuildInstance(ritem, i, worldBounds);
+
+		ritem->Culler.SetBox(i, worldBounds);
+		ritem->InstanceTree.Update(ritem->InstanceProxies[i], worldBounds);
+		ritem->InstanceDirty[i] = false;
+	}
+
+	ritem->MovedInstances.swap(ritem->DirtyInstances);
+	ritem->DirtyInstances.clear();
+}
+
+void InstancingAndCullingApp::BuildOccluders()
+{
+	// A unit cube; mOccluderLocal scales it to sit inside a skull.
+	GeometryGenerator geoGen;
+	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
+
+	std::vector<XMFLOAT3> positions(box.Vertices.size());
+	for(size_t i = 0; i < box.Vertices.size(); ++i)
+		positions[i] = box.Vertices[i].Position;
+
+	mOccluderBox = mOcclusionCuller.AddMesh(positions, box.Indices32);
+
+	const ModelMesh* skull = ModelLibrary::Get().Load("Models/skull.txt");
+	if(skull == nullptr)
+	{
+		mOcclusionCullingEnabled = false;
+		return;
+	}
+
+	// Start at half the skull's bounds and shrink until the skull's surface no longer
+	// passes through the box, so the box never pokes out of a skull.  The skull is
+	// not a closed mesh, though, and the box can show through its openings, so this
+	// is not conservative: a skull seen through the gaps of a nearer one can be dropped.
+	const BoundingBox& bounds = skull->Bounds;
+	BoundingBox occluder(bounds.Center,
+		XMFLOAT3(0.5f*bounds.Extents.x, 0.5f*bounds.Extents.y, 0.5f*bounds.Extents.z));
+	bool fits = false;
+	for(int attempt = 0; attempt < 16 && !fits; ++attempt)
+	{
+		fits = true;
+		for(size_t t = 0; t + 2 < skull->Indices.size() && fits; t += 3)
+		{
+			XMVECTOR v0 = XMLoadFloat3(&skull->Positions[skull->Indices[t + 0]]);
+			XMVECTOR v1 = XMLoadFloat3(&skull->Positions[skull->Indices[t + 1]]);
+			XMVECTOR v2 = XMLoadFloat3(&skull->Positions[skull->Indices[t + 2]]);
+			fits = !occluder.Intersects(v0, v1, v2);
+		}
+
+		if(!fits)
+			XMStoreFloat3(&occluder.Extents, 0.8f*XMLoadFloat3(&occluder.Extents));
+	}
+
+	if(!fits)
+	{
+		::OutputDebugStringA("No occluder box clears the skull's surface; occlusion culling is off.\n");
+		mOcclusionCullingEnabled = false;
+		return;
+	}
+
+	XMStoreFloat4x4(&mOccluderLocal,
+		XMMatrixScaling(2.0f*occluder.Extents.x, 2.0f*occluder.Extents.y, 2.0f*occluder.Extents.z)*
+		XMMatrixTranslation(occluder.Center.x, occluder.Center.y, occluder.Center.z));
+}
+
+void InstancingAndCullingApp::CullOccludedInstances(RenderItem* ritem, FXMMATRIX viewProj)
+{
+	// The nearest visible instances hide the most, so they are the occluders.
+	XMFLOAT3 eye = mCamera.GetPosition3f();
+	mOccluderCandidates.clear();
+	for(UINT i : mVisibleInstances)
+	{
+		const XMFLOAT3& c = ritem->WorldBounds[i].Center;
+		float distSq = (c.x - eye.x)*(c.x - eye.x) + (c.y - eye.y)*(c.y - eye.y) + (c.z - eye.z)*(c.z - eye.z);
+		mOccluderCandidates.push_back(std::make_pair(distSq, i));
+	}
+
+	const size_t occluderCount = std::min<size_t>(MaxOccluders, mOccluderCandidates.size());
+	std::partial_sort(mOccluderCandidates.begin(), mOccluderCandidates.begin() + occluderCount,
+		mOccluderCandidates.end());
+
+	// BuildOccluders shrank this box until the skull's surface clears it.
+	XMMATRIX occluderLocal = XMLoadFloat4x4(&mOccluderLocal);
+
+	mOcclusionCuller.BeginFrame(viewProj);
+	for(size_t k = 0; k < occluderCount; ++k)
+	{
+		XMMATRIX world = XMLoadFloat4x4(&ritem->Instances[mOccluderCandidates[k].second].World);
+		mOcclusionCuller.AddOccluder(mOccluderBox, occluderLocal*world);
+	}
+	mOcclusionCuller.Rasterize();
+
+	mOcclusionCuller.Cull(ritem->WorldBounds.data(), mVisibleInstances, mUnoccludedInstances);
+	mVisibleInstances.swap(mUnoccludedInstances);
+}
+
+void InstancingAndCullingApp::SelectInstanceLods(RenderItem* ritem)
+{
+	mLodSelector.Select(ritem->WorldSpheres.data(), mVisibleInstances, mCamera.GetView(), mCamera.GetProj(),
+		(float)mClientHeight);
+
+	// Lay the levels out one after another, most detailed first.
+	const UINT levelCount = mLodSelector.GetLevelCount();
+	ritem->LodInstanceStart.resize(levelCount);
+	ritem->LodInstanceCount.resize(levelCount);
+
+	mVisibleInstances.clear();
+	for(UINT l = 0; l < levelCount; ++l)
+	{
+		const std::vector<UINT>& level = mLodSelector.GetLevel(l);
+		ritem->LodInstanceStart[l] = (UINT)mVisibleInstances.size();
+		ritem->LodInstanceCount[l] = (UINT)level.size();
+		mVisibleInstances.insert(mVisibleInstances.end(), level.begin(), level.end());
+	}
+}
+
 void InstancingAndCullingApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
 {
     // For each render item...
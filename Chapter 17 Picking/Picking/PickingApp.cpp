@@ -7,6 +7,10 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/ModelLibrary.h"
+#include "../../Common/SceneBVH.h"
+#include "../../Common/TriangleBVH.h"
+#include "../../Common/RayTriangle4.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -48,6 +52,9 @@ struct RenderItem
 	Material* Mat = nullptr;
 	MeshGeometry* Geo = nullptr;
 
+	// Triangle tree over the item's part of Geo, for picking.
+	TriangleBVH* Triangles = nullptr;
+
     // Primitive topology.
     D3D12_PRIMITIVE_TOPOLOGY PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 
@@ -131,6 +138,18 @@ private:
 
 	RenderItem* mPickedRitem = nullptr;
 
+	// World-space bounds of the opaque render items, indexed as in their layer, so
+	// Pick only visits the items its ray passes through.
+	SceneBVH mPickingTree;
+
+	// Triangle trees over the CPU copies of the meshes, keyed like DrawArgs.
+	std::unordered_map<std::string, std::unique_ptr<TriangleBVH>> mTriangleTrees;
+
+	// Build triangle trees over meshes of 10k to 1M triangles, cast rays through
+	// them and through every triangle, compare the four-wide ray/triangle kernels
+	// with TriangleTests::Intersects, and print the timings to the debugger.
+	bool mBenchmarkPicking = false;
+
     PassConstants mMainPassCB;
 
 	Camera mCamera;
@@ -207,6 +226,34 @@ bool PickingApp::Initialize()
     // Wait until initialization is complete.
     FlushCommandQueue();
 
+	if(mBenchmarkPicking)
+	{
+		for(UINT triangleCount = 10000; triangleCount <= 1000000; triangleCount *= 10)
+		{
+			TriangleBVH::BenchmarkResult result;
+			TriangleBVH::Benchmark(triangleCount, 10000, result);
+
+			std::string msg = "TriangleBVH: " + std::to_string(result.Triangles) + " triangles, " +
+				std::to_string(result.Nodes) + " nodes, depth " + std::to_string(result.Depth) + ", built in " +
+				std::to_string(result.BuildMs) + " ms (" + std::to_string(result.SingleThreadBuildMs) +
+				" on one thread), ray " + std::to_string(result.RayUs) + " us (" +
+				std::to_string(result.BruteForceUs) + " testing every triangle)" +
+				(result.Matches ? "\n" : ", results differ\n");
+			::OutputDebugStringA(msg.c_str());
+		}
+
+		RayTriangle4::BenchmarkResult kernelResult;
+		RayTriangle4::Benchmark(4096, 1024, kernelResult);
+
+		std::string msg = "RayTriangle4: " + std::to_string(kernelResult.Hits) + " hits in " +
+			std::to_string(kernelResult.Rays) + " rays by " + std::to_string(kernelResult.Triangles) +
+			" triangles, millions of tests per second: " + std::to_string(kernelResult.ScalarRate) +
+			" one at a time, " + std::to_string(kernelResult.TriangleGroupRate) + " one ray by four triangles, " +
+			std::to_string(kernelResult.RayGroupRate) + " four rays by one triangle" +
+			(kernelResult.Matches ? "\n" : ", results differ\n");
+		::OutputDebugStringA(msg.c_str());
+	}
+
     return true;
 }
  
@@ -563,57 +610,28 @@ void PickingApp::BuildShadersAndInputLayout()
 
 void PickingApp::BuildCarGeometry()
 {
-	std::ifstream fin("Models/car.txt");
+	const ModelMesh* car = ModelLibrary::Get().Load("Models/car.txt");
 
-	if(!fin)
+	if(car == nullptr)
 	{
 		MessageBox(0, L"Models/car.txt not found.", 0, 0);
 		return;
 	}
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
-
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
-
-	XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
-	XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
-
-	XMVECTOR vMin = XMLoadFloat3(&vMinf3);
-	XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+	UINT vcount = (UINT)car->Positions.size();
 
 	std::vector<Vertex> vertices(vcount);
 	for(UINT i = 0; i < vcount; ++i)
 	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
-
-		XMVECTOR P = XMLoadFloat3(&vertices[i].Pos);
+		vertices[i].Pos = car->Positions[i];
+		vertices[i].Normal = car->Normals[i];
 
 		vertices[i].TexC = { 0.0f, 0.0f };
-
-		vMin = XMVectorMin(vMin, P);
-		vMax = XMVectorMax(vMax, P);
 	}
 
-	BoundingBox bounds;
-	XMStoreFloat3(&bounds.Center, 0.5f*(vMin + vMax));
-	XMStoreFloat3(&bounds.Extents, 0.5f*(vMax - vMin));
-
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
-
-	std::vector<std::int32_t> indices(3 * tcount);
-	for(UINT i = 0; i < tcount; ++i)
-	{
-		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
-	}
+	BoundingBox bounds = car->Bounds;
 
-	fin.close();
+	const std::vector<std::int32_t>& indices = car->Indices;
 
 	//
 	// Pack the indices of all the meshes into one index buffer.
@@ -651,6 +669,12 @@ void PickingApp::BuildCarGeometry()
 
 	geo->DrawArgs["car"] = submesh;
 
+	// Build the picking tree from the same CPU copies Pick used to walk.
+	auto carTriangles = std::make_unique<TriangleBVH>();
+	carTriangles->Build(geo->VertexBufferCPU->GetBufferPointer(), sizeof(Vertex),
+		(std::uint32_t*)geo->IndexBufferCPU->GetBufferPointer(), submesh.IndexCount);
+	mTriangleTrees["car"] = std::move(carTriangles);
+
 	mGeometries[geo->Name] = std::move(geo);
 }
 
@@ -760,6 +784,7 @@ void PickingApp::BuildRenderItems()
 	carRitem->IndexCount = carRitem->Geo->DrawArgs["car"].IndexCount;
 	carRitem->StartIndexLocation = carRitem->Geo->DrawArgs["car"].StartIndexLocation;
 	carRitem->BaseVertexLocation = carRitem->Geo->DrawArgs["car"].BaseVertexLocation;
+	carRitem->Triangles = mTriangleTrees["car"].get();
 	mRitemLayer[(int)RenderLayer::Opaque].push_back(carRitem.get());
 
 	auto pickedRitem = std::make_unique<RenderItem>();
@@ -783,6 +808,14 @@ void PickingApp::BuildRenderItems()
 
 	mAllRitems.push_back(std::move(carRitem));
 	mAllRitems.push_back(std::move(pickedRitem));
+
+	const auto& opaqueRitems = mRitemLayer[(int)RenderLayer::Opaque];
+	for(UINT i = 0; i < (UINT)opaqueRitems.size(); ++i)
+	{
+		BoundingBox worldBounds;
+		opaqueRitems[i]->Bounds.Transform(worldBounds, XMLoadFloat4x4(&opaqueRitems[i]->World));
+		mPickingTree.Insert(worldBounds, i);
+	}
 }
 
 void PickingApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
@@ -883,30 +916,37 @@ void PickingApp::Pick(int sx, int sy)
 	XMMATRIX V = mCamera.GetView();
 	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(V), V);
 
+	// The ray in world space, where mPickingTree keeps the bounds.
+	rayOrigin = XMVector3TransformCoord(rayOrigin, invView);
+	rayDir = XMVector3Normalize(XMVector3TransformNormal(rayDir, invView));
+
 	// Assume nothing is picked to start, so the picked render-item is invisible.
 	mPickedRitem->Visible = false;
 
-	// Check if we picked an opaque render item.  A real app might keep a separate "picking list"
-	// of objects that can be selected.   
-	for(auto ri : mRitemLayer[(int)RenderLayer::Opaque])
+	// Visit the opaque render items whose bounds the ray hits, nearest first.  Each
+	// returns the world distance of its nearest triangle hit, and items whose bounds
+	// are further than the nearest hit so far are skipped.  A real app might keep a
+	// separate "picking list" of objects that can be selected.
+	const auto& opaqueRitems = mRitemLayer[(int)RenderLayer::Opaque];
+	mPickingTree.QueryRay(rayOrigin, rayDir, MathHelper::Infinity, [&](UINT index, float maxDistance)
 	{
-		auto geo = ri->Geo;
+		auto ri = opaqueRitems[index];
 
 		// Skip invisible render-items.
 		if(ri->Visible == false)
-			continue;
+			return maxDistance;
 
 		XMMATRIX W = XMLoadFloat4x4(&ri->World);
 		XMMATRIX invWorld = XMMatrixInverse(&XMMatrixDeterminant(W), W);
 
-		// Tranform ray to vi space of Mesh.
-		XMMATRIX toLocal = XMMatrixMultiply(invView, invWorld);
-
-		rayOrigin = XMVector3TransformCoord(rayOrigin, toLocal);
-		rayDir = XMVector3TransformNormal(rayDir, toLocal);
+		// Tranform ray to the local space of the mesh.
+		XMVECTOR localOrigin = XMVector3TransformCoord(rayOrigin, invWorld);
+		XMVECTOR localDir = XMVector3TransformNormal(rayDir, invWorld);
 
-		// Make the ray direction unit length for the intersection tests.
-		rayDir = XMVector3Normalize(rayDir);
+		// Make the ray direction unit length for the intersection tests.  A world
+		// distance t is a local distance t*localScale.
+		float localScale = XMVectorGetX(XMVector3Length(localDir));
+		localDir = XMVector3Normalize(localDir);
 
 		// If we hit the bounding box of the Mesh, then we might have picked a Mesh triangle,
 		// so do the ray/triangle tests.
@@ -914,50 +954,27 @@ void PickingApp::Pick(int sx, int sy)
 		// If we did not hit the bounding box, then it is impossible that we hit 
 		// the Mesh, so do not waste effort doing ray/triangle tests.
 		float tmin = 0.0f;
-		if(ri->Bounds.Intersects(rayOrigin, rayDir, tmin))
-		{
-			// NOTE: For the demo, we know what to cast the vertex/index data to.  If we were mixing
-			// formats, some metadata would be needed to figure out what to cast it to.
-			auto vertices = (Vertex*)geo->VertexBufferCPU->GetBufferPointer();
-			auto indices = (std::uint32_t*)geo->IndexBufferCPU->GetBufferPointer();
-			UINT triCount = ri->IndexCount / 3;
-
-			// Find the nearest ray/triangle intersection.
-			tmin = MathHelper::Infinity;
-			for(UINT i = 0; i < triCount; ++i)
-			{
-				// Indices for this triangle.
-				UINT i0 = indices[i * 3 + 0];
-				UINT i1 = indices[i * 3 + 1];
-				UINT i2 = indices[i * 3 + 2];
-
-				// Vertices for this triangle.
-				XMVECTOR v0 = XMLoadFloat3(&vertices[i0].Pos);
-				XMVECTOR v1 = XMLoadFloat3(&vertices[i1].Pos);
-				XMVECTOR v2 = XMLoadFloat3(&vertices[i2].Pos);
-
-				// We have to iterate over all the triangles in order to find the nearest intersection.
-				float t = 0.0f;
-				if(TriangleTests::Intersects(rayOrigin, rayDir, v0, v1, v2, t))
-				{
-					if(t < tmin)
-					{
-						// This is the new nearest picked triangle.
-						tmin = t;
-						UINT pickedTriangle = i;
-
-						mPickedRitem->Visible = true;
-						mPickedRitem->IndexCount = 3;
-						mPickedRitem->BaseVertexLocation = 0;
-						// Offset to the picked triangle in the mesh index buffer.
-						mPickedRitem->StartIndexLocation = 3 * pickedTriangle;
-
-						// Picked render item needs same world matrix as object picked.
-						mPickedRitem->World = ri->World;
-						mPickedRitem->NumFramesDirty = gNumFrameResources;
-					}
-				}
-			}
-		}
-	}
+		if(!ri->Bounds.Intersects(localOrigin, localDir, tmin))
+			return maxDistance;
+
+		// Find the nearest ray/triangle intersection, nearer than any found on other items.
+		// The triangle tree visits only the triangles whose boxes the ray reaches before
+		// the nearest hit so far.
+		UINT pickedTriangle = 0;
+		if(ri->Triangles == nullptr ||
+			!ri->Triangles->Intersect(localOrigin, localDir, maxDistance*localScale, tmin, pickedTriangle))
+			return maxDistance;
+
+		mPickedRitem->Visible = true;
+		mPickedRitem->IndexCount = 3;
+		mPickedRitem->BaseVertexLocation = 0;
+		// Offset to the picked triangle in the mesh index buffer.
+		mPickedRitem->StartIndexLocation = 3 * pickedTriangle;
+
+		// Picked render item needs same world matrix as object picked.
+		mPickedRitem->World = ri->World;
+		mPickedRitem->NumFramesDirty = gNumFrameResources;
+
+		return tmin/localScale;
+	});
 }
\ No newline at end of file
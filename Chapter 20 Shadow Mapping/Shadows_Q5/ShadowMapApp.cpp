@@ -7,6 +7,7 @@
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
 #include "../../Common/Camera.h"
+#include "../../Common/ModelLibrary.h"
 #include "FrameResource.h"
 #include "ShadowMap.h"
 
@@ -950,38 +951,24 @@ void ShadowMapApp::BuildShapeGeometry()
 
 void ShadowMapApp::BuildSkullGeometry()
 {
-  std::ifstream fin("Models/skull.txt");
+  const ModelMesh* skull = ModelLibrary::Get().Load("Models/skull.txt");
 
-  if (!fin)
+  if(skull == nullptr)
   {
     MessageBox(0, L"Models/skull.txt not found.", 0, 0);
     return;
   }
 
-  UINT vcount = 0;
-  UINT tcount = 0;
-  std::string ignore;
-
-  fin >> ignore >> vcount;
-  fin >> ignore >> tcount;
-  fin >> ignore >> ignore >> ignore >> ignore;
-
-  XMFLOAT3 vMinf3(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
-  XMFLOAT3 vMaxf3(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
-
-  XMVECTOR vMin = XMLoadFloat3(&vMinf3);
-  XMVECTOR vMax = XMLoadFloat3(&vMaxf3);
+  UINT vcount = (UINT)skull->Positions.size();
 
   std::vector<Vertex> vertices(vcount);
   for (UINT i = 0; i < vcount; ++i)
   {
-    fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-    fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
+    vertices[i].Pos = skull->Positions[i];
+    vertices[i].Normal = skull->Normals[i];
 
     vertices[i].TexC = { 0.0f, 0.0f };
 
-    XMVECTOR P = XMLoadFloat3(&vertices[i].Pos);
-
     XMVECTOR N = XMLoadFloat3(&vertices[i].Normal);
 
     // Generate a tangent vector so normal mapping works.  We aren't applying
@@ -999,27 +986,11 @@ void ShadowMapApp::BuildSkullGeometry()
       XMVECTOR T = XMVector3Normalize(XMVector3Cross(N, up));
       XMStoreFloat3(&vertices[i].TangentU, T);
     }
-
-
-    vMin = XMVectorMin(vMin, P);
-    vMax = XMVectorMax(vMax, P);
   }
 
-  BoundingBox bounds;
-  XMStoreFloat3(&bounds.Center, 0.5f * (vMin + vMax));
-  XMStoreFloat3(&bounds.Extents, 0.5f * (vMax - vMin));
-
-  fin >> ignore;
-  fin >> ignore;
-  fin >> ignore;
-
-  std::vector<std::int32_t> indices(3 * tcount);
-  for (UINT i = 0; i < tcount; ++i)
-  {
-    fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
-  }
+  BoundingBox bounds = skull->Bounds;
 
-  fin.close();
+  const std::vector<std::int32_t>& indices = skull->Indices;
 
   //
   // Pack the indices of all the meshes into one index buffer.
@@ -0,0 +1,198 @@
+#include "BakedAnimation.h"
+#include "../../Common/ParallelFor.h"
+
+using namespace DirectX;
+
+namespace
+{
+	// File layout: header, then FrameCount*BoneCount XMFLOAT3X4s.
+	struct BakedAnimationHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint64_t SourceSize;      // The model file's size and last write time when
+		uint64_t SourceWriteTime; // it was baked.
+		uint32_t BoneCount;
+		uint32_t FrameCount;
+		float SampleRate;
+		float StartTime;
+		float EndTime;
+		uint32_t Reserved;
+	};
+
+	const uint32_t BakedAnimationMagic = 0x4D4E4142; // "BANM"
+	const uint32_t BakedAnimationVersion = 2;
+
+	bool GetSourceSizeAndTime(const std::string& filename, uint64_t& size, uint64_t& writeTime)
+	{
+		WIN32_FILE_ATTRIBUTE_DATA attributes;
+		if(!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attributes))
+			return false;
+
+		size = ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+		writeTime = ((uint64_t)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+		return true;
+	}
+}
+
+void BakedAnimation::Bake(const SkinnedData& skinInfo, UINT clip, float sampleRate)
+{
+	mBoneCount = skinInfo.BoneCount();
+	mStartTime = skinInfo.GetClipStartTime(clip);
+	mEndTime = skinInfo.GetClipEndTime(clip);
+
+	// Round up to a whole number of intervals and shrink the period to fit, so
+	// the first and last frames land exactly on the clip's start and end.
+	float duration = mEndTime - mStartTime;
+	UINT numIntervals = MathHelper::Max((UINT)ceilf(duration*sampleRate), 1u);
+	mFrameCount = numIntervals + 1;
+	mSampleRate = duration > 0.0f ? numIntervals/duration : sampleRate;
+
+	mPalette.resize((size_t)mFrameCount*mBoneCount);
+
+	// Each frame is independent, so the frames can be sampled in any order.
+	ParallelFor(mFrameCount, 4, [&](size_t begin, size_t end)
+	{
+		std::vector<XMFLOAT3X4> frameTransforms(mBoneCount);
+		for(size_t i = begin; i < end; ++i)
+		{
+			float t = MathHelper::Min(mStartTime + i/mSampleRate, mEndTime);
+			skinInfo.GetFinalTransforms(clip, t, frameTransforms);
+
+			std::copy(frameTransforms.begin(), frameTransforms.end(), &mPalette[i*mBoneCount]);
+		}
+	});
+}
+
+bool BakedAnimation::Save(const std::string& filename, const std::string& sourceFilename)const
+{
+	BakedAnimationHeader header;
+	if(!GetSourceSizeAndTime(sourceFilename, header.SourceSize, header.SourceWriteTime))
+		return false;
+
+	std::ofstream fout(filename, std::ios::binary);
+	if(!fout)
+		return false;
+
+	header.Magic = BakedAnimationMagic;
+	header.Version = BakedAnimationVersion;
+	header.BoneCount = mBoneCount;
+	header.FrameCount = mFrameCount;
+	header.SampleRate = mSampleRate;
+	header.StartTime = mStartTime;
+	header.EndTime = mEndTime;
+	header.Reserved = 0;
+
+	fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	fout.write(reinterpret_cast<const char*>(mPalette.data()), mPalette.size()*sizeof(XMFLOAT3X4));
+
+	return (bool)fout;
+}
+
+bool BakedAnimation::Load(const std::string& filename, const std::string& sourceFilename)
+{
+	uint64_t sourceSize = 0;
+	uint64_t sourceWriteTime = 0;
+	if(!GetSourceSizeAndTime(sourceFilename, sourceSize, sourceWriteTime))
+		return false;
+
+	std::ifstream fin(filename, std::ios::binary | std::ios::ate);
+	if(!fin)
+		return false;
+
+	const uint64_t fileSize = (uint64_t)fin.tellg();
+	fin.seekg(0);
+
+	BakedAnimationHeader header;
+	if(!fin.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+
+	if(header.Magic != BakedAnimationMagic || header.Version != BakedAnimationVersion ||
+	   header.BoneCount == 0 || header.FrameCount == 0 || header.SampleRate <= 0.0f)
+		return false;
+
+	// Baked from a different version of the model.
+	if(header.SourceSize != sourceSize || header.SourceWriteTime != sourceWriteTime)
+		return false;
+
+	// The counts must match what the file holds before the palette is sized from
+	// them.  Dividing avoids overflowing FrameCount*BoneCount*sizeof(XMFLOAT3X4).
+	const uint64_t frameSize = (uint64_t)header.BoneCount*sizeof(XMFLOAT3X4);
+	const uint64_t paletteSize = fileSize - sizeof(header);
+	if(paletteSize % frameSize != 0 || paletteSize/frameSize != header.FrameCount)
+		return false;
+
+	std::vector<XMFLOAT3X4> palette((size_t)header.FrameCount*header.BoneCount);
+	if(!fin.read(reinterpret_cast<char*>(palette.data()), palette.size()*sizeof(XMFLOAT3X4)))
+		return false;
+
+	mBoneCount = header.BoneCount;
+	mFrameCount = header.FrameCount;
+	mSampleRate = header.SampleRate;
+	mStartTime = header.StartTime;
+	mEndTime = header.EndTime;
+	mPalette = std::move(palette);
+
+	return true;
+}
+
+UINT BakedAnimation::BoneCount()const
+{
+	return mBoneCount;
+}
+
+UINT BakedAnimation::FrameCount()const
+{
+	return mFrameCount;
+}
+
+float BakedAnimation::GetClipStartTime()const
+{
+	return mStartTime;
+}
+
+float BakedAnimation::GetClipEndTime()const
+{
+	return mEndTime;
+}
+
+const XMFLOAT3X4* BakedAnimation::GetFrame(UINT frame)const
+{
+	return &mPalette[(size_t)frame*mBoneCount];
+}
+
+void BakedAnimation::Evaluate(float timePos, bool interpolate, XMFLOAT3X4* finalTransforms)const
+{
+	float framePos = (timePos - mStartTime)*mSampleRate;
+	framePos = MathHelper::Clamp(framePos, 0.0f, (float)(mFrameCount - 1));
+
+	if(!interpolate)
+	{
+		const XMFLOAT3X4* frame = GetFrame((UINT)(framePos + 0.5f));
+		std::copy(frame, frame + mBoneCount, finalTransforms);
+		return;
+	}
+
+	UINT frame0 = (UINT)framePos;
+	UINT frame1 = MathHelper::Min(frame0 + 1, mFrameCount - 1);
+	float lerpPercent = framePos - frame0;
+
+	const XMFLOAT3X4* f0 = GetFrame(frame0);
+	const XMFLOAT3X4* f1 = GetFrame(frame1);
+
+	// Lerping the matrices is not a true rotation blend, but the baked frames
+	// are close enough together that the error is not visible.
+	for(UINT i = 0; i < mBoneCount; ++i)
+	{
+		XMMATRIX M0 = XMLoadFloat3x4(&f0[i]);
+		XMMATRIX M1 = XMLoadFloat3x4(&f1[i]);
+
+		XMMATRIX M;
+		M.r[0] = XMVectorLerp(M0.r[0], M1.r[0], lerpPercent);
+		M.r[1] = XMVectorLerp(M0.r[1], M1.r[1], lerpPercent);
+		M.r[2] = XMVectorLerp(M0.r[2], M1.r[2], lerpPercent);
+		M.r[3] = XMVectorLerp(M0.r[3], M1.r[3], lerpPercent);
+
+		XMStoreFloat3x4(&finalTransforms[i], M);
+	}
+}
@@ -0,0 +1,50 @@
+#ifndef BAKEDANIMATION_H
+#define BAKEDANIMATION_H
+
+#include "SkinnedData.h"
+
+///<summary>
+/// A clip pre-sampled at a fixed rate into one contiguous palette of final
+/// bone transforms (frame-major, 3x4 like SkinnedConstants).  Evaluating a
+/// background character is then a frame lookup plus an optional lerp between
+/// two baked frames, with no keyframe search or hierarchy walk.  The palette
+/// can be saved as a binary blob, so startup can skip parsing the clip.  The
+/// blob records the size and write time of the model it was baked from, and
+/// Load rejects it once the model changes.
+///</summary>
+class BakedAnimation
+{
+public:
+	// Samples the clip at (at least) sampleRate frames per second.  The frames
+	// are spread over worker threads.
+	void Bake(const SkinnedData& skinInfo, UINT clip, float sampleRate);
+
+	// sourceFilename is the model the clip was loaded from.
+	bool Save(const std::string& filename, const std::string& sourceFilename)const;
+	bool Load(const std::string& filename, const std::string& sourceFilename);
+
+	UINT BoneCount()const;
+	UINT FrameCount()const;
+	float GetClipStartTime()const;
+	float GetClipEndTime()const;
+
+	// Returns the boneCount final transforms of the given frame.
+	const DirectX::XMFLOAT3X4* GetFrame(UINT frame)const;
+
+	// Writes the final transforms at timePos (clamped to the clip) into
+	// finalTransforms, which must hold BoneCount() entries.  Without
+	// interpolation the nearest frame is copied.
+	void Evaluate(float timePos, bool interpolate, DirectX::XMFLOAT3X4* finalTransforms)const;
+
+private:
+	UINT mBoneCount = 0;
+	UINT mFrameCount = 0;
+	float mSampleRate = 30.0f;
+	float mStartTime = 0.0f;
+	float mEndTime = 0.0f;
+
+	// mFrameCount*mBoneCount transforms; frame i starts at i*mBoneCount.
+	std::vector<DirectX::XMFLOAT3X4> mPalette;
+};
+
+#endif // BAKEDANIMATION_H
@@ -0,0 +1,150 @@
+#include "CpuSkinning.h"
+#include "../../Common/ParallelFor.h"
+#include <chrono>
+
+using namespace DirectX;
+
+namespace
+{
+	void GetBoneWeights(const M3DLoader::SkinnedVertex& v, float weights[4])
+	{
+		weights[0] = v.BoneWeights.x;
+		weights[1] = v.BoneWeights.y;
+		weights[2] = v.BoneWeights.z;
+		weights[3] = 1.0f - weights[0] - weights[1] - weights[2];
+	}
+}
+
+void CpuSkinning::ReferenceSkin(
+	const std::vector<M3DLoader::SkinnedVertex>& vertices,
+	const std::vector<XMFLOAT3X4>& finalTransforms,
+	std::vector<M3DLoader::SkinnedVertex>& skinnedVertices)
+{
+	skinnedVertices = vertices;
+
+	for(size_t i = 0; i < vertices.size(); ++i)
+	{
+		const M3DLoader::SkinnedVertex& v = vertices[i];
+
+		float weights[4];
+		GetBoneWeights(v, weights);
+
+		XMVECTOR pos = XMLoadFloat3(&v.Pos);
+		XMVECTOR normal = XMLoadFloat3(&v.Normal);
+		XMVECTOR tangent = XMLoadFloat3(&v.TangentU);
+
+		XMVECTOR posL = XMVectorZero();
+		XMVECTOR normalL = XMVectorZero();
+		XMVECTOR tangentL = XMVectorZero();
+		for(int j = 0; j < 4; ++j)
+		{
+			XMMATRIX M = XMLoadFloat3x4(&finalTransforms[v.BoneIndices[j]]);
+
+			posL += weights[j]*XMVector3Transform(pos, M);
+			normalL += weights[j]*XMVector3TransformNormal(normal, M);
+			tangentL += weights[j]*XMVector3TransformNormal(tangent, M);
+		}
+
+		XMStoreFloat3(&skinnedVertices[i].Pos, posL);
+		XMStoreFloat3(&skinnedVertices[i].Normal, normalL);
+		XMStoreFloat3(&skinnedVertices[i].TangentU, tangentL);
+	}
+}
+
+void CpuSkinning::Skin(
+	const std::vector<M3DLoader::SkinnedVertex>& vertices,
+	const std::vector<XMFLOAT3X4>& finalTransforms,
+	std::vector<XMFLOAT3>& positions,
+	std::vector<XMFLOAT3>& normals,
+	std::vector<XMFLOAT3>& tangents,
+	unsigned numThreads)
+{
+	// Unpack the palette once, so the per-vertex loop can blend whole matrix
+	// rows without any shuffling.
+	std::vector<XMMATRIX> palette(finalTransforms.size());
+	for(size_t i = 0; i < finalTransforms.size(); ++i)
+		palette[i] = XMLoadFloat3x4(&finalTransforms[i]);
+
+	positions.resize(vertices.size());
+	normals.resize(vertices.size());
+	tangents.resize(vertices.size());
+
+	// Small enough for a chunk to stay in L2, large enough to pay for a thread.
+	const size_t minChunkSize = 2048;
+
+	ParallelFor(vertices.size(), minChunkSize, [&](size_t begin, size_t end)
+	{
+		for(size_t i = begin; i < end; ++i)
+		{
+			const M3DLoader::SkinnedVertex& v = vertices[i];
+
+			XMVECTOR w0 = XMVectorReplicate(v.BoneWeights.x);
+			XMVECTOR w1 = XMVectorReplicate(v.BoneWeights.y);
+			XMVECTOR w2 = XMVectorReplicate(v.BoneWeights.z);
+			XMVECTOR w3 = XMVectorReplicate(1.0f - v.BoneWeights.x - v.BoneWeights.y - v.BoneWeights.z);
+
+			const XMMATRIX& B0 = palette[v.BoneIndices[0]];
+			const XMMATRIX& B1 = palette[v.BoneIndices[1]];
+			const XMMATRIX& B2 = palette[v.BoneIndices[2]];
+			const XMMATRIX& B3 = palette[v.BoneIndices[3]];
+
+			// Blending the matrices first means one transform per attribute
+			// instead of four, with the same result.
+			XMMATRIX M;
+			for(int r = 0; r < 4; ++r)
+			{
+				XMVECTOR row = XMVectorMultiply(w0, B0.r[r]);
+				row = XMVectorMultiplyAdd(w1, B1.r[r], row);
+				row = XMVectorMultiplyAdd(w2, B2.r[r], row);
+				M.r[r] = XMVectorMultiplyAdd(w3, B3.r[r], row);
+			}
+
+			XMStoreFloat3(&positions[i], XMVector3Transform(XMLoadFloat3(&v.Pos), M));
+			XMStoreFloat3(&normals[i], XMVector3TransformNormal(XMLoadFloat3(&v.Normal), M));
+			XMStoreFloat3(&tangents[i], XMVector3TransformNormal(XMLoadFloat3(&v.TangentU), M));
+		}
+	}, numThreads);
+}
+
+float CpuSkinning::MaxSkinError(
+	const std::vector<M3DLoader::SkinnedVertex>& vertices,
+	const std::vector<XMFLOAT3X4>& finalTransforms)
+{
+	std::vector<M3DLoader::SkinnedVertex> reference;
+	ReferenceSkin(vertices, finalTransforms, reference);
+
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT3> tangents;
+	Skin(vertices, finalTransforms, positions, normals, tangents);
+
+	float maxError = 0.0f;
+	for(size_t i = 0; i < vertices.size(); ++i)
+	{
+		XMVECTOR d = XMLoadFloat3(&positions[i]) - XMLoadFloat3(&reference[i].Pos);
+		maxError = MathHelper::Max(maxError, XMVectorGetX(XMVector3Length(d)));
+	}
+	return maxError;
+}
+
+double CpuSkinning::Benchmark(
+	const std::vector<M3DLoader::SkinnedVertex>& vertices,
+	const std::vector<XMFLOAT3X4>& finalTransforms,
+	UINT iterations,
+	unsigned numThreads)
+{
+	std::vector<XMFLOAT3> positions;
+	std::vector<XMFLOAT3> normals;
+	std::vector<XMFLOAT3> tangents;
+
+	// Warm up once so the output allocations are not timed.
+	Skin(vertices, finalTransforms, positions, normals, tangents, numThreads);
+
+	auto start = std::chrono::high_resolution_clock::now();
+	for(UINT i = 0; i < iterations; ++i)
+		Skin(vertices, finalTransforms, positions, normals, tangents, numThreads);
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	double ms = std::chrono::duration<double, std::milli>(stop - start).count();
+	return ms > 0.0 ? (double)vertices.size()*iterations / ms : 0.0;
+}
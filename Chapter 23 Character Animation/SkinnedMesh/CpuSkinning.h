@@ -0,0 +1,49 @@
+#ifndef CPUSKINNING_H
+#define CPUSKINNING_H
+
+#include "LoadM3d.h"
+
+///<summary>
+/// Applies the bone transforms to skinned vertices on the CPU, using the same
+/// math as the skinned vertex shaders.  This lets the skinning output be
+/// checked without a GPU.
+///</summary>
+class CpuSkinning
+{
+public:
+	// Linear blend skinning with the 3x4 final transforms from SkinnedData, one
+	// bone transform at a time as in the vertex shader.
+	static void ReferenceSkin(
+		const std::vector<M3DLoader::SkinnedVertex>& vertices,
+		const std::vector<DirectX::XMFLOAT3X4>& finalTransforms,
+		std::vector<M3DLoader::SkinnedVertex>& skinnedVertices);
+
+	// Linear blend skinning of a whole mesh for gameplay and tools (hitboxes,
+	// physics proxies, baking).  The vertices are split into chunks that run on
+	// worker threads, and each vertex blends its bone matrices with 4-wide SIMD
+	// before transforming.  The output arrays are resized to the vertex count.
+	static void Skin(
+		const std::vector<M3DLoader::SkinnedVertex>& vertices,
+		const std::vector<DirectX::XMFLOAT3X4>& finalTransforms,
+		std::vector<DirectX::XMFLOAT3>& positions,
+		std::vector<DirectX::XMFLOAT3>& normals,
+		std::vector<DirectX::XMFLOAT3>& tangents,
+		unsigned numThreads = 0);
+
+	// The largest distance between a position from Skin() and the same position
+	// from ReferenceSkin().  Skin() blends the matrices before transforming, so
+	// the two round differently, but they should agree to within float precision.
+	static float MaxSkinError(
+		const std::vector<M3DLoader::SkinnedVertex>& vertices,
+		const std::vector<DirectX::XMFLOAT3X4>& finalTransforms);
+
+	// Runs Skin() iterations times and returns the throughput in vertices per
+	// millisecond.
+	static double Benchmark(
+		const std::vector<M3DLoader::SkinnedVertex>& vertices,
+		const std::vector<DirectX::XMFLOAT3X4>& finalTransforms,
+		UINT iterations,
+		unsigned numThreads = 0);
+};
+
+#endif // CPUSKINNING_H
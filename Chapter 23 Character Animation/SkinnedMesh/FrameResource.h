@@ -3,6 +3,7 @@
 #include "../../Common/d3dUtil.h"
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
+#include "SkinnedData.h"
 
 struct ObjectConstants
 {
@@ -16,7 +17,16 @@ struct ObjectConstants
 
 struct SkinnedConstants
 {
-    DirectX::XMFLOAT4X4 BoneTransforms[96];
+    union
+    {
+        // Affine bone transforms, stored transposed with the constant last column
+        // dropped.  Matches float4x3 gBoneTransforms[96] in Common.hlsl.
+        DirectX::XMFLOAT3X4 BoneTransforms[96];
+
+        // Used instead when the shaders are compiled with DUAL_QUAT_SKINNING.
+        // Matches float4 gBoneDualQuats[192] in Common.hlsl.
+        DualQuaternion BoneDualQuats[96];
+    };
 };
 
 struct PassConstants
@@ -8,7 +8,7 @@ bool M3DLoader::LoadM3d(const std::string& filename,
   std::vector<Subset>& subsets,
   std::vector<M3dMaterial>& mats)
 {
-  std::ifstream fin(filename);
+  TextTokenizer tok;
 
   UINT numMaterials = 0;
   UINT numVertices = 0;
@@ -16,23 +16,21 @@ bool M3DLoader::LoadM3d(const std::string& filename,
   UINT numBones = 0;
   UINT numAnimationClips = 0;
 
-  std::string ignore;
-
-  if (fin)
+  if (tok.Open(filename))
   {
-    fin >> ignore; // file header text
-    fin >> ignore >> numMaterials;
-    fin >> ignore >> numVertices;
-    fin >> ignore >> numTriangles;
-    fin >> ignore >> numBones;
-    fin >> ignore >> numAnimationClips;
-
-    ReadMaterials(fin, numMaterials, mats);
-    ReadSubsetTable(fin, numMaterials, subsets);
-    ReadVertices(fin, numVertices, vertices);
-    ReadTriangles(fin, numTriangles, indices);
-
-    return true;
+    tok.SkipToken(); // file header text
+    tok.SkipToken(); numMaterials = tok.ReadUInt();
+    tok.SkipToken(); numVertices = tok.ReadUInt();
+    tok.SkipToken(); numTriangles = tok.ReadUInt();
+    tok.SkipToken(); numBones = tok.ReadUInt();
+    tok.SkipToken(); numAnimationClips = tok.ReadUInt();
+
+    ReadMaterials(tok, numMaterials, mats);
+    ReadSubsetTable(tok, numMaterials, subsets);
+    ReadVertices(tok, numVertices, vertices);
+    ReadTriangles(tok, numTriangles, indices);
+
+    return !tok.Failed();
   }
   return false;
 }
@@ -42,9 +40,10 @@ bool M3DLoader::LoadM3d(const std::string& filename,
   std::vector<USHORT>& indices,
   std::vector<Subset>& subsets,
   std::vector<M3dMaterial>& mats,
-  SkinnedData& skinInfo)
+  SkinnedData& skinInfo,
+  bool readAnimationClips)
 {
-  std::ifstream fin(filename);
+  TextTokenizer tok;
 
   UINT numMaterials = 0;
   UINT numVertices = 0;
@@ -52,206 +51,195 @@ bool M3DLoader::LoadM3d(const std::string& filename,
   UINT numBones = 0;
   UINT numAnimationClips = 0;
 
-  std::string ignore;
-
-  if (fin)
+  if (tok.Open(filename))
   {
-    fin >> ignore; // file header text
-    fin >> ignore >> numMaterials;
-    fin >> ignore >> numVertices;
-    fin >> ignore >> numTriangles;
-    fin >> ignore >> numBones;
-    fin >> ignore >> numAnimationClips;
+    tok.SkipToken(); // file header text
+    tok.SkipToken(); numMaterials = tok.ReadUInt();
+    tok.SkipToken(); numVertices = tok.ReadUInt();
+    tok.SkipToken(); numTriangles = tok.ReadUInt();
+    tok.SkipToken(); numBones = tok.ReadUInt();
+    tok.SkipToken(); numAnimationClips = tok.ReadUInt();
 
     std::vector<XMFLOAT4X4> boneOffsets;
     std::vector<int> boneIndexToParentIndex;
     std::unordered_map<std::string, AnimationClip> animations;
 
-    ReadMaterials(fin, numMaterials, mats);
-    ReadSubsetTable(fin, numMaterials, subsets);
-    ReadSkinnedVertices(fin, numVertices, vertices);
-    ReadTriangles(fin, numTriangles, indices);
-    ReadBoneOffsets(fin, numBones, boneOffsets);
-    ReadBoneHierarchy(fin, numBones, boneIndexToParentIndex);
-    ReadAnimationClips(fin, numBones, numAnimationClips, animations);
-
-    skinInfo.Set(boneIndexToParentIndex, boneOffsets, animations);
+    ReadMaterials(tok, numMaterials, mats);
+    ReadSubsetTable(tok, numMaterials, subsets);
+    ReadSkinnedVertices(tok, numVertices, vertices);
+    ReadTriangles(tok, numTriangles, indices);
+    ReadBoneOffsets(tok, numBones, boneOffsets);
+    ReadBoneHierarchy(tok, numBones, boneIndexToParentIndex);
+    if (readAnimationClips)
+      ReadAnimationClips(tok, numBones, numAnimationClips, animations);
 
-    return true;
+    return !tok.Failed() && skinInfo.Set(boneIndexToParentIndex, boneOffsets, animations);
   }
   return false;
 }
 
-void M3DLoader::ReadMaterials(std::ifstream& fin, UINT numMaterials, std::vector<M3dMaterial>& mats)
+void M3DLoader::ReadMaterials(TextTokenizer& tok, UINT numMaterials, std::vector<M3dMaterial>& mats)
 {
-  std::string ignore;
   mats.resize(numMaterials);
 
-  std::string diffuseMapName;
-  std::string normalMapName;
-
-  fin >> ignore; // materials header text
+  tok.SkipToken(); // materials header text
   for (UINT i = 0; i < numMaterials; ++i)
   {
-    fin >> ignore >> mats[i].Name;
-    fin >> ignore >> mats[i].DiffuseAlbedo.x >> mats[i].DiffuseAlbedo.y >> mats[i].DiffuseAlbedo.z;
-    fin >> ignore >> mats[i].FresnelR0.x >> mats[i].FresnelR0.y >> mats[i].FresnelR0.z;
-    fin >> ignore >> mats[i].Roughness;
-    fin >> ignore >> mats[i].AlphaClip;
-    fin >> ignore >> mats[i].MaterialTypeName;
-    fin >> ignore >> mats[i].DiffuseMapName;
-    fin >> ignore >> mats[i].NormalMapName;
+    tok.SkipToken(); mats[i].Name = tok.ReadString();
+    tok.SkipToken(); XMFLOAT3 diffuse = tok.ReadFloat3();
+    tok.SkipToken(); mats[i].FresnelR0 = tok.ReadFloat3();
+    tok.SkipToken(); mats[i].Roughness = tok.ReadFloat();
+    tok.SkipToken(); mats[i].AlphaClip = tok.ReadInt() != 0;
+    tok.SkipToken(); mats[i].MaterialTypeName = tok.ReadString();
+    tok.SkipToken(); mats[i].DiffuseMapName = tok.ReadString();
+    tok.SkipToken(); mats[i].NormalMapName = tok.ReadString();
+
+    mats[i].DiffuseAlbedo.x = diffuse.x;
+    mats[i].DiffuseAlbedo.y = diffuse.y;
+    mats[i].DiffuseAlbedo.z = diffuse.z;
   }
 }
 
-void M3DLoader::ReadSubsetTable(std::ifstream& fin, UINT numSubsets, std::vector<Subset>& subsets)
+void M3DLoader::ReadSubsetTable(TextTokenizer& tok, UINT numSubsets, std::vector<Subset>& subsets)
 {
-  std::string ignore;
   subsets.resize(numSubsets);
 
-  fin >> ignore; // subset header text
+  tok.SkipToken(); // subset header text
   for (UINT i = 0; i < numSubsets; ++i)
   {
-    fin >> ignore >> subsets[i].Id;
-    fin >> ignore >> subsets[i].VertexStart;
-    fin >> ignore >> subsets[i].VertexCount;
-    fin >> ignore >> subsets[i].FaceStart;
-    fin >> ignore >> subsets[i].FaceCount;
+    tok.SkipToken(); subsets[i].Id = tok.ReadUInt();
+    tok.SkipToken(); subsets[i].VertexStart = tok.ReadUInt();
+    tok.SkipToken(); subsets[i].VertexCount = tok.ReadUInt();
+    tok.SkipToken(); subsets[i].FaceStart = tok.ReadUInt();
+    tok.SkipToken(); subsets[i].FaceCount = tok.ReadUInt();
   }
 }
 
-void M3DLoader::ReadVertices(std::ifstream& fin, UINT numVertices, std::vector<Vertex>& vertices)
+void M3DLoader::ReadVertices(TextTokenizer& tok, UINT numVertices, std::vector<Vertex>& vertices)
 {
-  std::string ignore;
   vertices.resize(numVertices);
 
-  fin >> ignore; // vertices header text
+  tok.SkipToken(); // vertices header text
   for (UINT i = 0; i < numVertices; ++i)
   {
-    fin >> ignore >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-    fin >> ignore >> vertices[i].TangentU.x >> vertices[i].TangentU.y >> vertices[i].TangentU.z >> vertices[i].TangentU.w;
-    fin >> ignore >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
-    fin >> ignore >> vertices[i].TexC.x >> vertices[i].TexC.y;
+    tok.SkipToken(); vertices[i].Pos = tok.ReadFloat3();
+    tok.SkipToken(); vertices[i].TangentU = tok.ReadFloat4();
+    tok.SkipToken(); vertices[i].Normal = tok.ReadFloat3();
+    tok.SkipToken(); vertices[i].TexC = tok.ReadFloat2();
   }
 }
 
-void M3DLoader::ReadSkinnedVertices(std::ifstream& fin, UINT numVertices, std::vector<SkinnedVertex>& vertices)
+void M3DLoader::ReadSkinnedVertices(TextTokenizer& tok, UINT numVertices, std::vector<SkinnedVertex>& vertices)
 {
-  std::string ignore;
   vertices.resize(numVertices);
 
-  fin >> ignore; // vertices header text
-  int boneIndices[4];
-  float weights[4];
+  tok.SkipToken(); // vertices header text
+  ReadSkinnedVertexRange(tok, numVertices, vertices.data());
+}
+
+void M3DLoader::ReadSkinnedVertexRange(TextTokenizer& tok, UINT numVertices, SkinnedVertex* vertices)
+{
   for (UINT i = 0; i < numVertices; ++i)
   {
-    float blah;
-    fin >> ignore >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-    fin >> ignore >> vertices[i].TangentU.x >> vertices[i].TangentU.y >> vertices[i].TangentU.z >> blah /*vertices[i].TangentU.w*/;
-    fin >> ignore >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
-    fin >> ignore >> vertices[i].TexC.x >> vertices[i].TexC.y;
-    fin >> ignore >> weights[0] >> weights[1] >> weights[2] >> weights[3];
-    fin >> ignore >> boneIndices[0] >> boneIndices[1] >> boneIndices[2] >> boneIndices[3];
-
-    vertices[i].BoneWeights.x = weights[0];
-    vertices[i].BoneWeights.y = weights[1];
-    vertices[i].BoneWeights.z = weights[2];
-
-    vertices[i].BoneIndices[0] = (BYTE)boneIndices[0];
-    vertices[i].BoneIndices[1] = (BYTE)boneIndices[1];
-    vertices[i].BoneIndices[2] = (BYTE)boneIndices[2];
-    vertices[i].BoneIndices[3] = (BYTE)boneIndices[3];
+    tok.SkipToken(); vertices[i].Pos = tok.ReadFloat3();
+    tok.SkipToken(); vertices[i].TangentU = tok.ReadFloat3(); tok.ReadFloat(); /*vertices[i].TangentU.w*/
+    tok.SkipToken(); vertices[i].Normal = tok.ReadFloat3();
+    tok.SkipToken(); vertices[i].TexC = tok.ReadFloat2();
+
+    // The fourth weight is implied by the other three.
+    tok.SkipToken(); vertices[i].BoneWeights = tok.ReadFloat3(); tok.ReadFloat();
+
+    tok.SkipToken();
+    vertices[i].BoneIndices[0] = (BYTE)tok.ReadInt();
+    vertices[i].BoneIndices[1] = (BYTE)tok.ReadInt();
+    vertices[i].BoneIndices[2] = (BYTE)tok.ReadInt();
+    vertices[i].BoneIndices[3] = (BYTE)tok.ReadInt();
   }
 }
 
-void M3DLoader::ReadTriangles(std::ifstream& fin, UINT numTriangles, std::vector<USHORT>& indices)
+void M3DLoader::ReadTriangles(TextTokenizer& tok, UINT numTriangles, std::vector<USHORT>& indices)
 {
-  std::string ignore;
   indices.resize(numTriangles * 3);
 
-  fin >> ignore; // triangles header text
-  for (UINT i = 0; i < numTriangles; ++i)
+  tok.SkipToken(); // triangles header text
+  ReadTriangleRange(tok, numTriangles, indices.data());
+}
+
+void M3DLoader::ReadTriangleRange(TextTokenizer& tok, UINT numTriangles, USHORT* indices)
+{
+  for (UINT i = 0; i < numTriangles * 3; ++i)
   {
-    fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+    indices[i] = (USHORT)tok.ReadUInt();
   }
 }
 
-void M3DLoader::ReadBoneOffsets(std::ifstream& fin, UINT numBones, std::vector<XMFLOAT4X4>& boneOffsets)
+void M3DLoader::ReadBoneOffsets(TextTokenizer& tok, UINT numBones, std::vector<XMFLOAT4X4>& boneOffsets)
 {
-  std::string ignore;
   boneOffsets.resize(numBones);
 
-  fin >> ignore; // BoneOffsets header text
+  tok.SkipToken(); // BoneOffsets header text
   for (UINT i = 0; i < numBones; ++i)
   {
-    fin >> ignore >>
-      boneOffsets[i](0, 0) >> boneOffsets[i](0, 1) >> boneOffsets[i](0, 2) >> boneOffsets[i](0, 3) >>
-      boneOffsets[i](1, 0) >> boneOffsets[i](1, 1) >> boneOffsets[i](1, 2) >> boneOffsets[i](1, 3) >>
-      boneOffsets[i](2, 0) >> boneOffsets[i](2, 1) >> boneOffsets[i](2, 2) >> boneOffsets[i](2, 3) >>
-      boneOffsets[i](3, 0) >> boneOffsets[i](3, 1) >> boneOffsets[i](3, 2) >> boneOffsets[i](3, 3);
+    tok.SkipToken();
+    for (UINT j = 0; j < 16; ++j)
+      boneOffsets[i](j / 4, j % 4) = tok.ReadFloat();
   }
 }
 
-void M3DLoader::ReadBoneHierarchy(std::ifstream& fin, UINT numBones, std::vector<int>& boneIndexToParentIndex)
+void M3DLoader::ReadBoneHierarchy(TextTokenizer& tok, UINT numBones, std::vector<int>& boneIndexToParentIndex)
 {
-  std::string ignore;
   boneIndexToParentIndex.resize(numBones);
 
-  fin >> ignore; // BoneHierarchy header text
+  tok.SkipToken(); // BoneHierarchy header text
   for (UINT i = 0; i < numBones; ++i)
   {
-    fin >> ignore >> boneIndexToParentIndex[i];
+    tok.SkipToken(); boneIndexToParentIndex[i] = tok.ReadInt();
   }
 }
 
-void M3DLoader::ReadAnimationClips(std::ifstream& fin, UINT numBones, UINT numAnimationClips,
+void M3DLoader::ReadAnimationClips(TextTokenizer& tok, UINT numBones, UINT numAnimationClips,
   std::unordered_map<std::string, AnimationClip>& animations)
 {
-  std::string ignore;
-  fin >> ignore; // AnimationClips header text
+  tok.SkipToken(); // AnimationClips header text
   for (UINT clipIndex = 0; clipIndex < numAnimationClips; ++clipIndex)
   {
-    std::string clipName;
-    fin >> ignore >> clipName;
-    fin >> ignore; // {
-
     AnimationClip clip;
-    clip.BoneAnimations.resize(numBones);
+    std::string clipName = ReadAnimationClip(tok, numBones, clip);
+
+    animations[clipName] = std::move(clip);
+  }
+}
 
-    for (UINT boneIndex = 0; boneIndex < numBones; ++boneIndex)
-    {
-      ReadBoneKeyframes(fin, numBones, clip.BoneAnimations[boneIndex]);
-    }
-    fin >> ignore; // }
+std::string M3DLoader::ReadAnimationClip(TextTokenizer& tok, UINT numBones, AnimationClip& clip)
+{
+  tok.SkipToken();
+  std::string clipName = tok.ReadString();
+  tok.SkipToken(); // {
 
-    animations[clipName] = clip;
+  clip.BoneAnimations.resize(numBones);
+  for (UINT boneIndex = 0; boneIndex < numBones; ++boneIndex)
+  {
+    ReadBoneKeyframes(tok, numBones, clip.BoneAnimations[boneIndex]);
   }
+  tok.SkipToken(); // }
+
+  return clipName;
 }
 
-void M3DLoader::ReadBoneKeyframes(std::ifstream& fin, UINT numBones, BoneAnimation& boneAnimation)
+void M3DLoader::ReadBoneKeyframes(TextTokenizer& tok, UINT numBones, BoneAnimation& boneAnimation)
 {
-  std::string ignore;
-  UINT numKeyframes = 0;
-  fin >> ignore >> ignore >> numKeyframes;
-  fin >> ignore; // {
+  tok.SkipToken(2);
+  UINT numKeyframes = tok.ReadUInt();
+  tok.SkipToken(); // {
 
   boneAnimation.Keyframes.resize(numKeyframes);
   for (UINT i = 0; i < numKeyframes; ++i)
   {
-    float t = 0.0f;
-    XMFLOAT3 p(0.0f, 0.0f, 0.0f);
-    XMFLOAT3 s(1.0f, 1.0f, 1.0f);
-    XMFLOAT4 q(0.0f, 0.0f, 0.0f, 1.0f);
-    fin >> ignore >> t;
-    fin >> ignore >> p.x >> p.y >> p.z;
-    fin >> ignore >> s.x >> s.y >> s.z;
-    fin >> ignore >> q.x >> q.y >> q.z >> q.w;
-
-    boneAnimation.Keyframes[i].TimePos = t;
-    boneAnimation.Keyframes[i].Translation = p;
-    boneAnimation.Keyframes[i].Scale = s;
-    boneAnimation.Keyframes[i].RotationQuat = q;
+    tok.SkipToken(); boneAnimation.Keyframes[i].TimePos = tok.ReadFloat();
+    tok.SkipToken(); boneAnimation.Keyframes[i].Translation = tok.ReadFloat3();
+    tok.SkipToken(); boneAnimation.Keyframes[i].Scale = tok.ReadFloat3();
+    tok.SkipToken(); boneAnimation.Keyframes[i].RotationQuat = tok.ReadFloat4();
   }
 
-  fin >> ignore; // }
+  tok.SkipToken(); // }
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #define LOADM3D_H
 
 #include "SkinnedData.h"
+#include "../../Common/TextTokenizer.h"
 
 
 
@@ -49,28 +50,155 @@ public:
         std::string NormalMapName;
     };
 
+    struct SectionTiming
+    {
+        std::string Name;
+        double Ms;
+    };
+
+    // Milliseconds per load, averaged over the benchmark iterations.
+    struct LoadTimings
+    {
+        double TextMs = 0.0;       // LoadM3d on the text file.
+        double BinaryMapMs = 0.0;  // Mapping the binary file (M3dBinaryModel::Open).
+        double BinaryLoadMs = 0.0; // LoadM3dBinary, which also copies into the output vectors.
+    };
+
+    // Why LoadM3dValidated rejected a file: the section being read, and the line
+    // (1-based) and byte offset of the token that was wrong.
+    struct LoadError
+    {
+        std::string Section;
+        UINT Line = 0;
+        size_t Offset = 0;
+        std::string Message;
+
+        // "Triangles, line 96299 (offset 2998506): index 14000 is out of range (13748 vertices)"
+        std::string ToString()const;
+    };
+
+    struct StressReport
+    {
+        UINT Iterations = 0;
+        UINT Accepted = 0; // Corrupt copies that still loaded, e.g. a digit changed in a float.
+        UINT Rejected = 0;
+        UINT Broken = 0;   // Accepted copies with an out of range index or bone; must be 0.
+        double Ms = 0.0;
+
+        LoadError LastError; // The last rejection, as a sample of the messages.
+    };
+
 	bool LoadM3d(const std::string& filename, 
 		std::vector<Vertex>& vertices,
 		std::vector<USHORT>& indices,
 		std::vector<Subset>& subsets,
 		std::vector<M3dMaterial>& mats);
+	// With readAnimationClips false, the file is read up to the bone hierarchy and
+	// skinInfo gets no clips, e.g. when the animation comes from a BakedAnimation.
+	// The clips are the bulk of a skinned file, so this skips most of the parsing.
 	bool LoadM3d(const std::string& filename, 
+		std::vector<SkinnedVertex>& vertices,
+		std::vector<USHORT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats,
+		SkinnedData& skinInfo,
+		bool readAnimationClips = true);
+
+	// Same as LoadM3d, but reads a binary .m3db file (see LoadM3dBinary.h).  The
+	// arrays are bulk-copied out of the mapped file instead of parsed.
+	bool LoadM3dBinary(const std::string& filename, 
+		std::vector<Vertex>& vertices,
+		std::vector<USHORT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats);
+	bool LoadM3dBinary(const std::string& filename, 
 		std::vector<SkinnedVertex>& vertices,
 		std::vector<USHORT>& indices,
 		std::vector<Subset>& subsets,
 		std::vector<M3dMaterial>& mats,
 		SkinnedData& skinInfo);
 
+	// Writes the text .m3d file as a binary .m3db file.  A file with bones is
+	// written with skinned vertices.
+	bool ConvertM3dToBinary(const std::string& textFilename, const std::string& binaryFilename);
+
+	// Same as the skinned LoadM3d, but maps the file, finds where each section (and
+	// each vertex/triangle chunk and animation clip) starts, and then parses them
+	// concurrently on numThreads threads (0 = one per hardware thread).  If timings is
+	// given, it receives the time to locate the sections, the parse time of each
+	// section summed over its chunks, and the total wall time.
+	bool LoadM3dParallel(const std::string& filename, 
+		std::vector<SkinnedVertex>& vertices,
+		std::vector<USHORT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats,
+		SkinnedData& skinInfo,
+		std::vector<SectionTiming>* timings = nullptr,
+		unsigned numThreads = 0);
+
+	// Same as LoadM3d, but checks the file instead of trusting it.  Each count is
+	// capped by what the rest of the file could hold before anything is allocated,
+	// every label and number is checked, and triangle, subset and bone indices are
+	// checked against the counts.  Loading stops at the first problem, which is
+	// described in error.  Indices are returned as 32-bit, so a model with more than
+	// 65536 vertices loads too; NarrowIndices converts them for a 16-bit buffer.
+	bool LoadM3dValidated(const std::string& filename, 
+		std::vector<Vertex>& vertices,
+		std::vector<UINT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats,
+		LoadError& error);
+	bool LoadM3dValidated(const std::string& filename, 
+		std::vector<SkinnedVertex>& vertices,
+		std::vector<UINT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats,
+		SkinnedData& skinInfo,
+		LoadError& error);
+
+	// The same, on text already in memory.
+	bool LoadM3dValidated(const char* text, size_t size, 
+		std::vector<Vertex>& vertices,
+		std::vector<UINT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats,
+		LoadError& error);
+	bool LoadM3dValidated(const char* text, size_t size, 
+		std::vector<SkinnedVertex>& vertices,
+		std::vector<UINT>& indices,
+		std::vector<Subset>& subsets,
+		std::vector<M3dMaterial>& mats,
+		SkinnedData& skinInfo,
+		LoadError& error);
+
+	// Copies 32-bit indices to 16-bit ones.  Returns false (and leaves indices16
+	// alone) if any index does not fit.
+	static bool NarrowIndices(const std::vector<UINT>& indices, std::vector<USHORT>& indices16);
+
+	// Fuzz-style check of LoadM3dValidated: loads randomly corrupted copies of a
+	// skinned model (flipped bytes, truncation, deleted or repeated lines, huge or
+	// negative numbers, inflated header counts) and checks that each one is either
+	// rejected or loads with every index in range.  Returns false if the file itself
+	// does not load or a corrupt copy got through broken.
+	bool StressTestM3d(const std::string& filename, UINT iterations, UINT seed, StressReport& report);
+
+	// Loads the same (skinned) model from its text and binary files and times both.
+	bool BenchmarkLoad(const std::string& textFilename, const std::string& binaryFilename,
+		UINT iterations, LoadTimings& timings);
+
 private:
-	void ReadMaterials(std::ifstream& fin, UINT numMaterials, std::vector<M3dMaterial>& mats);
-	void ReadSubsetTable(std::ifstream& fin, UINT numSubsets, std::vector<Subset>& subsets);
-	void ReadVertices(std::ifstream& fin, UINT numVertices, std::vector<Vertex>& vertices);
-	void ReadSkinnedVertices(std::ifstream& fin, UINT numVertices, std::vector<SkinnedVertex>& vertices);
-	void ReadTriangles(std::ifstream& fin, UINT numTriangles, std::vector<USHORT>& indices);
-	void ReadBoneOffsets(std::ifstream& fin, UINT numBones, std::vector<DirectX::XMFLOAT4X4>& boneOffsets);
-	void ReadBoneHierarchy(std::ifstream& fin, UINT numBones, std::vector<int>& boneIndexToParentIndex);
-	void ReadAnimationClips(std::ifstream& fin, UINT numBones, UINT numAnimationClips, std::unordered_map<std::string, AnimationClip>& animations);
-	void ReadBoneKeyframes(std::ifstream& fin, UINT numBones, BoneAnimation& boneAnimation);
+	void ReadMaterials(TextTokenizer& tok, UINT numMaterials, std::vector<M3dMaterial>& mats);
+	void ReadSubsetTable(TextTokenizer& tok, UINT numSubsets, std::vector<Subset>& subsets);
+	void ReadVertices(TextTokenizer& tok, UINT numVertices, std::vector<Vertex>& vertices);
+	void ReadSkinnedVertices(TextTokenizer& tok, UINT numVertices, std::vector<SkinnedVertex>& vertices);
+	void ReadSkinnedVertexRange(TextTokenizer& tok, UINT numVertices, SkinnedVertex* vertices);
+	void ReadTriangles(TextTokenizer& tok, UINT numTriangles, std::vector<USHORT>& indices);
+	void ReadTriangleRange(TextTokenizer& tok, UINT numTriangles, USHORT* indices);
+	void ReadBoneOffsets(TextTokenizer& tok, UINT numBones, std::vector<DirectX::XMFLOAT4X4>& boneOffsets);
+	void ReadBoneHierarchy(TextTokenizer& tok, UINT numBones, std::vector<int>& boneIndexToParentIndex);
+	void ReadAnimationClips(TextTokenizer& tok, UINT numBones, UINT numAnimationClips, std::unordered_map<std::string, AnimationClip>& animations);
+	std::string ReadAnimationClip(TextTokenizer& tok, UINT numBones, AnimationClip& clip); // Returns the clip name.
+	void ReadBoneKeyframes(TextTokenizer& tok, UINT numBones, BoneAnimation& boneAnimation);
 };
 
 
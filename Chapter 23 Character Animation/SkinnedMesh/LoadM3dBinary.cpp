@@ -0,0 +1,486 @@
+#include "LoadM3dBinary.h"
+#include <chrono>
+
+using namespace DirectX;
+
+namespace
+{
+  // File layout: a Header, then each section at its offset.  Every section is
+  // 16-byte aligned, so the mapped arrays can be read in place.
+  struct M3dBinaryHeader
+  {
+    UINT Magic;
+    UINT Version;
+    UINT IsSkinned;
+    UINT VertexStride;
+
+    UINT NumMaterials;
+    UINT NumSubsets;
+    UINT NumVertices;
+    UINT NumIndices;
+    UINT NumBones;
+    UINT NumClips;
+    UINT NumKeyframes;
+
+    UINT MaterialsOffset;
+    UINT SubsetsOffset;
+    UINT VerticesOffset;
+    UINT IndicesOffset;
+    UINT BoneOffsetsOffset;
+    UINT BoneHierarchyOffset;
+    UINT ClipsOffset;
+    UINT KeyframeRangesOffset;
+    UINT KeyframesOffset;
+  };
+
+  const UINT M3dBinaryMagic = 0x4244334D; // "M3DB"
+  const UINT M3dBinaryVersion = 1;
+  const UINT M3dBinaryNameLength = 64;
+
+  struct M3dBinaryMaterial
+  {
+    char Name[M3dBinaryNameLength];
+    char MaterialTypeName[M3dBinaryNameLength];
+    char DiffuseMapName[M3dBinaryNameLength];
+    char NormalMapName[M3dBinaryNameLength];
+
+    XMFLOAT4 DiffuseAlbedo;
+    XMFLOAT3 FresnelR0;
+    float Roughness;
+    UINT AlphaClip;
+  };
+
+  struct M3dBinaryClip
+  {
+    char Name[M3dBinaryNameLength];
+  };
+
+  bool CopyName(char (&dst)[M3dBinaryNameLength], const std::string& src)
+  {
+    if(src.size() >= M3dBinaryNameLength)
+      return false;
+
+    memset(dst, 0, sizeof(dst));
+    memcpy(dst, src.c_str(), src.size());
+    return true;
+  }
+
+  std::string ReadName(const char (&src)[M3dBinaryNameLength])
+  {
+    return std::string(src, strnlen(src, M3dBinaryNameLength));
+  }
+
+  UINT AlignSection(UINT offset)
+  {
+    return (offset + 15) & ~15u;
+  }
+
+  // Appends a section to the file image and returns its offset.
+  UINT AppendSection(std::vector<BYTE>& image, const void* data, size_t byteSize)
+  {
+    UINT offset = AlignSection((UINT)image.size());
+    image.resize(offset + byteSize);
+    if(byteSize > 0)
+      memcpy(&image[offset], data, byteSize);
+    return offset;
+  }
+
+  // Returns a pointer to count elements of T at offset, or nullptr if they do not fit in the file.
+  template<typename T>
+  const T* GetSection(const MappedFile& file, UINT offset, UINT64 count)
+  {
+    if(offset % 4 != 0 || offset + count*sizeof(T) > file.Size())
+      return nullptr;
+    return reinterpret_cast<const T*>(file.Data() + offset);
+  }
+}
+
+bool M3dBinaryModel::Open(const std::string& filename)
+{
+  Close();
+
+  if(!mFile.Open(filename) || mFile.Size() < sizeof(M3dBinaryHeader))
+  {
+    Close();
+    return false;
+  }
+
+  const M3dBinaryHeader* header = reinterpret_cast<const M3dBinaryHeader*>(mFile.Data());
+  UINT vertexStride = header->IsSkinned ? sizeof(M3DLoader::SkinnedVertex) : sizeof(M3DLoader::Vertex);
+  if(header->Magic != M3dBinaryMagic || header->Version != M3dBinaryVersion ||
+     header->VertexStride != vertexStride)
+  {
+    Close();
+    return false;
+  }
+
+  mIsSkinned    = header->IsSkinned != 0;
+  mNumMaterials = header->NumMaterials;
+  mNumSubsets   = header->NumSubsets;
+  mNumVertices  = header->NumVertices;
+  mNumIndices   = header->NumIndices;
+  mNumBones     = header->NumBones;
+  mNumClips     = header->NumClips;
+
+  mMaterials      = (const BYTE*)GetSection<M3dBinaryMaterial>(mFile, header->MaterialsOffset, mNumMaterials);
+  mSubsets        = GetSection<M3DLoader::Subset>(mFile, header->SubsetsOffset, mNumSubsets);
+  mVertices       = mIsSkinned ?
+    (const void*)GetSection<M3DLoader::SkinnedVertex>(mFile, header->VerticesOffset, mNumVertices) :
+    (const void*)GetSection<M3DLoader::Vertex>(mFile, header->VerticesOffset, mNumVertices);
+  mIndices        = GetSection<USHORT>(mFile, header->IndicesOffset, mNumIndices);
+  mBoneOffsets    = GetSection<XMFLOAT4X4>(mFile, header->BoneOffsetsOffset, mNumBones);
+  mBoneHierarchy  = GetSection<int>(mFile, header->BoneHierarchyOffset, mNumBones);
+  mClips          = (const BYTE*)GetSection<M3dBinaryClip>(mFile, header->ClipsOffset, mNumClips);
+  mKeyframeRanges = GetSection<KeyframeRange>(mFile, header->KeyframeRangesOffset, (UINT64)mNumClips*mNumBones);
+  mKeyframes      = GetSection<Keyframe>(mFile, header->KeyframesOffset, header->NumKeyframes);
+
+  if(!mMaterials || !mSubsets || !mVertices || !mIndices || !mBoneOffsets ||
+     !mBoneHierarchy || !mClips || !mKeyframeRanges || !mKeyframes)
+  {
+    Close();
+    return false;
+  }
+
+  // The ranges index into the keyframe array, so they must stay inside it.
+  for(UINT64 i = 0; i < (UINT64)mNumClips*mNumBones; ++i)
+  {
+    if((UINT64)mKeyframeRanges[i].First + mKeyframeRanges[i].Count > header->NumKeyframes)
+    {
+      Close();
+      return false;
+    }
+  }
+
+  return true;
+}
+
+void M3dBinaryModel::Close()
+{
+  mFile.Close();
+
+  mIsSkinned = false;
+  mNumMaterials = mNumSubsets = mNumVertices = mNumIndices = mNumBones = mNumClips = 0;
+
+  mMaterials = nullptr;
+  mClips = nullptr;
+  mVertices = nullptr;
+  mIndices = nullptr;
+  mSubsets = nullptr;
+  mBoneOffsets = nullptr;
+  mBoneHierarchy = nullptr;
+  mKeyframeRanges = nullptr;
+  mKeyframes = nullptr;
+}
+
+bool M3dBinaryModel::IsSkinned()const
+{
+  return mIsSkinned;
+}
+
+UINT M3dBinaryModel::MaterialCount()const
+{
+  return mNumMaterials;
+}
+
+UINT M3dBinaryModel::SubsetCount()const
+{
+  return mNumSubsets;
+}
+
+UINT M3dBinaryModel::VertexCount()const
+{
+  return mNumVertices;
+}
+
+UINT M3dBinaryModel::IndexCount()const
+{
+  return mNumIndices;
+}
+
+UINT M3dBinaryModel::BoneCount()const
+{
+  return mNumBones;
+}
+
+UINT M3dBinaryModel::ClipCount()const
+{
+  return mNumClips;
+}
+
+const M3DLoader::Vertex* M3dBinaryModel::Vertices()const
+{
+  return mIsSkinned ? nullptr : static_cast<const M3DLoader::Vertex*>(mVertices);
+}
+
+const M3DLoader::SkinnedVertex* M3dBinaryModel::SkinnedVertices()const
+{
+  return mIsSkinned ? static_cast<const M3DLoader::SkinnedVertex*>(mVertices) : nullptr;
+}
+
+const USHORT* M3dBinaryModel::Indices()const
+{
+  return mIndices;
+}
+
+const M3DLoader::Subset* M3dBinaryModel::Subsets()const
+{
+  return mSubsets;
+}
+
+const XMFLOAT4X4* M3dBinaryModel::BoneOffsets()const
+{
+  return mBoneOffsets;
+}
+
+const int* M3dBinaryModel::BoneHierarchy()const
+{
+  return mBoneHierarchy;
+}
+
+const Keyframe* M3dBinaryModel::Keyframes()const
+{
+  return mKeyframes;
+}
+
+std::string M3dBinaryModel::GetClipName(UINT clip)const
+{
+  return ReadName(reinterpret_cast<const M3dBinaryClip*>(mClips)[clip].Name);
+}
+
+const M3dBinaryModel::KeyframeRange* M3dBinaryModel::GetClipKeyframeRanges(UINT clip)const
+{
+  return &mKeyframeRanges[clip*mNumBones];
+}
+
+void M3dBinaryModel::GetMaterials(std::vector<M3DLoader::M3dMaterial>& mats)const
+{
+  const M3dBinaryMaterial* src = reinterpret_cast<const M3dBinaryMaterial*>(mMaterials);
+
+  mats.resize(mNumMaterials);
+  for(UINT i = 0; i < mNumMaterials; ++i)
+  {
+    mats[i].Name             = ReadName(src[i].Name);
+    mats[i].DiffuseAlbedo    = src[i].DiffuseAlbedo;
+    mats[i].FresnelR0        = src[i].FresnelR0;
+    mats[i].Roughness        = src[i].Roughness;
+    mats[i].AlphaClip        = src[i].AlphaClip != 0;
+    mats[i].MaterialTypeName = ReadName(src[i].MaterialTypeName);
+    mats[i].DiffuseMapName   = ReadName(src[i].DiffuseMapName);
+    mats[i].NormalMapName    = ReadName(src[i].NormalMapName);
+  }
+}
+
+bool M3DLoader::ConvertM3dToBinary(const std::string& textFilename, const std::string& binaryFilename)
+{
+  TextTokenizer tok;
+  if(!tok.Open(textFilename))
+    return false;
+
+  UINT numMaterials = 0;
+  UINT numVertices = 0;
+  UINT numTriangles = 0;
+  UINT numBones = 0;
+  UINT numAnimationClips = 0;
+
+  tok.SkipToken(); // file header text
+  tok.SkipToken(); numMaterials = tok.ReadUInt();
+  tok.SkipToken(); numVertices = tok.ReadUInt();
+  tok.SkipToken(); numTriangles = tok.ReadUInt();
+  tok.SkipToken(); numBones = tok.ReadUInt();
+  tok.SkipToken(); numAnimationClips = tok.ReadUInt();
+
+  std::vector<M3dMaterial> mats;
+  std::vector<Subset> subsets;
+  std::vector<Vertex> vertices;
+  std::vector<SkinnedVertex> skinnedVertices;
+  std::vector<USHORT> indices;
+  std::vector<XMFLOAT4X4> boneOffsets;
+  std::vector<int> boneIndexToParentIndex;
+  std::unordered_map<std::string, AnimationClip> animations;
+
+  bool isSkinned = numBones > 0;
+
+  ReadMaterials(tok, numMaterials, mats);
+  ReadSubsetTable(tok, numMaterials, subsets);
+  if(isSkinned)
+    ReadSkinnedVertices(tok, numVertices, skinnedVertices);
+  else
+    ReadVertices(tok, numVertices, vertices);
+  ReadTriangles(tok, numTriangles, indices);
+  if(isSkinned)
+  {
+    ReadBoneOffsets(tok, numBones, boneOffsets);
+    ReadBoneHierarchy(tok, numBones, boneIndexToParentIndex);
+    ReadAnimationClips(tok, numBones, numAnimationClips, animations);
+  }
+
+  if(tok.Failed())
+    return false;
+
+  std::vector<M3dBinaryMaterial> binaryMats(mats.size());
+  for(size_t i = 0; i < mats.size(); ++i)
+  {
+    if(!CopyName(binaryMats[i].Name, mats[i].Name) ||
+       !CopyName(binaryMats[i].MaterialTypeName, mats[i].MaterialTypeName) ||
+       !CopyName(binaryMats[i].DiffuseMapName, mats[i].DiffuseMapName) ||
+       !CopyName(binaryMats[i].NormalMapName, mats[i].NormalMapName))
+      return false;
+
+    binaryMats[i].DiffuseAlbedo = mats[i].DiffuseAlbedo;
+    binaryMats[i].FresnelR0     = mats[i].FresnelR0;
+    binaryMats[i].Roughness     = mats[i].Roughness;
+    binaryMats[i].AlphaClip     = mats[i].AlphaClip ? 1 : 0;
+  }
+
+  // Write the clips in name order, the same order SkinnedData hands out clip handles in.
+  std::vector<std::string> clipNames;
+  for(auto& clip : animations)
+    clipNames.push_back(clip.first);
+  std::sort(clipNames.begin(), clipNames.end());
+
+  std::vector<M3dBinaryClip> binaryClips(clipNames.size());
+  std::vector<M3dBinaryModel::KeyframeRange> keyframeRanges;
+  std::vector<Keyframe> keyframes;
+  for(size_t i = 0; i < clipNames.size(); ++i)
+  {
+    if(!CopyName(binaryClips[i].Name, clipNames[i]))
+      return false;
+
+    for(auto& boneAnim : animations[clipNames[i]].BoneAnimations)
+    {
+      keyframeRanges.push_back({ (UINT)keyframes.size(), (UINT)boneAnim.Keyframes.size() });
+      keyframes.insert(keyframes.end(), boneAnim.Keyframes.begin(), boneAnim.Keyframes.end());
+    }
+  }
+
+  M3dBinaryHeader header = {};
+  header.Magic        = M3dBinaryMagic;
+  header.Version      = M3dBinaryVersion;
+  header.IsSkinned    = isSkinned ? 1 : 0;
+  header.VertexStride = isSkinned ? sizeof(SkinnedVertex) : sizeof(Vertex);
+  header.NumMaterials = (UINT)binaryMats.size();
+  header.NumSubsets   = (UINT)subsets.size();
+  header.NumVertices  = numVertices;
+  header.NumIndices   = (UINT)indices.size();
+  header.NumBones     = (UINT)boneOffsets.size();
+  header.NumClips     = (UINT)binaryClips.size();
+  header.NumKeyframes = (UINT)keyframes.size();
+
+  std::vector<BYTE> image(sizeof(M3dBinaryHeader));
+  header.MaterialsOffset = AppendSection(image, binaryMats.data(), binaryMats.size()*sizeof(M3dBinaryMaterial));
+  header.SubsetsOffset   = AppendSection(image, subsets.data(), subsets.size()*sizeof(Subset));
+  header.VerticesOffset  = isSkinned ?
+    AppendSection(image, skinnedVertices.data(), skinnedVertices.size()*sizeof(SkinnedVertex)) :
+    AppendSection(image, vertices.data(), vertices.size()*sizeof(Vertex));
+  header.IndicesOffset        = AppendSection(image, indices.data(), indices.size()*sizeof(USHORT));
+  header.BoneOffsetsOffset    = AppendSection(image, boneOffsets.data(), boneOffsets.size()*sizeof(XMFLOAT4X4));
+  header.BoneHierarchyOffset  = AppendSection(image, boneIndexToParentIndex.data(), boneIndexToParentIndex.size()*sizeof(int));
+  header.ClipsOffset          = AppendSection(image, binaryClips.data(), binaryClips.size()*sizeof(M3dBinaryClip));
+  header.KeyframeRangesOffset = AppendSection(image, keyframeRanges.data(), keyframeRanges.size()*sizeof(M3dBinaryModel::KeyframeRange));
+  header.KeyframesOffset      = AppendSection(image, keyframes.data(), keyframes.size()*sizeof(Keyframe));
+  memcpy(image.data(), &header, sizeof(header));
+
+  std::ofstream fout(binaryFilename, std::ios::binary);
+  if(!fout)
+    return false;
+
+  fout.write(reinterpret_cast<const char*>(image.data()), image.size());
+  return (bool)fout;
+}
+
+bool M3DLoader::LoadM3dBinary(const std::string& filename,
+  std::vector<Vertex>& vertices,
+  std::vector<USHORT>& indices,
+  std::vector<Subset>& subsets,
+  std::vector<M3dMaterial>& mats)
+{
+  M3dBinaryModel model;
+  if(!model.Open(filename) || model.IsSkinned())
+    return false;
+
+  vertices.assign(model.Vertices(), model.Vertices() + model.VertexCount());
+  indices.assign(model.Indices(), model.Indices() + model.IndexCount());
+  subsets.assign(model.Subsets(), model.Subsets() + model.SubsetCount());
+  model.GetMaterials(mats);
+
+  return true;
+}
+
+bool M3DLoader::LoadM3dBinary(const std::string& filename,
+  std::vector<SkinnedVertex>& vertices,
+  std::vector<USHORT>& indices,
+  std::vector<Subset>& subsets,
+  std::vector<M3dMaterial>& mats,
+  SkinnedData& skinInfo)
+{
+  M3dBinaryModel model;
+  if(!model.Open(filename) || !model.IsSkinned())
+    return false;
+
+  vertices.assign(model.SkinnedVertices(), model.SkinnedVertices() + model.VertexCount());
+  indices.assign(model.Indices(), model.Indices() + model.IndexCount());
+  subsets.assign(model.Subsets(), model.Subsets() + model.SubsetCount());
+  model.GetMaterials(mats);
+
+  UINT numBones = model.BoneCount();
+  std::vector<XMFLOAT4X4> boneOffsets(model.BoneOffsets(), model.BoneOffsets() + numBones);
+  std::vector<int> boneIndexToParentIndex(model.BoneHierarchy(), model.BoneHierarchy() + numBones);
+
+  std::unordered_map<std::string, AnimationClip> animations;
+  for(UINT clipIndex = 0; clipIndex < model.ClipCount(); ++clipIndex)
+  {
+    const M3dBinaryModel::KeyframeRange* ranges = model.GetClipKeyframeRanges(clipIndex);
+
+    AnimationClip& clip = animations[model.GetClipName(clipIndex)];
+    clip.BoneAnimations.resize(numBones);
+    for(UINT boneIndex = 0; boneIndex < numBones; ++boneIndex)
+    {
+      const Keyframe* first = model.Keyframes() + ranges[boneIndex].First;
+      clip.BoneAnimations[boneIndex].Keyframes.assign(first, first + ranges[boneIndex].Count);
+    }
+  }
+
+  return skinInfo.Set(boneIndexToParentIndex, boneOffsets, animations);
+}
+
+bool M3DLoader::BenchmarkLoad(const std::string& textFilename, const std::string& binaryFilename,
+  UINT iterations, LoadTimings& timings)
+{
+  typedef std::chrono::high_resolution_clock Clock;
+
+  std::vector<SkinnedVertex> vertices;
+  std::vector<USHORT> indices;
+  std::vector<Subset> subsets;
+  std::vector<M3dMaterial> mats;
+  SkinnedData skinInfo;
+
+  iterations = MathHelper::Max(iterations, 1u);
+  timings = LoadTimings();
+
+  for(UINT i = 0; i < iterations; ++i)
+  {
+    auto t0 = Clock::now();
+    if(!LoadM3d(textFilename, vertices, indices, subsets, mats, skinInfo))
+      return false;
+
+    auto t1 = Clock::now();
+    M3dBinaryModel model;
+    if(!model.Open(binaryFilename))
+      return false;
+
+    auto t2 = Clock::now();
+    if(!LoadM3dBinary(binaryFilename, vertices, indices, subsets, mats, skinInfo))
+      return false;
+
+    auto t3 = Clock::now();
+    timings.TextMs       += std::chrono::duration<double, std::milli>(t1 - t0).count();
+    timings.BinaryMapMs  += std::chrono::duration<double, std::milli>(t2 - t1).count();
+    timings.BinaryLoadMs += std::chrono::duration<double, std::milli>(t3 - t2).count();
+  }
+
+  timings.TextMs       /= iterations;
+  timings.BinaryMapMs  /= iterations;
+  timings.BinaryLoadMs /= iterations;
+
+  return true;
+}
@@ -0,0 +1,79 @@
+#ifndef LOADM3DBINARY_H
+#define LOADM3DBINARY_H
+
+#include "LoadM3d.h"
+#include "../../Common/MappedFile.h"
+
+///<summary>
+/// A binary .m3db model mapped into memory.  The file stores the same data as
+/// a text .m3d, but as raw arrays in the loader's own structs, so the vertex,
+/// index, subset, bone and keyframe arrays are used straight out of the mapping
+/// with no per-element parsing.  The pointers stay valid until Close().
+///
+/// Use M3DLoader::ConvertM3dToBinary to produce a .m3db from a text .m3d.
+///</summary>
+class M3dBinaryModel
+{
+public:
+    // The keyframes of one bone in one clip are Keyframes()[First, First+Count).
+    struct KeyframeRange
+    {
+        UINT First;
+        UINT Count;
+    };
+
+    // Returns false if the file is missing, has the wrong version, or any
+    // section lies outside the file.
+    bool Open(const std::string& filename);
+    void Close();
+
+    bool IsSkinned()const;
+
+    UINT MaterialCount()const;
+    UINT SubsetCount()const;
+    UINT VertexCount()const;
+    UINT IndexCount()const;
+    UINT BoneCount()const;
+    UINT ClipCount()const;
+
+    // Only one of these is non-null, depending on IsSkinned().
+    const M3DLoader::Vertex* Vertices()const;
+    const M3DLoader::SkinnedVertex* SkinnedVertices()const;
+
+    const USHORT* Indices()const;
+    const M3DLoader::Subset* Subsets()const;
+    const DirectX::XMFLOAT4X4* BoneOffsets()const;
+    const int* BoneHierarchy()const;
+    const Keyframe* Keyframes()const;
+
+    std::string GetClipName(UINT clip)const;
+
+    // Returns BoneCount() ranges, one per bone.
+    const KeyframeRange* GetClipKeyframeRanges(UINT clip)const;
+
+    // Materials hold strings, so these are unpacked rather than used in place.
+    void GetMaterials(std::vector<M3DLoader::M3dMaterial>& mats)const;
+
+private:
+    MappedFile mFile;
+
+    bool mIsSkinned = false;
+    UINT mNumMaterials = 0;
+    UINT mNumSubsets = 0;
+    UINT mNumVertices = 0;
+    UINT mNumIndices = 0;
+    UINT mNumBones = 0;
+    UINT mNumClips = 0;
+
+    const BYTE* mMaterials = nullptr;
+    const BYTE* mClips = nullptr;
+    const void* mVertices = nullptr;
+    const USHORT* mIndices = nullptr;
+    const M3DLoader::Subset* mSubsets = nullptr;
+    const DirectX::XMFLOAT4X4* mBoneOffsets = nullptr;
+    const int* mBoneHierarchy = nullptr;
+    const KeyframeRange* mKeyframeRanges = nullptr;
+    const Keyframe* mKeyframes = nullptr;
+};
+
+#endif // LOADM3DBINARY_H
@@ -0,0 +1,299 @@
+#include "LoadM3d.h"
+#include "../../Common/MappedFile.h"
+#include "../../Common/ParallelFor.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+  typedef std::chrono::high_resolution_clock Clock;
+
+  double ElapsedMs(Clock::time_point t0, Clock::time_point t1)
+  {
+    return std::chrono::duration<double, std::milli>(t1 - t0).count();
+  }
+
+  enum ParseSection
+  {
+    SectionMaterials = 0,
+    SectionVertices,
+    SectionTriangles,
+    SectionBones,
+    SectionAnimationClips,
+    SectionCount
+  };
+
+  const char* const SectionNames[SectionCount] =
+  {
+    "Materials", "Vertices", "Triangles", "Bones", "AnimationClips"
+  };
+
+  // One independent block of text: a run of vertices or triangles, one animation
+  // clip, or a small section parsed whole.
+  struct ParseTask
+  {
+    ParseSection Section;
+    const char* Begin;
+    const char* End;
+    UINT First;
+    UINT Count;
+    double Ms;      // Set when the task runs.
+    bool Failed;
+  };
+
+  bool StartsWith(const char* s, const char* end, const char* prefix)
+  {
+    size_t length = strlen(prefix);
+    return (size_t)(end - s) >= length && memcmp(s, prefix, length) == 0;
+  }
+
+  // Where each section starts, plus the start of every chunk of vertices and
+  // triangles and of every animation clip.  Found in one pass over the line starts.
+  struct SectionLayout
+  {
+    const char* Materials = nullptr;
+    const char* Vertices = nullptr;
+    const char* Triangles = nullptr;
+    const char* BoneOffsets = nullptr;
+    const char* AnimationClips = nullptr;
+
+    std::vector<const char*> VertexChunks;
+    std::vector<const char*> TriangleChunks;
+    std::vector<const char*> Clips;
+
+    UINT NumVertices = 0;
+    UINT NumTriangles = 0;
+  };
+
+  // The exporter writes each section under a "****Name****" banner, each vertex as
+  // a block starting with a "Position:" line, one triangle per line and each clip
+  // starting with an "AnimationClip" line; those are what the scan looks for.
+  void LocateSections(const char* data, const char* end,
+    UINT verticesPerChunk, UINT trianglesPerChunk, SectionLayout& layout)
+  {
+    const char** current = nullptr;
+
+    for(const char* line = data; line < end; )
+    {
+      const char* lineEnd = (const char*)memchr(line, '\n', end - line);
+      if(lineEnd == nullptr)
+        lineEnd = end;
+
+      const char* s = line;
+      while(s != lineEnd && (*s == ' ' || *s == '\t'))
+        ++s;
+
+      if(s != lineEnd && *s == '*')
+      {
+        const char* name = s;
+        while(name != lineEnd && *name == '*')
+          ++name;
+
+        current = nullptr;
+        if(StartsWith(name, lineEnd, "Materials*"))           current = &layout.Materials;
+        else if(StartsWith(name, lineEnd, "Vertices*"))       current = &layout.Vertices;
+        else if(StartsWith(name, lineEnd, "Triangles*"))      current = &layout.Triangles;
+        else if(StartsWith(name, lineEnd, "BoneOffsets*"))    current = &layout.BoneOffsets;
+        else if(StartsWith(name, lineEnd, "AnimationClips*")) current = &layout.AnimationClips;
+
+        if(current != nullptr)
+          *current = line;
+      }
+      else if(current == &layout.Vertices)
+      {
+        if(StartsWith(s, lineEnd, "Position:"))
+        {
+          if(layout.NumVertices % verticesPerChunk == 0)
+            layout.VertexChunks.push_back(line);
+          ++layout.NumVertices;
+        }
+      }
+      else if(current == &layout.Triangles)
+      {
+        if(s != lineEnd && *s != '\r')
+        {
+          if(layout.NumTriangles % trianglesPerChunk == 0)
+            layout.TriangleChunks.push_back(line);
+          ++layout.NumTriangles;
+        }
+      }
+      else if(current == &layout.AnimationClips)
+      {
+        if(StartsWith(s, lineEnd, "AnimationClip"))
+          layout.Clips.push_back(line);
+      }
+
+      line = lineEnd + 1;
+    }
+  }
+}
+
+bool M3DLoader::LoadM3dParallel(const std::string& filename,
+  std::vector<SkinnedVertex>& vertices,
+  std::vector<USHORT>& indices,
+  std::vector<Subset>& subsets,
+  std::vector<M3dMaterial>& mats,
+  SkinnedData& skinInfo,
+  std::vector<SectionTiming>* timings,
+  unsigned numThreads)
+{
+  auto t0 = Clock::now();
+
+  MappedFile file;
+  if(!file.Open(filename) || file.Size() == 0)
+    return false;
+
+  const char* data = (const char*)file.Data();
+  const char* end = data + file.Size();
+
+  UINT numMaterials = 0;
+  UINT numVertices = 0;
+  UINT numTriangles = 0;
+  UINT numBones = 0;
+  UINT numAnimationClips = 0;
+
+  TextTokenizer headerTok(data, end);
+  headerTok.SkipToken(); // file header text
+  headerTok.SkipToken(); numMaterials = headerTok.ReadUInt();
+  headerTok.SkipToken(); numVertices = headerTok.ReadUInt();
+  headerTok.SkipToken(); numTriangles = headerTok.ReadUInt();
+  headerTok.SkipToken(); numBones = headerTok.ReadUInt();
+  headerTok.SkipToken(); numAnimationClips = headerTok.ReadUInt();
+  if(headerTok.Failed())
+    return false;
+
+  if(numThreads == 0)
+    numThreads = MathHelper::Max(1u, std::thread::hardware_concurrency());
+
+  // A couple of chunks per thread evens out the load without making the chunks so
+  // small that the task overhead shows.
+  UINT numChunks = 2 * numThreads;
+  UINT verticesPerChunk = MathHelper::Max(512u, (numVertices + numChunks - 1) / numChunks);
+  UINT trianglesPerChunk = MathHelper::Max(1024u, (numTriangles + numChunks - 1) / numChunks);
+
+  SectionLayout layout;
+  LocateSections(data, end, verticesPerChunk, trianglesPerChunk, layout);
+
+  // Anything laid out differently from what the exporter writes (several values
+  // per line, missing banners) is still valid for the sequential parser.
+  if(layout.Materials == nullptr || layout.Vertices == nullptr || layout.Triangles == nullptr ||
+     layout.BoneOffsets == nullptr || layout.AnimationClips == nullptr ||
+     !(layout.Materials < layout.Vertices && layout.Vertices < layout.Triangles &&
+       layout.Triangles < layout.BoneOffsets && layout.BoneOffsets < layout.AnimationClips) ||
+     layout.NumVertices != numVertices || layout.NumTriangles != numTriangles ||
+     layout.Clips.size() != numAnimationClips)
+  {
+    ::OutputDebugStringA(("LoadM3dParallel: unexpected layout in " + filename + ", parsing sequentially.\n").c_str());
+    file.Close();
+    return LoadM3d(filename, vertices, indices, subsets, mats, skinInfo);
+  }
+
+  // Each task writes only its own slice of the outputs, so they are sized up front.
+  vertices.resize(numVertices);
+  indices.resize(numTriangles * 3);
+
+  std::vector<XMFLOAT4X4> boneOffsets;
+  std::vector<int> boneIndexToParentIndex;
+  std::vector<std::string> clipNames(numAnimationClips);
+  std::vector<AnimationClip> clips(numAnimationClips);
+
+  // Largest tasks first so the small ones fill in at the end.
+  std::vector<ParseTask> tasks;
+  for(size_t i = 0; i < layout.VertexChunks.size(); ++i)
+  {
+    const char* chunkEnd = i + 1 < layout.VertexChunks.size() ? layout.VertexChunks[i + 1] : layout.Triangles;
+    UINT first = (UINT)i * verticesPerChunk;
+    tasks.push_back({ SectionVertices, layout.VertexChunks[i], chunkEnd, first, MathHelper::Min(verticesPerChunk, numVertices - first), 0.0, false });
+  }
+  for(size_t i = 0; i < layout.TriangleChunks.size(); ++i)
+  {
+    const char* chunkEnd = i + 1 < layout.TriangleChunks.size() ? layout.TriangleChunks[i + 1] : layout.BoneOffsets;
+    UINT first = (UINT)i * trianglesPerChunk;
+    tasks.push_back({ SectionTriangles, layout.TriangleChunks[i], chunkEnd, first, MathHelper::Min(trianglesPerChunk, numTriangles - first), 0.0, false });
+  }
+  for(size_t i = 0; i < layout.Clips.size(); ++i)
+  {
+    const char* clipEnd = i + 1 < layout.Clips.size() ? layout.Clips[i + 1] : end;
+    tasks.push_back({ SectionAnimationClips, layout.Clips[i], clipEnd, (UINT)i, 1, 0.0, false });
+  }
+  tasks.push_back({ SectionBones, layout.BoneOffsets, layout.AnimationClips, 0, numBones, 0.0, false });
+  tasks.push_back({ SectionMaterials, layout.Materials, layout.Vertices, 0, numMaterials, 0.0, false });
+
+  auto t1 = Clock::now();
+
+  auto runTask = [&](ParseTask& task)
+  {
+    auto start = Clock::now();
+
+    TextTokenizer tok(task.Begin, task.End);
+    switch(task.Section)
+    {
+    case SectionMaterials:
+      ReadMaterials(tok, numMaterials, mats);
+      ReadSubsetTable(tok, numMaterials, subsets);
+      break;
+    case SectionVertices:
+      ReadSkinnedVertexRange(tok, task.Count, &vertices[task.First]);
+      break;
+    case SectionTriangles:
+      ReadTriangleRange(tok, task.Count, &indices[task.First * 3]);
+      break;
+    case SectionBones:
+      ReadBoneOffsets(tok, numBones, boneOffsets);
+      ReadBoneHierarchy(tok, numBones, boneIndexToParentIndex);
+      break;
+    case SectionAnimationClips:
+      clipNames[task.First] = ReadAnimationClip(tok, numBones, clips[task.First]);
+      break;
+    default:
+      break;
+    }
+
+    task.Failed = tok.Failed();
+    task.Ms = ElapsedMs(start, Clock::now());
+  };
+
+  // Each thread keeps taking the next task until none are left.
+  std::atomic<size_t> nextTask(0);
+  ParallelFor(numThreads, 1, [&](size_t, size_t)
+  {
+    for(size_t i = nextTask++; i < tasks.size(); i = nextTask++)
+      runTask(tasks[i]);
+  }, numThreads);
+
+  auto t2 = Clock::now();
+
+  bool failed = false;
+  double sectionMs[SectionCount] = {};
+  for(const ParseTask& task : tasks)
+  {
+    failed |= task.Failed;
+    sectionMs[task.Section] += task.Ms;
+  }
+
+  if(timings != nullptr)
+  {
+    timings->clear();
+    timings->push_back({ "Locate", ElapsedMs(t0, t1) });
+    for(int i = 0; i < SectionCount; ++i)
+      timings->push_back({ SectionNames[i], sectionMs[i] });
+    timings->push_back({ "Parse (wall)", ElapsedMs(t1, t2) });
+  }
+
+  if(failed)
+    return false;
+
+  std::unordered_map<std::string, AnimationClip> animations;
+  for(UINT i = 0; i < numAnimationClips; ++i)
+    animations[clipNames[i]] = std::move(clips[i]);
+
+  bool result = skinInfo.Set(boneIndexToParentIndex, boneOffsets, animations);
+
+  if(timings != nullptr)
+    timings->push_back({ "Total", ElapsedMs(t0, Clock::now()) });
+
+  return result;
+}
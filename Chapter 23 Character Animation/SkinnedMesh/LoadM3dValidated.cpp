@@ -0,0 +1,726 @@
+#include "LoadM3d.h"
+#include "../../Common/MappedFile.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <type_traits>
+
+using namespace DirectX;
+
+namespace
+{
+  // Fewest bytes each kind of record can take in the text: every token is at least
+  // one character plus a separator.  A count is checked against the bytes left in
+  // the file before anything is sized from it, so a corrupt header cannot ask for
+  // gigabytes.
+  const UINT64 MinMaterialBytes = 2 * 20;
+  const UINT64 MinSubsetBytes = 2 * 10;
+  const UINT64 MinVertexBytes = 2 * 16;
+  const UINT64 MinSkinnedVertexBytes = 2 * 26;
+  const UINT64 MinTriangleBytes = 2 * 3;
+  const UINT64 MinBoneOffsetBytes = 2 * 17;
+  const UINT64 MinBoneParentBytes = 2 * 2;
+  const UINT64 MinBoneAnimationBytes = 2 * 5; // Label, count and braces.
+  const UINT64 MinKeyframeBytes = 2 * 15;
+
+  // Bone indices are stored as bytes.
+  const UINT MaxBones = 256;
+
+  // Blend weights may be off by the rounding of the exporter.
+  const float WeightTolerance = 0.01f;
+
+  class M3dValidator
+  {
+  public:
+    M3dValidator(const char* text, size_t size, M3DLoader::LoadError& error)
+      : mText(text), mSize(size), mTok(text, text + size), mError(error)
+    {
+    }
+
+    bool ReadHeader(UINT& numMaterials, UINT& numVertices, UINT& numTriangles,
+      UINT& numBones, UINT& numAnimationClips)
+    {
+      return ExpectSection("m3d-File-Header") &&
+        Expect("#Materials") && ReadUInt(numMaterials) &&
+        Expect("#Vertices") && ReadUInt(numVertices) &&
+        Expect("#Triangles") && ReadUInt(numTriangles) &&
+        Expect("#Bones") && ReadUInt(numBones) &&
+        Expect("#AnimationClips") && ReadUInt(numAnimationClips);
+    }
+
+    bool ReadMaterials(UINT numMaterials, std::vector<M3DLoader::M3dMaterial>& mats)
+    {
+      if(!ExpectSection("Materials") || !CheckFits(numMaterials, MinMaterialBytes, "materials"))
+        return false;
+
+      mats.resize(numMaterials);
+      for(auto& m : mats)
+      {
+        UINT alphaClip = 0;
+        if(!Expect("Name:") || !ReadString(m.Name) ||
+           !Expect("Diffuse:") || !ReadFloats(&m.DiffuseAlbedo.x, 3) ||
+           !Expect("Fresnel0:") || !ReadFloats(&m.FresnelR0.x, 3) ||
+           !Expect("Roughness:") || !ReadFloats(&m.Roughness, 1) ||
+           !Expect("AlphaClip:") || !ReadUInt(alphaClip) ||
+           !Expect("MaterialTypeName:") || !ReadString(m.MaterialTypeName) ||
+           !Expect("DiffuseMap:") || !ReadString(m.DiffuseMapName) ||
+           !Expect("NormalMap:") || !ReadString(m.NormalMapName))
+          return false;
+
+        m.AlphaClip = alphaClip != 0;
+      }
+      return true;
+    }
+
+    bool ReadSubsetTable(UINT numSubsets, UINT numVertices, UINT numTriangles,
+      std::vector<M3DLoader::Subset>& subsets)
+    {
+      if(!ExpectSection("SubsetTable") || !CheckFits(numSubsets, MinSubsetBytes, "subsets"))
+        return false;
+
+      subsets.resize(numSubsets);
+      for(auto& s : subsets)
+      {
+        size_t offset = mTok.Offset();
+        if(!Expect("SubsetID:") || !ReadUInt(s.Id) ||
+           !Expect("VertexStart:") || !ReadUInt(s.VertexStart) ||
+           !Expect("VertexCount:") || !ReadUInt(s.VertexCount) ||
+           !Expect("FaceStart:") || !ReadUInt(s.FaceStart) ||
+           !Expect("FaceCount:") || !ReadUInt(s.FaceCount))
+          return false;
+
+        if((UINT64)s.VertexStart + s.VertexCount > numVertices)
+        {
+          return FailAt(offset, "subset " + std::to_string(s.Id) + " vertices end at " +
+            std::to_string((UINT64)s.VertexStart + s.VertexCount) + " (" + std::to_string(numVertices) + " vertices)");
+        }
+        if((UINT64)s.FaceStart + s.FaceCount > numTriangles)
+        {
+          return FailAt(offset, "subset " + std::to_string(s.Id) + " faces end at " +
+            std::to_string((UINT64)s.FaceStart + s.FaceCount) + " (" + std::to_string(numTriangles) + " triangles)");
+        }
+      }
+      return true;
+    }
+
+    template<typename VertexT>
+    bool ReadVertices(UINT numVertices, UINT numBones, std::vector<VertexT>& vertices)
+    {
+      const bool skinned = std::is_same<VertexT, M3DLoader::SkinnedVertex>::value;
+      if(!ExpectSection("Vertices") ||
+         !CheckFits(numVertices, skinned ? MinSkinnedVertexBytes : MinVertexBytes, "vertices"))
+        return false;
+
+      vertices.resize(numVertices);
+      for(auto& v : vertices)
+      {
+        if(!ReadVertex(v, numBones))
+          return false;
+      }
+      return true;
+    }
+
+    bool ReadTriangles(UINT numTriangles, UINT numVertices, std::vector<UINT>& indices)
+    {
+      if(!ExpectSection("Triangles") || !CheckFits(numTriangles, MinTriangleBytes, "triangles"))
+        return false;
+
+      indices.resize(3 * (size_t)numTriangles);
+      for(UINT& index : indices)
+      {
+        size_t offset = mTok.Offset();
+        if(!ReadUInt(index))
+          return false;
+
+        if(index >= numVertices)
+        {
+          return FailAt(offset, "index " + std::to_string(index) + " is out of range (" +
+            std::to_string(numVertices) + " vertices)");
+        }
+      }
+      return true;
+    }
+
+    bool ReadBoneOffsets(UINT numBones, std::vector<XMFLOAT4X4>& boneOffsets)
+    {
+      if(!ExpectSection("BoneOffsets") || !CheckFits(numBones, MinBoneOffsetBytes, "bone offsets"))
+        return false;
+
+      boneOffsets.resize(numBones);
+      for(auto& m : boneOffsets)
+      {
+        if(!ExpectPrefix("BoneOffset") || !ReadFloats(&m._11, 16))
+          return false;
+      }
+      return true;
+    }
+
+    bool ReadBoneHierarchy(UINT numBones, std::vector<int>& boneIndexToParentIndex)
+    {
+      if(!ExpectSection("BoneHierarchy") || !CheckFits(numBones, MinBoneParentBytes, "bone parents"))
+        return false;
+
+      // Only the range is checked here; SkinnedData::Set orders the bones and
+      // rejects cycles.
+      boneIndexToParentIndex.resize(numBones);
+      for(UINT i = 0; i < numBones; ++i)
+      {
+        if(!ExpectPrefix("ParentIndexOfBone"))
+          return false;
+
+        size_t offset = mTok.Offset();
+        int parent = mTok.ReadInt();
+        if(!CheckRead(offset))
+          return false;
+
+        if(parent < -1 || parent >= (int)numBones || parent == (int)i)
+        {
+          return FailAt(offset, "bone " + std::to_string(i) + " has parent " + std::to_string(parent) +
+            " (" + std::to_string(numBones) + " bones)");
+        }
+        boneIndexToParentIndex[i] = parent;
+      }
+      return true;
+    }
+
+    bool ReadAnimationClips(UINT numBones, UINT numAnimationClips,
+      std::unordered_map<std::string, AnimationClip>& animations)
+    {
+      if(!ExpectSection("AnimationClips"))
+        return false;
+
+      for(UINT clipIndex = 0; clipIndex < numAnimationClips; ++clipIndex)
+      {
+        if(!Expect("AnimationClip"))
+          return false;
+
+        std::string clipName;
+        size_t nameOffset = mTok.Offset();
+        if(!ReadString(clipName) || !Expect("{"))
+          return false;
+
+        if(animations.count(clipName) != 0)
+          return FailAt(nameOffset, "clip '" + clipName + "' appears twice");
+
+        if(!CheckFits(numBones, MinBoneAnimationBytes + MinKeyframeBytes, "bone animations"))
+          return false;
+
+        AnimationClip& clip = animations[clipName];
+        clip.BoneAnimations.resize(numBones);
+        for(auto& boneAnimation : clip.BoneAnimations)
+        {
+          if(!ReadBoneKeyframes(boneAnimation))
+            return false;
+        }
+
+        if(!Expect("}"))
+          return false;
+      }
+
+      if(!mTok.AtEnd())
+        return Fail("unexpected " + DescribeToken(mTok.Offset()) + " after the last clip");
+
+      return true;
+    }
+
+    bool Fail(const std::string& message)
+    {
+      return FailAt(mTok.Offset(), message);
+    }
+
+  private:
+    bool ReadVertex(M3DLoader::Vertex& v, UINT /*numBones*/)
+    {
+      return Expect("Position:") && ReadFloats(&v.Pos.x, 3) &&
+        Expect("Tangent:") && ReadFloats(&v.TangentU.x, 4) &&
+        Expect("Normal:") && ReadFloats(&v.Normal.x, 3) &&
+        Expect("Tex-Coords:") && ReadFloats(&v.TexC.x, 2);
+    }
+
+    bool ReadVertex(M3DLoader::SkinnedVertex& v, UINT numBones)
+    {
+      float tangentW = 0.0f;
+      float weights[4];
+
+      if(!Expect("Position:") || !ReadFloats(&v.Pos.x, 3) ||
+         !Expect("Tangent:") || !ReadFloats(&v.TangentU.x, 3) || !ReadFloats(&tangentW, 1) ||
+         !Expect("Normal:") || !ReadFloats(&v.Normal.x, 3) ||
+         !Expect("Tex-Coords:") || !ReadFloats(&v.TexC.x, 2))
+        return false;
+
+      if(!Expect("BlendWeights:"))
+        return false;
+
+      size_t weightsOffset = mTok.Offset();
+      if(!ReadFloats(weights, 4))
+        return false;
+
+      float sum = 0.0f;
+      for(float w : weights)
+      {
+        if(w < 0.0f || w > 1.0f + WeightTolerance)
+          return FailAt(weightsOffset, "blend weight " + std::to_string(w) + " is outside [0, 1]");
+        sum += w;
+      }
+      if(std::fabs(sum - 1.0f) > WeightTolerance)
+        return FailAt(weightsOffset, "blend weights add up to " + std::to_string(sum));
+
+      // The fourth weight is implied by the other three.
+      v.BoneWeights = XMFLOAT3(weights[0], weights[1], weights[2]);
+
+      if(!Expect("BlendIndices:"))
+        return false;
+
+      for(int j = 0; j < 4; ++j)
+      {
+        size_t offset = mTok.Offset();
+        int bone = mTok.ReadInt();
+        if(!CheckRead(offset))
+          return false;
+
+        // Checked even when the weight is 0: the shader still reads the matrix.
+        if(bone < 0 || (UINT)bone >= numBones)
+        {
+          return FailAt(offset, "bone index " + std::to_string(bone) + " is out of range (" +
+            std::to_string(numBones) + " bones)");
+        }
+        v.BoneIndices[j] = (BYTE)bone;
+      }
+      return true;
+    }
+
+    bool ReadBoneKeyframes(BoneAnimation& boneAnimation)
+    {
+      if(!ExpectPrefix("Bone") || !Expect("#Keyframes:"))
+        return false;
+
+      UINT numKeyframes = 0;
+      size_t countOffset = mTok.Offset();
+      if(!ReadUInt(numKeyframes) || !Expect("{"))
+        return false;
+
+      if(numKeyframes == 0)
+        return FailAt(countOffset, "a bone animation needs at least one keyframe");
+      if(!CheckFits(numKeyframes, MinKeyframeBytes, "keyframes"))
+        return false;
+
+      boneAnimation.Keyframes.resize(numKeyframes);
+      for(UINT i = 0; i < numKeyframes; ++i)
+      {
+        Keyframe& k = boneAnimation.Keyframes[i];
+
+        if(!Expect("Time:"))
+          return false;
+
+        size_t timeOffset = mTok.Offset();
+        if(!ReadFloats(&k.TimePos, 1) ||
+           !Expect("Pos:") || !ReadFloats(&k.Translation.x, 3) ||
+           !Expect("Scale:") || !ReadFloats(&k.Scale.x, 3) ||
+           !Expect("Quat:") || !ReadFloats(&k.RotationQuat.x, 4))
+          return false;
+
+        // Interpolate searches the keyframes in time order.
+        if(i > 0 && k.TimePos < boneAnimation.Keyframes[i - 1].TimePos)
+          return FailAt(timeOffset, "keyframe time " + std::to_string(k.TimePos) + " goes backwards");
+      }
+
+      return Expect("}");
+    }
+
+    bool ExpectSection(const char* name)
+    {
+      mSection = name;
+
+      size_t offset = mTok.Offset();
+      std::string banner = mTok.ReadString();
+      if(banner.empty() || banner[0] != '*' || banner.find(name) == std::string::npos)
+        return FailAt(offset, std::string("expected the ") + name + " section, found " + DescribeToken(offset));
+      return true;
+    }
+
+    bool Expect(const char* label)
+    {
+      size_t offset = mTok.Offset();
+      if(mTok.ReadString() != label)
+        return FailAt(offset, std::string("expected '") + label + "', found " + DescribeToken(offset));
+      return true;
+    }
+
+    // For numbered labels such as BoneOffset12 and ParentIndexOfBone12:.
+    bool ExpectPrefix(const char* prefix)
+    {
+      size_t offset = mTok.Offset();
+      if(mTok.ReadString().compare(0, strlen(prefix), prefix) != 0)
+        return FailAt(offset, std::string("expected '") + prefix + "...', found " + DescribeToken(offset));
+      return true;
+    }
+
+    bool ReadString(std::string& s)
+    {
+      size_t offset = mTok.Offset();
+      s = mTok.ReadString();
+      return CheckRead(offset);
+    }
+
+    bool ReadUInt(UINT& value)
+    {
+      size_t offset = mTok.Offset();
+      value = mTok.ReadUInt();
+      return CheckRead(offset);
+    }
+
+    bool ReadFloats(float* values, int count)
+    {
+      for(int i = 0; i < count; ++i)
+      {
+        size_t offset = mTok.Offset();
+        values[i] = mTok.ReadFloat();
+        if(!CheckRead(offset))
+          return false;
+
+        if(!std::isfinite(values[i]))
+          return FailAt(offset, DescribeToken(offset) + " is not a finite float");
+      }
+      return true;
+    }
+
+    bool CheckRead(size_t offset)
+    {
+      if(!mTok.Failed())
+        return true;
+      return FailAt(offset, offset >= mSize ? "unexpected end of file" :
+        "expected a number, found " + DescribeToken(offset));
+    }
+
+    // Fails unless count records of at least minBytes each fit in the rest of the file.
+    bool CheckFits(UINT count, UINT64 minBytes, const char* what)
+    {
+      size_t offset = mTok.Offset();
+      if(count > (mSize - offset) / minBytes)
+      {
+        return FailAt(offset, std::to_string(count) + " " + what + " cannot fit in the " +
+          std::to_string(mSize - offset) + " bytes left in the file");
+      }
+      return true;
+    }
+
+    bool FailAt(size_t offset, const std::string& message)
+    {
+      mError.Section = mSection;
+      mError.Line = mTok.LineAt(offset);
+      mError.Offset = offset;
+      mError.Message = message;
+      return false;
+    }
+
+    std::string DescribeToken(size_t offset)const
+    {
+      if(offset >= mSize)
+        return "end of file";
+
+      std::string token = "'";
+      for(size_t i = offset; i < mSize && (unsigned char)mText[i] > ' ' && token.size() < 32; ++i)
+        token += (mText[i] >= 0x7f) ? '?' : mText[i];
+      return token + "'";
+    }
+
+    const char* mText;
+    size_t mSize;
+    TextTokenizer mTok;
+    M3DLoader::LoadError& mError;
+    std::string mSection = "Header";
+  };
+
+  // Checks a loaded model without trusting the loader, for StressTestM3d.
+  bool IndicesAreInRange(const std::vector<M3DLoader::SkinnedVertex>& vertices,
+    const std::vector<UINT>& indices, const std::vector<M3DLoader::Subset>& subsets, UINT numBones)
+  {
+    if(indices.size() % 3 != 0)
+      return false;
+
+    for(UINT index : indices)
+    {
+      if(index >= vertices.size())
+        return false;
+    }
+
+    for(const auto& v : vertices)
+    {
+      for(BYTE bone : v.BoneIndices)
+      {
+        if(bone >= numBones)
+          return false;
+      }
+    }
+
+    for(const auto& s : subsets)
+    {
+      if((UINT64)s.VertexStart + s.VertexCount > vertices.size() ||
+         3 * ((UINT64)s.FaceStart + s.FaceCount) > indices.size())
+        return false;
+    }
+    return true;
+  }
+
+  // Values that tend to break a loader that trusts them.
+  const char* const HostileNumbers[] =
+  {
+    "-1", "0", "255", "256", "65535", "65536", "2147483647", "2147483648", "4294967295",
+    "99999999999", "1e39", "-1e39", "nan", "inf", "0x10", "1.5.2", "-", "",
+  };
+
+  // Replaces the token at or after pos.
+  void ReplaceToken(std::string& text, size_t pos, const char* replacement)
+  {
+    while(pos < text.size() && (unsigned char)text[pos] <= ' ')
+      ++pos;
+    size_t end = pos;
+    while(end < text.size() && (unsigned char)text[end] > ' ')
+      ++end;
+
+    text.replace((std::min)(pos, text.size()), end - (std::min)(pos, text.size()), replacement);
+  }
+
+  // Applies one random corruption to an m3d file.
+  void Mutate(std::string& text, std::mt19937& rng)
+  {
+    auto pick = [&rng](size_t n) { return std::uniform_int_distribution<size_t>(0, n - 1)(rng); };
+
+    auto lineStart = [&text](size_t pos)
+    {
+      size_t start = text.rfind('\n', pos);
+      return start == std::string::npos ? 0 : start + 1;
+    };
+    auto lineEnd = [&text](size_t pos)
+    {
+      size_t end = text.find('\n', pos);
+      return end == std::string::npos ? text.size() : end + 1;
+    };
+
+    if(text.empty())
+      return;
+
+    size_t pos = pick(text.size());
+    switch(pick(6))
+    {
+    case 0: // Flip a byte.
+      text[pos] = (char)pick(256);
+      break;
+
+    case 1: // Truncate.
+      text.resize(pos);
+      break;
+
+    case 2: // Delete a line.
+      text.erase(lineStart(pos), lineEnd(pos) - lineStart(pos));
+      break;
+
+    case 3: // Repeat a line.
+    {
+      size_t start = lineStart(pos);
+      text.insert(start, text.substr(start, lineEnd(pos) - start));
+      break;
+    }
+
+    case 4: // Replace a token, usually a number, with a hostile one.
+      ReplaceToken(text, pos, HostileNumbers[pick(_countof(HostileNumbers))]);
+      break;
+
+    case 5: // The same, for one of the counts on the header lines ("#Vertices 13748").
+    {
+      size_t label = 0;
+      for(size_t n = 1 + pick(5); n > 0 && label != std::string::npos; --n)
+        label = text.find('#', label + 1);
+      if(label != std::string::npos)
+        ReplaceToken(text, text.find(' ', label), HostileNumbers[pick(_countof(HostileNumbers))]);
+      break;
+    }
+    }
+  }
+}
+
+std::string M3DLoader::LoadError::ToString()const
+{
+  return Section + ", line " + std::to_string(Line) + " (offset " + std::to_string(Offset) + "): " + Message;
+}
+
+bool M3DLoader::LoadM3dValidated(const std::string& filename,
+  std::vector<Vertex>& vertices,
+  std::vector<UINT>& indices,
+  std::vector<Subset>& subsets,
+  std::vector<M3dMaterial>& mats,
+  LoadError& error)
+{
+  MappedFile file;
+  if(!file.Open(filename))
+  {
+    error = LoadError();
+    error.Message = "cannot open " + filename;
+    return false;
+  }
+
+  return LoadM3dValidated(reinterpret_cast<const char*>(file.Data()), file.Size(),
+    vertices, indices, subsets, mats, error);
+}
+
+bool M3DLoader::LoadM3dValidated(const std::string& filename,
+  std::vector<SkinnedVertex>& vertices,
+  std::vector<UINT>& indices,
+  std::vector<Subset>& subsets,
+  std::vector<M3dMaterial>& mats,
+  SkinnedData& skinInfo,
+  LoadError& error)
+{
+  MappedFile file;
+  if(!file.Open(filename))
+  {
+    error = LoadError();
+    error.Message = "cannot open " + filename;
+    return false;
+  }
+
+  return LoadM3dValidated(reinterpret_cast<const char*>(file.Data()), file.Size(),
+    vertices, indices, subsets, mats, skinInfo, error);
+}
+
+bool M3DLoader::LoadM3dValidated(const char* text, size_t size,
+  std::vector<Vertex>& vertices,
+  std::vector<UINT>& indices,
+  std::vector<Subset>& subsets,
+  std::vector<M3dMaterial>& mats,
+  LoadError& error)
+{
+  M3dValidator validator(text, size, error);
+
+  UINT numMaterials = 0;
+  UINT numVertices = 0;
+  UINT numTriangles = 0;
+  UINT numBones = 0;
+  UINT numAnimationClips = 0;
+
+  // Any bones and clips after the triangles are ignored, as in LoadM3d.
+  return validator.ReadHeader(numMaterials, numVertices, numTriangles, numBones, numAnimationClips) &&
+    validator.ReadMaterials(numMaterials, mats) &&
+    validator.ReadSubsetTable(numMaterials, numVertices, numTriangles, subsets) &&
+    validator.ReadVertices(numVertices, numBones, vertices) &&
+    validator.ReadTriangles(numTriangles, numVertices, indices);
+}
+
+bool M3DLoader::LoadM3dValidated(const char* text, size_t size,
+  std::vector<SkinnedVertex>& vertices,
+  std::vector<UINT>& indices,
+  std::vector<Subset>& subsets,
+  std::vector<M3dMaterial>& mats,
+  SkinnedData& skinInfo,
+  LoadError& error)
+{
+  M3dValidator validator(text, size, error);
+
+  UINT numMaterials = 0;
+  UINT numVertices = 0;
+  UINT numTriangles = 0;
+  UINT numBones = 0;
+  UINT numAnimationClips = 0;
+
+  if(!validator.ReadHeader(numMaterials, numVertices, numTriangles, numBones, numAnimationClips))
+    return false;
+
+  if(numBones == 0 || numBones > MaxBones)
+    return validator.Fail("a skinned model needs 1 to " + std::to_string(MaxBones) + " bones, not " + std::to_string(numBones));
+
+  std::vector<XMFLOAT4X4> boneOffsets;
+  std::vector<int> boneIndexToParentIndex;
+  std::unordered_map<std::string, AnimationClip> animations;
+
+  if(!validator.ReadMaterials(numMaterials, mats) ||
+     !validator.ReadSubsetTable(numMaterials, numVertices, numTriangles, subsets) ||
+     !validator.ReadVertices(numVertices, numBones, vertices) ||
+     !validator.ReadTriangles(numTriangles, numVertices, indices) ||
+     !validator.ReadBoneOffsets(numBones, boneOffsets) ||
+     !validator.ReadBoneHierarchy(numBones, boneIndexToParentIndex) ||
+     !validator.ReadAnimationClips(numBones, numAnimationClips, animations))
+    return false;
+
+  if(!skinInfo.Set(boneIndexToParentIndex, boneOffsets, animations))
+    return validator.Fail("the bone hierarchy has a cycle, or the clips do not match the skeleton");
+
+  return true;
+}
+
+bool M3DLoader::NarrowIndices(const std::vector<UINT>& indices, std::vector<USHORT>& indices16)
+{
+  for(UINT index : indices)
+  {
+    if(index > 0xffff)
+      return false;
+  }
+
+  indices16.assign(indices.begin(), indices.end());
+  return true;
+}
+
+bool M3DLoader::StressTestM3d(const std::string& filename, UINT iterations, UINT seed, StressReport& report)
+{
+  report = StressReport();
+
+  MappedFile file;
+  if(!file.Open(filename))
+    return false;
+
+  const std::string original(reinterpret_cast<const char*>(file.Data()), file.Size());
+  file.Close();
+
+  std::vector<SkinnedVertex> vertices;
+  std::vector<UINT> indices;
+  std::vector<Subset> subsets;
+  std::vector<M3dMaterial> mats;
+
+  {
+    SkinnedData skinInfo;
+    if(!LoadM3dValidated(original.data(), original.size(), vertices, indices, subsets, mats, skinInfo, report.LastError))
+      return false;
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+
+  std::mt19937 rng(seed);
+  std::string text;
+  for(UINT i = 0; i < iterations; ++i)
+  {
+    text = original;
+
+    // Usually one corruption, sometimes a few.
+    UINT numMutations = 1 + (rng() % 4 == 0 ? rng() % 4 : 0);
+    for(UINT j = 0; j < numMutations; ++j)
+      Mutate(text, rng);
+
+    SkinnedData skinInfo;
+    LoadError error;
+    vertices.clear();
+    indices.clear();
+    subsets.clear();
+    mats.clear();
+
+    ++report.Iterations;
+    if(!LoadM3dValidated(text.data(), text.size(), vertices, indices, subsets, mats, skinInfo, error))
+    {
+      ++report.Rejected;
+      report.LastError = error;
+    }
+    else if(IndicesAreInRange(vertices, indices, subsets, skinInfo.BoneCount()))
+    {
+      ++report.Accepted;
+    }
+    else
+    {
+      ++report.Broken;
+    }
+  }
+
+  report.Ms = std::chrono::duration<double, std::milli>(
+    std::chrono::high_resolution_clock::now() - start).count();
+
+  return report.Broken == 0;
+}
@@ -64,7 +64,12 @@ cbuffer cbPerObject : register(b0)
 
 cbuffer cbSkinned : register(b1)
 {
-    float4x4 gBoneTransforms[96];
+#ifdef DUAL_QUAT_SKINNING
+    // Two rows per bone: the real part, then the dual part.
+    float4 gBoneDualQuats[192];
+#else
+    float4x3 gBoneTransforms[96];
+#endif
 };
 
 // Constant data that varies per material.
@@ -153,3 +158,40 @@ float CalcShadowFactor(float4 shadowPosH)
     return percentLit / 9.0f;
 }
 
+#ifdef DUAL_QUAT_SKINNING
+// Blends the dual quaternions of the influencing bones and normalizes the result.
+void BlendBoneDualQuats(float weights[4], uint4 boneIndices, out float4 real, out float4 dual)
+{
+    float4 real0 = gBoneDualQuats[2*boneIndices[0]];
+
+    real = float4(0.0f, 0.0f, 0.0f, 0.0f);
+    dual = float4(0.0f, 0.0f, 0.0f, 0.0f);
+    for(int i = 0; i < 4; ++i)
+    {
+        float4 r = gBoneDualQuats[2*boneIndices[i]];
+        float4 d = gBoneDualQuats[2*boneIndices[i] + 1];
+
+        // q and -q are the same rotation; flip to the hemisphere of the first
+        // bone so the blend takes the short way around.
+        float w = dot(r, real0) < 0.0f ? -weights[i] : weights[i];
+
+        real += w*r;
+        dual += w*d;
+    }
+
+    float invLength = 1.0f / length(real);
+    real *= invLength;
+    dual *= invLength;
+}
+
+float3 QuatRotate(float4 q, float3 v)
+{
+    return v + 2.0f*cross(q.xyz, cross(q.xyz, v) + q.w*v);
+}
+
+float3 DualQuatTransformPoint(float4 real, float4 dual, float3 p)
+{
+    float3 t = 2.0f*(real.w*dual.xyz - dual.w*real.xyz + cross(real.xyz, dual.xyz));
+    return QuatRotate(real, p) + t;
+}
+#endif
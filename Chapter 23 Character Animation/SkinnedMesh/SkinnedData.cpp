@@ -30,14 +30,20 @@ float BoneAnimation::GetEndTime()const
 
 void BoneAnimation::Interpolate(float t, XMFLOAT4X4& M)const
 {
+	XMStoreFloat4x4(&M, Interpolate(t));
+}
+
+XMMATRIX BoneAnimation::Interpolate(float t)const
+{
+	XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
+
 	if( t <= Keyframes.front().TimePos )
 	{
 		XMVECTOR S = XMLoadFloat3(&Keyframes.front().Scale);
 		XMVECTOR P = XMLoadFloat3(&Keyframes.front().Translation);
 		XMVECTOR Q = XMLoadFloat4(&Keyframes.front().RotationQuat);
 
-		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+		return XMMatrixAffineTransformation(S, zero, Q, P);
 	}
 	else if( t >= Keyframes.back().TimePos )
 	{
@@ -45,8 +51,7 @@ void BoneAnimation::Interpolate(float t, XMFLOAT4X4& M)const
 		XMVECTOR P = XMLoadFloat3(&Keyframes.back().Translation);
 		XMVECTOR Q = XMLoadFloat4(&Keyframes.back().RotationQuat);
 
-		XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-		XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
+		return XMMatrixAffineTransformation(S, zero, Q, P);
 	}
 	else
 	{
@@ -69,13 +74,13 @@ void BoneAnimation::Interpolate(float t, XMFLOAT4X4& M)const
 				XMVECTOR P = XMVectorLerp(p0, p1, lerpPercent);
 				XMVECTOR Q = XMQuaternionSlerp(q0, q1, lerpPercent);
 
-				XMVECTOR zero = XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f);
-				XMStoreFloat4x4(&M, XMMatrixAffineTransformation(S, zero, Q, P));
-
-				break;
+				return XMMatrixAffineTransformation(S, zero, Q, P);
 			}
 		}
 	}
+
+	// Only reached if t is NaN.
+	return XMMatrixIdentity();
 }
 
 float AnimationClip::GetClipStartTime()const
@@ -110,16 +115,129 @@ void AnimationClip::Interpolate(float t, std::vector<XMFLOAT4X4>& boneTransforms
 	}
 }
 
+void AnimationClip::ExtractRootMotion(UINT rootBone)
+{
+	std::vector<Keyframe>& rootKeys = BoneAnimations[rootBone].Keyframes;
+	XMFLOAT3 origin = rootKeys.front().Translation;
+
+	RootMotion.Keyframes.resize(rootKeys.size());
+	for(UINT i = 0; i < rootKeys.size(); ++i)
+	{
+		RootMotion.Keyframes[i].TimePos = rootKeys[i].TimePos;
+		RootMotion.Keyframes[i].Translation = XMFLOAT3(
+			rootKeys[i].Translation.x - origin.x, 0.0f, rootKeys[i].Translation.z - origin.z);
+
+		// Pin the root over its starting point; the vertical motion stays in the pose.
+		rootKeys[i].Translation.x = origin.x;
+		rootKeys[i].Translation.z = origin.z;
+	}
+}
+
+namespace
+{
+	XMVECTOR GetRootPosition(const BoneAnimation& rootMotion, float t)
+	{
+		return XMVectorSetW(rootMotion.Interpolate(t).r[3], 0.0f);
+	}
+}
+
+XMVECTOR AnimationClip::GetRootMotionDelta(float t0, float t1)const
+{
+	if(RootMotion.Keyframes.empty())
+		return XMVectorZero();
+
+	if(t1 >= t0)
+		return XMVectorSubtract(GetRootPosition(RootMotion, t1), GetRootPosition(RootMotion, t0));
+
+	XMVECTOR toEnd = XMVectorSubtract(
+		GetRootPosition(RootMotion, RootMotion.GetEndTime()), GetRootPosition(RootMotion, t0));
+	XMVECTOR fromStart = XMVectorSubtract(
+		GetRootPosition(RootMotion, t1), GetRootPosition(RootMotion, RootMotion.GetStartTime()));
+	return XMVectorAdd(toEnd, fromStart);
+}
+
+namespace
+{
+	bool EventTimeLess(float t, const AnimationEvent& e)
+	{
+		return t < e.TimePos;
+	}
+}
+
+void AnimationClip::AddEvent(const AnimationEvent& e)
+{
+	// Insert after any events at the same time, so equal times keep the order they were added.
+	auto it = std::upper_bound(Events.begin(), Events.end(), e.TimePos, EventTimeLess);
+	Events.insert(it, e);
+}
+
+void AnimationClip::GetEvents(float t0, float t1, std::vector<AnimationEvent>& events)const
+{
+	auto first = std::upper_bound(Events.begin(), Events.end(), t0, EventTimeLess);
+
+	if(t1 >= t0)
+	{
+		auto last = std::upper_bound(first, Events.end(), t1, EventTimeLess);
+		events.insert(events.end(), first, last);
+	}
+	else
+	{
+		auto last = std::upper_bound(Events.begin(), Events.end(), t1, EventTimeLess);
+		events.insert(events.end(), first, Events.end());
+		events.insert(events.end(), Events.begin(), last);
+	}
+}
+
+UINT SkinnedData::FindClip(const std::string& clipName)const
+{
+	auto it = mClipHandles.find(clipName);
+	return it != mClipHandles.end() ? it->second : InvalidClip;
+}
+
+UINT SkinnedData::ClipCount()const
+{
+	return (UINT)mClips.size();
+}
+
+const AnimationClip& SkinnedData::GetClip(UINT clip)const
+{
+	assert(clip < mClips.size());
+	return mClips[clip];
+}
+
+AnimationClip& SkinnedData::GetClip(UINT clip)
+{
+	assert(clip < mClips.size());
+	return mClips[clip];
+}
+
+float SkinnedData::GetClipStartTime(UINT clip)const
+{
+	return GetClip(clip).GetClipStartTime();
+}
+
+float SkinnedData::GetClipEndTime(UINT clip)const
+{
+	return GetClip(clip).GetClipEndTime();
+}
+
 float SkinnedData::GetClipStartTime(const std::string& clipName)const
 {
-	auto clip = mAnimations.find(clipName);
-	return clip->second.GetClipStartTime();
+	return GetClipStartTime(FindClip(clipName));
 }
 
 float SkinnedData::GetClipEndTime(const std::string& clipName)const
 {
-	auto clip = mAnimations.find(clipName);
-	return clip->second.GetClipEndTime();
+	return GetClipEndTime(FindClip(clipName));
+}
+
+void SkinnedData::ExtractRootMotion()
+{
+	if(mBoneOrder.empty())
+		return;
+
+	for(auto& clip : mClips)
+		clip.ExtractRootMotion(mBoneOrder[0]);
 }
 
 UINT SkinnedData::BoneCount()const
@@ -127,54 +245,160 @@ UINT SkinnedData::BoneCount()const
 	return mBoneHierarchy.size();
 }
 
-void SkinnedData::Set(std::vector<int>& boneHierarchy, 
+bool SkinnedData::Set(std::vector<int>& boneHierarchy, 
 		              std::vector<XMFLOAT4X4>& boneOffsets,
 		              std::unordered_map<std::string, AnimationClip>& animations)
 {
+	UINT numBones = (UINT)boneHierarchy.size();
+
+	if(boneOffsets.size() != numBones)
+		return false;
+
+	for(auto& clip : animations)
+	{
+		if(clip.second.BoneAnimations.size() != numBones)
+			return false;
+
+		for(auto& boneAnim : clip.second.BoneAnimations)
+		{
+			if(boneAnim.Keyframes.empty())
+				return false;
+		}
+	}
+
+	// Find the depth of every bone by walking up to its root.  A walk longer
+	// than the bone count means the parent links contain a cycle.
+	std::vector<UINT> depth(numBones, 0);
+	for(UINT i = 0; i < numBones; ++i)
+	{
+		int parentIndex = boneHierarchy[i];
+		while(parentIndex >= 0)
+		{
+			if(parentIndex >= (int)numBones || depth[i] >= numBones)
+				return false;
+
+			++depth[i];
+			parentIndex = boneHierarchy[parentIndex];
+		}
+	}
+
+	// Sorting by depth puts every parent before its children.  The sort is
+	// stable, so a file that is already ordered keeps its order.
+	std::vector<UINT> boneOrder(numBones);
+	for(UINT i = 0; i < numBones; ++i)
+		boneOrder[i] = i;
+
+	std::stable_sort(boneOrder.begin(), boneOrder.end(),
+		[&depth](UINT a, UINT b) { return depth[a] < depth[b]; });
+
+	// Hand out clip handles in name order, so they do not depend on the
+	// iteration order of the map.
+	std::vector<std::string> clipNames;
+	for(auto& clip : animations)
+		clipNames.push_back(clip.first);
+	std::sort(clipNames.begin(), clipNames.end());
+
+	mClips.clear();
+	mClipHandles.clear();
+	for(auto& clipName : clipNames)
+	{
+		mClipHandles[clipName] = (UINT)mClips.size();
+		mClips.push_back(animations[clipName]);
+	}
+
 	mBoneHierarchy = boneHierarchy;
+	mBoneOrder     = boneOrder;
 	mBoneOffsets   = boneOffsets;
-	mAnimations    = animations;
+
+	return true;
 }
- 
-void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos,  std::vector<XMFLOAT4X4>& finalTransforms)const
+
+namespace
 {
-	UINT numBones = mBoneOffsets.size();
+	// The final transforms are transposed for the HLSL column-major packing.
+	// XMStoreFloat3x4 does the transpose itself.
+	void StoreFinalTransform(XMFLOAT4X4* dst, FXMMATRIX M)
+	{
+		XMStoreFloat4x4(dst, XMMatrixTranspose(M));
+	}
+
+	void StoreFinalTransform(XMFLOAT3X4* dst, FXMMATRIX M)
+	{
+		XMStoreFloat3x4(dst, M);
+	}
 
-	std::vector<XMFLOAT4X4> toParentTransforms(numBones);
+	void StoreFinalTransform(DualQuaternion* dst, FXMMATRIX M)
+	{
+		XMVECTOR S, Q, T;
+		XMMatrixDecompose(&S, &Q, &T, M);
 
-	// Interpolate all the bones of this clip at the given time instance.
-	auto clip = mAnimations.find(clipName);
-	clip->second.Interpolate(timePos, toParentTransforms);
+		// dual = 0.5 * t * q, where t is the translation as a pure quaternion.
+		// XMQuaternionMultiply(Q1, Q2) returns the product Q2*Q1.
+		T = XMVectorSetW(T, 0.0f);
+		XMVECTOR D = XMVectorScale(XMQuaternionMultiply(Q, T), 0.5f);
 
-	//
-	// Traverse the hierarchy and transform all the bones to the root space.
-	//
+		XMStoreFloat4(&dst->Real, Q);
+		XMStoreFloat4(&dst->Dual, D);
+	}
+}
 
-	std::vector<XMFLOAT4X4> toRootTransforms(numBones);
+template<typename T>
+void SkinnedData::ComputeFinalTransforms(const AnimationClip& clip, float timePos, T* finalTransforms)const
+{
+	UINT numBones = (UINT)mBoneOrder.size();
 
-	// The root bone has index 0.  The root bone has no parent, so its toRootTransform
-	// is just its local bone transform.
-	toRootTransforms[0] = toParentTransforms[0];
+	// Only the to-root transforms have to be kept around, since the children
+	// need them.  Everything else goes straight from registers to the output.
+	std::vector<XMFLOAT4X4> toRootTransforms(numBones);
 
-	// Now find the toRootTransform of the children.
-	for(UINT i = 1; i < numBones; ++i)
+	// Visit the bones in hierarchy order, so a parent's toRootTransform is
+	// always ready when its children need it.  A root bone has no parent, so
+	// its toRootTransform is just its local bone transform.
+	for(UINT i : mBoneOrder)
 	{
-		XMMATRIX toParent = XMLoadFloat4x4(&toParentTransforms[i]);
+		XMMATRIX toRoot = clip.BoneAnimations[i].Interpolate(timePos);
 
 		int parentIndex = mBoneHierarchy[i];
-		XMMATRIX parentToRoot = XMLoadFloat4x4(&toRootTransforms[parentIndex]);
-
-		XMMATRIX toRoot = XMMatrixMultiply(toParent, parentToRoot);
+		if(parentIndex >= 0)
+		{
+			XMMATRIX parentToRoot = XMLoadFloat4x4(&toRootTransforms[parentIndex]);
+			toRoot = XMMatrixMultiply(toRoot, parentToRoot);
+		}
 
 		XMStoreFloat4x4(&toRootTransforms[i], toRoot);
-	}
 
-	// Premultiply by the bone offset transform to get the final transform.
-	for(UINT i = 0; i < numBones; ++i)
-	{
+		// Premultiply by the bone offset transform to get the final transform.
 		XMMATRIX offset = XMLoadFloat4x4(&mBoneOffsets[i]);
-		XMMATRIX toRoot = XMLoadFloat4x4(&toRootTransforms[i]);
-        XMMATRIX finalTransform = XMMatrixMultiply(offset, toRoot);
-		XMStoreFloat4x4(&finalTransforms[i], XMMatrixTranspose(finalTransform));
+		StoreFinalTransform(&finalTransforms[i], XMMatrixMultiply(offset, toRoot));
 	}
+}
+
+void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos,  std::vector<XMFLOAT4X4>& finalTransforms)const
+{
+	GetFinalTransforms(FindClip(clipName), timePos, finalTransforms);
+}
+
+void SkinnedData::GetFinalTransforms(UINT clip, float timePos, std::vector<XMFLOAT4X4>& finalTransforms)const
+{
+	ComputeFinalTransforms(GetClip(clip), timePos, finalTransforms.data());
+}
+
+void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos,  std::vector<XMFLOAT3X4>& finalTransforms)const
+{
+	GetFinalTransforms(FindClip(clipName), timePos, finalTransforms);
+}
+
+void SkinnedData::GetFinalTransforms(UINT clip, float timePos, std::vector<XMFLOAT3X4>& finalTransforms)const
+{
+	ComputeFinalTransforms(GetClip(clip), timePos, finalTransforms.data());
+}
+
+void SkinnedData::GetFinalTransforms(const std::string& clipName, float timePos,  std::vector<DualQuaternion>& finalTransforms)const
+{
+	GetFinalTransforms(FindClip(clipName), timePos, finalTransforms);
+}
+
+void SkinnedData::GetFinalTransforms(UINT clip, float timePos, std::vector<DualQuaternion>& finalTransforms)const
+{
+	ComputeFinalTransforms(GetClip(clip), timePos, finalTransforms.data());
 }
\ No newline at end of file
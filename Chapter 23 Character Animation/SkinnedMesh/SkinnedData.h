@@ -18,6 +18,17 @@ struct Keyframe
     DirectX::XMFLOAT4 RotationQuat;
 };
 
+///<summary>
+/// A unit dual quaternion stores a rigid transform (rotation followed by
+/// translation) in 8 floats.  Blending dual quaternions instead of matrices
+/// keeps skinned joints from collapsing ("candy-wrapper" artifacts).
+///</summary>
+struct DualQuaternion
+{
+	DirectX::XMFLOAT4 Real;
+	DirectX::XMFLOAT4 Dual;
+};
+
 ///<summary>
 /// A BoneAnimation is defined by a list of keyframes.  For time
 /// values inbetween two keyframes, we interpolate between the
@@ -31,10 +42,21 @@ struct BoneAnimation
 	float GetEndTime()const;
 
     void Interpolate(float t, DirectX::XMFLOAT4X4& M)const;
+    DirectX::XMMATRIX Interpolate(float t)const;
 
 	std::vector<Keyframe> Keyframes; 	
 };
 
+///<summary>
+/// A gameplay cue (footstep, sound, hit frame, ...) that fires when playback
+/// crosses TimePos.  Id is game-defined.
+///</summary>
+struct AnimationEvent
+{
+	float TimePos;
+	UINT Id;
+};
+
 ///<summary>
 /// Examples of AnimationClips are "Walk", "Run", "Attack", "Defend".
 /// An AnimationClip requires a BoneAnimation for every bone to form
@@ -47,19 +69,62 @@ struct AnimationClip
 
     void Interpolate(float t, std::vector<DirectX::XMFLOAT4X4>& boneTransforms)const;
 
+	// Moves the horizontal (xz) travel of rootBone out of the pose and into
+	// RootMotion, so the clip plays in place and the game moves the character.
+	void ExtractRootMotion(UINT rootBone);
+
+	// Root displacement from t0 to t1.  If t1 < t0 the clip is taken to have
+	// looped, and the travel to the end plus the travel from the start is returned.
+	DirectX::XMVECTOR GetRootMotionDelta(float t0, float t1)const;
+
+	// Inserts an event, keeping Events sorted by time.
+	void AddEvent(const AnimationEvent& e);
+
+	// Appends the events in (t0, t1] to events with a binary search.  If t1 < t0
+	// the window wraps: (t0, end] and [start, t1].
+	void GetEvents(float t0, float t1, std::vector<AnimationEvent>& events)const;
+
     std::vector<BoneAnimation> BoneAnimations; 	
+
+	// Root translation relative to the first key (only the translations are
+	// used).  Empty unless ExtractRootMotion was called.
+	BoneAnimation RootMotion;
+
+	// Sorted by TimePos.
+	std::vector<AnimationEvent> Events;
 };
 
 class SkinnedData
 {
 public:
 
+	// What FindClip returns for a name with no clip.
+	static const UINT InvalidClip = 0xffffffff;
+
 	UINT BoneCount()const;
 
+	// Clips are also addressed by an integer handle, which avoids hashing the
+	// name on every query.  Returns InvalidClip if there is no such clip; the
+	// other functions assert that a handle or name is valid.
+	UINT FindClip(const std::string& clipName)const;
+	UINT ClipCount()const;
+
+	const AnimationClip& GetClip(UINT clip)const;
+	AnimationClip& GetClip(UINT clip);
+
+	float GetClipStartTime(UINT clip)const;
+	float GetClipEndTime(UINT clip)const;
+
 	float GetClipStartTime(const std::string& clipName)const;
 	float GetClipEndTime(const std::string& clipName)const;
 
-	void Set(
+	// Extracts root motion from every clip.  The first bone in hierarchy order
+	// is taken as the root.
+	void ExtractRootMotion();
+
+	// Returns false if the hierarchy is not a forest (bad parent index or a
+	// cycle), or if the offsets/clips do not match the bone count.
+	bool Set(
 		std::vector<int>& boneHierarchy, 
 		std::vector<DirectX::XMFLOAT4X4>& boneOffsets,
 		std::unordered_map<std::string, AnimationClip>& animations);
@@ -70,13 +135,38 @@ public:
     void GetFinalTransforms(const std::string& clipName, float timePos, 
 		 std::vector<DirectX::XMFLOAT4X4>& finalTransforms)const;
 
+	// Same as above, but stores each final transform as a transposed 3x4 affine
+	// matrix (the constant last column is dropped), which is 25% less data to
+	// upload.  Bind as float4x3 in HLSL.
+    void GetFinalTransforms(const std::string& clipName, float timePos, 
+		 std::vector<DirectX::XMFLOAT3X4>& finalTransforms)const;
+
+	// Same as above, but stores each final transform as a dual quaternion, which
+	// is half the size of a 4x4 matrix.  Any scale in the bone transforms is
+	// dropped, since a dual quaternion can only hold rotation and translation.
+    void GetFinalTransforms(const std::string& clipName, float timePos, 
+		 std::vector<DualQuaternion>& finalTransforms)const;
+
+	// Handle versions of the above.
+    void GetFinalTransforms(UINT clip, float timePos, std::vector<DirectX::XMFLOAT4X4>& finalTransforms)const;
+    void GetFinalTransforms(UINT clip, float timePos, std::vector<DirectX::XMFLOAT3X4>& finalTransforms)const;
+    void GetFinalTransforms(UINT clip, float timePos, std::vector<DualQuaternion>& finalTransforms)const;
+
 private:
+	template<typename T>
+	void ComputeFinalTransforms(const AnimationClip& clip, float timePos, T* finalTransforms)const;
+
     // Gives parentIndex of ith bone.
 	std::vector<int> mBoneHierarchy;
 
+	// Bone indices sorted so that every parent comes before its children.
+	std::vector<UINT> mBoneOrder;
+
 	std::vector<DirectX::XMFLOAT4X4> mBoneOffsets;
    
-	std::unordered_map<std::string, AnimationClip> mAnimations;
+	// Indexed by clip handle.
+	std::vector<AnimationClip> mClips;
+	std::unordered_map<std::string, UINT> mClipHandles;
 };
  
 #endif // SKINNEDDATA_H
\ No newline at end of file
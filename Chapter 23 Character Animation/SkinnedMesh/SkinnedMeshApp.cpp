@@ -12,6 +12,9 @@
 #include "Ssao.h"
 #include "SkinnedData.h"
 #include "LoadM3d.h"
+#include "CpuSkinning.h"
+#include "BakedAnimation.h"
+#include "VertexQuantizer.h"
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -19,27 +22,66 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// AnimationEvent::Id of the event that mRootMotion puts at the end of the clip.
+const UINT gClipEndEvent = 0;
+
 struct SkinnedModelInstance
 {
     SkinnedData* SkinnedInfo = nullptr;
-    std::vector<DirectX::XMFLOAT4X4> FinalTransforms;
-    std::string ClipName;
+    std::vector<DirectX::XMFLOAT3X4> FinalTransforms;
+    std::vector<DualQuaternion> FinalDualQuats;
+    UINT Clip = SkinnedData::InvalidClip;
     float TimePos = 0.0f;
 
+    // Root displacement and events crossed during the last update, for the
+    // game to consume.
+    DirectX::XMFLOAT3 RootMotionDelta = { 0.0f, 0.0f, 0.0f };
+    std::vector<AnimationEvent> Events;
+
+    // Generate FinalDualQuats instead of FinalTransforms.
+    bool UseDualQuats = false;
+
+    // If set, FinalTransforms are read from this pre-sampled palette instead
+    // of being interpolated from SkinnedInfo.  Ignored with UseDualQuats.
+    const BakedAnimation* Baked = nullptr;
+
     // Called every frame and increments the time position, interpolates the 
     // animations for each bone based on the current animation clip, and 
     // generates the final transforms which are ultimately set to the effect
     // for processing in the vertex shader.
+    // Without a clip only a bake can move the bones; with neither the final
+    // transforms are left as they are.
     void UpdateSkinnedAnimation(float dt)
     {
+        const bool hasClip = Clip != SkinnedData::InvalidClip;
+        if(!hasClip && (Baked == nullptr || UseDualQuats))
+            return;
+
+        float prevTimePos = TimePos;
         TimePos += dt;
 
         // Loop animation
-        if(TimePos > SkinnedInfo->GetClipEndTime(ClipName))
+        float endTime = hasClip ? SkinnedInfo->GetClipEndTime(Clip) : Baked->GetClipEndTime();
+        if(TimePos > endTime)
             TimePos = 0.0f;
 
+        // A model loaded for its bake alone has no root motion or events.
+        RootMotionDelta = { 0.0f, 0.0f, 0.0f };
+        Events.clear();
+        if(hasClip)
+        {
+            const AnimationClip& clip = SkinnedInfo->GetClip(Clip);
+            XMStoreFloat3(&RootMotionDelta, clip.GetRootMotionDelta(prevTimePos, TimePos));
+            clip.GetEvents(prevTimePos, TimePos, Events);
+        }
+
         // Compute the final transforms for this time position.
-        SkinnedInfo->GetFinalTransforms(ClipName, TimePos, FinalTransforms);
+        if(UseDualQuats)
+            SkinnedInfo->GetFinalTransforms(Clip, TimePos, FinalDualQuats);
+        else if(Baked != nullptr)
+            Baked->Evaluate(TimePos, true, FinalTransforms.data());
+        else
+            SkinnedInfo->GetFinalTransforms(Clip, TimePos, FinalTransforms);
     }
 };
 
@@ -129,7 +171,7 @@ private:
 	void BuildDescriptorHeaps();
     void BuildShadersAndInputLayout();
     void BuildShapeGeometry();
-	void LoadSkinnedModel();
+	bool LoadSkinnedModel();
     void BuildPSOs();
     void BuildFrameResources();
     void BuildMaterials();
@@ -187,6 +229,45 @@ private:
 
     UINT mSkinnedSrvHeapStart = 0;
     std::string mSkinnedModelFilename = "Models\\soldier.m3d";
+
+    // Load mSkinnedModelBinaryFilename, cooking it from mSkinnedModelFilename if needed.
+    bool mUseBinaryModel = false;
+    std::string mSkinnedModelBinaryFilename = "Models\\soldier.m3db";
+
+    // Parse the text model's sections on worker threads (M3DLoader::LoadM3dParallel)
+    // and print how long each section took to the debugger.
+    bool mParallelModelLoad = false;
+
+    // Load the text model with M3DLoader::LoadM3dValidated, which reports where a
+    // malformed file goes wrong and switches to 32-bit indices if they need it.
+    bool mValidateModelLoad = false;
+
+    // Run M3DLoader::StressTestM3d on the model and print the results to the debugger.
+    bool mStressTestModelLoad = false;
+
+    // Time text vs. binary model loading and print the results to the debugger.
+    bool mBenchmarkModelLoad = false;
+
+    // Quantize the loaded vertices (QuantizedMesh) and print the size saved and
+    // the worst decode error to the debugger.
+    bool mReportVertexQuantization = false;
+
+    // Skin with dual quaternions instead of 3x4 bone matrices.  This uploads 32 bytes
+    // a bone instead of 48 and avoids the candy-wrapper collapse at twisting joints.
+    bool mDualQuatSkinning = false;
+
+    // Time CpuSkinning::Skin on the loaded model and print verts/ms to the debugger.
+    bool mBenchmarkCpuSkinning = false;
+
+    // Take the root's horizontal travel out of the clip and move the soldier's render
+    // items by it instead, and print an event to the debugger each time the clip loops.
+    bool mRootMotion = false;
+
+    // Drive the model from a palette baked at the clip's 60 Hz key rate.  It is cached
+    // next to the model and keyed on the model file's size and write time, so later
+    // runs load it and read the model without its clips instead of resampling them.
+    bool mUseBakedAnimation = false;
+    BakedAnimation mBakedAnimation;
     std::unique_ptr<SkinnedModelInstance> mSkinnedModelInst; 
     SkinnedData mSkinnedInfo;
     std::vector<M3DLoader::Subset> mSkinnedSubsets;
@@ -277,7 +358,8 @@ bool SkinnedMeshApp::Initialize()
         mCommandList.Get(),
         mClientWidth, mClientHeight);
 
-    LoadSkinnedModel();
+    if(!LoadSkinnedModel())
+        return false;
 	LoadTextures();
     BuildRootSignature();
     BuildSsaoRootSignature();
@@ -371,8 +453,9 @@ void SkinnedMeshApp::Update(const GameTimer& gt)
     }
  
 	AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
+    // Skinning first, since root motion moves the skinned render items.
     UpdateSkinnedCBs(gt);
+	UpdateObjectCBs(gt);
 	UpdateMaterialBuffer(gt);
     UpdateShadowTransform(gt);
 	UpdateMainPassCB(gt);
@@ -594,14 +677,37 @@ void SkinnedMeshApp::UpdateSkinnedCBs(const GameTimer& gt)
    
     // We only have one skinned model being animated.
     mSkinnedModelInst->UpdateSkinnedAnimation(gt.DeltaTime());
-        
-    SkinnedConstants skinnedConstants;
-    std::copy(
-        std::begin(mSkinnedModelInst->FinalTransforms),
-        std::end(mSkinnedModelInst->FinalTransforms),
-        &skinnedConstants.BoneTransforms[0]);
-
-    currSkinnedCB->CopyData(0, skinnedConstants);
+
+    // The root delta is in the model's space, so it is applied before the world transform.
+    XMVECTOR rootMotion = XMLoadFloat3(&mSkinnedModelInst->RootMotionDelta);
+    if(!XMVector3Equal(rootMotion, XMVectorZero()))
+    {
+        for(auto ri : mRitemLayer[(int)RenderLayer::SkinnedOpaque])
+        {
+            XMMATRIX world = XMMatrixTranslationFromVector(rootMotion)*XMLoadFloat4x4(&ri->World);
+            XMStoreFloat4x4(&ri->World, world);
+            ri->NumFramesDirty = gNumFrameResources;
+        }
+    }
+
+    for(const AnimationEvent& e : mSkinnedModelInst->Events)
+    {
+        if(e.Id == gClipEndEvent)
+            ::OutputDebugStringA("Skinned clip looped\n");
+    }
+
+    // Only the model's bones are written, 32 bytes each as dual quaternions or 48
+    // as 3x4 matrices; the rest of the 96-bone array is never read.
+    if(mSkinnedModelInst->UseDualQuats)
+    {
+        const std::vector<DualQuaternion>& dualQuats = mSkinnedModelInst->FinalDualQuats;
+        currSkinnedCB->CopyBytes(0, dualQuats.data(), dualQuats.size()*sizeof(DualQuaternion));
+    }
+    else
+    {
+        const std::vector<XMFLOAT3X4>& transforms = mSkinnedModelInst->FinalTransforms;
+        currSkinnedCB->CopyBytes(0, transforms.data(), transforms.size()*sizeof(XMFLOAT3X4));
+    }
 }
  
 void SkinnedMeshApp::UpdateMaterialBuffer(const GameTimer& gt)
@@ -1077,12 +1183,21 @@ void SkinnedMeshApp::BuildShadersAndInputLayout()
 		NULL, NULL
 	};
 
-    const D3D_SHADER_MACRO skinnedDefines[] =
+    const D3D_SHADER_MACRO linearSkinnedDefines[] =
+    {
+        "SKINNED", "1",
+        NULL, NULL
+    };
+
+    const D3D_SHADER_MACRO dualQuatSkinnedDefines[] =
     {
         "SKINNED", "1",
+        "DUAL_QUAT_SKINNING", "1",
         NULL, NULL
     };
 
+    const D3D_SHADER_MACRO* skinnedDefines = mDualQuatSkinning ? dualQuatSkinnedDefines : linearSkinnedDefines;
+
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
     mShaders["skinnedVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", skinnedDefines, "VS", "vs_5_1");
 	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1");
@@ -1274,23 +1389,190 @@ void SkinnedMeshApp::BuildShapeGeometry()
 	mGeometries[geo->Name] = std::move(geo);
 }
 
-void SkinnedMeshApp::LoadSkinnedModel()
+bool SkinnedMeshApp::LoadSkinnedModel()
 {
 	std::vector<M3DLoader::SkinnedVertex> vertices;
 	std::vector<std::uint16_t> indices;	
+	std::vector<std::uint32_t> indices32; // Only used when the indices do not fit in 16 bits.
  
 	M3DLoader m3dLoader;
-	m3dLoader.LoadM3d(mSkinnedModelFilename, vertices, indices, 
-        mSkinnedSubsets, mSkinnedMats, mSkinnedInfo);
+
+    // A bake made from the current model file makes the clips unnecessary, so the
+    // model is read without them.  The dual quaternion and CPU skinning paths
+    // still sample the clips themselves.
+    const std::string bakedFilename = mSkinnedModelFilename + ".banim";
+    bool bakeIsCurrent = mUseBakedAnimation && !mDualQuatSkinning && !mBenchmarkCpuSkinning &&
+        mBakedAnimation.Load(bakedFilename, mSkinnedModelFilename);
+
+    if(bakeIsCurrent)
+    {
+        if(!m3dLoader.LoadM3d(mSkinnedModelFilename, vertices, indices,
+               mSkinnedSubsets, mSkinnedMats, mSkinnedInfo, false) ||
+           mSkinnedInfo.BoneCount() != mBakedAnimation.BoneCount())
+        {
+            // Rebake from a full load.
+            bakeIsCurrent = false;
+            m3dLoader.LoadM3d(mSkinnedModelFilename, vertices, indices,
+                mSkinnedSubsets, mSkinnedMats, mSkinnedInfo);
+        }
+    }
+    else if(mUseBinaryModel)
+    {
+        // Cook the binary file from the text one the first time through.
+        if(!m3dLoader.LoadM3dBinary(mSkinnedModelBinaryFilename, vertices, indices,
+            mSkinnedSubsets, mSkinnedMats, mSkinnedInfo))
+        {
+            m3dLoader.ConvertM3dToBinary(mSkinnedModelFilename, mSkinnedModelBinaryFilename);
+            m3dLoader.LoadM3d(mSkinnedModelFilename, vertices, indices,
+                mSkinnedSubsets, mSkinnedMats, mSkinnedInfo);
+        }
+    }
+    else if(mParallelModelLoad)
+    {
+        std::vector<M3DLoader::SectionTiming> timings;
+        m3dLoader.LoadM3dParallel(mSkinnedModelFilename, vertices, indices,
+            mSkinnedSubsets, mSkinnedMats, mSkinnedInfo, &timings);
+
+        std::string msg = "Parallel load " + mSkinnedModelFilename + ":";
+        for(const auto& t : timings)
+            msg += " " + t.Name + " " + std::to_string(t.Ms) + " ms,";
+        msg.back() = '\n';
+        ::OutputDebugStringA(msg.c_str());
+    }
+    else if(mValidateModelLoad)
+    {
+        M3DLoader::LoadError error;
+        if(!m3dLoader.LoadM3dValidated(mSkinnedModelFilename, vertices, indices32,
+            mSkinnedSubsets, mSkinnedMats, mSkinnedInfo, error))
+        {
+            std::string msg = mSkinnedModelFilename + ": " + error.ToString() + "\n";
+            ::OutputDebugStringA(msg.c_str());
+            MessageBoxA(0, msg.c_str(), 0, 0);
+            return false;
+        }
+
+        if(M3DLoader::NarrowIndices(indices32, indices))
+            indices32.clear();
+    }
+    else
+    {
+        m3dLoader.LoadM3d(mSkinnedModelFilename, vertices, indices, 
+            mSkinnedSubsets, mSkinnedMats, mSkinnedInfo);
+    }
+
+    if(mBenchmarkModelLoad)
+    {
+        M3DLoader::LoadTimings timings;
+        if(m3dLoader.ConvertM3dToBinary(mSkinnedModelFilename, mSkinnedModelBinaryFilename) &&
+           m3dLoader.BenchmarkLoad(mSkinnedModelFilename, mSkinnedModelBinaryFilename, 5, timings))
+        {
+            std::string msg = "Load " + mSkinnedModelFilename + ": text " + std::to_string(timings.TextMs) +
+                " ms, binary map " + std::to_string(timings.BinaryMapMs) +
+                " ms, binary load " + std::to_string(timings.BinaryLoadMs) + " ms\n";
+            ::OutputDebugStringA(msg.c_str());
+        }
+    }
+
+    if(mStressTestModelLoad)
+    {
+        M3DLoader::StressReport report;
+        bool passed = m3dLoader.StressTestM3d(mSkinnedModelFilename, 200, 1, report);
+
+        std::string msg = "Stress test " + mSkinnedModelFilename + (passed ? ": passed, " : ": FAILED, ") +
+            std::to_string(report.Rejected) + " rejected, " + std::to_string(report.Accepted) + " accepted, " +
+            std::to_string(report.Broken) + " broken in " + std::to_string(report.Ms) + " ms; last error: " +
+            report.LastError.ToString() + "\n";
+        ::OutputDebugStringA(msg.c_str());
+    }
+
+    if(mReportVertexQuantization)
+    {
+        for(int quantizePositions = 0; quantizePositions < 2; ++quantizePositions)
+        {
+            QuantizeOptions options;
+            options.QuantizePositions = quantizePositions != 0;
+
+            QuantizedMesh quantized;
+            quantized.Quantize(vertices, options);
+            QuantizedMesh::Report report = quantized.Validate(vertices);
+
+            std::string msg = "Quantized " + mSkinnedModelFilename +
+                (options.QuantizePositions ? " (quantized positions): " : ": ") +
+                std::to_string(report.SourceBytesPerVertex) + " -> " + std::to_string(report.QuantizedBytesPerVertex) +
+                " bytes/vertex, max error pos " + std::to_string(report.MaxPositionError) +
+                ", normal " + std::to_string(report.MaxNormalErrorDegrees) +
+                " deg, tangent " + std::to_string(report.MaxTangentErrorDegrees) +
+                " deg, uv " + std::to_string(report.MaxTexCError) +
+                ", weight " + std::to_string(report.MaxWeightError) + "\n";
+            ::OutputDebugStringA(msg.c_str());
+        }
+    }
 
     mSkinnedModelInst = std::make_unique<SkinnedModelInstance>();
     mSkinnedModelInst->SkinnedInfo = &mSkinnedInfo;
-    mSkinnedModelInst->FinalTransforms.resize(mSkinnedInfo.BoneCount());
-    mSkinnedModelInst->ClipName = "Take1";
+    mSkinnedModelInst->UseDualQuats = mDualQuatSkinning;
     mSkinnedModelInst->TimePos = 0.0f;
+
+    // Start in the bind pose, which is what is drawn if there is no clip to play.
+    XMFLOAT3X4 identity;
+    XMStoreFloat3x4(&identity, XMMatrixIdentity());
+    DualQuaternion identityDualQuat = { XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f), XMFLOAT4(0.0f, 0.0f, 0.0f, 0.0f) };
+    mSkinnedModelInst->FinalTransforms.assign(mSkinnedInfo.BoneCount(), identity);
+    mSkinnedModelInst->FinalDualQuats.assign(mSkinnedInfo.BoneCount(), identityDualQuat);
+
+    // Play "Take1", or the first clip if the model names its clips differently.
+    mSkinnedModelInst->Clip = mSkinnedInfo.FindClip("Take1");
+    if(mSkinnedModelInst->Clip == SkinnedData::InvalidClip && mSkinnedInfo.ClipCount() > 0)
+        mSkinnedModelInst->Clip = 0;
+
+    // The bake cache is keyed on the model file alone, so a baked clip keeps the root
+    // travel in its pose and has no root motion to extract.
+    if(mRootMotion && !mUseBakedAnimation && mSkinnedModelInst->Clip != SkinnedData::InvalidClip)
+    {
+        mSkinnedInfo.ExtractRootMotion();
+
+        AnimationClip& clip = mSkinnedInfo.GetClip(mSkinnedModelInst->Clip);
+        clip.AddEvent({ clip.GetClipEndTime(), gClipEndEvent });
+    }
+
+    if(mUseBakedAnimation && !bakeIsCurrent && mSkinnedModelInst->Clip != SkinnedData::InvalidClip)
+    {
+        mBakedAnimation.Bake(mSkinnedInfo, mSkinnedModelInst->Clip, 60.0f);
+        mBakedAnimation.Save(bakedFilename, mSkinnedModelFilename);
+        bakeIsCurrent = true;
+    }
+
+    if(bakeIsCurrent)
+    {
+        mSkinnedModelInst->Baked = &mBakedAnimation;
+    }
+    else if(mSkinnedModelInst->Clip == SkinnedData::InvalidClip)
+    {
+        std::string msg = mSkinnedModelFilename + " has no animation clips; drawing the bind pose.\n";
+        ::OutputDebugStringA(msg.c_str());
+    }
+
+    if(mBenchmarkCpuSkinning && mSkinnedModelInst->Clip != SkinnedData::InvalidClip)
+    {
+        std::vector<XMFLOAT3X4> finalTransforms(mSkinnedInfo.BoneCount());
+        mSkinnedInfo.GetFinalTransforms(mSkinnedModelInst->Clip, 0.0f, finalTransforms);
+
+        double vertsPerMs = CpuSkinning::Benchmark(vertices, finalTransforms, 100);
+        float maxError = CpuSkinning::MaxSkinError(vertices, finalTransforms);
+
+        std::string msg = "CPU skinning " + mSkinnedModelFilename + ": " +
+            std::to_string(vertsPerMs) + " verts/ms, " + std::to_string(maxError) +
+            " max distance from the reference skinning\n";
+        ::OutputDebugStringA(msg.c_str());
+    }
  
+	const bool use32BitIndices = !indices32.empty();
+	const void* indexData = use32BitIndices ? (const void*)indices32.data() : (const void*)indices.data();
+
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(SkinnedVertex);
-    const UINT ibByteSize = (UINT)indices.size()  * sizeof(std::uint16_t);
+    const UINT ibByteSize = use32BitIndices ?
+        (UINT)indices32.size() * sizeof(std::uint32_t) :
+        (UINT)indices.size()  * sizeof(std::uint16_t);
 
 	auto geo = std::make_unique<MeshGeometry>();
 	geo->Name = mSkinnedModelFilename;
@@ -1299,17 +1581,17 @@ void SkinnedMeshApp::LoadSkinnedModel()
 	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indexData, ibByteSize);
 
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), indexData, ibByteSize, geo->IndexBufferUploader);
 
 	geo->VertexByteStride = sizeof(SkinnedVertex);
 	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+	geo->IndexFormat = use32BitIndices ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
 	for(UINT i = 0; i < (UINT)mSkinnedSubsets.size(); ++i)
@@ -1325,6 +1607,8 @@ void SkinnedMeshApp::LoadSkinnedModel()
 	}
 
 	mGeometries[geo->Name] = std::move(geo);
+
+	return true;
 }
 
 void SkinnedMeshApp::BuildPSOs()
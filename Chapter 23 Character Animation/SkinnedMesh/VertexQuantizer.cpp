@@ -0,0 +1,423 @@
+#include "VertexQuantizer.h"
+#include <DirectXPackedVector.h>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	float SignNotZero(float x)
+	{
+		return x >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	XMFLOAT3 Normalize(const XMFLOAT3& v)
+	{
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, XMVector3Normalize(XMLoadFloat3(&v)));
+		return n;
+	}
+
+	// Maps a unit vector onto the octahedron and unfolds it into [-1,1]^2.
+	XMFLOAT2 OctEncode(const XMFLOAT3& n)
+	{
+		float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		if(l1 == 0.0f)
+			return XMFLOAT2(0.0f, 0.0f);
+
+		float x = n.x / l1;
+		float y = n.y / l1;
+		if(n.z < 0.0f)
+		{
+			float foldedX = (1.0f - fabsf(y)) * SignNotZero(x);
+			float foldedY = (1.0f - fabsf(x)) * SignNotZero(y);
+			x = foldedX;
+			y = foldedY;
+		}
+		return XMFLOAT2(x, y);
+	}
+
+	XMFLOAT3 OctDecode(float x, float y)
+	{
+		XMFLOAT3 n(x, y, 1.0f - fabsf(x) - fabsf(y));
+		float t = MathHelper::Max(-n.z, 0.0f);
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		return Normalize(n);
+	}
+
+	float SnormToFloat(int q, int maxValue)
+	{
+		return MathHelper::Max((float)q / maxValue, -1.0f);
+	}
+
+	// Octahedral encoding into two signed integers of the given range.  Rounding
+	// each coordinate on its own is not always closest on the sphere, so the four
+	// neighbouring grid points are tried and the best kept.
+	void OctQuantize(const XMFLOAT3& n, int maxValue, int& qx, int& qy)
+	{
+		XMFLOAT2 e = OctEncode(Normalize(n));
+		int baseX = (int)floorf(e.x * maxValue);
+		int baseY = (int)floorf(e.y * maxValue);
+
+		XMVECTOR N = XMVector3Normalize(XMLoadFloat3(&n));
+		float bestDot = -2.0f;
+		for(int dy = 0; dy <= 1; ++dy)
+		{
+			for(int dx = 0; dx <= 1; ++dx)
+			{
+				int x = MathHelper::Clamp(baseX + dx, -maxValue, maxValue);
+				int y = MathHelper::Clamp(baseY + dy, -maxValue, maxValue);
+
+				XMFLOAT3 d = OctDecode(SnormToFloat(x, maxValue), SnormToFloat(y, maxValue));
+				float dot = XMVectorGetX(XMVector3Dot(N, XMLoadFloat3(&d)));
+				if(dot > bestDot)
+				{
+					bestDot = dot;
+					qx = x;
+					qy = y;
+				}
+			}
+		}
+	}
+
+	// Quantizes the three stored weights plus the implied fourth to bytes that
+	// sum to exactly 255, handing the rounding remainder to the largest fractions.
+	void QuantizeWeights(const XMFLOAT3& weights, BYTE out[4])
+	{
+		float w[4] = { weights.x, weights.y, weights.z, 0.0f };
+		w[3] = MathHelper::Max(1.0f - w[0] - w[1] - w[2], 0.0f);
+
+		float total = w[0] + w[1] + w[2] + w[3];
+		int sum = 0;
+		float fraction[4];
+		for(int i = 0; i < 4; ++i)
+		{
+			float scaled = total > 0.0f ? 255.0f * MathHelper::Max(w[i], 0.0f) / total : (i == 0 ? 255.0f : 0.0f);
+			out[i] = (BYTE)scaled;
+			fraction[i] = scaled - out[i];
+			sum += out[i];
+		}
+
+		for(; sum < 255; ++sum)
+		{
+			int largest = 0;
+			for(int i = 1; i < 4; ++i)
+			{
+				if(fraction[i] > fraction[largest])
+					largest = i;
+			}
+			++out[largest];
+			fraction[largest] = -1.0f;
+		}
+	}
+
+	// Angle between a source direction and its decoded value.  A zero source vector
+	// (the soldier has a few degenerate tangents) has no direction to lose.
+	float AngleDegrees(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		if(XMVectorGetX(XMVector3LengthSq(XMLoadFloat3(&a))) < 1e-12f)
+			return 0.0f;
+
+		XMVECTOR A = XMVector3Normalize(XMLoadFloat3(&a));
+		XMVECTOR B = XMVector3Normalize(XMLoadFloat3(&b));
+		float dot = MathHelper::Clamp(XMVectorGetX(XMVector3Dot(A, B)), -1.0f, 1.0f);
+		return XMConvertToDegrees(acosf(dot));
+	}
+
+	float MaxAbsDifference(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		return MathHelper::Max(fabsf(a.x - b.x), MathHelper::Max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+	}
+}
+
+void QuantizedMesh::Quantize(const std::vector<M3DLoader::Vertex>& vertices, const QuantizeOptions& options)
+{
+	XMFLOAT3 vMin(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
+	XMFLOAT3 vMax(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
+	for(const auto& v : vertices)
+	{
+		XMStoreFloat3(&vMin, XMVectorMin(XMLoadFloat3(&vMin), XMLoadFloat3(&v.Pos)));
+		XMStoreFloat3(&vMax, XMVectorMax(XMLoadFloat3(&vMax), XMLoadFloat3(&v.Pos)));
+	}
+
+	Begin((UINT)vertices.size(), false, options, vMin, vMax);
+
+	for(UINT i = 0; i < mVertexCount; ++i)
+	{
+		const M3DLoader::Vertex& v = vertices[i];
+
+		CommonAttributes c;
+		c.Pos = v.Pos;
+		c.Normal = v.Normal;
+		c.Tangent = XMFLOAT3(v.TangentU.x, v.TangentU.y, v.TangentU.z);
+		c.TangentSign = v.TangentU.w;
+		c.TexC = v.TexC;
+		WriteCommon(i, c);
+	}
+}
+
+void QuantizedMesh::Quantize(const std::vector<M3DLoader::SkinnedVertex>& vertices, const QuantizeOptions& options)
+{
+	XMFLOAT3 vMin(+MathHelper::Infinity, +MathHelper::Infinity, +MathHelper::Infinity);
+	XMFLOAT3 vMax(-MathHelper::Infinity, -MathHelper::Infinity, -MathHelper::Infinity);
+	for(const auto& v : vertices)
+	{
+		XMStoreFloat3(&vMin, XMVectorMin(XMLoadFloat3(&vMin), XMLoadFloat3(&v.Pos)));
+		XMStoreFloat3(&vMax, XMVectorMax(XMLoadFloat3(&vMax), XMLoadFloat3(&v.Pos)));
+	}
+
+	Begin((UINT)vertices.size(), true, options, vMin, vMax);
+
+	for(UINT i = 0; i < mVertexCount; ++i)
+	{
+		const M3DLoader::SkinnedVertex& v = vertices[i];
+
+		// The skinned shaders ignore tangent handedness.
+		CommonAttributes c;
+		c.Pos = v.Pos;
+		c.Normal = v.Normal;
+		c.Tangent = v.TangentU;
+		c.TangentSign = 1.0f;
+		c.TexC = v.TexC;
+		BYTE* p = WriteCommon(i, c);
+
+		QuantizeWeights(v.BoneWeights, p);
+		memcpy(p + 4, v.BoneIndices, 4);
+	}
+}
+
+void QuantizedMesh::Decode(std::vector<M3DLoader::Vertex>& vertices)const
+{
+	vertices.resize(mVertexCount);
+	for(UINT i = 0; i < mVertexCount; ++i)
+	{
+		CommonAttributes c;
+		ReadCommon(i, c);
+
+		vertices[i].Pos = c.Pos;
+		vertices[i].Normal = c.Normal;
+		vertices[i].TangentU = XMFLOAT4(c.Tangent.x, c.Tangent.y, c.Tangent.z, c.TangentSign);
+		vertices[i].TexC = c.TexC;
+	}
+}
+
+void QuantizedMesh::Decode(std::vector<M3DLoader::SkinnedVertex>& vertices)const
+{
+	vertices.resize(mVertexCount);
+	for(UINT i = 0; i < mVertexCount; ++i)
+	{
+		CommonAttributes c;
+		const BYTE* p = ReadCommon(i, c);
+
+		vertices[i].Pos = c.Pos;
+		vertices[i].Normal = c.Normal;
+		vertices[i].TangentU = c.Tangent;
+		vertices[i].TexC = c.TexC;
+
+		if(mSkinned)
+		{
+			vertices[i].BoneWeights = XMFLOAT3(p[0] / 255.0f, p[1] / 255.0f, p[2] / 255.0f);
+			memcpy(vertices[i].BoneIndices, p + 4, 4);
+		}
+		else
+		{
+			vertices[i].BoneWeights = XMFLOAT3(1.0f, 0.0f, 0.0f);
+			memset(vertices[i].BoneIndices, 0, 4);
+		}
+	}
+}
+
+QuantizedMesh::Report QuantizedMesh::Validate(const std::vector<M3DLoader::Vertex>& source)const
+{
+	std::vector<M3DLoader::Vertex> decoded;
+	Decode(decoded);
+
+	Report report;
+	report.SourceBytesPerVertex = sizeof(M3DLoader::Vertex);
+	report.QuantizedBytesPerVertex = mVertexStride;
+
+	for(size_t i = 0; i < source.size() && i < decoded.size(); ++i)
+	{
+		const auto& s = source[i];
+		const auto& d = decoded[i];
+
+		report.MaxPositionError = MathHelper::Max(report.MaxPositionError, MaxAbsDifference(s.Pos, d.Pos));
+		report.MaxNormalErrorDegrees = MathHelper::Max(report.MaxNormalErrorDegrees, AngleDegrees(s.Normal, d.Normal));
+		report.MaxTangentErrorDegrees = MathHelper::Max(report.MaxTangentErrorDegrees,
+			AngleDegrees(XMFLOAT3(s.TangentU.x, s.TangentU.y, s.TangentU.z), XMFLOAT3(d.TangentU.x, d.TangentU.y, d.TangentU.z)));
+		report.MaxTexCError = MathHelper::Max(report.MaxTexCError,
+			MathHelper::Max(fabsf(s.TexC.x - d.TexC.x), fabsf(s.TexC.y - d.TexC.y)));
+	}
+
+	return report;
+}
+
+QuantizedMesh::Report QuantizedMesh::Validate(const std::vector<M3DLoader::SkinnedVertex>& source)const
+{
+	std::vector<M3DLoader::SkinnedVertex> decoded;
+	Decode(decoded);
+
+	Report report;
+	report.SourceBytesPerVertex = sizeof(M3DLoader::SkinnedVertex);
+	report.QuantizedBytesPerVertex = mVertexStride;
+
+	for(size_t i = 0; i < source.size() && i < decoded.size(); ++i)
+	{
+		const auto& s = source[i];
+		const auto& d = decoded[i];
+
+		report.MaxPositionError = MathHelper::Max(report.MaxPositionError, MaxAbsDifference(s.Pos, d.Pos));
+		report.MaxNormalErrorDegrees = MathHelper::Max(report.MaxNormalErrorDegrees, AngleDegrees(s.Normal, d.Normal));
+		report.MaxTangentErrorDegrees = MathHelper::Max(report.MaxTangentErrorDegrees, AngleDegrees(s.TangentU, d.TangentU));
+		report.MaxTexCError = MathHelper::Max(report.MaxTexCError,
+			MathHelper::Max(fabsf(s.TexC.x - d.TexC.x), fabsf(s.TexC.y - d.TexC.y)));
+		report.MaxWeightError = MathHelper::Max(report.MaxWeightError, MaxAbsDifference(s.BoneWeights, d.BoneWeights));
+	}
+
+	return report;
+}
+
+bool QuantizedMesh::IsSkinned()const
+{
+	return mSkinned;
+}
+
+bool QuantizedMesh::HasQuantizedPositions()const
+{
+	return mQuantizedPositions;
+}
+
+UINT QuantizedMesh::VertexCount()const
+{
+	return mVertexCount;
+}
+
+UINT QuantizedMesh::VertexStride()const
+{
+	return mVertexStride;
+}
+
+const BYTE* QuantizedMesh::Data()const
+{
+	return mData.data();
+}
+
+size_t QuantizedMesh::DataSize()const
+{
+	return mData.size();
+}
+
+XMFLOAT3 QuantizedMesh::GetPositionMin()const
+{
+	return mPositionMin;
+}
+
+XMFLOAT3 QuantizedMesh::GetPositionExtent()const
+{
+	return mPositionExtent;
+}
+
+void QuantizedMesh::Begin(UINT vertexCount, bool skinned, const QuantizeOptions& options,
+	const XMFLOAT3& boundsMin, const XMFLOAT3& boundsMax)
+{
+	mSkinned = skinned;
+	mQuantizedPositions = options.QuantizePositions;
+	mVertexCount = vertexCount;
+	mVertexStride = (mQuantizedPositions ? 8 : 12) + 4 + 4 + 4 + (mSkinned ? 8 : 0);
+
+	if(vertexCount > 0)
+	{
+		mPositionMin = boundsMin;
+		XMStoreFloat3(&mPositionExtent, XMLoadFloat3(&boundsMax) - XMLoadFloat3(&boundsMin));
+	}
+	else
+	{
+		mPositionMin = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		mPositionExtent = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	}
+
+	mData.assign((size_t)mVertexCount * mVertexStride, 0);
+}
+
+BYTE* QuantizedMesh::WriteCommon(UINT i, const CommonAttributes& v)
+{
+	BYTE* p = &mData[(size_t)i * mVertexStride];
+
+	if(mQuantizedPositions)
+	{
+		const float* pos = &v.Pos.x;
+		const float* posMin = &mPositionMin.x;
+		const float* extent = &mPositionExtent.x;
+
+		USHORT q[4] = { 0, 0, 0, 0 };
+		for(int j = 0; j < 3; ++j)
+		{
+			float t = extent[j] > 0.0f ? (pos[j] - posMin[j]) / extent[j] : 0.0f;
+			q[j] = (USHORT)(MathHelper::Clamp(t, 0.0f, 1.0f) * 65535.0f + 0.5f);
+		}
+		memcpy(p, q, 8);
+		p += 8;
+	}
+	else
+	{
+		memcpy(p, &v.Pos, 12);
+		p += 12;
+	}
+
+	int nx = 0, ny = 0;
+	OctQuantize(v.Normal, 32767, nx, ny);
+	short normal[2] = { (short)nx, (short)ny };
+	memcpy(p, normal, 4);
+	p += 4;
+
+	int tx = 0, ty = 0;
+	OctQuantize(v.Tangent, 127, tx, ty);
+	p[0] = (BYTE)(signed char)tx;
+	p[1] = (BYTE)(signed char)ty;
+	p[2] = (BYTE)(signed char)(v.TangentSign < 0.0f ? -127 : 127);
+	p[3] = 0;
+	p += 4;
+
+	HALF texC[2] = { XMConvertFloatToHalf(v.TexC.x), XMConvertFloatToHalf(v.TexC.y) };
+	memcpy(p, texC, 4);
+	p += 4;
+
+	return p;
+}
+
+const BYTE* QuantizedMesh::ReadCommon(UINT i, CommonAttributes& v)const
+{
+	const BYTE* p = &mData[(size_t)i * mVertexStride];
+
+	if(mQuantizedPositions)
+	{
+		USHORT q[4];
+		memcpy(q, p, 8);
+		v.Pos.x = mPositionMin.x + q[0] / 65535.0f * mPositionExtent.x;
+		v.Pos.y = mPositionMin.y + q[1] / 65535.0f * mPositionExtent.y;
+		v.Pos.z = mPositionMin.z + q[2] / 65535.0f * mPositionExtent.z;
+		p += 8;
+	}
+	else
+	{
+		memcpy(&v.Pos, p, 12);
+		p += 12;
+	}
+
+	short normal[2];
+	memcpy(normal, p, 4);
+	v.Normal = OctDecode(SnormToFloat(normal[0], 32767), SnormToFloat(normal[1], 32767));
+	p += 4;
+
+	v.Tangent = OctDecode(SnormToFloat((signed char)p[0], 127), SnormToFloat((signed char)p[1], 127));
+	v.TangentSign = (signed char)p[2] < 0 ? -1.0f : 1.0f;
+	p += 4;
+
+	HALF texC[2];
+	memcpy(texC, p, 4);
+	v.TexC = XMFLOAT2(XMConvertHalfToFloat(texC[0]), XMConvertHalfToFloat(texC[1]));
+	p += 4;
+
+	return p;
+}
@@ -0,0 +1,89 @@
+#ifndef VERTEXQUANTIZER_H
+#define VERTEXQUANTIZER_H
+
+#include "LoadM3d.h"
+
+struct QuantizeOptions
+{
+	// Store positions as 16-bit fractions of the mesh bounds instead of floats.
+	bool QuantizePositions = false;
+};
+
+///<summary>
+/// Compact copy of an M3D vertex buffer.  Each vertex is packed as
+///   Position  float3 (12 bytes), or unorm16x3 within the mesh bounds + pad (8)
+///   Normal    octahedral snorm16x2 (4)
+///   Tangent   octahedral snorm8x2, handedness snorm8, pad (4)
+///   TexC      half2 (4)
+///   Weights   unorm8x4 summing to 255 (4, skinned only)
+///   Indices   uint8x4 (4, skinned only)
+/// which takes a SkinnedVertex from 60 to 28-32 bytes and a Vertex from 48 to
+/// 20-24.  Decode unpacks back to the loader's vertex types so the error can be
+/// checked against the source.
+///</summary>
+class QuantizedMesh
+{
+public:
+	// How far the decoded vertices are from the source and what was saved.
+	// Angles are in degrees; position error is in model units.
+	struct Report
+	{
+		UINT SourceBytesPerVertex = 0;
+		UINT QuantizedBytesPerVertex = 0;
+
+		float MaxPositionError = 0.0f;
+		float MaxNormalErrorDegrees = 0.0f;
+		float MaxTangentErrorDegrees = 0.0f;
+		float MaxTexCError = 0.0f;
+		float MaxWeightError = 0.0f;
+	};
+
+	void Quantize(const std::vector<M3DLoader::Vertex>& vertices, const QuantizeOptions& options);
+	void Quantize(const std::vector<M3DLoader::SkinnedVertex>& vertices, const QuantizeOptions& options);
+
+	void Decode(std::vector<M3DLoader::Vertex>& vertices)const;
+	void Decode(std::vector<M3DLoader::SkinnedVertex>& vertices)const;
+
+	// Decodes and compares against the vertices that were quantized.
+	Report Validate(const std::vector<M3DLoader::Vertex>& source)const;
+	Report Validate(const std::vector<M3DLoader::SkinnedVertex>& source)const;
+
+	bool IsSkinned()const;
+	bool HasQuantizedPositions()const;
+	UINT VertexCount()const;
+	UINT VertexStride()const;
+	const BYTE* Data()const;
+	size_t DataSize()const;
+
+	// Quantized positions decode as PositionMin + unorm*PositionExtent.
+	DirectX::XMFLOAT3 GetPositionMin()const;
+	DirectX::XMFLOAT3 GetPositionExtent()const;
+
+private:
+	// Fields shared by both vertex types.
+	struct CommonAttributes
+	{
+		DirectX::XMFLOAT3 Pos;
+		DirectX::XMFLOAT3 Normal;
+		DirectX::XMFLOAT3 Tangent;
+		float TangentSign;
+		DirectX::XMFLOAT2 TexC;
+	};
+
+	void Begin(UINT vertexCount, bool skinned, const QuantizeOptions& options,
+		const DirectX::XMFLOAT3& boundsMin, const DirectX::XMFLOAT3& boundsMax);
+	BYTE* WriteCommon(UINT i, const CommonAttributes& v);
+	const BYTE* ReadCommon(UINT i, CommonAttributes& v)const;
+
+	bool mSkinned = false;
+	bool mQuantizedPositions = false;
+	UINT mVertexCount = 0;
+	UINT mVertexStride = 0;
+
+	DirectX::XMFLOAT3 mPositionMin = { 0.0f, 0.0f, 0.0f };
+	DirectX::XMFLOAT3 mPositionExtent = { 0.0f, 0.0f, 0.0f };
+
+	std::vector<BYTE> mData;
+};
+
+#endif // VERTEXQUANTIZER_H
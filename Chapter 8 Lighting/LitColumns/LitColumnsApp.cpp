@@ -6,6 +6,8 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/ModelLibrary.h"
+#include "../../Common/AsyncLoader.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -76,11 +78,13 @@ private:
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
+	void UpdateStreamedSkull();
 
     void BuildRootSignature();
     void BuildShadersAndInputLayout();
     void BuildShapeGeometry();
 	void BuildSkullGeometry();
+	void BuildSkullGeometry(const ModelMesh& skull);
     void BuildPSOs();
     void BuildFrameResources();
     void BuildMaterials();
@@ -114,6 +118,13 @@ private:
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mOpaqueRitems;
 
+	// Load the skull on a loader thread and draw a sphere in its place until it
+	// arrives, instead of loading it before the first frame.
+	bool mStreamSkull = true;
+	AsyncLoader mAssetLoader;
+	AssetHandle<const ModelMesh> mSkullLoad;
+	RenderItem* mSkullRitem = nullptr;
+
     PassConstants mMainPassCB;
 
 	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
@@ -176,7 +187,19 @@ bool LitColumnsApp::Initialize()
     BuildRootSignature();
     BuildShadersAndInputLayout();
     BuildShapeGeometry();
-	BuildSkullGeometry();
+	if(mStreamSkull)
+	{
+		mSkullLoad = mAssetLoader.Load<const ModelMesh>([]() -> std::shared_ptr<const ModelMesh>
+		{
+			// The library owns the mesh, so the handle does not.
+			const ModelMesh* skull = ModelLibrary::Get().Load("Models/skull.txt");
+			return skull ? std::shared_ptr<const ModelMesh>(std::shared_ptr<const ModelMesh>(), skull) : nullptr;
+		}, AssetPriority::High);
+	}
+	else
+	{
+		BuildSkullGeometry();
+	}
 	BuildMaterials();
     BuildRenderItems();
     BuildFrameResources();
@@ -221,6 +244,7 @@ void LitColumnsApp::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
+	UpdateStreamedSkull();
 	AnimateMaterials(gt);
 	UpdateObjectCBs(gt);
 	UpdateMaterialCBs(gt);
@@ -354,6 +378,44 @@ void LitColumnsApp::AnimateMaterials(const GameTimer& gt)
 	
 }
 
+void LitColumnsApp::UpdateStreamedSkull()
+{
+	if(!mSkullLoad.IsValid() || !mSkullLoad.IsDone())
+		return;
+
+	std::shared_ptr<const ModelMesh> skull = mSkullLoad.Get();
+	mSkullLoad = AssetHandle<const ModelMesh>();
+
+	if(skull == nullptr)
+	{
+		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
+		return;
+	}
+
+	// Upload on the initialization allocator, which is idle after Initialize.
+	ThrowIfFailed(mDirectCmdListAlloc->Reset());
+	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
+
+	BuildSkullGeometry(*skull);
+
+	ThrowIfFailed(mCommandList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	FlushCommandQueue();
+
+	auto geo = mGeometries["skullGeo"].get();
+	mSkullRitem->Geo = geo;
+	mSkullRitem->IndexCount = geo->DrawArgs["skull"].IndexCount;
+	mSkullRitem->StartIndexLocation = geo->DrawArgs["skull"].StartIndexLocation;
+	mSkullRitem->BaseVertexLocation = geo->DrawArgs["skull"].BaseVertexLocation;
+
+	AsyncLoader::Stats stats = mAssetLoader.GetStats();
+	std::string msg = "Streamed skull: " + std::to_string(skull->LoadMs) + " ms load, " +
+		std::to_string(stats.AverageLatencyMs) + " ms average latency, queue depth " +
+		std::to_string(stats.QueueDepth) + "\n";
+	::OutputDebugStringA(msg.c_str());
+}
+
 void LitColumnsApp::UpdateObjectCBs(const GameTimer& gt)
 {
 	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
@@ -612,40 +674,29 @@ void LitColumnsApp::BuildShapeGeometry()
 
 void LitColumnsApp::BuildSkullGeometry()
 {
-	std::ifstream fin("Models/skull.txt");
+	const ModelMesh* skull = ModelLibrary::Get().Load("Models/skull.txt");
 
-	if(!fin)
+	if(skull == nullptr)
 	{
 		MessageBox(0, L"Models/skull.txt not found.", 0, 0);
 		return;
 	}
 
-	UINT vcount = 0;
-	UINT tcount = 0;
-	std::string ignore;
+	BuildSkullGeometry(*skull);
+}
 
-	fin >> ignore >> vcount;
-	fin >> ignore >> tcount;
-	fin >> ignore >> ignore >> ignore >> ignore;
+void LitColumnsApp::BuildSkullGeometry(const ModelMesh& skull)
+{
+	UINT vcount = (UINT)skull.Positions.size();
 
 	std::vector<Vertex> vertices(vcount);
 	for(UINT i = 0; i < vcount; ++i)
 	{
-		fin >> vertices[i].Pos.x >> vertices[i].Pos.y >> vertices[i].Pos.z;
-		fin >> vertices[i].Normal.x >> vertices[i].Normal.y >> vertices[i].Normal.z;
-	}
-
-	fin >> ignore;
-	fin >> ignore;
-	fin >> ignore;
-
-	std::vector<std::int32_t> indices(3 * tcount);
-	for(UINT i = 0; i < tcount; ++i)
-	{
-		fin >> indices[i * 3 + 0] >> indices[i * 3 + 1] >> indices[i * 3 + 2];
+		vertices[i].Pos = skull.Positions[i];
+		vertices[i].Normal = skull.Normals[i];
 	}
 
-	fin.close();
+	const std::vector<std::int32_t>& indices = skull.Indices;
 
 	//
 	// Pack the indices of all the meshes into one index buffer.
@@ -798,11 +849,15 @@ void LitColumnsApp::BuildRenderItems()
 	skullRitem->TexTransform = MathHelper::Identity4x4();
 	skullRitem->ObjCBIndex = 2;
 	skullRitem->Mat = mMaterials["skullMat"].get();
-	skullRitem->Geo = mGeometries["skullGeo"].get();
+	// A streamed skull is drawn as a sphere until UpdateStreamedSkull swaps it in.
+	bool skullLoaded = mGeometries.find("skullGeo") != mGeometries.end();
+	const char* skullArgs = skullLoaded ? "skull" : "sphere";
+	skullRitem->Geo = skullLoaded ? mGeometries["skullGeo"].get() : mGeometries["shapeGeo"].get();
 	skullRitem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-	skullRitem->IndexCount = skullRitem->Geo->DrawArgs["skull"].IndexCount;
-	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs["skull"].StartIndexLocation;
-	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs["skull"].BaseVertexLocation;
+	skullRitem->IndexCount = skullRitem->Geo->DrawArgs[skullArgs].IndexCount;
+	skullRitem->StartIndexLocation = skullRitem->Geo->DrawArgs[skullArgs].StartIndexLocation;
+	skullRitem->BaseVertexLocation = skullRitem->Geo->DrawArgs[skullArgs].BaseVertexLocation;
+	mSkullRitem = skullRitem.get();
 	mAllRitems.push_back(std::move(skullRitem));
 
 	XMMATRIX brickTexTransform = XMMatrixScaling(1.0f, 1.0f, 1.0f);
@@ -6,6 +6,7 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/BCEncoder.h"
 #include "FrameResource.h"
 
 using Microsoft::WRL::ComPtr;
@@ -127,6 +128,14 @@ private:
   float mPhi = 0.4f * XM_PI;
   float mRadius = 2.5f;
 
+  // Load each texture both the old way (read into a heap buffer, then copy) and the
+  // mapped way, and print the memory and copies each took to the debugger.
+  bool mMeasureTextureUpload = false;
+
+  // Compress a few source images with BCEncoder and print the quality, the
+  // throughput and the size saved to the debugger.
+  bool mBenchmarkBCEncoder = false;
+
   POINT mLastMousePos;
 };
 
@@ -469,6 +478,60 @@ void CrateApp::LoadTextures()
   mCommandList.Get(), woodCrateTex2->Filename.c_str(),
     woodCrateTex2->Resource, woodCrateTex2->UploadHeap));
 
+  if (mMeasureTextureUpload)
+  {
+    for (const std::wstring& filename : { woodCrateTex->Filename, woodCrateTex2->Filename })
+    {
+      DDSUploadCost legacy, mapped;
+      if (FAILED(MeasureDDSUpload(filename, legacy, mapped)))
+        continue;
+
+      // The peak and the pass count are tallied from each path, not measured.
+      for (const DDSUploadCost* cost : { &legacy, &mapped })
+      {
+        std::string msg = std::string(cost == &legacy ? "  read: " : "mapped: ") +
+          std::to_string(cost->Ms) + " ms, " + std::to_string(cost->BytesCopied) + " bytes copied (tallied: " +
+          std::to_string(cost->Copies) + " passes, " + std::to_string(cost->PeakBytes) + " bytes peak)\n";
+        ::OutputDebugStringA(msg.c_str());
+      }
+    }
+  }
+
+  if (mBenchmarkBCEncoder)
+  {
+    struct EncoderRun
+    {
+      const wchar_t* Filename;
+      BCFormat Format;
+      const char* Name;
+    };
+    const EncoderRun runs[] =
+    {
+      { L"../../Textures/tree0.bmp", BCFormat::BC1, "BC1" },
+      { L"../../Textures/tree0.bmp", BCFormat::BC3, "BC3" },
+      { L"../../Textures/bricks_nmap.dds", BCFormat::BC5, "BC5" },
+    };
+
+    for (const EncoderRun& run : runs)
+    {
+      BCImage image;
+      if (!BCEncoder::ReadImage(run.Filename, image))
+        continue;
+
+      BCEncodeOptions options;
+      options.Format = run.Format;
+      BCEncoder::BenchmarkResult result;
+      if (!BCEncoder::Benchmark(image, options, 4, result))
+        continue;
+
+      std::string msg = std::string(run.Name) + ": " + std::to_string(result.PSNR) + " dB, " +
+        std::to_string(result.MegatexelsPerSecond) + " Mtexels/s (" +
+        std::to_string(result.SingleThreadMegatexelsPerSecond) + " on one thread), " +
+        std::to_string(result.SourceBytes) + " -> " + std::to_string(result.EncodedBytes) + " bytes\n";
+      ::OutputDebugStringA(msg.c_str());
+    }
+  }
+
   mTextures[woodCrateTex->Name] = std::move(woodCrateTex);
   mTextures[woodCrateTex2->Name] = std::move(woodCrateTex2);
 }
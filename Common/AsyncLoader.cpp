@@ -0,0 +1,229 @@
+//***************************************************************************************
+// AsyncLoader.cpp
+//***************************************************************************************
+
+#include "AsyncLoader.h"
+#include <algorithm>
+#include <fstream>
+
+namespace
+{
+    double ElapsedMs(std::chrono::high_resolution_clock::time_point t0,
+        std::chrono::high_resolution_clock::time_point t1)
+    {
+        return std::chrono::duration<double, std::milli>(t1 - t0).count();
+    }
+}
+
+AssetState AsyncRequest::GetState()const
+{
+    return (AssetState)mState.load();
+}
+
+bool AsyncRequest::IsDone()const
+{
+    AssetState state = GetState();
+    return state != AssetState::Queued && state != AssetState::Loading;
+}
+
+void AsyncRequest::Wait()const
+{
+    std::unique_lock<std::mutex> lock(mDoneMutex);
+    mDoneCV.wait(lock, [this]() { return IsDone(); });
+}
+
+bool AsyncRequest::Cancel()
+{
+    return Transition(AssetState::Queued, AssetState::Cancelled) ||
+           Transition(AssetState::Loading, AssetState::Cancelled);
+}
+
+double AsyncRequest::WaitMs()const
+{
+    std::lock_guard<std::mutex> lock(mDoneMutex);
+    return mWaitMs;
+}
+
+double AsyncRequest::LatencyMs()const
+{
+    std::lock_guard<std::mutex> lock(mDoneMutex);
+    return mLatencyMs;
+}
+
+bool AsyncRequest::Transition(AssetState from, AssetState to)
+{
+    {
+        std::lock_guard<std::mutex> lock(mDoneMutex);
+
+        int expected = (int)from;
+        if(!mState.compare_exchange_strong(expected, (int)to))
+            return false;
+    }
+
+    mDoneCV.notify_all();
+    return true;
+}
+
+AsyncLoader::AsyncLoader(unsigned numThreads)
+{
+    if(numThreads == 0)
+        numThreads = (std::max)(2u, std::thread::hardware_concurrency()) - 1;
+
+    for(unsigned i = 0; i < numThreads; ++i)
+        mWorkers.emplace_back(&AsyncLoader::WorkerMain, this);
+}
+
+AsyncLoader::~AsyncLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        for(auto& request : mQueue)
+            request->Cancel();
+        mShutdown = true;
+    }
+    mWorkCV.notify_all();
+
+    for(auto& worker : mWorkers)
+        worker.join();
+}
+
+AssetHandle<std::vector<BYTE>> AsyncLoader::LoadFile(const std::string& filename, AssetPriority priority)
+{
+    return Load<std::vector<BYTE>>([filename]() -> std::shared_ptr<std::vector<BYTE>>
+    {
+        std::ifstream fin(filename, std::ios::binary | std::ios::ate);
+        if(!fin)
+            return nullptr;
+
+        std::streamoff size = fin.tellg();
+        fin.seekg(0, std::ios::beg);
+
+        auto bytes = std::make_shared<std::vector<BYTE>>((size_t)size);
+        if(size > 0 && !fin.read(reinterpret_cast<char*>(bytes->data()), size))
+            return nullptr;
+
+        return bytes;
+    }, priority);
+}
+
+void AsyncLoader::WaitIdle()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mIdleCV.wait(lock, [this]() { return mQueue.empty() && mStats.Loading == 0; });
+}
+
+AsyncLoader::Stats AsyncLoader::GetStats()const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    Stats stats = mStats;
+
+    // Requests cancelled while queued stay in the heap until a thread pops them.
+    stats.QueueDepth = 0;
+    for(const auto& request : mQueue)
+    {
+        if(request->GetState() == AssetState::Cancelled)
+            ++stats.Cancelled;
+        else
+            ++stats.QueueDepth;
+    }
+
+    UINT finished = stats.Ready + stats.Failed;
+    if(finished > 0)
+    {
+        stats.AverageWaitMs = mTotalWaitMs / finished;
+        stats.AverageLatencyMs = mTotalLatencyMs / finished;
+    }
+
+    return stats;
+}
+
+bool AsyncLoader::RunsAfter(const std::shared_ptr<AsyncRequest>& a, const std::shared_ptr<AsyncRequest>& b)
+{
+    if(a->mPriority != b->mPriority)
+        return a->mPriority < b->mPriority;
+    return a->mSequence > b->mSequence;
+}
+
+void AsyncLoader::Enqueue(const std::shared_ptr<AsyncRequest>& request, AssetPriority priority)
+{
+    request->mPriority = priority;
+    request->mSubmitTime = AsyncRequest::Clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        request->mSequence = mNextSequence++;
+        mQueue.push_back(request);
+        std::push_heap(mQueue.begin(), mQueue.end(), RunsAfter);
+
+        mStats.MaxQueueDepth = (std::max)(mStats.MaxQueueDepth, (UINT)mQueue.size());
+    }
+
+    mWorkCV.notify_one();
+}
+
+void AsyncLoader::WorkerMain()
+{
+    for(;;)
+    {
+        std::shared_ptr<AsyncRequest> request;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWorkCV.wait(lock, [this]() { return mShutdown || !mQueue.empty(); });
+
+            if(mQueue.empty())
+                return;
+
+            std::pop_heap(mQueue.begin(), mQueue.end(), RunsAfter);
+            request = std::move(mQueue.back());
+            mQueue.pop_back();
+
+            // Cancelled while it was queued.
+            if(!request->Transition(AssetState::Queued, AssetState::Loading))
+            {
+                ++mStats.Cancelled;
+                if(mQueue.empty() && mStats.Loading == 0)
+                    mIdleCV.notify_all();
+                continue;
+            }
+
+            ++mStats.Loading;
+        }
+
+        auto start = AsyncRequest::Clock::now();
+        bool loaded = request->mRun();
+        auto end = AsyncRequest::Clock::now();
+
+        // Release whatever the load captured.
+        request->mRun = nullptr;
+
+        {
+            std::lock_guard<std::mutex> lock(request->mDoneMutex);
+            request->mWaitMs = ElapsedMs(request->mSubmitTime, start);
+            request->mLatencyMs = ElapsedMs(request->mSubmitTime, end);
+        }
+
+        bool finished = request->Transition(AssetState::Loading,
+            loaded ? AssetState::Ready : AssetState::Failed);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        --mStats.Loading;
+        if(!finished)
+        {
+            ++mStats.Cancelled;
+        }
+        else
+        {
+            ++(loaded ? mStats.Ready : mStats.Failed);
+
+            double latencyMs = ElapsedMs(request->mSubmitTime, end);
+            mTotalWaitMs += ElapsedMs(request->mSubmitTime, start);
+            mTotalLatencyMs += latencyMs;
+            mStats.MaxLatencyMs = (std::max)(mStats.MaxLatencyMs, latencyMs);
+        }
+
+        if(mQueue.empty() && mStats.Loading == 0)
+            mIdleCV.notify_all();
+    }
+}
@@ -0,0 +1,195 @@
+//***************************************************************************************
+// AsyncLoader.h
+//
+// Runs asset loads (models, texture files, ...) on a pool of background threads so an
+// app can keep rendering placeholders while they stream in.  A load is any function
+// that returns its asset; Load hands back a handle that can be polled, waited on or
+// cancelled.  Only file I/O and CPU work belong in a load: the D3D objects are created
+// on the render thread once the handle is ready.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class AssetPriority
+{
+    Low = 0,
+    Normal = 1,
+    High = 2,
+};
+
+enum class AssetState
+{
+    Queued,
+    Loading,
+    Ready,
+    Failed,
+    Cancelled,
+};
+
+///<summary>
+/// State shared between a handle and the thread running its load.
+///</summary>
+class AsyncRequest
+{
+public:
+    AssetState GetState()const;
+
+    // True once the request is Ready, Failed or Cancelled.
+    bool IsDone()const;
+
+    // Blocks until IsDone.
+    void Wait()const;
+
+    // A queued request is dropped without running.  A request that is already
+    // loading is marked Cancelled at once, and its result is thrown away when the
+    // load returns.  Returns false if the request was already done.
+    bool Cancel();
+
+    // Milliseconds from Load to the start of the load and to its end (0 until then).
+    double WaitMs()const;
+    double LatencyMs()const;
+
+private:
+    friend class AsyncLoader;
+    typedef std::chrono::high_resolution_clock Clock;
+
+    // Moves the request from one state to another and wakes any waiters.  Fails if
+    // it is no longer in the from state (e.g. it was cancelled meanwhile).
+    bool Transition(AssetState from, AssetState to);
+
+    std::atomic<int> mState{ (int)AssetState::Queued };
+
+    AssetPriority mPriority = AssetPriority::Normal;
+    UINT64 mSequence = 0;
+
+    Clock::time_point mSubmitTime;
+    double mWaitMs = 0.0;
+    double mLatencyMs = 0.0;
+
+    // Runs the load and stores its result; returns false if it failed.
+    std::function<bool()> mRun;
+
+    mutable std::mutex mDoneMutex;
+    mutable std::condition_variable mDoneCV;
+};
+
+///<summary>
+/// Typed view of a request.  Get returns the asset once the handle is Ready, and
+/// nullptr before then or if the load failed or was cancelled.
+///</summary>
+template<typename T>
+class AssetHandle
+{
+public:
+    AssetHandle() = default;
+
+    bool IsValid()const { return mRequest != nullptr; }
+    AssetState GetState()const { return mRequest ? mRequest->GetState() : AssetState::Failed; }
+    bool IsDone()const { return !mRequest || mRequest->IsDone(); }
+    bool IsReady()const { return GetState() == AssetState::Ready; }
+
+    void Wait()const { if(mRequest) mRequest->Wait(); }
+    bool Cancel() { return mRequest && mRequest->Cancel(); }
+
+    std::shared_ptr<T> Get()const { return IsReady() ? *mResult : nullptr; }
+
+    double WaitMs()const { return mRequest ? mRequest->WaitMs() : 0.0; }
+    double LatencyMs()const { return mRequest ? mRequest->LatencyMs() : 0.0; }
+
+private:
+    friend class AsyncLoader;
+
+    std::shared_ptr<AsyncRequest> mRequest;
+    std::shared_ptr<std::shared_ptr<T>> mResult;
+};
+
+class AsyncLoader
+{
+public:
+    struct Stats
+    {
+        UINT QueueDepth = 0;    // Waiting for a thread.
+        UINT MaxQueueDepth = 0;
+        UINT Loading = 0;       // Running right now.
+        UINT Ready = 0;
+        UINT Failed = 0;
+        UINT Cancelled = 0;
+
+        // Over the finished (Ready or Failed) loads: time spent queued, and time
+        // from Load to the asset being available.
+        double AverageWaitMs = 0.0;
+        double AverageLatencyMs = 0.0;
+        double MaxLatencyMs = 0.0;
+    };
+
+    // numThreads = 0 uses one thread per hardware thread, less one for rendering.
+    explicit AsyncLoader(unsigned numThreads = 0);
+    AsyncLoader(const AsyncLoader& rhs) = delete;
+    AsyncLoader& operator=(const AsyncLoader& rhs) = delete;
+
+    // Cancels whatever is still queued and joins the threads.
+    ~AsyncLoader();
+
+    // Queues load() to run on a loader thread.  Higher priorities run first, and
+    // requests of equal priority run in the order they were made.  load() returns
+    // nullptr to report a failure.
+    template<typename T>
+    AssetHandle<T> Load(std::function<std::shared_ptr<T>()> load, AssetPriority priority = AssetPriority::Normal)
+    {
+        AssetHandle<T> handle;
+        handle.mRequest = std::make_shared<AsyncRequest>();
+        handle.mResult = std::make_shared<std::shared_ptr<T>>();
+
+        std::shared_ptr<std::shared_ptr<T>> result = handle.mResult;
+        handle.mRequest->mRun = [result, load]()
+        {
+            *result = load();
+            return *result != nullptr;
+        };
+
+        Enqueue(handle.mRequest, priority);
+        return handle;
+    }
+
+    // Reads a whole file into memory, e.g. a .dds file to create the texture from.
+    AssetHandle<std::vector<BYTE>> LoadFile(const std::string& filename,
+        AssetPriority priority = AssetPriority::Normal);
+
+    // Blocks until nothing is queued or loading.
+    void WaitIdle();
+
+    Stats GetStats()const;
+
+private:
+    // Heap order for mQueue: the top is the highest priority, oldest request.
+    static bool RunsAfter(const std::shared_ptr<AsyncRequest>& a, const std::shared_ptr<AsyncRequest>& b);
+
+    void Enqueue(const std::shared_ptr<AsyncRequest>& request, AssetPriority priority);
+    void WorkerMain();
+
+    std::vector<std::thread> mWorkers;
+
+    mutable std::mutex mMutex;
+    std::condition_variable mWorkCV;
+    std::condition_variable mIdleCV;
+
+    // Kept as a heap ordered by priority, then sequence.
+    std::vector<std::shared_ptr<AsyncRequest>> mQueue;
+    UINT64 mNextSequence = 0;
+    bool mShutdown = false;
+
+    Stats mStats;
+    double mTotalWaitMs = 0.0;
+    double mTotalLatencyMs = 0.0;
+};
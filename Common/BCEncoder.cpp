@@ -0,0 +1,1044 @@
+//***************************************************************************************
+// BCEncoder.cpp
+//***************************************************************************************
+
+#include "BCEncoder.h"
+#include "ParallelFor.h"
+#include <DirectXMath.h>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+using namespace DirectX;
+
+namespace
+{
+    // One 4x4 block, texels in row-major order.
+    struct Block
+    {
+        uint8_t Rgba[16][4];
+    };
+
+    // The colors of a block as four texels per vector, one array per channel.
+    struct BlockColors
+    {
+        alignas(16) float R[16];
+        alignas(16) float G[16];
+        alignas(16) float B[16];
+
+        // 1, or 0 for texels that BC1 makes transparent.
+        alignas(16) float Weight[16];
+        UINT Count = 0;
+    };
+
+    // Copies a block out of the image, repeating the last row and column where the
+    // block hangs over the edge.
+    void GatherBlock(const BCImage& image, UINT bx, UINT by, Block& block)
+    {
+        for(UINT y = 0; y < 4; ++y)
+        {
+            const UINT sy = (std::min)(by*4 + y, image.Height - 1);
+            for(UINT x = 0; x < 4; ++x)
+            {
+                const UINT sx = (std::min)(bx*4 + x, image.Width - 1);
+                memcpy(block.Rgba[y*4 + x], &image.Rgba[(size_t(sy)*image.Width + sx)*4], 4);
+            }
+        }
+    }
+
+    void ScatterBlock(const Block& block, UINT bx, UINT by, BCImage& image)
+    {
+        for(UINT y = 0; y < 4 && by*4 + y < image.Height; ++y)
+        {
+            for(UINT x = 0; x < 4 && bx*4 + x < image.Width; ++x)
+            {
+                const size_t i = size_t(by*4 + y)*image.Width + bx*4 + x;
+                memcpy(&image.Rgba[i*4], block.Rgba[y*4 + x], 4);
+            }
+        }
+    }
+
+    //
+    // BC1 color blocks: two 5:6:5 endpoints and a 2-bit index per texel.
+    //
+
+    uint16_t To565(const float c[3])
+    {
+        const UINT r = UINT((std::min)((std::max)(c[0], 0.0f), 255.0f)*31.0f/255.0f + 0.5f);
+        const UINT g = UINT((std::min)((std::max)(c[1], 0.0f), 255.0f)*63.0f/255.0f + 0.5f);
+        const UINT b = UINT((std::min)((std::max)(c[2], 0.0f), 255.0f)*31.0f/255.0f + 0.5f);
+        return uint16_t((r << 11) | (g << 5) | b);
+    }
+
+    void From565(uint16_t c, int rgb[3])
+    {
+        const int r = (c >> 11) & 31;
+        const int g = (c >> 5) & 63;
+        const int b = c & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    // The colors a block's indices select.  In BC1, color0 <= color1 switches to
+    // three colors and transparent black; BC2 and BC3 always use four colors.
+    void ColorPalette(uint16_t c0, uint16_t c1, bool threeColor, int palette[4][4])
+    {
+        int a[3];
+        int b[3];
+        From565(c0, a);
+        From565(c1, b);
+
+        for(int i = 0; i < 3; ++i)
+        {
+            palette[0][i] = a[i];
+            palette[1][i] = b[i];
+            if(threeColor)
+            {
+                palette[2][i] = (a[i] + b[i])/2;
+                palette[3][i] = 0;
+            }
+            else
+            {
+                palette[2][i] = (2*a[i] + b[i])/3;
+                palette[3][i] = (a[i] + 2*b[i])/3;
+            }
+        }
+        palette[0][3] = palette[1][3] = palette[2][3] = 255;
+        palette[3][3] = threeColor ? 0 : 255;
+    }
+
+    void LoadColors(const Block& block, uint8_t alphaThreshold, BlockColors& c)
+    {
+        c.Count = 0;
+        for(UINT i = 0; i < 16; ++i)
+        {
+            c.R[i] = block.Rgba[i][0];
+            c.G[i] = block.Rgba[i][1];
+            c.B[i] = block.Rgba[i][2];
+            c.Weight[i] = block.Rgba[i][3] < alphaThreshold ? 0.0f : 1.0f;
+            c.Count += UINT(c.Weight[i]);
+        }
+    }
+
+    // Fits a line through the weighted colors along their principal axis, and
+    // returns where the outermost colors project onto it.
+    void FitLine(const BlockColors& c, float e0[3], float e1[3])
+    {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for(UINT i = 0; i < 16; ++i)
+        {
+            mean[0] += c.Weight[i]*c.R[i];
+            mean[1] += c.Weight[i]*c.G[i];
+            mean[2] += c.Weight[i]*c.B[i];
+        }
+        for(int k = 0; k < 3; ++k)
+            mean[k] /= float(c.Count);
+
+        // rr, rg, rb, gg, gb, bb
+        float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for(UINT i = 0; i < 16; ++i)
+        {
+            const float r = c.R[i] - mean[0];
+            const float g = c.G[i] - mean[1];
+            const float b = c.B[i] - mean[2];
+            const float w = c.Weight[i];
+            cov[0] += w*r*r;
+            cov[1] += w*r*g;
+            cov[2] += w*r*b;
+            cov[3] += w*g*g;
+            cov[4] += w*g*b;
+            cov[5] += w*b*b;
+        }
+
+        // Power iteration, starting from the column with the largest variance so the
+        // start is never orthogonal to the axis.
+        float axis[3];
+        if(cov[0] >= cov[3] && cov[0] >= cov[5])
+        {
+            axis[0] = cov[0]; axis[1] = cov[1]; axis[2] = cov[2];
+        }
+        else if(cov[3] >= cov[5])
+        {
+            axis[0] = cov[1]; axis[1] = cov[3]; axis[2] = cov[4];
+        }
+        else
+        {
+            axis[0] = cov[2]; axis[1] = cov[4]; axis[2] = cov[5];
+        }
+
+        for(int iteration = 0; iteration < 4; ++iteration)
+        {
+            const float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+            const float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+            const float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+            const float length = (std::max)((std::max)(std::fabs(x), std::fabs(y)), std::fabs(z));
+            if(length < FLT_EPSILON)
+                break;
+            axis[0] = x/length;
+            axis[1] = y/length;
+            axis[2] = z/length;
+        }
+
+        const float lengthSq = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+        if(lengthSq < FLT_EPSILON)
+        {
+            // One color.
+            for(int k = 0; k < 3; ++k)
+                e0[k] = e1[k] = mean[k];
+            return;
+        }
+
+        float tMin = FLT_MAX;
+        float tMax = -FLT_MAX;
+        for(UINT i = 0; i < 16; ++i)
+        {
+            if(c.Weight[i] == 0.0f)
+                continue;
+            const float t = (c.R[i] - mean[0])*axis[0] + (c.G[i] - mean[1])*axis[1] + (c.B[i] - mean[2])*axis[2];
+            tMin = (std::min)(tMin, t);
+            tMax = (std::max)(tMax, t);
+        }
+
+        for(int k = 0; k < 3; ++k)
+        {
+            e0[k] = mean[k] + axis[k]*tMax/lengthSq;
+            e1[k] = mean[k] + axis[k]*tMin/lengthSq;
+        }
+    }
+
+    // Picks the nearest palette color for each texel, four texels at a time, and
+    // returns the summed squared error.  Texels with zero weight get index 3, which
+    // is transparent in three-color mode.
+    float SelectIndices(const BlockColors& c, uint16_t c0, uint16_t c1, bool threeColor, uint8_t indices[16])
+    {
+        int palette[4][4];
+        ColorPalette(c0, c1, threeColor, palette);
+        const UINT numColors = threeColor ? 3 : 4;
+
+        XMVECTOR error = XMVectorZero();
+        for(UINT g = 0; g < 16; g += 4)
+        {
+            const XMVECTOR r = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(&c.R[g]));
+            const XMVECTOR gr = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(&c.G[g]));
+            const XMVECTOR b = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(&c.B[g]));
+            const XMVECTOR weight = XMLoadFloat4A(reinterpret_cast<const XMFLOAT4A*>(&c.Weight[g]));
+
+            XMVECTOR best = XMVectorReplicate(FLT_MAX);
+            XMVECTOR bestIndex = XMVectorZero();
+            for(UINT k = 0; k < numColors; ++k)
+            {
+                const XMVECTOR dr = XMVectorSubtract(r, XMVectorReplicate(float(palette[k][0])));
+                const XMVECTOR dg = XMVectorSubtract(gr, XMVectorReplicate(float(palette[k][1])));
+                const XMVECTOR db = XMVectorSubtract(b, XMVectorReplicate(float(palette[k][2])));
+                const XMVECTOR d = XMVectorMultiplyAdd(dr, dr, XMVectorMultiplyAdd(dg, dg, XMVectorMultiply(db, db)));
+
+                const XMVECTOR closer = XMVectorLess(d, best);
+                best = XMVectorSelect(best, d, closer);
+                bestIndex = XMVectorSelect(bestIndex, XMVectorReplicate(float(k)), closer);
+            }
+
+            error = XMVectorMultiplyAdd(best, weight, error);
+            bestIndex = XMVectorSelect(XMVectorReplicate(3.0f), bestIndex, XMVectorGreater(weight, XMVectorZero()));
+
+            XMFLOAT4A index;
+            XMStoreFloat4A(&index, bestIndex);
+            indices[g + 0] = uint8_t(index.x);
+            indices[g + 1] = uint8_t(index.y);
+            indices[g + 2] = uint8_t(index.z);
+            indices[g + 3] = uint8_t(index.w);
+        }
+
+        XMFLOAT4A sum;
+        XMStoreFloat4A(&sum, error);
+        return sum.x + sum.y + sum.z + sum.w;
+    }
+
+    // The endpoints that minimize the squared error for the indices chosen.
+    bool LeastSquares(const BlockColors& c, const uint8_t indices[16], bool threeColor, float e0[3], float e1[3])
+    {
+        static const float fourColorT[4] = { 0.0f, 1.0f, 1.0f/3.0f, 2.0f/3.0f };
+        static const float threeColorT[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+        const float* weights = threeColor ? threeColorT : fourColorT;
+
+        float aa = 0.0f;
+        float ab = 0.0f;
+        float bb = 0.0f;
+        float x0[3] = { 0.0f, 0.0f, 0.0f };
+        float x1[3] = { 0.0f, 0.0f, 0.0f };
+        for(UINT i = 0; i < 16; ++i)
+        {
+            if(c.Weight[i] == 0.0f)
+                continue;
+
+            const float t = weights[indices[i]];
+            const float s = 1.0f - t;
+            aa += s*s;
+            ab += s*t;
+            bb += t*t;
+
+            const float color[3] = { c.R[i], c.G[i], c.B[i] };
+            for(int k = 0; k < 3; ++k)
+            {
+                x0[k] += s*color[k];
+                x1[k] += t*color[k];
+            }
+        }
+
+        const float det = aa*bb - ab*ab;
+        if(std::fabs(det) < 1e-6f)
+            return false;
+
+        for(int k = 0; k < 3; ++k)
+        {
+            e0[k] = (bb*x0[k] - ab*x1[k])/det;
+            e1[k] = (aa*x1[k] - ab*x0[k])/det;
+        }
+        return true;
+    }
+
+    // Orders the endpoints for the mode the decoder will pick, remapping the
+    // indices to match, and packs the block.
+    void WriteColorBlock(uint16_t c0, uint16_t c1, uint8_t indices[16], bool threeColor, uint8_t* out)
+    {
+        if(threeColor)
+        {
+            if(c0 > c1)
+            {
+                std::swap(c0, c1);
+                for(UINT i = 0; i < 16; ++i)
+                {
+                    if(indices[i] < 2)
+                        indices[i] ^= 1;
+                }
+            }
+        }
+        else if(c0 < c1)
+        {
+            // Swapping the ends swaps the two thirds as well.
+            std::swap(c0, c1);
+            for(UINT i = 0; i < 16; ++i)
+                indices[i] ^= 1;
+        }
+        else if(c0 == c1)
+        {
+            // Reads as three-color mode, where only the first two entries are c0.
+            memset(indices, 0, 16);
+        }
+
+        uint32_t bits = 0;
+        for(UINT i = 0; i < 16; ++i)
+            bits |= uint32_t(indices[i]) << (2*i);
+
+        memcpy(out, &c0, 2);
+        memcpy(out + 2, &c1, 2);
+        memcpy(out + 4, &bits, 4);
+    }
+
+    // Texels with alpha below alphaThreshold are made transparent, which takes the
+    // three-color mode; BC3 passes 0.
+    void EncodeColorBlock(const Block& block, uint8_t alphaThreshold, bool refine, uint8_t* out)
+    {
+        BlockColors c;
+        LoadColors(block, alphaThreshold, c);
+
+        uint8_t indices[16];
+        if(c.Count == 0)
+        {
+            memset(indices, 3, sizeof(indices));
+            WriteColorBlock(0, 0, indices, true, out);
+            return;
+        }
+
+        const bool threeColor = c.Count < 16;
+
+        float e0[3];
+        float e1[3];
+        FitLine(c, e0, e1);
+        uint16_t c0 = To565(e0);
+        uint16_t c1 = To565(e1);
+        float error = SelectIndices(c, c0, c1, threeColor, indices);
+
+        for(int iteration = 0; refine && iteration < 2 && error > 0.0f; ++iteration)
+        {
+            if(!LeastSquares(c, indices, threeColor, e0, e1))
+                break;
+
+            const uint16_t n0 = To565(e0);
+            const uint16_t n1 = To565(e1);
+            if(n0 == c0 && n1 == c1)
+                break;
+
+            uint8_t newIndices[16];
+            const float newError = SelectIndices(c, n0, n1, threeColor, newIndices);
+            if(newError >= error)
+                break;
+
+            c0 = n0;
+            c1 = n1;
+            error = newError;
+            memcpy(indices, newIndices, sizeof(indices));
+        }
+
+        WriteColorBlock(c0, c1, indices, threeColor, out);
+    }
+
+    void DecodeColorBlock(const uint8_t* in, bool alwaysFourColor, Block& block)
+    {
+        uint16_t c0;
+        uint16_t c1;
+        uint32_t bits;
+        memcpy(&c0, in, 2);
+        memcpy(&c1, in + 2, 2);
+        memcpy(&bits, in + 4, 4);
+
+        int palette[4][4];
+        ColorPalette(c0, c1, !alwaysFourColor && c0 <= c1, palette);
+        for(UINT i = 0; i < 16; ++i)
+        {
+            const int* color = palette[(bits >> (2*i)) & 3];
+            for(int k = 0; k < 4; ++k)
+                block.Rgba[i][k] = uint8_t(color[k]);
+        }
+    }
+
+    //
+    // BC4 blocks, which BC3 uses for alpha and BC5 for each channel: two 8-bit
+    // endpoints and a 3-bit index per texel.
+    //
+
+    void SingleChannelPalette(int a0, int a1, int palette[8])
+    {
+        palette[0] = a0;
+        palette[1] = a1;
+        if(a0 > a1)
+        {
+            for(int i = 2; i < 8; ++i)
+                palette[i] = ((8 - i)*a0 + (i - 1)*a1 + 3)/7;
+        }
+        else
+        {
+            for(int i = 2; i < 6; ++i)
+                palette[i] = ((6 - i)*a0 + (i - 1)*a1 + 2)/5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    int SelectSingleChannelIndices(const uint8_t values[16], int a0, int a1, uint8_t indices[16])
+    {
+        int palette[8];
+        SingleChannelPalette(a0, a1, palette);
+
+        int error = 0;
+        for(UINT i = 0; i < 16; ++i)
+        {
+            int best = INT_MAX;
+            for(int k = 0; k < 8; ++k)
+            {
+                const int d = (values[i] - palette[k])*(values[i] - palette[k]);
+                if(d < best)
+                {
+                    best = d;
+                    indices[i] = uint8_t(k);
+                }
+            }
+            error += best;
+        }
+        return error;
+    }
+
+    // The eight-value mode endpoints that minimize the squared error for the
+    // indices chosen.
+    bool SingleChannelLeastSquares(const uint8_t values[16], const uint8_t indices[16], int& a0, int& a1)
+    {
+        static const float weights[8] = { 0.0f, 1.0f, 1.0f/7.0f, 2.0f/7.0f, 3.0f/7.0f, 4.0f/7.0f, 5.0f/7.0f, 6.0f/7.0f };
+
+        float aa = 0.0f;
+        float ab = 0.0f;
+        float bb = 0.0f;
+        float x0 = 0.0f;
+        float x1 = 0.0f;
+        for(UINT i = 0; i < 16; ++i)
+        {
+            const float t = weights[indices[i]];
+            const float s = 1.0f - t;
+            aa += s*s;
+            ab += s*t;
+            bb += t*t;
+            x0 += s*values[i];
+            x1 += t*values[i];
+        }
+
+        const float det = aa*bb - ab*ab;
+        if(std::fabs(det) < 1e-6f)
+            return false;
+
+        a0 = (std::min)((std::max)(int((bb*x0 - ab*x1)/det + 0.5f), 0), 255);
+        a1 = (std::min)((std::max)(int((aa*x1 - ab*x0)/det + 0.5f), 0), 255);
+        return a0 > a1;
+    }
+
+    void EncodeSingleChannelBlock(const uint8_t values[16], bool refine, uint8_t* out)
+    {
+        int lo = 255;
+        int hi = 0;
+        for(UINT i = 0; i < 16; ++i)
+        {
+            lo = std::min<int>(lo, values[i]);
+            hi = std::max<int>(hi, values[i]);
+        }
+
+        // Eight values across the block's range...
+        uint8_t indices[16];
+        int a0 = hi;
+        int a1 = lo;
+        int error = SelectSingleChannelIndices(values, a0, a1, indices);
+
+        for(int iteration = 0; refine && iteration < 2 && error > 0 && a0 > a1; ++iteration)
+        {
+            int n0;
+            int n1;
+            if(!SingleChannelLeastSquares(values, indices, n0, n1) || (n0 == a0 && n1 == a1))
+                break;
+
+            uint8_t newIndices[16];
+            const int newError = SelectSingleChannelIndices(values, n0, n1, newIndices);
+            if(newError >= error)
+                break;
+
+            a0 = n0;
+            a1 = n1;
+            error = newError;
+            memcpy(indices, newIndices, sizeof(indices));
+        }
+
+        // ...or six across the range of what is not exactly 0 or 255, which that
+        // mode has as extra entries.
+        if(error > 0)
+        {
+            int innerLo = 255;
+            int innerHi = 0;
+            for(UINT i = 0; i < 16; ++i)
+            {
+                if(values[i] != 0 && values[i] != 255)
+                {
+                    innerLo = std::min<int>(innerLo, values[i]);
+                    innerHi = std::max<int>(innerHi, values[i]);
+                }
+            }
+
+            if(innerLo <= innerHi)
+            {
+                uint8_t sixIndices[16];
+                const int sixError = SelectSingleChannelIndices(values, innerLo, innerHi, sixIndices);
+                if(sixError < error)
+                {
+                    a0 = innerLo;
+                    a1 = innerHi;
+                    memcpy(indices, sixIndices, sizeof(indices));
+                }
+            }
+        }
+
+        uint64_t bits = 0;
+        for(UINT i = 0; i < 16; ++i)
+            bits |= uint64_t(indices[i]) << (3*i);
+
+        out[0] = uint8_t(a0);
+        out[1] = uint8_t(a1);
+        for(UINT i = 0; i < 6; ++i)
+            out[2 + i] = uint8_t(bits >> (8*i));
+    }
+
+    void DecodeSingleChannelBlock(const uint8_t* in, uint8_t values[16])
+    {
+        int palette[8];
+        SingleChannelPalette(in[0], in[1], palette);
+
+        uint64_t bits = 0;
+        for(UINT i = 0; i < 6; ++i)
+            bits |= uint64_t(in[2 + i]) << (8*i);
+
+        for(UINT i = 0; i < 16; ++i)
+            values[i] = uint8_t(palette[(bits >> (3*i)) & 7]);
+    }
+
+    size_t BlockBytes(BCFormat format)
+    {
+        return format == BCFormat::BC1 ? 8 : 16;
+    }
+
+    void EncodeBlock(const Block& block, const BCEncodeOptions& options, uint8_t* out)
+    {
+        uint8_t values[16];
+        switch(options.Format)
+        {
+        case BCFormat::BC1:
+            EncodeColorBlock(block, options.AlphaThreshold, options.Refine, out);
+            break;
+
+        case BCFormat::BC3:
+            for(UINT i = 0; i < 16; ++i)
+                values[i] = block.Rgba[i][3];
+            EncodeSingleChannelBlock(values, options.Refine, out);
+            EncodeColorBlock(block, 0, options.Refine, out + 8);
+            break;
+
+        case BCFormat::BC5:
+            for(UINT k = 0; k < 2; ++k)
+            {
+                for(UINT i = 0; i < 16; ++i)
+                    values[i] = block.Rgba[i][k];
+                EncodeSingleChannelBlock(values, options.Refine, out + 8*k);
+            }
+            break;
+        }
+    }
+
+    float SrgbToLinear(float c)
+    {
+        return c <= 0.04045f ? c/12.92f : std::pow((c + 0.055f)/1.055f, 2.4f);
+    }
+
+    float LinearToSrgb(float c)
+    {
+        return c <= 0.0031308f ? 12.92f*c : 1.055f*std::pow(c, 1.0f/2.4f) - 0.055f;
+    }
+
+    uint32_t ReadU32(const uint8_t* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    uint16_t ReadU16(const uint8_t* p)
+    {
+        uint16_t v;
+        memcpy(&v, p, 2);
+        return v;
+    }
+
+    // Uncompressed 24- and 32-bit .bmp files, bottom-up or top-down.
+    bool ReadBitmap(const uint8_t* data, size_t size, BCImage& image)
+    {
+        const size_t fileHeaderSize = 14;
+        if(size < fileHeaderSize + 40 || data[0] != 'B' || data[1] != 'M')
+            return false;
+
+        const uint32_t offBits = ReadU32(data + 10);
+        const uint8_t* info = data + fileHeaderSize;
+        const int32_t width = int32_t(ReadU32(info + 4));
+        const int32_t height = int32_t(ReadU32(info + 8));
+        const uint16_t bitCount = ReadU16(info + 14);
+        const uint32_t compression = ReadU32(info + 16);
+
+        // BI_RGB, or BI_BITFIELDS with the usual BGRA masks.
+        if(width <= 0 || height == 0 || (bitCount != 24 && bitCount != 32) ||
+           (compression != 0 && !(compression == 3 && bitCount == 32)))
+            return false;
+
+        const UINT w = UINT(width);
+        const UINT h = UINT(height < 0 ? -height : height);
+        if(w > 16384 || h > 16384)
+            return false;
+
+        const size_t bytesPerTexel = bitCount/8;
+        const size_t rowBytes = (w*bytesPerTexel + 3) & ~size_t(3);
+        if(offBits > size || size - offBits < rowBytes*h)
+            return false;
+
+        image.Width = w;
+        image.Height = h;
+        image.Rgba.resize(size_t(w)*h*4);
+
+        bool anyAlpha = false;
+        for(UINT y = 0; y < h; ++y)
+        {
+            const UINT row = height < 0 ? y : h - 1 - y;
+            const uint8_t* src = data + offBits + rowBytes*row;
+            uint8_t* dest = &image.Rgba[size_t(y)*w*4];
+            for(UINT x = 0; x < w; ++x)
+            {
+                dest[4*x + 0] = src[x*bytesPerTexel + 2];
+                dest[4*x + 1] = src[x*bytesPerTexel + 1];
+                dest[4*x + 2] = src[x*bytesPerTexel + 0];
+                dest[4*x + 3] = bytesPerTexel == 4 ? src[x*bytesPerTexel + 3] : 255;
+                anyAlpha |= dest[4*x + 3] != 0;
+            }
+        }
+
+        // Most 32-bit bitmaps leave the fourth byte at 0 rather than storing alpha.
+        if(!anyAlpha)
+        {
+            for(size_t i = 3; i < image.Rgba.size(); i += 4)
+                image.Rgba[i] = 255;
+        }
+
+        return true;
+    }
+}
+
+DXGI_FORMAT BCEncoder::GetFormat(BCFormat format, bool srgb)
+{
+    switch(format)
+    {
+    case BCFormat::BC1:
+        return srgb ? DXGI_FORMAT_BC1_UNORM_SRGB : DXGI_FORMAT_BC1_UNORM;
+    case BCFormat::BC3:
+        return srgb ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC3_UNORM;
+    case BCFormat::BC5:
+        return DXGI_FORMAT_BC5_UNORM;
+    }
+    return DXGI_FORMAT_UNKNOWN;
+}
+
+bool BCEncoder::ReadImage(const std::wstring& filename, BCImage& image)
+{
+    DDSReader dds;
+    if(SUCCEEDED(dds.Open(filename)))
+    {
+        const DDSTextureDesc& desc = dds.GetDesc();
+        if(desc.Dimension != DDS_DIMENSION_TEXTURE2D)
+            return false;
+
+        const DDSSubresource& top = dds.GetSubresources()[0];
+        const UINT w = UINT(desc.Width);
+        const UINT h = UINT(desc.Height);
+
+        bool swizzle = false;
+        bool opaque = false;
+        switch(desc.Format)
+        {
+        case DXGI_FORMAT_R8G8B8A8_UNORM:
+        case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+            break;
+
+        case DXGI_FORMAT_B8G8R8A8_UNORM:
+        case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+            swizzle = true;
+            break;
+
+        case DXGI_FORMAT_B8G8R8X8_UNORM:
+        case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+            swizzle = true;
+            opaque = true;
+            break;
+
+        default:
+            return DecodeImage(top.Data, desc.Format, w, h, image);
+        }
+
+        image.Width = w;
+        image.Height = h;
+        image.Rgba.resize(size_t(w)*h*4);
+        for(UINT y = 0; y < h; ++y)
+        {
+            const uint8_t* src = top.Data + top.RowBytes*y;
+            uint8_t* dest = &image.Rgba[size_t(y)*w*4];
+            memcpy(dest, src, size_t(w)*4);
+            for(UINT x = 0; x < w; ++x)
+            {
+                if(swizzle)
+                    std::swap(dest[4*x + 0], dest[4*x + 2]);
+                if(opaque)
+                    dest[4*x + 3] = 255;
+            }
+        }
+        return true;
+    }
+
+    MappedFile file;
+    if(!file.Open(filename) || file.Data() == nullptr)
+        return false;
+
+    return ReadBitmap(file.Data(), file.Size(), image);
+}
+
+void BCEncoder::GenerateMips(const BCImage& image, bool srgb, UINT mipLevels,
+    std::vector<BCImage>& mips, unsigned numThreads)
+{
+    mips.clear();
+    mips.push_back(image);
+
+    float toLinear[256];
+    for(int i = 0; i < 256; ++i)
+        toLinear[i] = SrgbToLinear(i/255.0f);
+
+    while((mipLevels == 0 || mips.size() < mipLevels) && (mips.back().Width > 1 || mips.back().Height > 1))
+    {
+        const BCImage& src = mips.back();
+
+        BCImage dest;
+        dest.Width = (std::max)(src.Width/2, 1u);
+        dest.Height = (std::max)(src.Height/2, 1u);
+        dest.Rgba.resize(size_t(dest.Width)*dest.Height*4);
+
+        ParallelFor(dest.Height, 16, [&](size_t begin, size_t end)
+        {
+            for(size_t y = begin; y < end; ++y)
+            {
+                const size_t y0 = std::min<size_t>(2*y, src.Height - 1);
+                const size_t y1 = std::min<size_t>(2*y + 1, src.Height - 1);
+                for(size_t x = 0; x < dest.Width; ++x)
+                {
+                    const size_t x0 = std::min<size_t>(2*x, src.Width - 1);
+                    const size_t x1 = std::min<size_t>(2*x + 1, src.Width - 1);
+                    const uint8_t* t[4] =
+                    {
+                        &src.Rgba[(y0*src.Width + x0)*4],
+                        &src.Rgba[(y0*src.Width + x1)*4],
+                        &src.Rgba[(y1*src.Width + x0)*4],
+                        &src.Rgba[(y1*src.Width + x1)*4],
+                    };
+
+                    uint8_t* d = &dest.Rgba[(y*dest.Width + x)*4];
+                    for(int k = 0; k < 4; ++k)
+                    {
+                        if(srgb && k < 3)
+                        {
+                            const float linear = 0.25f*(toLinear[t[0][k]] + toLinear[t[1][k]] + toLinear[t[2][k]] + toLinear[t[3][k]]);
+                            d[k] = uint8_t((std::min)((std::max)(LinearToSrgb(linear), 0.0f), 1.0f)*255.0f + 0.5f);
+                        }
+                        else
+                        {
+                            d[k] = uint8_t((t[0][k] + t[1][k] + t[2][k] + t[3][k] + 2)/4);
+                        }
+                    }
+                }
+            }
+        }, numThreads);
+
+        mips.push_back(std::move(dest));
+    }
+}
+
+void BCEncoder::EncodeImage(const BCImage& image, const BCEncodeOptions& options,
+    std::vector<uint8_t>& blocks)
+{
+    const UINT blocksWide = (std::max)((image.Width + 3)/4, 1u);
+    const UINT blocksHigh = (std::max)((image.Height + 3)/4, 1u);
+    const size_t blockBytes = BlockBytes(options.Format);
+    blocks.resize(size_t(blocksWide)*blocksHigh*blockBytes);
+
+    ParallelFor(blocksHigh, 4, [&](size_t begin, size_t end)
+    {
+        Block block;
+        for(size_t by = begin; by < end; ++by)
+        {
+            for(UINT bx = 0; bx < blocksWide; ++bx)
+            {
+                GatherBlock(image, bx, UINT(by), block);
+                EncodeBlock(block, options, &blocks[(by*blocksWide + bx)*blockBytes]);
+            }
+        }
+    }, options.NumThreads);
+}
+
+bool BCEncoder::DecodeImage(const uint8_t* blocks, DXGI_FORMAT format, UINT width, UINT height,
+    BCImage& image)
+{
+    size_t blockBytes = 16;
+    switch(format)
+    {
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+        blockBytes = 8;
+        break;
+    case DXGI_FORMAT_BC2_UNORM:
+    case DXGI_FORMAT_BC2_UNORM_SRGB:
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+    case DXGI_FORMAT_BC5_UNORM:
+        break;
+    default:
+        return false;
+    }
+
+    image.Width = width;
+    image.Height = height;
+    image.Rgba.resize(size_t(width)*height*4);
+
+    const UINT blocksWide = (std::max)((width + 3)/4, 1u);
+    const UINT blocksHigh = (std::max)((height + 3)/4, 1u);
+    for(UINT by = 0; by < blocksHigh; ++by)
+    {
+        for(UINT bx = 0; bx < blocksWide; ++bx)
+        {
+            const uint8_t* in = blocks + (size_t(by)*blocksWide + bx)*blockBytes;
+
+            Block block;
+            uint8_t values[16];
+            switch(format)
+            {
+            case DXGI_FORMAT_BC1_UNORM:
+            case DXGI_FORMAT_BC1_UNORM_SRGB:
+                DecodeColorBlock(in, false, block);
+                break;
+
+            case DXGI_FORMAT_BC2_UNORM:
+            case DXGI_FORMAT_BC2_UNORM_SRGB:
+                DecodeColorBlock(in + 8, true, block);
+                for(UINT i = 0; i < 16; ++i)
+                    block.Rgba[i][3] = uint8_t(((in[i/2] >> (4*(i & 1))) & 0xF)*17);
+                break;
+
+            case DXGI_FORMAT_BC3_UNORM:
+            case DXGI_FORMAT_BC3_UNORM_SRGB:
+                DecodeColorBlock(in + 8, true, block);
+                DecodeSingleChannelBlock(in, values);
+                for(UINT i = 0; i < 16; ++i)
+                    block.Rgba[i][3] = values[i];
+                break;
+
+            default:
+                for(UINT k = 0; k < 2; ++k)
+                {
+                    DecodeSingleChannelBlock(in + 8*k, values);
+                    for(UINT i = 0; i < 16; ++i)
+                        block.Rgba[i][k] = values[i];
+                }
+                for(UINT i = 0; i < 16; ++i)
+                {
+                    block.Rgba[i][2] = 0;
+                    block.Rgba[i][3] = 255;
+                }
+                break;
+            }
+
+            ScatterBlock(block, bx, by, image);
+        }
+    }
+
+    return true;
+}
+
+bool BCEncoder::Encode(const BCImage& image, const BCEncodeOptions& options,
+    std::vector<uint8_t>& ddsData, Stats* stats)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    if(image.Width == 0 || image.Height == 0 || image.Width > 16384 || image.Height > 16384 ||
+       image.Rgba.size() != size_t(image.Width)*image.Height*4)
+        return false;
+
+    if(options.SRGB && options.Format == BCFormat::BC5)
+        return false;
+
+    Stats s;
+
+    auto start = Clock::now();
+    std::vector<BCImage> mips;
+    GenerateMips(image, options.SRGB, options.MipLevels, mips, options.NumThreads);
+    s.MipMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    // The levels follow each other in the file, largest first.
+    start = Clock::now();
+    std::vector<uint8_t> texels;
+    std::vector<uint8_t> blocks;
+    for(const BCImage& mip : mips)
+    {
+        EncodeImage(mip, options, blocks);
+        texels.insert(texels.end(), blocks.begin(), blocks.end());
+
+        s.Texels += UINT64(mip.Width)*mip.Height;
+    }
+    s.EncodeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    DDSTextureDesc desc;
+    desc.Dimension = DDS_DIMENSION_TEXTURE2D;
+    desc.Format = GetFormat(options.Format, options.SRGB);
+    desc.Width = image.Width;
+    desc.Height = image.Height;
+    desc.Depth = 1;
+    desc.MipLevels = mips.size();
+    desc.ArraySize = 1;
+    WriteDDS(desc, texels.data(), texels.size(), ddsData);
+
+    s.MipLevels = UINT(mips.size());
+    s.SourceBytes = s.Texels*4;
+    s.EncodedBytes = texels.size();
+    if(stats != nullptr)
+        *stats = s;
+
+    return true;
+}
+
+double BCEncoder::PSNR(const BCImage& reference, const BCImage& image, BCFormat format)
+{
+    if(reference.Width != image.Width || reference.Height != image.Height ||
+       reference.Rgba.size() != image.Rgba.size() || reference.Rgba.empty())
+        return 0.0;
+
+    const int channels = format == BCFormat::BC1 ? 3 : (format == BCFormat::BC3 ? 4 : 2);
+
+    double sum = 0.0;
+    for(size_t i = 0; i < reference.Rgba.size(); i += 4)
+    {
+        for(int k = 0; k < channels; ++k)
+        {
+            const double d = double(reference.Rgba[i + k]) - double(image.Rgba[i + k]);
+            sum += d*d;
+        }
+    }
+
+    const double mse = sum/(double(reference.Rgba.size()/4)*channels);
+    if(mse == 0.0)
+        return std::numeric_limits<double>::infinity();
+
+    return 10.0*std::log10(255.0*255.0/mse);
+}
+
+bool BCEncoder::Benchmark(const BCImage& image, const BCEncodeOptions& options,
+    UINT iterations, BenchmarkResult& result)
+{
+    result = BenchmarkResult();
+    iterations = (std::max)(iterations, 1u);
+
+    BCEncodeOptions singleThread = options;
+    singleThread.NumThreads = 1;
+
+    std::vector<uint8_t> ddsData;
+    Stats stats;
+    double ms = 0.0;
+    double singleThreadMs = 0.0;
+    for(UINT i = 0; i < iterations; ++i)
+    {
+        if(!Encode(image, options, ddsData, &stats))
+            return false;
+        ms += stats.EncodeMs;
+    }
+    for(UINT i = 0; i < iterations; ++i)
+    {
+        if(!Encode(image, singleThread, ddsData, &stats))
+            return false;
+        singleThreadMs += stats.EncodeMs;
+    }
+
+    const double megatexels = double(stats.Texels)*iterations/1e6;
+    result.MegatexelsPerSecond = ms > 0.0 ? megatexels/(ms/1000.0) : 0.0;
+    result.SingleThreadMegatexelsPerSecond = singleThreadMs > 0.0 ? megatexels/(singleThreadMs/1000.0) : 0.0;
+    result.SourceBytes = stats.SourceBytes;
+    result.EncodedBytes = stats.EncodedBytes;
+
+    DDSReader dds;
+    if(FAILED(dds.Parse(ddsData.data(), ddsData.size())))
+        return false;
+
+    const DDSTextureDesc& desc = dds.GetDesc();
+    result.Readable = desc.Format == GetFormat(options.Format, options.SRGB) &&
+        desc.Width == image.Width && desc.Height == image.Height &&
+        desc.MipLevels == stats.MipLevels && dds.GetDataSize() == stats.EncodedBytes;
+
+    BCImage decoded;
+    if(!DecodeImage(dds.GetSubresources()[0].Data, desc.Format, image.Width, image.Height, decoded))
+        return false;
+
+    result.PSNR = PSNR(image, decoded, options.Format);
+    return result.Readable;
+}
@@ -0,0 +1,120 @@
+//***************************************************************************************
+// BCEncoder.h
+//
+// Compresses RGBA8 images to BC1, BC3 or BC5 on the CPU, builds their mip chains, and
+// writes .dds files that DDSTextureLoader reads.  Against 32-bit texels, BC1 takes an
+// eighth of the memory and BC3 and BC5 a quarter.  BC1 keeps 1-bit alpha, BC3 keeps
+// full alpha, and BC5 keeps two channels, e.g. the x and y of a normal map.
+//
+// Blocks are independent, so rows of blocks are spread over worker threads.  Within
+// a block, color indices are chosen four texels at a time with DirectXMath vectors.
+// A decoder is included, so the quality can be measured as PSNR against the source.
+//***************************************************************************************
+
+#pragma once
+
+#include "DDSReader.h"
+#include <string>
+#include <vector>
+
+enum class BCFormat
+{
+    BC1, // RGB and 1-bit alpha, 8 bytes per 4x4 block.
+    BC3, // RGBA, 16 bytes per block.
+    BC5, // RG, 16 bytes per block.
+};
+
+// An uncompressed image: 4 bytes per texel in RGBA order, rows tightly packed.
+struct BCImage
+{
+    UINT Width = 0;
+    UINT Height = 0;
+    std::vector<uint8_t> Rgba;
+};
+
+struct BCEncodeOptions
+{
+    BCFormat Format = BCFormat::BC1;
+
+    // Writes the _SRGB format and averages mips in linear space.  BC1 and BC3 only.
+    bool SRGB = false;
+
+    // 0 builds the full chain down to 1x1; 1 keeps just the top level.
+    UINT MipLevels = 0;
+
+    // BC1 only: texels with alpha below this are made transparent.  0 keeps every
+    // texel opaque, for images whose alpha is not coverage.
+    uint8_t AlphaThreshold = 128;
+
+    // Refits endpoints by least squares to the indices first chosen.
+    bool Refine = true;
+
+    // 0 uses one thread per hardware thread.
+    unsigned NumThreads = 0;
+};
+
+class BCEncoder
+{
+public:
+    struct Stats
+    {
+        UINT MipLevels = 0;
+        UINT64 Texels = 0;       // Over all mips.
+        UINT64 SourceBytes = 0;  // RGBA8 bytes over all mips.
+        UINT64 EncodedBytes = 0; // Block bytes over all mips.
+        double MipMs = 0.0;
+        double EncodeMs = 0.0;
+    };
+
+    struct BenchmarkResult
+    {
+        // Of the top mip, decoded from the .dds output, against the source.
+        double PSNR = 0.0;
+
+        // Encoding only, mip generation excluded.
+        double MegatexelsPerSecond = 0.0;
+        double SingleThreadMegatexelsPerSecond = 0.0;
+
+        UINT64 SourceBytes = 0;
+        UINT64 EncodedBytes = 0;
+
+        // DDSReader took the output with the format and mip count that were asked for.
+        bool Readable = false;
+    };
+
+    static DXGI_FORMAT GetFormat(BCFormat format, bool srgb);
+
+    // Reads 24- and 32-bit uncompressed .bmp files, and the top mip of .dds files in
+    // R8G8B8A8, B8G8R8A8, B8G8R8X8, BC1, BC2, BC3 or BC5, decoding block-compressed
+    // ones, so existing textures can be re-encoded.
+    static bool ReadImage(const std::wstring& filename, BCImage& image);
+
+    // Fills mips with the image followed by each level halved, by a 2x2 box filter,
+    // down to 1x1 or mipLevels levels (0 for all).  With srgb, colors are averaged in
+    // linear space.
+    static void GenerateMips(const BCImage& image, bool srgb, UINT mipLevels,
+        std::vector<BCImage>& mips, unsigned numThreads = 0);
+
+    // Encodes one level.  The blocks are in row-major order; blocks that hang over
+    // the edge repeat the last row and column.
+    static void EncodeImage(const BCImage& image, const BCEncodeOptions& options,
+        std::vector<uint8_t>& blocks);
+
+    // Decodes BC1, BC2, BC3 or BC5 blocks (either color space).  Returns false for
+    // other formats.
+    static bool DecodeImage(const uint8_t* blocks, DXGI_FORMAT format, UINT width, UINT height,
+        BCImage& image);
+
+    // Builds the mips, encodes them, and wraps them in a .dds file.
+    static bool Encode(const BCImage& image, const BCEncodeOptions& options,
+        std::vector<uint8_t>& ddsData, Stats* stats = nullptr);
+
+    // Over the channels the format keeps: RGB for BC1, RGBA for BC3, RG for BC5.
+    // Infinite when the images match.
+    static double PSNR(const BCImage& reference, const BCImage& image, BCFormat format);
+
+    // Encodes the image iterations times on all threads, then on one, and checks the
+    // output reads back.
+    static bool Benchmark(const BCImage& image, const BCEncodeOptions& options,
+        UINT iterations, BenchmarkResult& result);
+};
@@ -0,0 +1,1165 @@
+//***************************************************************************************
+// DDSReader.cpp
+//***************************************************************************************
+
+#include "DDSReader.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+
+using namespace DirectX;
+
+namespace
+{
+    // The Direct3D 12 resource limits (D3D12_REQ_*), so that the reader does not need
+    // d3d12.h.  For security we don't trust DDS file metadata larger than these.
+    const size_t MaxMipLevels = 15;
+    const size_t MaxTexture1DSize = 16384;
+    const size_t MaxTexture1DArraySize = 2048;
+    const size_t MaxTexture2DSize = 16384;
+    const size_t MaxTexture2DArraySize = 2048;
+    const size_t MaxTextureCubeSize = 16384;
+    const size_t MaxTexture3DSize = 2048;
+
+    bool HasDX10Header(const DDS_HEADER* header)
+    {
+        return (header->ddspf.flags & DDS_FOURCC) &&
+               (MAKEFOURCC('D', 'X', '1', '0') == header->ddspf.fourCC);
+    }
+
+    // DDS_HEADER flags and caps for what WriteDDS writes.
+    const uint32_t DDSD_CAPS = 0x00000001;
+    const uint32_t DDSD_PIXELFORMAT = 0x00001000;
+    const uint32_t DDSD_MIPMAPCOUNT = 0x00020000;
+    const uint32_t DDSCAPS_COMPLEX = 0x00000008;
+    const uint32_t DDSCAPS_TEXTURE = 0x00001000;
+    const uint32_t DDSCAPS_MIPMAP = 0x00400000;
+
+    uint64_t AlignUp(uint64_t value, uint64_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+    // Pads each row out to its placed pitch.  When the pitches agree the whole slice
+    // goes in one memcpy.
+    void CopyRows(uint8_t* dest, const DDSPlacedSubresource& to, const DDSSubresource& from)
+    {
+        for(size_t z = 0; z < from.Depth; ++z)
+        {
+            uint8_t* destSlice = dest + to.Offset + uint64_t(to.RowPitch) * to.NumRows * z;
+            const uint8_t* srcSlice = from.Data + from.SliceBytes * z;
+            if(to.RowPitch == from.RowBytes)
+            {
+                memcpy(destSlice, srcSlice, from.SliceBytes);
+                continue;
+            }
+
+            for(size_t y = 0; y < from.NumRows; ++y)
+            {
+                uint8_t* destRow = destSlice + uint64_t(to.RowPitch) * y;
+                memcpy(destRow, srcSlice + from.RowBytes * y, from.RowBytes);
+                memset(destRow + from.RowBytes, 0, to.RowPitch - from.RowBytes);
+            }
+        }
+    }
+
+    // The copy UpdateSubresources makes from the D3D12_SUBRESOURCE_DATA that
+    // FillInitData points into the file buffer: MemcpySubresource's memcpy per row,
+    // with the source pitches taken from the file.  Returns the bytes copied.
+    size_t CopyRowsLikeUpdateSubresources(uint8_t* dest, const DDSPlacedSubresource& to, const DDSSubresource& from)
+    {
+        size_t bytesCopied = 0;
+        for(size_t z = 0; z < from.Depth; ++z)
+        {
+            uint8_t* destSlice = dest + to.Offset + uint64_t(to.RowPitch) * to.NumRows * z;
+            const uint8_t* srcSlice = from.Data + from.SliceBytes * z;
+            for(size_t y = 0; y < from.NumRows; ++y)
+            {
+                memcpy(destSlice + uint64_t(to.RowPitch) * y, srcSlice + from.RowBytes * y, from.RowBytes);
+                bytesCopied += from.RowBytes;
+            }
+        }
+        return bytesCopied;
+    }
+}
+
+namespace DirectX
+{
+
+//--------------------------------------------------------------------------------------
+// Return the BPP for a particular format
+//--------------------------------------------------------------------------------------
+size_t BitsPerPixel( _In_ DXGI_FORMAT fmt )
+{
+    switch( fmt )
+    {
+    case DXGI_FORMAT_R32G32B32A32_TYPELESS:
+    case DXGI_FORMAT_R32G32B32A32_FLOAT:
+    case DXGI_FORMAT_R32G32B32A32_UINT:
+    case DXGI_FORMAT_R32G32B32A32_SINT:
+        return 128;
+
+    case DXGI_FORMAT_R32G32B32_TYPELESS:
+    case DXGI_FORMAT_R32G32B32_FLOAT:
+    case DXGI_FORMAT_R32G32B32_UINT:
+    case DXGI_FORMAT_R32G32B32_SINT:
+        return 96;
+
+    case DXGI_FORMAT_R16G16B16A16_TYPELESS:
+    case DXGI_FORMAT_R16G16B16A16_FLOAT:
+    case DXGI_FORMAT_R16G16B16A16_UNORM:
+    case DXGI_FORMAT_R16G16B16A16_UINT:
+    case DXGI_FORMAT_R16G16B16A16_SNORM:
+    case DXGI_FORMAT_R16G16B16A16_SINT:
+    case DXGI_FORMAT_R32G32_TYPELESS:
+    case DXGI_FORMAT_R32G32_FLOAT:
+    case DXGI_FORMAT_R32G32_UINT:
+    case DXGI_FORMAT_R32G32_SINT:
+    case DXGI_FORMAT_R32G8X24_TYPELESS:
+    case DXGI_FORMAT_D32_FLOAT_S8X24_UINT:
+    case DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS:
+    case DXGI_FORMAT_X32_TYPELESS_G8X24_UINT:
+    case DXGI_FORMAT_Y416:
+    case DXGI_FORMAT_Y210:
+    case DXGI_FORMAT_Y216:
+        return 64;
+
+    case DXGI_FORMAT_R10G10B10A2_TYPELESS:
+    case DXGI_FORMAT_R10G10B10A2_UNORM:
+    case DXGI_FORMAT_R10G10B10A2_UINT:
+    case DXGI_FORMAT_R11G11B10_FLOAT:
+    case DXGI_FORMAT_R8G8B8A8_TYPELESS:
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+    case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+    case DXGI_FORMAT_R8G8B8A8_UINT:
+    case DXGI_FORMAT_R8G8B8A8_SNORM:
+    case DXGI_FORMAT_R8G8B8A8_SINT:
+    case DXGI_FORMAT_R16G16_TYPELESS:
+    case DXGI_FORMAT_R16G16_FLOAT:
+    case DXGI_FORMAT_R16G16_UNORM:
+    case DXGI_FORMAT_R16G16_UINT:
+    case DXGI_FORMAT_R16G16_SNORM:
+    case DXGI_FORMAT_R16G16_SINT:
+    case DXGI_FORMAT_R32_TYPELESS:
+    case DXGI_FORMAT_D32_FLOAT:
+    case DXGI_FORMAT_R32_FLOAT:
+    case DXGI_FORMAT_R32_UINT:
+    case DXGI_FORMAT_R32_SINT:
+    case DXGI_FORMAT_R24G8_TYPELESS:
+    case DXGI_FORMAT_D24_UNORM_S8_UINT:
+    case DXGI_FORMAT_R24_UNORM_X8_TYPELESS:
+    case DXGI_FORMAT_X24_TYPELESS_G8_UINT:
+    case DXGI_FORMAT_R9G9B9E5_SHAREDEXP:
+    case DXGI_FORMAT_R8G8_B8G8_UNORM:
+    case DXGI_FORMAT_G8R8_G8B8_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+    case DXGI_FORMAT_R10G10B10_XR_BIAS_A2_UNORM:
+    case DXGI_FORMAT_B8G8R8A8_TYPELESS:
+    case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+    case DXGI_FORMAT_B8G8R8X8_TYPELESS:
+    case DXGI_FORMAT_B8G8R8X8_UNORM_SRGB:
+    case DXGI_FORMAT_AYUV:
+    case DXGI_FORMAT_Y410:
+    case DXGI_FORMAT_YUY2:
+        return 32;
+
+    case DXGI_FORMAT_P010:
+    case DXGI_FORMAT_P016:
+        return 24;
+
+    case DXGI_FORMAT_R8G8_TYPELESS:
+    case DXGI_FORMAT_R8G8_UNORM:
+    case DXGI_FORMAT_R8G8_UINT:
+    case DXGI_FORMAT_R8G8_SNORM:
+    case DXGI_FORMAT_R8G8_SINT:
+    case DXGI_FORMAT_R16_TYPELESS:
+    case DXGI_FORMAT_R16_FLOAT:
+    case DXGI_FORMAT_D16_UNORM:
+    case DXGI_FORMAT_R16_UNORM:
+    case DXGI_FORMAT_R16_UINT:
+    case DXGI_FORMAT_R16_SNORM:
+    case DXGI_FORMAT_R16_SINT:
+    case DXGI_FORMAT_B5G6R5_UNORM:
+    case DXGI_FORMAT_B5G5R5A1_UNORM:
+    case DXGI_FORMAT_A8P8:
+    case DXGI_FORMAT_B4G4R4A4_UNORM:
+        return 16;
+
+    case DXGI_FORMAT_NV12:
+    case DXGI_FORMAT_420_OPAQUE:
+    case DXGI_FORMAT_NV11:
+        return 12;
+
+    case DXGI_FORMAT_R8_TYPELESS:
+    case DXGI_FORMAT_R8_UNORM:
+    case DXGI_FORMAT_R8_UINT:
+    case DXGI_FORMAT_R8_SNORM:
+    case DXGI_FORMAT_R8_SINT:
+    case DXGI_FORMAT_A8_UNORM:
+    case DXGI_FORMAT_AI44:
+    case DXGI_FORMAT_IA44:
+    case DXGI_FORMAT_P8:
+        return 8;
+
+    case DXGI_FORMAT_R1_UNORM:
+        return 1;
+
+    case DXGI_FORMAT_BC1_TYPELESS:
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+    case DXGI_FORMAT_BC4_TYPELESS:
+    case DXGI_FORMAT_BC4_UNORM:
+    case DXGI_FORMAT_BC4_SNORM:
+        return 4;
+
+    case DXGI_FORMAT_BC2_TYPELESS:
+    case DXGI_FORMAT_BC2_UNORM:
+    case DXGI_FORMAT_BC2_UNORM_SRGB:
+    case DXGI_FORMAT_BC3_TYPELESS:
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+    case DXGI_FORMAT_BC5_TYPELESS:
+    case DXGI_FORMAT_BC5_UNORM:
+    case DXGI_FORMAT_BC5_SNORM:
+    case DXGI_FORMAT_BC6H_TYPELESS:
+    case DXGI_FORMAT_BC6H_UF16:
+    case DXGI_FORMAT_BC6H_SF16:
+    case DXGI_FORMAT_BC7_TYPELESS:
+    case DXGI_FORMAT_BC7_UNORM:
+    case DXGI_FORMAT_BC7_UNORM_SRGB:
+        return 8;
+
+    default:
+        return 0;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Get surface information for a particular format
+//--------------------------------------------------------------------------------------
+void GetSurfaceInfo( _In_ size_t width,
+                            _In_ size_t height,
+                            _In_ DXGI_FORMAT fmt,
+                            _Out_opt_ size_t* outNumBytes,
+                            _Out_opt_ size_t* outRowBytes,
+                            _Out_opt_ size_t* outNumRows )
+{
+    size_t numBytes = 0;
+    size_t rowBytes = 0;
+    size_t numRows = 0;
+
+    bool bc = false;
+    bool packed = false;
+    bool planar = false;
+    size_t bpe = 0;
+    switch (fmt)
+    {
+    case DXGI_FORMAT_BC1_TYPELESS:
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+    case DXGI_FORMAT_BC4_TYPELESS:
+    case DXGI_FORMAT_BC4_UNORM:
+    case DXGI_FORMAT_BC4_SNORM:
+        bc=true;
+        bpe = 8;
+        break;
+
+    case DXGI_FORMAT_BC2_TYPELESS:
+    case DXGI_FORMAT_BC2_UNORM:
+    case DXGI_FORMAT_BC2_UNORM_SRGB:
+    case DXGI_FORMAT_BC3_TYPELESS:
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+    case DXGI_FORMAT_BC5_TYPELESS:
+    case DXGI_FORMAT_BC5_UNORM:
+    case DXGI_FORMAT_BC5_SNORM:
+    case DXGI_FORMAT_BC6H_TYPELESS:
+    case DXGI_FORMAT_BC6H_UF16:
+    case DXGI_FORMAT_BC6H_SF16:
+    case DXGI_FORMAT_BC7_TYPELESS:
+    case DXGI_FORMAT_BC7_UNORM:
+    case DXGI_FORMAT_BC7_UNORM_SRGB:
+        bc = true;
+        bpe = 16;
+        break;
+
+    case DXGI_FORMAT_R8G8_B8G8_UNORM:
+    case DXGI_FORMAT_G8R8_G8B8_UNORM:
+    case DXGI_FORMAT_YUY2:
+        packed = true;
+        bpe = 4;
+        break;
+
+    case DXGI_FORMAT_Y210:
+    case DXGI_FORMAT_Y216:
+        packed = true;
+        bpe = 8;
+        break;
+
+    case DXGI_FORMAT_NV12:
+    case DXGI_FORMAT_420_OPAQUE:
+        planar = true;
+        bpe = 2;
+        break;
+
+    case DXGI_FORMAT_P010:
+    case DXGI_FORMAT_P016:
+        planar = true;
+        bpe = 4;
+        break;
+    }
+
+    if (bc)
+    {
+        size_t numBlocksWide = 0;
+        if (width > 0)
+        {
+            numBlocksWide = std::max<size_t>( 1, (width + 3) / 4 );
+        }
+        size_t numBlocksHigh = 0;
+        if (height > 0)
+        {
+            numBlocksHigh = std::max<size_t>( 1, (height + 3) / 4 );
+        }
+        rowBytes = numBlocksWide * bpe;
+        numRows = numBlocksHigh;
+        numBytes = rowBytes * numBlocksHigh;
+    }
+    else if (packed)
+    {
+        rowBytes = ( ( width + 1 ) >> 1 ) * bpe;
+        numRows = height;
+        numBytes = rowBytes * height;
+    }
+    else if ( fmt == DXGI_FORMAT_NV11 )
+    {
+        rowBytes = ( ( width + 3 ) >> 2 ) * 4;
+        numRows = height * 2; // Direct3D makes this simplifying assumption, although it is larger than the 4:1:1 data
+        numBytes = rowBytes * numRows;
+    }
+    else if (planar)
+    {
+        rowBytes = ( ( width + 1 ) >> 1 ) * bpe;
+        numBytes = ( rowBytes * height ) + ( ( rowBytes * height + 1 ) >> 1 );
+        numRows = height + ( ( height + 1 ) >> 1 );
+    }
+    else
+    {
+        size_t bpp = BitsPerPixel( fmt );
+        rowBytes = ( width * bpp + 7 ) / 8; // round up to nearest byte
+        numRows = height;
+        numBytes = rowBytes * height;
+    }
+
+    if (outNumBytes)
+    {
+        *outNumBytes = numBytes;
+    }
+    if (outRowBytes)
+    {
+        *outRowBytes = rowBytes;
+    }
+    if (outNumRows)
+    {
+        *outNumRows = numRows;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+#define ISBITMASK( r,g,b,a ) ( ddpf.RBitMask == r && ddpf.GBitMask == g && ddpf.BBitMask == b && ddpf.ABitMask == a )
+
+DXGI_FORMAT GetDXGIFormat( const DDS_PIXELFORMAT& ddpf )
+{
+    if (ddpf.flags & DDS_RGB)
+    {
+        // Note that sRGB formats are written using the "DX10" extended header
+
+        switch (ddpf.RGBBitCount)
+        {
+        case 32:
+            if (ISBITMASK(0x000000ff,0x0000ff00,0x00ff0000,0xff000000))
+            {
+                return DXGI_FORMAT_R8G8B8A8_UNORM;
+            }
+
+            if (ISBITMASK(0x00ff0000,0x0000ff00,0x000000ff,0xff000000))
+            {
+                return DXGI_FORMAT_B8G8R8A8_UNORM;
+            }
+
+            if (ISBITMASK(0x00ff0000,0x0000ff00,0x000000ff,0x00000000))
+            {
+                return DXGI_FORMAT_B8G8R8X8_UNORM;
+            }
+
+            // No DXGI format maps to ISBITMASK(0x000000ff,0x0000ff00,0x00ff0000,0x00000000) aka D3DFMT_X8B8G8R8
+
+            // Note that many common DDS reader/writers (including D3DX) swap the
+            // the RED/BLUE masks for 10:10:10:2 formats. We assume
+            // below that the 'backwards' header mask is being used since it is most
+            // likely written by D3DX. The more robust solution is to use the 'DX10'
+            // header extension and specify the DXGI_FORMAT_R10G10B10A2_UNORM format directly
+
+            // For 'correct' writers, this should be 0x000003ff,0x000ffc00,0x3ff00000 for RGB data
+            if (ISBITMASK(0x3ff00000,0x000ffc00,0x000003ff,0xc0000000))
+            {
+                return DXGI_FORMAT_R10G10B10A2_UNORM;
+            }
+
+            // No DXGI format maps to ISBITMASK(0x000003ff,0x000ffc00,0x3ff00000,0xc0000000) aka D3DFMT_A2R10G10B10
+
+            if (ISBITMASK(0x0000ffff,0xffff0000,0x00000000,0x00000000))
+            {
+                return DXGI_FORMAT_R16G16_UNORM;
+            }
+
+            if (ISBITMASK(0xffffffff,0x00000000,0x00000000,0x00000000))
+            {
+                // Only 32-bit color channel format in D3D9 was R32F
+                return DXGI_FORMAT_R32_FLOAT; // D3DX writes this out as a FourCC of 114
+            }
+            break;
+
+        case 24:
+            // No 24bpp DXGI formats aka D3DFMT_R8G8B8
+            break;
+
+        case 16:
+            if (ISBITMASK(0x7c00,0x03e0,0x001f,0x8000))
+            {
+                return DXGI_FORMAT_B5G5R5A1_UNORM;
+            }
+            if (ISBITMASK(0xf800,0x07e0,0x001f,0x0000))
+            {
+                return DXGI_FORMAT_B5G6R5_UNORM;
+            }
+
+            // No DXGI format maps to ISBITMASK(0x7c00,0x03e0,0x001f,0x0000) aka D3DFMT_X1R5G5B5
+
+            if (ISBITMASK(0x0f00,0x00f0,0x000f,0xf000))
+            {
+                return DXGI_FORMAT_B4G4R4A4_UNORM;
+            }
+
+            // No DXGI format maps to ISBITMASK(0x0f00,0x00f0,0x000f,0x0000) aka D3DFMT_X4R4G4B4
+
+            // No 3:3:2, 3:3:2:8, or paletted DXGI formats aka D3DFMT_A8R3G3B2, D3DFMT_R3G3B2, D3DFMT_P8, D3DFMT_A8P8, etc.
+            break;
+        }
+    }
+    else if (ddpf.flags & DDS_LUMINANCE)
+    {
+        if (8 == ddpf.RGBBitCount)
+        {
+            if (ISBITMASK(0x000000ff,0x00000000,0x00000000,0x00000000))
+            {
+                return DXGI_FORMAT_R8_UNORM; // D3DX10/11 writes this out as DX10 extension
+            }
+
+            // No DXGI format maps to ISBITMASK(0x0f,0x00,0x00,0xf0) aka D3DFMT_A4L4
+        }
+
+        if (16 == ddpf.RGBBitCount)
+        {
+            if (ISBITMASK(0x0000ffff,0x00000000,0x00000000,0x00000000))
+            {
+                return DXGI_FORMAT_R16_UNORM; // D3DX10/11 writes this out as DX10 extension
+            }
+            if (ISBITMASK(0x000000ff,0x00000000,0x00000000,0x0000ff00))
+            {
+                return DXGI_FORMAT_R8G8_UNORM; // D3DX10/11 writes this out as DX10 extension
+            }
+        }
+    }
+    else if (ddpf.flags & DDS_ALPHA)
+    {
+        if (8 == ddpf.RGBBitCount)
+        {
+            return DXGI_FORMAT_A8_UNORM;
+        }
+    }
+    else if (ddpf.flags & DDS_FOURCC)
+    {
+        if (MAKEFOURCC( 'D', 'X', 'T', '1' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC1_UNORM;
+        }
+        if (MAKEFOURCC( 'D', 'X', 'T', '3' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC2_UNORM;
+        }
+        if (MAKEFOURCC( 'D', 'X', 'T', '5' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC3_UNORM;
+        }
+
+        // While pre-multiplied alpha isn't directly supported by the DXGI formats,
+        // they are basically the same as these BC formats so they can be mapped
+        if (MAKEFOURCC( 'D', 'X', 'T', '2' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC2_UNORM;
+        }
+        if (MAKEFOURCC( 'D', 'X', 'T', '4' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC3_UNORM;
+        }
+
+        if (MAKEFOURCC( 'A', 'T', 'I', '1' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC4_UNORM;
+        }
+        if (MAKEFOURCC( 'B', 'C', '4', 'U' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC4_UNORM;
+        }
+        if (MAKEFOURCC( 'B', 'C', '4', 'S' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC4_SNORM;
+        }
+
+        if (MAKEFOURCC( 'A', 'T', 'I', '2' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC5_UNORM;
+        }
+        if (MAKEFOURCC( 'B', 'C', '5', 'U' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC5_UNORM;
+        }
+        if (MAKEFOURCC( 'B', 'C', '5', 'S' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_BC5_SNORM;
+        }
+
+        // BC6H and BC7 are written using the "DX10" extended header
+
+        if (MAKEFOURCC( 'R', 'G', 'B', 'G' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_R8G8_B8G8_UNORM;
+        }
+        if (MAKEFOURCC( 'G', 'R', 'G', 'B' ) == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_G8R8_G8B8_UNORM;
+        }
+
+        if (MAKEFOURCC('Y','U','Y','2') == ddpf.fourCC)
+        {
+            return DXGI_FORMAT_YUY2;
+        }
+
+        // Check for D3DFORMAT enums being set here
+        switch( ddpf.fourCC )
+        {
+        case 36: // D3DFMT_A16B16G16R16
+            return DXGI_FORMAT_R16G16B16A16_UNORM;
+
+        case 110: // D3DFMT_Q16W16V16U16
+            return DXGI_FORMAT_R16G16B16A16_SNORM;
+
+        case 111: // D3DFMT_R16F
+            return DXGI_FORMAT_R16_FLOAT;
+
+        case 112: // D3DFMT_G16R16F
+            return DXGI_FORMAT_R16G16_FLOAT;
+
+        case 113: // D3DFMT_A16B16G16R16F
+            return DXGI_FORMAT_R16G16B16A16_FLOAT;
+
+        case 114: // D3DFMT_R32F
+            return DXGI_FORMAT_R32_FLOAT;
+
+        case 115: // D3DFMT_G32R32F
+            return DXGI_FORMAT_R32G32_FLOAT;
+
+        case 116: // D3DFMT_A32B32G32R32F
+            return DXGI_FORMAT_R32G32B32A32_FLOAT;
+        }
+    }
+
+    return DXGI_FORMAT_UNKNOWN;
+}
+
+
+//--------------------------------------------------------------------------------------
+DXGI_FORMAT MakeSRGB( _In_ DXGI_FORMAT format )
+{
+    switch( format )
+    {
+    case DXGI_FORMAT_R8G8B8A8_UNORM:
+        return DXGI_FORMAT_R8G8B8A8_UNORM_SRGB;
+
+    case DXGI_FORMAT_BC1_UNORM:
+        return DXGI_FORMAT_BC1_UNORM_SRGB;
+
+    case DXGI_FORMAT_BC2_UNORM:
+        return DXGI_FORMAT_BC2_UNORM_SRGB;
+
+    case DXGI_FORMAT_BC3_UNORM:
+        return DXGI_FORMAT_BC3_UNORM_SRGB;
+
+    case DXGI_FORMAT_B8G8R8A8_UNORM:
+        return DXGI_FORMAT_B8G8R8A8_UNORM_SRGB;
+
+    case DXGI_FORMAT_B8G8R8X8_UNORM:
+        return DXGI_FORMAT_B8G8R8X8_UNORM_SRGB;
+
+    case DXGI_FORMAT_BC7_UNORM:
+        return DXGI_FORMAT_BC7_UNORM_SRGB;
+
+    default:
+        return format;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void GetBlockSize( DXGI_FORMAT fmt, uint32_t* blockWidth, uint32_t* blockHeight )
+{
+    *blockWidth = 1;
+    *blockHeight = 1;
+    switch( fmt )
+    {
+    case DXGI_FORMAT_BC1_TYPELESS:
+    case DXGI_FORMAT_BC1_UNORM:
+    case DXGI_FORMAT_BC1_UNORM_SRGB:
+    case DXGI_FORMAT_BC2_TYPELESS:
+    case DXGI_FORMAT_BC2_UNORM:
+    case DXGI_FORMAT_BC2_UNORM_SRGB:
+    case DXGI_FORMAT_BC3_TYPELESS:
+    case DXGI_FORMAT_BC3_UNORM:
+    case DXGI_FORMAT_BC3_UNORM_SRGB:
+    case DXGI_FORMAT_BC4_TYPELESS:
+    case DXGI_FORMAT_BC4_UNORM:
+    case DXGI_FORMAT_BC4_SNORM:
+    case DXGI_FORMAT_BC5_TYPELESS:
+    case DXGI_FORMAT_BC5_UNORM:
+    case DXGI_FORMAT_BC5_SNORM:
+    case DXGI_FORMAT_BC6H_TYPELESS:
+    case DXGI_FORMAT_BC6H_UF16:
+    case DXGI_FORMAT_BC6H_SF16:
+    case DXGI_FORMAT_BC7_TYPELESS:
+    case DXGI_FORMAT_BC7_UNORM:
+    case DXGI_FORMAT_BC7_UNORM_SRGB:
+        *blockWidth = 4;
+        *blockHeight = 4;
+        break;
+
+    case DXGI_FORMAT_R8G8_B8G8_UNORM:
+    case DXGI_FORMAT_G8R8_G8B8_UNORM:
+    case DXGI_FORMAT_YUY2:
+        *blockWidth = 2;
+        break;
+
+    default:
+        break;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+DDS_ALPHA_MODE GetAlphaMode( _In_ const DDS_HEADER* header )
+{
+    if ( header->ddspf.flags & DDS_FOURCC )
+    {
+        if ( MAKEFOURCC( 'D', 'X', '1', '0' ) == header->ddspf.fourCC )
+        {
+            auto d3d10ext = reinterpret_cast<const DDS_HEADER_DXT10*>( (const char*)header + sizeof(DDS_HEADER) );
+            auto mode = static_cast<DDS_ALPHA_MODE>( d3d10ext->miscFlags2 & DDS_MISC_FLAGS2_ALPHA_MODE_MASK );
+            switch( mode )
+            {
+            case DDS_ALPHA_MODE_STRAIGHT:
+            case DDS_ALPHA_MODE_PREMULTIPLIED:
+            case DDS_ALPHA_MODE_OPAQUE:
+            case DDS_ALPHA_MODE_CUSTOM:
+                return mode;
+            }
+        }
+        else if ( ( MAKEFOURCC( 'D', 'X', 'T', '2' ) == header->ddspf.fourCC )
+                  || ( MAKEFOURCC( 'D', 'X', 'T', '4' ) == header->ddspf.fourCC ) )
+        {
+            return DDS_ALPHA_MODE_PREMULTIPLIED;
+        }
+    }
+
+    return DDS_ALPHA_MODE_UNKNOWN;
+}
+
+}
+
+HRESULT DDSReader::Open(const std::wstring& filename, size_t maxsize)
+{
+    Close();
+
+    if(!mFile.Open(filename))
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    HRESULT hr = Parse(mFile.Data(), mFile.Size(), maxsize);
+    if(FAILED(hr))
+        Close();
+
+    return hr;
+}
+
+HRESULT DDSReader::Open(const std::string& filename, size_t maxsize)
+{
+    Close();
+
+    if(!mFile.Open(filename))
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    HRESULT hr = Parse(mFile.Data(), mFile.Size(), maxsize);
+    if(FAILED(hr))
+        Close();
+
+    return hr;
+}
+
+HRESULT DDSReader::Parse(const uint8_t* ddsData, size_t ddsDataSize, size_t maxsize)
+{
+    mDesc = DDSTextureDesc();
+    mSubresources.clear();
+
+    // Need at least enough data to fill the header and magic number to be a valid DDS
+    if(ddsData == nullptr || ddsDataSize < sizeof(uint32_t) + sizeof(DDS_HEADER))
+        return E_FAIL;
+
+    // DDS files always start with the same magic number ("DDS ")
+    uint32_t magic;
+    memcpy(&magic, ddsData, sizeof(magic));
+    if(magic != DDS_MAGIC)
+        return E_FAIL;
+
+    auto header = reinterpret_cast<const DDS_HEADER*>(ddsData + sizeof(uint32_t));
+
+    // Verify header to validate DDS file
+    if(header->size != sizeof(DDS_HEADER) ||
+       header->ddspf.size != sizeof(DDS_PIXELFORMAT))
+        return E_FAIL;
+
+    // Must be long enough for both headers and magic value
+    const bool dx10 = HasDX10Header(header);
+    if(dx10 && ddsDataSize < sizeof(uint32_t) + sizeof(DDS_HEADER) + sizeof(DDS_HEADER_DXT10))
+        return E_FAIL;
+
+    HRESULT hr = ReadDesc(header);
+    if(FAILED(hr))
+        return hr;
+
+    size_t offset = sizeof(uint32_t) + sizeof(DDS_HEADER) + (dx10 ? sizeof(DDS_HEADER_DXT10) : 0);
+    hr = LayOutSubresources(ddsData, ddsDataSize, offset, maxsize);
+    if(FAILED(hr))
+    {
+        mDesc = DDSTextureDesc();
+        mSubresources.clear();
+        return hr;
+    }
+
+    mDesc.AlphaMode = GetAlphaMode(header);
+    return S_OK;
+}
+
+void DDSReader::Close()
+{
+    mFile.Close();
+    mDesc = DDSTextureDesc();
+    mSubresources.clear();
+}
+
+const DDSTextureDesc& DDSReader::GetDesc()const
+{
+    return mDesc;
+}
+
+const std::vector<DDSSubresource>& DDSReader::GetSubresources()const
+{
+    return mSubresources;
+}
+
+size_t DDSReader::GetDataSize()const
+{
+    size_t size = 0;
+    for(const DDSSubresource& s : mSubresources)
+        size += s.SliceBytes * s.Depth;
+    return size;
+}
+
+uint64_t DDSReader::GetPlacedSubresources(std::vector<DDSPlacedSubresource>& placed)const
+{
+    uint32_t blockWidth = 1;
+    uint32_t blockHeight = 1;
+    GetBlockSize(mDesc.Format, &blockWidth, &blockHeight);
+
+    placed.resize(mSubresources.size());
+
+    uint64_t size = 0;
+    for(size_t i = 0; i < mSubresources.size(); ++i)
+    {
+        const DDSSubresource& s = mSubresources[i];
+        DDSPlacedSubresource& p = placed[i];
+
+        p.Offset = AlignUp(size, DDS_PLACEMENT_ALIGNMENT);
+        p.Width = static_cast<uint32_t>(AlignUp(s.Width, blockWidth));
+        p.Height = static_cast<uint32_t>(AlignUp(s.Height, blockHeight));
+        p.Depth = static_cast<uint32_t>(s.Depth);
+        p.RowPitch = static_cast<uint32_t>(AlignUp(s.RowBytes, DDS_ROW_PITCH_ALIGNMENT));
+        p.NumRows = static_cast<uint32_t>(s.NumRows);
+
+        size = p.Offset + uint64_t(p.RowPitch) * p.NumRows * p.Depth;
+    }
+
+    return size;
+}
+
+bool DDSReader::CopyToUploadBuffer(uint8_t* dest, uint64_t destSize,
+                                   const std::vector<DDSPlacedSubresource>& placed)const
+{
+    if(placed.size() != mSubresources.size())
+        return false;
+
+    for(size_t i = 0; i < placed.size(); ++i)
+    {
+        const DDSPlacedSubresource& p = placed[i];
+        const DDSSubresource& s = mSubresources[i];
+        if(p.RowPitch < s.RowBytes || p.NumRows != s.NumRows || p.Depth != s.Depth ||
+           p.Offset + uint64_t(p.RowPitch) * p.NumRows * p.Depth > destSize)
+            return false;
+    }
+
+    for(size_t i = 0; i < placed.size(); ++i)
+        CopyRows(dest, placed[i], mSubresources[i]);
+
+    return true;
+}
+
+HRESULT DDSReader::ReadDesc(const DDS_HEADER* header)
+{
+    size_t width = header->width;
+    size_t height = header->height;
+    size_t depth = header->depth;
+
+    uint32_t resDim = 0;
+    size_t arraySize = 1;
+    DXGI_FORMAT format = DXGI_FORMAT_UNKNOWN;
+    bool isCubeMap = false;
+
+    size_t mipCount = header->mipMapCount;
+    if(mipCount == 0)
+        mipCount = 1;
+
+    if(HasDX10Header(header))
+    {
+        auto d3d10ext = reinterpret_cast<const DDS_HEADER_DXT10*>((const char*)header + sizeof(DDS_HEADER));
+
+        arraySize = d3d10ext->arraySize;
+        if(arraySize == 0)
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+        switch(d3d10ext->dxgiFormat)
+        {
+        case DXGI_FORMAT_AI44:
+        case DXGI_FORMAT_IA44:
+        case DXGI_FORMAT_P8:
+        case DXGI_FORMAT_A8P8:
+            return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+        default:
+            if(BitsPerPixel(d3d10ext->dxgiFormat) == 0)
+                return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+        }
+
+        format = d3d10ext->dxgiFormat;
+        resDim = d3d10ext->resourceDimension;
+
+        switch(resDim)
+        {
+        case DDS_DIMENSION_TEXTURE1D:
+            if((header->flags & DDS_HEIGHT) && height != 1)
+                return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            height = depth = 1;
+            break;
+
+        case DDS_DIMENSION_TEXTURE2D:
+            if(d3d10ext->miscFlag & DDS_RESOURCE_MISC_TEXTURECUBE)
+            {
+                arraySize *= 6;
+                isCubeMap = true;
+            }
+            depth = 1;
+            break;
+
+        case DDS_DIMENSION_TEXTURE3D:
+            if(!(header->flags & DDS_HEADER_FLAGS_VOLUME))
+                return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            if(arraySize > 1)
+                return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+            break;
+
+        default:
+            return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+        }
+    }
+    else
+    {
+        format = GetDXGIFormat(header->ddspf);
+        if(format == DXGI_FORMAT_UNKNOWN)
+            return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+        if(header->flags & DDS_HEADER_FLAGS_VOLUME)
+        {
+            resDim = DDS_DIMENSION_TEXTURE3D;
+        }
+        else
+        {
+            if(header->caps2 & DDS_CUBEMAP)
+            {
+                // We require all six faces to be defined
+                if((header->caps2 & DDS_CUBEMAP_ALLFACES) != DDS_CUBEMAP_ALLFACES)
+                    return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+                arraySize = 6;
+                isCubeMap = true;
+            }
+
+            depth = 1;
+            resDim = DDS_DIMENSION_TEXTURE2D;
+        }
+    }
+
+    if(width == 0 || height == 0 || depth == 0)
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+    // Bound sizes
+    if(mipCount > MaxMipLevels)
+        return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+    switch(resDim)
+    {
+    case DDS_DIMENSION_TEXTURE1D:
+        if(arraySize > MaxTexture1DArraySize || width > MaxTexture1DSize)
+            return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+        break;
+
+    case DDS_DIMENSION_TEXTURE2D:
+        // arraySize counts the faces of a cube map, so the array bound still applies.
+        if(arraySize > MaxTexture2DArraySize)
+            return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+        if(isCubeMap ? (width > MaxTextureCubeSize || height > MaxTextureCubeSize) :
+                       (width > MaxTexture2DSize || height > MaxTexture2DSize))
+            return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+        break;
+
+    case DDS_DIMENSION_TEXTURE3D:
+        if(width > MaxTexture3DSize || height > MaxTexture3DSize || depth > MaxTexture3DSize)
+            return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+        break;
+    }
+
+    mDesc.Dimension = resDim;
+    mDesc.Format = format;
+    mDesc.Width = width;
+    mDesc.Height = height;
+    mDesc.Depth = depth;
+    mDesc.MipLevels = mipCount;
+    mDesc.ArraySize = arraySize;
+    mDesc.IsCubeMap = isCubeMap;
+
+    return S_OK;
+}
+
+HRESULT DDSReader::LayOutSubresources(const uint8_t* ddsData, size_t ddsDataSize, size_t offset, size_t maxsize)
+{
+    const size_t mipCount = mDesc.MipLevels;
+    const size_t arraySize = mDesc.ArraySize;
+
+    size_t skipMip = 0;
+    size_t twidth = 0;
+    size_t theight = 0;
+    size_t tdepth = 0;
+
+    mSubresources.reserve(mipCount * arraySize);
+    for(size_t j = 0; j < arraySize; ++j)
+    {
+        size_t w = mDesc.Width;
+        size_t h = mDesc.Height;
+        size_t d = mDesc.Depth;
+        for(size_t i = 0; i < mipCount; ++i)
+        {
+            size_t numBytes = 0;
+            size_t rowBytes = 0;
+            size_t numRows = 0;
+            GetSurfaceInfo(w, h, mDesc.Format, &numBytes, &rowBytes, &numRows);
+
+            if(numBytes * d > ddsDataSize - offset)
+                return HRESULT_FROM_WIN32(ERROR_HANDLE_EOF);
+
+            if(mipCount <= 1 || !maxsize || (w <= maxsize && h <= maxsize && d <= maxsize))
+            {
+                if(!twidth)
+                {
+                    twidth = w;
+                    theight = h;
+                    tdepth = d;
+                }
+
+                DDSSubresource s;
+                s.Data = ddsData + offset;
+                s.Offset = offset;
+                s.Width = w;
+                s.Height = h;
+                s.Depth = d;
+                s.RowBytes = rowBytes;
+                s.NumRows = numRows;
+                s.SliceBytes = numBytes;
+                mSubresources.push_back(s);
+            }
+            else if(!j)
+            {
+                // Count number of skipped mipmaps (first item only)
+                ++skipMip;
+            }
+
+            offset += numBytes * d;
+
+            w = std::max<size_t>(w >> 1, 1);
+            h = std::max<size_t>(h >> 1, 1);
+            d = std::max<size_t>(d >> 1, 1);
+        }
+    }
+
+    if(mSubresources.empty())
+        return E_FAIL;
+
+    mDesc.Width = twidth;
+    mDesc.Height = theight;
+    mDesc.Depth = tdepth;
+    mDesc.MipLevels = mipCount - skipMip;
+
+    return S_OK;
+}
+
+HRESULT DirectX::MeasureDDSUpload(const std::wstring& filename,
+                                  DDSUploadCost& legacy, DDSUploadCost& mapped)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    legacy = DDSUploadCost();
+    mapped = DDSUploadCost();
+
+    std::vector<DDSPlacedSubresource> placed;
+
+    // Legacy: LoadTextureDataFromFile reads the file into a heap buffer, and
+    // UpdateSubresources copies each row from there into the upload buffer.
+    {
+        auto start = Clock::now();
+
+        HANDLE file = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                                  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if(file == INVALID_HANDLE_VALUE)
+            return HRESULT_FROM_WIN32(GetLastError());
+
+        LARGE_INTEGER size = {};
+        GetFileSizeEx(file, &size);
+        const size_t fileSize = static_cast<size_t>(size.QuadPart);
+
+        std::unique_ptr<uint8_t[]> ddsData(new (std::nothrow) uint8_t[fileSize]);
+        DWORD bytesRead = 0;
+        const bool read = ddsData && size.HighPart == 0 &&
+            ReadFile(file, ddsData.get(), size.LowPart, &bytesRead, nullptr) && bytesRead == size.LowPart;
+        CloseHandle(file);
+        if(!read)
+            return E_FAIL;
+
+        DDSReader dds;
+        HRESULT hr = dds.Parse(ddsData.get(), fileSize);
+        if(FAILED(hr))
+            return hr;
+
+        const uint64_t uploadSize = dds.GetPlacedSubresources(placed);
+        std::vector<uint8_t> upload(static_cast<size_t>(uploadSize));
+
+        size_t rowBytesCopied = 0;
+        const std::vector<DDSSubresource>& subresources = dds.GetSubresources();
+        for(size_t i = 0; i < placed.size(); ++i)
+            rowBytesCopied += CopyRowsLikeUpdateSubresources(upload.data(), placed[i], subresources[i]);
+
+        // The file buffer is still alive while the rows are copied out of it.
+        legacy.FileBytes = fileSize;
+        legacy.UploadBytes = upload.size();
+        legacy.PeakBytes = fileSize + upload.size();
+        legacy.BytesCopied = bytesRead + rowBytesCopied;
+        legacy.Copies = 2;
+        legacy.Ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    // Mapped: the rows come straight out of the file mapping.
+    {
+        auto start = Clock::now();
+
+        DDSReader dds;
+        HRESULT hr = dds.Open(filename);
+        if(FAILED(hr))
+            return hr;
+
+        const uint64_t uploadSize = dds.GetPlacedSubresources(placed);
+        std::vector<uint8_t> upload(static_cast<size_t>(uploadSize));
+        dds.CopyToUploadBuffer(upload.data(), uploadSize, placed);
+
+        mapped.FileBytes = legacy.FileBytes;
+        mapped.UploadBytes = static_cast<size_t>(uploadSize);
+        mapped.PeakBytes = mapped.UploadBytes;
+        mapped.BytesCopied = dds.GetDataSize();
+        mapped.Copies = 1;
+        mapped.Ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    return S_OK;
+}
+
+void DirectX::WriteDDS(const DDSTextureDesc& desc, const uint8_t* texels, size_t texelBytes,
+                       std::vector<uint8_t>& ddsData)
+{
+    DDS_HEADER header = {};
+    header.size = sizeof(DDS_HEADER);
+    header.flags = DDSD_CAPS | DDS_HEIGHT | DDS_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT;
+    header.height = uint32_t(desc.Height);
+    header.width = uint32_t(desc.Width);
+    header.mipMapCount = uint32_t(desc.MipLevels);
+    header.ddspf.size = sizeof(DDS_PIXELFORMAT);
+    header.ddspf.flags = DDS_FOURCC;
+    header.ddspf.fourCC = MAKEFOURCC('D', 'X', '1', '0');
+    header.caps = DDSCAPS_TEXTURE | (desc.MipLevels > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+    DDS_HEADER_DXT10 header10 = {};
+    header10.dxgiFormat = desc.Format;
+    header10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+    header10.arraySize = uint32_t(desc.ArraySize);
+    header10.miscFlags2 = uint32_t(desc.AlphaMode);
+
+    const uint32_t magic = DDS_MAGIC;
+    ddsData.resize(sizeof(magic) + sizeof(header) + sizeof(header10) + texelBytes);
+    uint8_t* p = ddsData.data();
+    memcpy(p, &magic, sizeof(magic));
+    p += sizeof(magic);
+    memcpy(p, &header, sizeof(header));
+    p += sizeof(header);
+    memcpy(p, &header10, sizeof(header10));
+    p += sizeof(header10);
+    if(texelBytes > 0)
+        memcpy(p, texels, texelBytes);
+}
+
+HRESULT DirectX::SaveDDSFile(const std::wstring& filename, const std::vector<uint8_t>& ddsData)
+{
+    HANDLE file = CreateFileW(filename.c_str(), GENERIC_WRITE, 0, nullptr,
+                              CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    DWORD written = 0;
+    const bool ok = WriteFile(file, ddsData.data(), DWORD(ddsData.size()), &written, nullptr) &&
+        written == ddsData.size();
+    CloseHandle(file);
+    return ok ? S_OK : E_FAIL;
+}
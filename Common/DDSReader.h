@@ -0,0 +1,263 @@
+//***************************************************************************************
+// DDSReader.h
+//
+// Parses a .dds file without a Direct3D device: the header is checked, and every
+// mip level of every array slice is located in place in the file's bytes.  Nothing
+// is copied, so the subresources can go straight from a mapped file to an upload
+// buffer.  DDSTextureLoader creates the D3D12 texture from a DDSReader.
+//***************************************************************************************
+
+#pragma once
+
+#include "MappedFile.h"
+#include <dxgiformat.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//--------------------------------------------------------------------------------------
+// Macros
+//--------------------------------------------------------------------------------------
+#ifndef MAKEFOURCC
+    #define MAKEFOURCC(ch0, ch1, ch2, ch3)                              \
+                ((uint32_t)(uint8_t)(ch0) | ((uint32_t)(uint8_t)(ch1) << 8) |       \
+                ((uint32_t)(uint8_t)(ch2) << 16) | ((uint32_t)(uint8_t)(ch3) << 24 ))
+#endif /* defined(MAKEFOURCC) */
+
+//--------------------------------------------------------------------------------------
+// DDS file structure definitions
+//
+// See DDS.h in the 'Texconv' sample and the 'DirectXTex' library
+//--------------------------------------------------------------------------------------
+#pragma pack(push,1)
+
+const uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+
+struct DDS_PIXELFORMAT
+{
+    uint32_t    size;
+    uint32_t    flags;
+    uint32_t    fourCC;
+    uint32_t    RGBBitCount;
+    uint32_t    RBitMask;
+    uint32_t    GBitMask;
+    uint32_t    BBitMask;
+    uint32_t    ABitMask;
+};
+
+#define DDS_FOURCC      0x00000004  // DDPF_FOURCC
+#define DDS_RGB         0x00000040  // DDPF_RGB
+#define DDS_LUMINANCE   0x00020000  // DDPF_LUMINANCE
+#define DDS_ALPHA       0x00000002  // DDPF_ALPHA
+
+#define DDS_HEADER_FLAGS_VOLUME         0x00800000  // DDSD_DEPTH
+
+#define DDS_HEIGHT 0x00000002 // DDSD_HEIGHT
+#define DDS_WIDTH  0x00000004 // DDSD_WIDTH
+
+#define DDS_CUBEMAP_POSITIVEX 0x00000600 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEX
+#define DDS_CUBEMAP_NEGATIVEX 0x00000a00 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEX
+#define DDS_CUBEMAP_POSITIVEY 0x00001200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEY
+#define DDS_CUBEMAP_NEGATIVEY 0x00002200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEY
+#define DDS_CUBEMAP_POSITIVEZ 0x00004200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_POSITIVEZ
+#define DDS_CUBEMAP_NEGATIVEZ 0x00008200 // DDSCAPS2_CUBEMAP | DDSCAPS2_CUBEMAP_NEGATIVEZ
+
+#define DDS_CUBEMAP_ALLFACES ( DDS_CUBEMAP_POSITIVEX | DDS_CUBEMAP_NEGATIVEX |\
+                               DDS_CUBEMAP_POSITIVEY | DDS_CUBEMAP_NEGATIVEY |\
+                               DDS_CUBEMAP_POSITIVEZ | DDS_CUBEMAP_NEGATIVEZ )
+
+#define DDS_CUBEMAP 0x00000200 // DDSCAPS2_CUBEMAP
+
+enum DDS_MISC_FLAGS2
+{
+    DDS_MISC_FLAGS2_ALPHA_MODE_MASK = 0x7L,
+};
+
+struct DDS_HEADER
+{
+    uint32_t        size;
+    uint32_t        flags;
+    uint32_t        height;
+    uint32_t        width;
+    uint32_t        pitchOrLinearSize;
+    uint32_t        depth; // only if DDS_HEADER_FLAGS_VOLUME is set in flags
+    uint32_t        mipMapCount;
+    uint32_t        reserved1[11];
+    DDS_PIXELFORMAT ddspf;
+    uint32_t        caps;
+    uint32_t        caps2;
+    uint32_t        caps3;
+    uint32_t        caps4;
+    uint32_t        reserved2;
+};
+
+struct DDS_HEADER_DXT10
+{
+    DXGI_FORMAT     dxgiFormat;
+    uint32_t        resourceDimension;
+    uint32_t        miscFlag; // see D3D11_RESOURCE_MISC_FLAG
+    uint32_t        arraySize;
+    uint32_t        miscFlags2;
+};
+
+#pragma pack(pop)
+
+// Resource dimensions in DDS_HEADER_DXT10.  The values match D3D11_RESOURCE_DIMENSION
+// and D3D12_RESOURCE_DIMENSION.
+#define DDS_DIMENSION_TEXTURE1D 2
+#define DDS_DIMENSION_TEXTURE2D 3
+#define DDS_DIMENSION_TEXTURE3D 4
+
+#define DDS_RESOURCE_MISC_TEXTURECUBE 0x4 // D3D11_RESOURCE_MISC_TEXTURECUBE
+
+// D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT and D3D12_TEXTURE_DATA_PITCH_ALIGNMENT.
+#define DDS_PLACEMENT_ALIGNMENT 512
+#define DDS_ROW_PITCH_ALIGNMENT 256
+
+namespace DirectX
+{
+    enum DDS_ALPHA_MODE
+    {
+        DDS_ALPHA_MODE_UNKNOWN       = 0,
+        DDS_ALPHA_MODE_STRAIGHT      = 1,
+        DDS_ALPHA_MODE_PREMULTIPLIED = 2,
+        DDS_ALPHA_MODE_OPAQUE        = 3,
+        DDS_ALPHA_MODE_CUSTOM        = 4,
+    };
+
+    // Format helpers.  A format the reader does not know has 0 bits per pixel.
+    size_t BitsPerPixel( DXGI_FORMAT fmt );
+    void GetSurfaceInfo( size_t width, size_t height, DXGI_FORMAT fmt,
+                         size_t* outNumBytes, size_t* outRowBytes, size_t* outNumRows );
+    DXGI_FORMAT GetDXGIFormat( const DDS_PIXELFORMAT& ddpf );
+    DXGI_FORMAT MakeSRGB( DXGI_FORMAT format );
+
+    // Texels per block: 4x4 for BC formats, 2x1 for the packed 4:2:2 ones, else 1x1.
+    void GetBlockSize( DXGI_FORMAT fmt, uint32_t* blockWidth, uint32_t* blockHeight );
+
+    // The header is followed by the DX10 header when the fourCC is 'DX10'.
+    DDS_ALPHA_MODE GetAlphaMode( const DDS_HEADER* header );
+
+    struct DDSTextureDesc
+    {
+        uint32_t Dimension = 0; // DDS_DIMENSION_*
+        DXGI_FORMAT Format = DXGI_FORMAT_UNKNOWN;
+
+        // Of the largest mip level that was kept.
+        size_t Width = 0;
+        size_t Height = 0;
+        size_t Depth = 0;
+
+        size_t MipLevels = 0;
+        size_t ArraySize = 0; // Six faces per cube for cube maps.
+        bool IsCubeMap = false;
+
+        DDS_ALPHA_MODE AlphaMode = DDS_ALPHA_MODE_UNKNOWN;
+    };
+
+    // One mip level of one array slice, where it lies in the file.  The depth slices
+    // of a volume texture follow each other SliceBytes apart.
+    struct DDSSubresource
+    {
+        const uint8_t* Data = nullptr;
+        size_t Offset = 0; // Of Data from the start of the file.
+
+        size_t Width = 0;
+        size_t Height = 0;
+        size_t Depth = 0;
+
+        size_t RowBytes = 0;   // One row of texels, or of 4x4 blocks for BC formats.
+        size_t NumRows = 0;
+        size_t SliceBytes = 0; // RowBytes * NumRows.
+    };
+
+    // Where a subresource goes in an upload buffer.  The layout follows the rules
+    // CopyTextureRegion checks, so it can be worked out without a device: every
+    // subresource starts on a DDS_PLACEMENT_ALIGNMENT boundary and every row on a
+    // DDS_ROW_PITCH_ALIGNMENT boundary.
+    struct DDSPlacedSubresource
+    {
+        uint64_t Offset = 0; // From the start of the upload buffer.
+
+        // In texels, rounded up to whole blocks for block-compressed formats.
+        uint32_t Width = 0;
+        uint32_t Height = 0;
+        uint32_t Depth = 0;
+
+        uint32_t RowPitch = 0; // Aligned; RowBytes of the source is what gets copied.
+        uint32_t NumRows = 0;
+    };
+
+    // What it takes to get a file's texels into an upload buffer.  Ms and BytesCopied
+    // are measured on the run.  Copies and PeakBytes are tallied from the code path,
+    // not from the heap: Copies counts its passes over the texel data on the CPU, and
+    // PeakBytes the buffers it allocates, including the upload buffer but not the
+    // file mapping.
+    struct DDSUploadCost
+    {
+        size_t FileBytes = 0;
+        size_t UploadBytes = 0;
+        size_t PeakBytes = 0;
+        size_t BytesCopied = 0;
+        UINT Copies = 0;
+        double Ms = 0.0;
+    };
+
+    class DDSReader
+    {
+    public:
+        DDSReader() = default;
+        DDSReader(const DDSReader& rhs) = delete;
+        DDSReader& operator=(const DDSReader& rhs) = delete;
+
+        // Maps the file and parses it.  The subresources point into the mapping,
+        // which stays open until Close or the reader is destroyed.  Mip levels larger
+        // than maxsize (if not 0) in any dimension are skipped.
+        HRESULT Open(const std::wstring& filename, size_t maxsize = 0);
+        HRESULT Open(const std::string& filename, size_t maxsize = 0);
+
+        // Parses a file that is already in memory; the caller keeps it alive.
+        HRESULT Parse(const uint8_t* ddsData, size_t ddsDataSize, size_t maxsize = 0);
+
+        void Close();
+
+        const DDSTextureDesc& GetDesc()const;
+
+        // In D3D12 subresource order: mip + slice*MipLevels.
+        const std::vector<DDSSubresource>& GetSubresources()const;
+
+        // Bytes of texel data in the subresources that were kept.
+        size_t GetDataSize()const;
+
+        // Lays the subresources out for an upload buffer and returns the size it needs.
+        uint64_t GetPlacedSubresources(std::vector<DDSPlacedSubresource>& placed)const;
+
+        // Copies every row from the file into the upload buffer in one pass, padding
+        // rows out to the aligned pitch.  Returns false if the buffer is too small.
+        bool CopyToUploadBuffer(uint8_t* dest, uint64_t destSize,
+                                const std::vector<DDSPlacedSubresource>& placed)const;
+
+    private:
+        HRESULT ReadDesc(const DDS_HEADER* header);
+        HRESULT LayOutSubresources(const uint8_t* ddsData, size_t ddsDataSize, size_t offset, size_t maxsize);
+
+        MappedFile mFile;
+        DDSTextureDesc mDesc;
+        std::vector<DDSSubresource> mSubresources;
+    };
+
+    // Loads a file both ways into a scratch upload buffer and reports the cost of
+    // each: legacy reads the whole file into a heap buffer and copies from there, the
+    // way LoadTextureDataFromFile and UpdateSubresources do; mapped copies straight
+    // from the file mapping.
+    HRESULT MeasureDDSUpload(const std::wstring& filename,
+                             DDSUploadCost& legacy, DDSUploadCost& mapped);
+
+    // Builds a .dds file with a DX10 header for a 2D texture or texture array.  The
+    // texels are laid out in subresource order, tightly packed, the way DDSReader
+    // reads them back.
+    void WriteDDS(const DDSTextureDesc& desc, const uint8_t* texels, size_t texelBytes,
+                  std::vector<uint8_t>& ddsData);
+
+    HRESULT SaveDDSFile(const std::wstring& filename, const std::vector<uint8_t>& ddsData);
+}
@@ -0,0 +1,310 @@
+//***************************************************************************************
+// FrustumCuller.cpp
+//***************************************************************************************
+
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+    // Puts a padding box behind every plane without overflowing the plane test.
+    const float PaddingExtent = -1e30f;
+}
+
+void FrustumCuller::SetBoxes(const std::vector<BoundingBox>& boxes)
+{
+    mBoxCount = (UINT)boxes.size();
+
+    const size_t padded = (boxes.size() + 3) & ~size_t(3);
+    mCenterX.assign(padded, 0.0f);
+    mCenterY.assign(padded, 0.0f);
+    mCenterZ.assign(padded, 0.0f);
+    mExtentX.assign(padded, PaddingExtent);
+    mExtentY.assign(padded, PaddingExtent);
+    mExtentZ.assign(padded, PaddingExtent);
+
+    for(UINT i = 0; i < mBoxCount; ++i)
+        SetBox(i, boxes[i]);
+}
+
+void FrustumCuller::SetBox(UINT index, const BoundingBox& box)
+{
+    assert(index < mBoxCount);
+
+    mCenterX[index] = box.Center.x;
+    mCenterY[index] = box.Center.y;
+    mCenterZ[index] = box.Center.z;
+    mExtentX[index] = box.Extents.x;
+    mExtentY[index] = box.Extents.y;
+    mExtentZ[index] = box.Extents.z;
+}
+
+UINT FrustumCuller::GetBoxCount()const
+{
+    return mBoxCount;
+}
+
+void FrustumCuller::TransformBox(const BoundingBox& local, FXMMATRIX world, BoundingBox& out)
+{
+    XMVECTOR c = XMVector3Transform(XMLoadFloat3(&local.Center), world);
+    XMVECTOR e = XMLoadFloat3(&local.Extents);
+
+    XMVECTOR extents = XMVectorMultiply(XMVectorSplatX(e), XMVectorAbs(world.r[0]));
+    extents = XMVectorMultiplyAdd(XMVectorSplatY(e), XMVectorAbs(world.r[1]), extents);
+    extents = XMVectorMultiplyAdd(XMVectorSplatZ(e), XMVectorAbs(world.r[2]), extents);
+
+    XMStoreFloat3(&out.Center, c);
+    XMStoreFloat3(&out.Extents, extents);
+}
+
+void FrustumCuller::ExtractPlanes(FXMMATRIX viewProj, XMFLOAT4 planes[6])
+{
+    // With clip = p*M, the clip-space coordinates are p dotted with the columns of M,
+    // i.e. the rows of its transpose.  A point is inside when -w <= x <= w,
+    // -w <= y <= w and 0 <= z <= w.
+    XMMATRIX m = XMMatrixTranspose(viewProj);
+
+    XMVECTOR p[6] =
+    {
+        XMVectorAdd(m.r[3], m.r[0]),      // Left
+        XMVectorSubtract(m.r[3], m.r[0]), // Right
+        XMVectorAdd(m.r[3], m.r[1]),      // Bottom
+        XMVectorSubtract(m.r[3], m.r[1]), // Top
+        m.r[2],                           // Near
+        XMVectorSubtract(m.r[3], m.r[2]), // Far
+    };
+
+    for(int i = 0; i < 6; ++i)
+        XMStoreFloat4(&planes[i], XMPlaneNormalize(p[i]));
+}
+
+void FrustumCuller::CullChunk(const XMFLOAT4 planes[6], size_t chunk)
+{
+    // Each plane component splatted across a vector, and |n| for the box's
+    // projected radius r = |n.x|*e.x + |n.y|*e.y + |n.z|*e.z.
+    XMVECTOR nx[6], ny[6], nz[6], nw[6];
+    XMVECTOR ax[6], ay[6], az[6];
+    for(int p = 0; p < 6; ++p)
+    {
+        nx[p] = XMVectorReplicate(planes[p].x);
+        ny[p] = XMVectorReplicate(planes[p].y);
+        nz[p] = XMVectorReplicate(planes[p].z);
+        nw[p] = XMVectorReplicate(planes[p].w);
+        ax[p] = XMVectorAbs(nx[p]);
+        ay[p] = XMVectorAbs(ny[p]);
+        az[p] = XMVectorAbs(nz[p]);
+    }
+
+    std::vector<UINT>& visible = mChunkVisible[chunk];
+    visible.clear();
+
+    const size_t groupCount = mCenterX.size()/4;
+    const size_t firstGroup = chunk*GroupsPerChunk;
+    const size_t lastGroup = (std::min)(firstGroup + GroupsPerChunk, groupCount);
+    const XMVECTOR zero = XMVectorZero();
+
+    for(size_t g = firstGroup; g < lastGroup; ++g)
+    {
+        const size_t i = g*4;
+        XMVECTOR cx = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterX[i]));
+        XMVECTOR cy = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterY[i]));
+        XMVECTOR cz = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mCenterZ[i]));
+        XMVECTOR ex = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mExtentX[i]));
+        XMVECTOR ey = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mExtentY[i]));
+        XMVECTOR ez = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(&mExtentZ[i]));
+
+        // A box is outside if its center is further behind some plane than its
+        // radius along that plane's normal: n.c + w + r < 0.
+        XMVECTOR outside = XMVectorFalseInt();
+        for(int p = 0; p < 6; ++p)
+        {
+            XMVECTOR d = XMVectorMultiplyAdd(cx, nx[p], XMVectorMultiplyAdd(cy, ny[p], XMVectorMultiplyAdd(cz, nz[p], nw[p])));
+            XMVECTOR r = XMVectorMultiplyAdd(ex, ax[p], XMVectorMultiplyAdd(ey, ay[p], XMVectorMultiply(ez, az[p])));
+            outside = XMVectorOrInt(outside, XMVectorLess(XMVectorAdd(d, r), zero));
+        }
+
+        uint32_t mask[4];
+        XMStoreInt4(mask, outside);
+        for(int k = 0; k < 4; ++k)
+        {
+            if(mask[k] == 0)
+                visible.push_back(UINT(i + k));
+        }
+    }
+}
+
+UINT FrustumCuller::Cull(FXMMATRIX viewProj, std::vector<UINT>& visible, unsigned numThreads)
+{
+    XMFLOAT4 planes[6];
+    ExtractPlanes(viewProj, planes);
+
+    const size_t groupCount = mCenterX.size()/4;
+    const size_t chunkCount = (groupCount + GroupsPerChunk - 1)/GroupsPerChunk;
+    mChunkVisible.resize(chunkCount);
+
+    ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t c = begin; c < end; ++c)
+            CullChunk(planes, c);
+    }, numThreads);
+
+    // Chunks are in index order, so concatenating them keeps the indices sorted.
+    std::vector<size_t> offsets(chunkCount + 1, 0);
+    for(size_t c = 0; c < chunkCount; ++c)
+        offsets[c + 1] = offsets[c] + mChunkVisible[c].size();
+
+    visible.resize(offsets[chunkCount]);
+    ParallelFor(chunkCount, 16, [&](size_t begin, size_t end)
+    {
+        for(size_t c = begin; c < end; ++c)
+        {
+            if(!mChunkVisible[c].empty())
+                std::memcpy(&visible[offsets[c]], mChunkVisible[c].data(), mChunkVisible[c].size()*sizeof(UINT));
+        }
+    }, numThreads);
+
+    return (UINT)visible.size();
+}
+
+UINT FrustumCuller::CullScalar(FXMMATRIX viewProj, std::vector<UINT>& visible)const
+{
+    XMFLOAT4 planes[6];
+    ExtractPlanes(viewProj, planes);
+
+    visible.clear();
+    for(UINT i = 0; i < mBoxCount; ++i)
+    {
+        bool outside = false;
+        for(int p = 0; p < 6 && !outside; ++p)
+        {
+            // Same operations in the same order as CullChunk, so the results agree
+            // exactly.
+            const XMFLOAT4& n = planes[p];
+            float d = mCenterX[i]*n.x + (mCenterY[i]*n.y + (mCenterZ[i]*n.z + n.w));
+            float r = mExtentX[i]*std::fabs(n.x) + (mExtentY[i]*std::fabs(n.y) + mExtentZ[i]*std::fabs(n.z));
+            outside = d + r < 0.0f;
+        }
+
+        if(!outside)
+            visible.push_back(i);
+    }
+
+    return (UINT)visible.size();
+}
+
+bool FrustumCuller::Benchmark(UINT boxCount, UINT iterations, BenchmarkResult& result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    result = BenchmarkResult();
+    result.Boxes = boxCount;
+    iterations = (std::max)(iterations, 1u);
+
+    // Boxes of a few units scattered through a cube twice the far distance across,
+    // around a camera at the origin.
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> extent(0.5f, 5.0f);
+
+    std::vector<BoundingBox> boxes(boxCount);
+    for(auto& b : boxes)
+    {
+        b.Center.x = position(rng);
+        b.Center.y = position(rng);
+        b.Center.z = position(rng);
+        b.Extents.x = extent(rng);
+        b.Extents.y = extent(rng);
+        b.Extents.z = extent(rng);
+    }
+
+    FrustumCuller culler;
+    culler.SetBoxes(boxes);
+
+    XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f),
+        XMVectorSet(0.3f, 0.1f, 1.0f, 1.0f), XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f/9.0f, 1.0f, 1000.0f);
+    XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+
+    std::vector<UINT> scalar, simd, threaded;
+
+    auto start = Clock::now();
+    for(UINT i = 0; i < iterations; ++i)
+        culler.CullScalar(viewProj, scalar);
+    result.ScalarMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count()/iterations;
+
+    start = Clock::now();
+    for(UINT i = 0; i < iterations; ++i)
+        culler.Cull(viewProj, simd, 1);
+    result.SimdMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count()/iterations;
+
+    start = Clock::now();
+    for(UINT i = 0; i < iterations; ++i)
+        culler.Cull(viewProj, threaded);
+    result.ThreadedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count()/iterations;
+
+    XMFLOAT4X4 identity;
+    XMStoreFloat4x4(&identity, XMMatrixIdentity());
+    std::vector<XMFLOAT4X4> source(boxCount, identity);
+    std::vector<XMFLOAT4X4> dest(threaded.size());
+    start = Clock::now();
+    for(UINT i = 0; i < iterations; ++i)
+        Compact(source.data(), threaded, dest.data());
+    result.CompactMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count()/iterations;
+
+    // Each box as a local box at the origin placed by a world matrix, as instances
+    // are.  First the test this class replaces: per box, invert the world matrix,
+    // move the view-space frustum into local space and test the local box there.
+    std::vector<XMFLOAT4X4> worlds(boxCount);
+    for(UINT i = 0; i < boxCount; ++i)
+        XMStoreFloat4x4(&worlds[i], XMMatrixTranslation(boxes[i].Center.x, boxes[i].Center.y, boxes[i].Center.z));
+
+    BoundingFrustum viewFrustum;
+    BoundingFrustum::CreateFromMatrix(viewFrustum, proj);
+    XMMATRIX invView = XMMatrixInverse(nullptr, view);
+
+    std::vector<UINT> localSpace;
+    start = Clock::now();
+    for(UINT i = 0; i < iterations; ++i)
+    {
+        localSpace.clear();
+        for(UINT k = 0; k < boxCount; ++k)
+        {
+            XMMATRIX world = XMLoadFloat4x4(&worlds[k]);
+            XMMATRIX invWorld = XMMatrixInverse(nullptr, world);
+
+            BoundingFrustum localFrustum;
+            viewFrustum.Transform(localFrustum, XMMatrixMultiply(invView, invWorld));
+
+            BoundingBox localBox(XMFLOAT3(0.0f, 0.0f, 0.0f), boxes[k].Extents);
+            if(localFrustum.Contains(localBox) != DISJOINT)
+                localSpace.push_back(k);
+        }
+    }
+    result.LocalSpaceMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count()/iterations;
+    result.LocalSpaceVisible = (UINT)localSpace.size();
+
+    // Then what the world-space test pays instead when instances move: a world box
+    // per moved instance.  This rebuilds all of them.
+    start = Clock::now();
+    for(UINT i = 0; i < iterations; ++i)
+    {
+        for(UINT k = 0; k < boxCount; ++k)
+        {
+            BoundingBox localBox(XMFLOAT3(0.0f, 0.0f, 0.0f), boxes[k].Extents);
+            BoundingBox worldBox;
+            TransformBox(localBox, XMLoadFloat4x4(&worlds[k]), worldBox);
+            culler.SetBox(k, worldBox);
+        }
+    }
+    result.RebuildBoundsMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count()/iterations;
+
+    result.Visible = (UINT)threaded.size();
+    result.Matches = simd == scalar && threaded == scalar;
+    return result.Matches;
+}
@@ -0,0 +1,118 @@
+//***************************************************************************************
+// FrustumCuller.h
+//
+// Culls large numbers of world-space axis-aligned boxes against a view frustum.  The
+// boxes are kept as structure-of-arrays (all center x, then all center y, ...), so
+// four boxes load into four DirectXMath vectors and are tested against a plane in a
+// handful of vector instructions.  Runs of boxes are spread over worker threads, and
+// the indices of the visible ones come out in increasing order, ready to compact the
+// matching instance data into one contiguous run.
+//
+// A box is culled only when it lies entirely behind one of the six planes.  That is
+// conservative: a box near a frustum corner can be kept although it misses the
+// frustum, which costs a draw but never drops a visible object.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+#include <cstring>
+#include "ParallelFor.h"
+
+class FrustumCuller
+{
+public:
+    struct BenchmarkResult
+    {
+        UINT Boxes = 0;
+        UINT Visible = 0;
+
+        // Per cull, averaged over the iterations.
+        double ScalarMs = 0.0;       // One box at a time, one thread.
+        double SimdMs = 0.0;         // Four boxes at a time, one thread.
+        double ThreadedMs = 0.0;     // Four boxes at a time, all threads.
+        double CompactMs = 0.0;      // Gathering a 64-byte element per visible box.
+
+        // The per-instance local-space test this replaces: inverting each world
+        // matrix and moving the frustum into local space.  BoundingFrustum's test
+        // is tighter than the plane test, so it can keep fewer boxes.
+        double LocalSpaceMs = 0.0;
+        UINT LocalSpaceVisible = 0;
+
+        // Rebuilding every world box from a local box and world matrix; a frame
+        // pays this only for the instances that moved.
+        double RebuildBoundsMs = 0.0;
+
+        // The vector and threaded paths kept exactly the boxes the scalar one did.
+        bool Matches = false;
+    };
+
+    FrustumCuller() = default;
+    FrustumCuller(const FrustumCuller& rhs) = delete;
+    FrustumCuller& operator=(const FrustumCuller& rhs) = delete;
+
+    // Replaces the boxes.  Box i keeps index i.
+    void SetBoxes(const std::vector<DirectX::BoundingBox>& boxes);
+    void SetBox(UINT index, const DirectX::BoundingBox& box);
+    UINT GetBoxCount()const;
+
+    // The world box around a local box placed by an affine world matrix: the
+    // center is transformed and the extents scaled by the absolute values of the
+    // matrix's upper 3x3.  The same box as BoundingBox::Transform, which transforms
+    // all eight corners, for a fraction of the work.
+    static void TransformBox(const DirectX::BoundingBox& local, DirectX::FXMMATRIX world,
+        DirectX::BoundingBox& out);
+
+    // The six planes bounding the clip volume of viewProj (row vectors, depth in
+    // [0, 1]), normalized and facing inward, in the space viewProj transforms from:
+    // left, right, bottom, top, near, far.
+    static void ExtractPlanes(DirectX::FXMMATRIX viewProj, DirectX::XMFLOAT4 planes[6]);
+
+    // Fills visible with the indices of the boxes that are not wholly outside the
+    // frustum of viewProj, in increasing order, and returns how many there are.
+    // numThreads = 0 uses one thread per hardware thread.
+    UINT Cull(DirectX::FXMMATRIX viewProj, std::vector<UINT>& visible, unsigned numThreads = 0);
+
+    // The same test one box at a time, to check Cull against.
+    UINT CullScalar(DirectX::FXMMATRIX viewProj, std::vector<UINT>& visible)const;
+
+    // dest[i] = source[visible[i]].  dest must hold visible.size() elements.
+    template<typename T>
+    static void Compact(const T* source, const std::vector<UINT>& visible, T* dest,
+        unsigned numThreads = 0)
+    {
+        ParallelFor(visible.size(), CompactChunkSize, [&](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; ++i)
+                std::memcpy(&dest[i], &source[visible[i]], sizeof(T));
+        }, numThreads);
+    }
+
+    // Culls boxCount random boxes scattered around a camera, iterations times per
+    // path, and checks the paths agree.
+    static bool Benchmark(UINT boxCount, UINT iterations, BenchmarkResult& result);
+
+private:
+    // Boxes are tested in groups of four; a chunk of groups is the unit of work.
+    static const size_t GroupsPerChunk = 1024;
+    static const size_t CompactChunkSize = 16384;
+
+    void CullChunk(const DirectX::XMFLOAT4 planes[6], size_t chunk);
+
+    UINT mBoxCount = 0;
+
+    // Padded to a multiple of four.  Padding boxes have negative extents, which
+    // puts them behind every plane.
+    std::vector<float> mCenterX;
+    std::vector<float> mCenterY;
+    std::vector<float> mCenterZ;
+    std::vector<float> mExtentX;
+    std::vector<float> mExtentY;
+    std::vector<float> mExtentZ;
+
+    // Visible indices found by each chunk, concatenated once every chunk is done.
+    std::vector<std::vector<UINT>> mChunkVisible;
+};
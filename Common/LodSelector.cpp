@@ -0,0 +1,211 @@
+//***************************************************************************************
+// LodSelector.cpp
+//***************************************************************************************
+
+#include "LodSelector.h"
+#include "FrustumCuller.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+    // What ProjectedDiameter needs from the matrices: the view-space z row, how the
+    // projection makes w from z, and pixels per unit at w = 1.
+    struct Projection
+    {
+        XMFLOAT4 ViewZ;
+        float WFromZ;
+        float WBias;
+        float PixelsPerUnit;
+    };
+
+    Projection MakeProjection(FXMMATRIX view, CXMMATRIX proj, float viewportHeight)
+    {
+        XMFLOAT4X4 v, p;
+        XMStoreFloat4x4(&v, view);
+        XMStoreFloat4x4(&p, proj);
+
+        Projection result;
+        result.ViewZ = XMFLOAT4(v._13, v._23, v._33, v._43);
+        result.WFromZ = p._34;
+        result.WBias = p._44;
+        result.PixelsPerUnit = p._22*viewportHeight;
+        return result;
+    }
+
+    // w is the view depth for a perspective projection and 1 for an orthographic
+    // one.  A sphere of radius r at depth w spans an angle whose tangent is
+    // r/sqrt(w^2 - r^2) in perspective; that term is 0 in orthographic.
+    float Diameter(const Projection& p, const BoundingSphere& s)
+    {
+        const XMFLOAT3& c = s.Center;
+        float z = c.x*p.ViewZ.x + c.y*p.ViewZ.y + c.z*p.ViewZ.z + p.ViewZ.w;
+        float w = z*p.WFromZ + p.WBias;
+        float rw = s.Radius*p.WFromZ;
+        if(w <= rw)
+            return FLT_MAX;
+
+        return s.Radius*p.PixelsPerUnit/std::sqrt(w*w - rw*rw);
+    }
+}
+
+void LodSelector::SetLevels(const std::vector<float>& minPixels)
+{
+    mMinPixels = minPixels;
+    std::sort(mMinPixels.begin(), mMinPixels.end(), std::greater<float>());
+    mLevels.assign(mMinPixels.size(), std::vector<UINT>());
+}
+
+UINT LodSelector::GetLevelCount()const
+{
+    return (UINT)mMinPixels.size();
+}
+
+float LodSelector::ProjectedDiameter(const BoundingSphere& sphere, FXMMATRIX view, CXMMATRIX proj,
+    float viewportHeight)
+{
+    return Diameter(MakeProjection(view, proj, viewportHeight), sphere);
+}
+
+UINT LodSelector::Select(const BoundingSphere* spheres, const std::vector<UINT>& candidates,
+    FXMMATRIX view, CXMMATRIX proj, float viewportHeight, unsigned numThreads)
+{
+    assert(!mMinPixels.empty());
+
+    const Projection projection = MakeProjection(view, proj, viewportHeight);
+    const size_t levelCount = mMinPixels.size();
+    const size_t chunkCount = (candidates.size() + ChunkSize - 1)/ChunkSize;
+
+    mChunkLevels.resize(chunkCount);
+    ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t c = begin; c < end; ++c)
+        {
+            std::vector<std::vector<UINT>>& levels = mChunkLevels[c];
+            levels.resize(levelCount);
+            for(auto& level : levels)
+                level.clear();
+
+            const size_t last = (std::min)((c + 1)*ChunkSize, candidates.size());
+            for(size_t i = c*ChunkSize; i < last; ++i)
+            {
+                UINT index = candidates[i];
+                float diameter = Diameter(projection, spheres[index]);
+
+                // The first level the instance is large enough for, if any.
+                for(size_t l = 0; l < levelCount; ++l)
+                {
+                    if(diameter >= mMinPixels[l])
+                    {
+                        levels[l].push_back(index);
+                        break;
+                    }
+                }
+            }
+        }
+    }, numThreads);
+
+    UINT kept = 0;
+    for(size_t l = 0; l < levelCount; ++l)
+    {
+        std::vector<UINT>& level = mLevels[l];
+        level.clear();
+        for(size_t c = 0; c < chunkCount; ++c)
+            level.insert(level.end(), mChunkLevels[c][l].begin(), mChunkLevels[c][l].end());
+        kept += (UINT)level.size();
+    }
+
+    mDropped = (UINT)candidates.size() - kept;
+    return kept;
+}
+
+const std::vector<UINT>& LodSelector::GetLevel(UINT level)const
+{
+    return mLevels[level];
+}
+
+UINT LodSelector::GetDropped()const
+{
+    return mDropped;
+}
+
+bool LodSelector::Benchmark(UINT objectCount, UINT iterations, BenchmarkResult& result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    result = BenchmarkResult();
+    result.Objects = objectCount;
+    iterations = (std::max)(iterations, 1u);
+
+    // A cube of spheres 2000 across, seen from the middle on a 1080-line screen.
+    std::mt19937 rng(1357);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    std::uniform_real_distribution<float> radius(0.5f, 5.0f);
+
+    std::vector<BoundingSphere> spheres(objectCount);
+    std::vector<BoundingBox> boxes(objectCount);
+    for(UINT i = 0; i < objectCount; ++i)
+    {
+        BoundingSphere& s = spheres[i];
+        s.Center = XMFLOAT3(position(rng), position(rng), position(rng));
+        s.Radius = radius(rng);
+        boxes[i] = BoundingBox(s.Center, XMFLOAT3(s.Radius, s.Radius, s.Radius));
+    }
+
+    XMMATRIX view = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f),
+        XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f/9.0f, 1.0f, 2000.0f);
+    const float height = 1080.0f;
+
+    FrustumCuller culler;
+    culler.SetBoxes(boxes);
+    std::vector<UINT> visible;
+    result.FrustumVisible = culler.Cull(XMMatrixMultiply(view, proj), visible);
+
+    LodSelector selector;
+    selector.SetLevels({ 32.0f, 8.0f, 2.0f });
+
+    double singleMs = 0.0;
+    double threadedMs = 0.0;
+    std::vector<std::vector<UINT>> single(selector.GetLevelCount());
+    bool matches = true;
+    for(UINT i = 0; i < iterations; ++i)
+    {
+        auto start = Clock::now();
+        selector.Select(spheres.data(), visible, view, proj, height, 1);
+        singleMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        for(UINT l = 0; l < selector.GetLevelCount(); ++l)
+            single[l] = selector.GetLevel(l);
+
+        start = Clock::now();
+        selector.Select(spheres.data(), visible, view, proj, height);
+        threadedMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        for(UINT l = 0; l < selector.GetLevelCount(); ++l)
+            matches = matches && single[l] == selector.GetLevel(l);
+    }
+
+    result.SingleThreadMs = singleMs/iterations;
+    result.ThreadedMs = threadedMs/iterations;
+    result.Dropped = selector.GetDropped();
+    for(UINT l = 0; l < selector.GetLevelCount(); ++l)
+        result.LevelCounts.push_back((UINT)selector.GetLevel(l).size());
+
+    // A unit sphere straight ahead at depth 100 spans cot(fovY/2)*height/sqrt(100^2 - 1)
+    // pixels, with cot(fovY/2) = 1 + sqrt(2) for a 45 degree view.
+    BoundingSphere ahead(XMFLOAT3(0.0f, 0.0f, 100.0f), 1.0f);
+    float expected = 2.4142136f*height/std::sqrt(9999.0f);
+    matches = matches && std::fabs(ProjectedDiameter(ahead, view, proj, height) - expected) < 1e-3f*expected;
+
+    result.Matches = matches;
+    return matches;
+}
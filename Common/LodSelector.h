@@ -0,0 +1,76 @@
+//***************************************************************************************
+// LodSelector.h
+//
+// Screen-size culling and level-of-detail selection, run on the instances that
+// survived frustum culling.  Each instance's world bounding sphere is projected to
+// a diameter in pixels, using the camera's projection and the viewport height.
+// Instances smaller than the last level's size are dropped.  The rest go to the
+// first level whose size they reach, level 0 being the most detailed, so each level
+// comes out as its own compacted list ready for one instanced draw.
+//
+// The diameter is the sphere's angular size seen from the eye, which is exact for a
+// sphere straight ahead and slightly small for one near the edge of a wide view,
+// where perspective stretches it.  A sphere that reaches the eye plane counts as
+// infinitely large.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+class LodSelector
+{
+public:
+    struct BenchmarkResult
+    {
+        UINT Objects = 0;
+        UINT FrustumVisible = 0;
+        UINT Dropped = 0;
+        std::vector<UINT> LevelCounts;
+
+        double SingleThreadMs = 0.0;
+        double ThreadedMs = 0.0;
+
+        // The threaded pass gave every level exactly what one thread did.
+        bool Matches = false;
+    };
+
+    LodSelector() = default;
+    LodSelector(const LodSelector& rhs) = delete;
+    LodSelector& operator=(const LodSelector& rhs) = delete;
+
+    // The smallest diameter in pixels for each level, sorted here from largest to
+    // smallest.  Anything smaller than the last is dropped.
+    void SetLevels(const std::vector<float>& minPixels);
+    UINT GetLevelCount()const;
+
+    // Sorts the candidates (indices into spheres) into levels, each keeping the
+    // candidates' order, and returns how many were kept.  numThreads = 0 uses one
+    // thread per hardware thread.
+    UINT Select(const DirectX::BoundingSphere* spheres, const std::vector<UINT>& candidates,
+        DirectX::FXMMATRIX view, DirectX::CXMMATRIX proj, float viewportHeight, unsigned numThreads = 0);
+
+    const std::vector<UINT>& GetLevel(UINT level)const;
+    UINT GetDropped()const;
+
+    // The sphere's diameter in pixels on a viewport viewportHeight pixels high.
+    static float ProjectedDiameter(const DirectX::BoundingSphere& sphere, DirectX::FXMMATRIX view,
+        DirectX::CXMMATRIX proj, float viewportHeight);
+
+    // Frustum culls objectCount random spheres with FrustumCuller, then selects
+    // levels for the visible ones on one thread and on all of them.
+    static bool Benchmark(UINT objectCount, UINT iterations, BenchmarkResult& result);
+
+private:
+    static const size_t ChunkSize = 1024;
+
+    std::vector<float> mMinPixels;
+
+    // Per level, then per chunk and level while selecting.
+    std::vector<std::vector<UINT>> mLevels;
+    std::vector<std::vector<std::vector<UINT>>> mChunkLevels;
+    UINT mDropped = 0;
+};
@@ -0,0 +1,92 @@
+//***************************************************************************************
+// MappedFile.cpp
+//***************************************************************************************
+
+#include "MappedFile.h"
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::string& filename)
+{
+    Close();
+
+    mFile = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    return Map();
+}
+
+bool MappedFile::Open(const std::wstring& filename)
+{
+    Close();
+
+    mFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    return Map();
+}
+
+bool MappedFile::Map()
+{
+    if(mFile == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if(!GetFileSizeEx(mFile, &fileSize))
+    {
+        Close();
+        return false;
+    }
+
+    // A zero-length file cannot be mapped, but it is still a valid (empty) file.
+    mSize = (size_t)fileSize.QuadPart;
+    if(mSize == 0)
+        return true;
+
+    mMapping = CreateFileMappingA(mFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if(mMapping == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    mData = static_cast<const BYTE*>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+    if(mData == nullptr)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if(mData != nullptr)
+        UnmapViewOfFile(mData);
+    if(mMapping != nullptr)
+        CloseHandle(mMapping);
+    if(mFile != INVALID_HANDLE_VALUE)
+        CloseHandle(mFile);
+
+    mFile = INVALID_HANDLE_VALUE;
+    mMapping = nullptr;
+    mData = nullptr;
+    mSize = 0;
+}
+
+bool MappedFile::IsOpen()const
+{
+    return mFile != INVALID_HANDLE_VALUE;
+}
+
+const BYTE* MappedFile::Data()const
+{
+    return mData;
+}
+
+size_t MappedFile::Size()const
+{
+    return mSize;
+}
@@ -0,0 +1,39 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// Read-only memory mapping of a whole file.  The file's bytes can be used in place
+// for as long as the MappedFile is open, without copying them into a buffer.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <string>
+
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile& rhs) = delete;
+    MappedFile& operator=(const MappedFile& rhs) = delete;
+    ~MappedFile();
+
+    // Returns false if the file cannot be opened or mapped.  An empty file
+    // opens successfully with Data() == nullptr.
+    bool Open(const std::string& filename);
+    bool Open(const std::wstring& filename);
+    void Close();
+
+    bool IsOpen()const;
+    const BYTE* Data()const;
+    size_t Size()const;
+
+private:
+    // Maps mFile once it has been opened.
+    bool Map();
+
+    HANDLE mFile = INVALID_HANDLE_VALUE;
+    HANDLE mMapping = nullptr;
+    const BYTE* mData = nullptr;
+    size_t mSize = 0;
+};
@@ -0,0 +1,306 @@
+//***************************************************************************************
+// ModelLibrary.cpp
+//***************************************************************************************
+
+#include "ModelLibrary.h"
+#include "MappedFile.h"
+#include "MathHelper.h"
+#include "TextTokenizer.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+using namespace DirectX;
+
+namespace
+{
+    const UINT CookedMagic = 0x434C444D; // "MDLC"
+    const UINT CookedVersion = 1;
+
+    // Followed by the positions, normals and indices.
+    struct CookedHeader
+    {
+        UINT Magic;
+        UINT Version;
+
+        UINT64 SourceSize;
+        UINT64 SourceWriteTime;
+        UINT64 SourceHash;
+
+        UINT NumVertices;
+        UINT NumIndices;
+
+        XMFLOAT3 BoundsCenter;
+        XMFLOAT3 BoundsExtents;
+        XMFLOAT3 SphereCenter;
+        float SphereRadius;
+    };
+
+    // 64-bit FNV-1a.
+    UINT64 HashBytes(const BYTE* data, size_t size)
+    {
+        UINT64 hash = 14695981039346656037ULL;
+        for(size_t i = 0; i < size; ++i)
+        {
+            hash ^= data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    bool GetSourceSizeAndTime(const std::string& filename, UINT64& size, UINT64& writeTime)
+    {
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if(!GetFileAttributesExA(filename.c_str(), GetFileExInfoStandard, &attributes))
+            return false;
+
+        size = ((UINT64)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+        writeTime = ((UINT64)attributes.ftLastWriteTime.dwHighDateTime << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+        return true;
+    }
+
+    void ComputeBounds(ModelMesh& mesh)
+    {
+        XMVECTOR vMin = XMVectorReplicate(+MathHelper::Infinity);
+        XMVECTOR vMax = XMVectorReplicate(-MathHelper::Infinity);
+        for(const XMFLOAT3& p : mesh.Positions)
+        {
+            XMVECTOR P = XMLoadFloat3(&p);
+            vMin = XMVectorMin(vMin, P);
+            vMax = XMVectorMax(vMax, P);
+        }
+
+        XMStoreFloat3(&mesh.Bounds.Center, 0.5f*(vMin + vMax));
+        XMStoreFloat3(&mesh.Bounds.Extents, 0.5f*(vMax - vMin));
+
+        if(!mesh.Positions.empty())
+        {
+            BoundingSphere::CreateFromPoints(mesh.Sphere, mesh.Positions.size(),
+                mesh.Positions.data(), sizeof(XMFLOAT3));
+        }
+    }
+}
+
+ModelLibrary& ModelLibrary::Get()
+{
+    static ModelLibrary library;
+    return library;
+}
+
+const ModelMesh* ModelLibrary::Load(const std::string& filename)
+{
+    std::shared_ptr<Entry> entry;
+    bool cacheEnabled = true;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        std::shared_ptr<Entry>& slot = mModels[filename];
+        if(slot)
+            ++mStats.SharedHits;
+        else
+            slot = std::make_shared<Entry>();
+
+        entry = slot;
+        cacheEnabled = mCacheEnabled;
+    }
+
+    std::call_once(entry->Once, [&]() { entry->Mesh = LoadMesh(filename, cacheEnabled); });
+
+    if(entry->Mesh == nullptr)
+    {
+        // Forget the failure so that a later call tries the file again.
+        std::lock_guard<std::mutex> lock(mMutex);
+        auto it = mModels.find(filename);
+        if(it != mModels.end() && it->second == entry)
+            mModels.erase(it);
+    }
+
+    return entry->Mesh.get();
+}
+
+std::unique_ptr<ModelMesh> ModelLibrary::LoadMesh(const std::string& filename, bool cacheEnabled)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    SourceKey source;
+    if(!GetSourceSizeAndTime(filename, source.Size, source.WriteTime))
+        return nullptr;
+
+    auto mesh = std::make_unique<ModelMesh>();
+    mesh->Filename = filename;
+
+    const std::string cookedFilename = filename + ".cooked";
+    if(cacheEnabled && LoadCooked(filename, cookedFilename, source, *mesh))
+    {
+        mesh->FromCache = true;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mStats.CacheLoads;
+    }
+    else
+    {
+        if(!LoadText(filename, *mesh, source.Hash))
+            return nullptr;
+
+        ComputeBounds(*mesh);
+
+        // A failed write (e.g. a read-only folder) only costs the next run a parse.
+        if(cacheEnabled)
+            SaveCooked(cookedFilename, source, *mesh);
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        ++mStats.TextLoads;
+    }
+
+    mesh->LoadMs = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    return mesh;
+}
+
+void ModelLibrary::Clear()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mModels.clear();
+}
+
+void ModelLibrary::SetCacheEnabled(bool enabled)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mCacheEnabled = enabled;
+}
+
+ModelLibrary::Stats ModelLibrary::GetStats()const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mStats;
+}
+
+bool ModelLibrary::LoadText(const std::string& filename, ModelMesh& mesh, UINT64& hash)
+{
+    MappedFile file;
+    if(!file.Open(filename) || file.Size() == 0)
+        return false;
+
+    const char* text = reinterpret_cast<const char*>(file.Data());
+    hash = HashBytes(file.Data(), file.Size());
+
+    TextTokenizer tok(text, text + file.Size());
+
+    UINT vcount = 0;
+    UINT tcount = 0;
+
+    tok.SkipToken(); vcount = tok.ReadUInt();
+    tok.SkipToken(); tcount = tok.ReadUInt();
+    tok.SkipToken(4); // VertexList (pos, normal) {
+    if(tok.Failed())
+        return false;
+
+    mesh.Positions.resize(vcount);
+    mesh.Normals.resize(vcount);
+    for(UINT i = 0; i < vcount; ++i)
+    {
+        mesh.Positions[i] = tok.ReadFloat3();
+        mesh.Normals[i] = tok.ReadFloat3();
+    }
+
+    tok.SkipToken(3); // } TriangleList {
+
+    mesh.Indices.resize(3 * (size_t)tcount);
+    for(size_t i = 0; i < mesh.Indices.size(); ++i)
+    {
+        mesh.Indices[i] = tok.ReadInt();
+        if((UINT)mesh.Indices[i] >= vcount)
+            return false;
+    }
+
+    return !tok.Failed();
+}
+
+bool ModelLibrary::LoadCooked(const std::string& filename, const std::string& cookedFilename,
+    const SourceKey& source, ModelMesh& mesh)
+{
+    MappedFile file;
+    if(!file.Open(cookedFilename) || file.Size() < sizeof(CookedHeader))
+        return false;
+
+    CookedHeader header;
+    memcpy(&header, file.Data(), sizeof(header));
+    if(header.Magic != CookedMagic || header.Version != CookedVersion)
+        return false;
+
+    const UINT64 payloadSize = (UINT64)header.NumVertices * 2 * sizeof(XMFLOAT3) +
+        (UINT64)header.NumIndices * sizeof(std::int32_t);
+    if(file.Size() != sizeof(CookedHeader) + payloadSize)
+        return false;
+
+    // Same size and write time as when it was cooked: the source is unchanged.
+    // Otherwise the source may only have been touched or copied (as a checkout
+    // does), so compare contents before giving up on the cooked file.
+    const bool restamp = header.SourceWriteTime != source.WriteTime;
+    if(header.SourceSize != source.Size)
+        return false;
+    if(restamp)
+    {
+        MappedFile sourceFile;
+        if(!sourceFile.Open(filename) || HashBytes(sourceFile.Data(), sourceFile.Size()) != header.SourceHash)
+            return false;
+    }
+
+    const BYTE* p = file.Data() + sizeof(CookedHeader);
+    mesh.Positions.assign((const XMFLOAT3*)p, (const XMFLOAT3*)p + header.NumVertices);
+    p += header.NumVertices * sizeof(XMFLOAT3);
+    mesh.Normals.assign((const XMFLOAT3*)p, (const XMFLOAT3*)p + header.NumVertices);
+    p += header.NumVertices * sizeof(XMFLOAT3);
+    mesh.Indices.assign((const std::int32_t*)p, (const std::int32_t*)p + header.NumIndices);
+
+    for(std::int32_t index : mesh.Indices)
+    {
+        if((UINT)index >= header.NumVertices)
+            return false;
+    }
+
+    mesh.Bounds.Center = header.BoundsCenter;
+    mesh.Bounds.Extents = header.BoundsExtents;
+    mesh.Sphere.Center = header.SphereCenter;
+    mesh.Sphere.Radius = header.SphereRadius;
+
+    // Record the new write time so the next run takes the fast path again.
+    if(restamp)
+    {
+        file.Close();
+
+        SourceKey key = source;
+        key.Hash = header.SourceHash;
+        SaveCooked(cookedFilename, key, mesh);
+    }
+
+    return true;
+}
+
+bool ModelLibrary::SaveCooked(const std::string& cookedFilename, const SourceKey& source, const ModelMesh& mesh)
+{
+    std::ofstream fout(cookedFilename, std::ios::binary);
+    if(!fout)
+        return false;
+
+    CookedHeader header;
+    header.Magic = CookedMagic;
+    header.Version = CookedVersion;
+    header.SourceSize = source.Size;
+    header.SourceWriteTime = source.WriteTime;
+    header.SourceHash = source.Hash;
+    header.NumVertices = (UINT)mesh.Positions.size();
+    header.NumIndices = (UINT)mesh.Indices.size();
+    header.BoundsCenter = mesh.Bounds.Center;
+    header.BoundsExtents = mesh.Bounds.Extents;
+    header.SphereCenter = mesh.Sphere.Center;
+    header.SphereRadius = mesh.Sphere.Radius;
+
+    fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    fout.write(reinterpret_cast<const char*>(mesh.Positions.data()), mesh.Positions.size()*sizeof(XMFLOAT3));
+    fout.write(reinterpret_cast<const char*>(mesh.Normals.data()), mesh.Normals.size()*sizeof(XMFLOAT3));
+    fout.write(reinterpret_cast<const char*>(mesh.Indices.data()), mesh.Indices.size()*sizeof(std::int32_t));
+
+    return (bool)fout;
+}
@@ -0,0 +1,103 @@
+//***************************************************************************************
+// ModelLibrary.h
+//
+// Loads the book's text models (Models/skull.txt, Models/car.txt) once per process
+// and computes their bounds while loading.  Each load also writes a cooked binary
+// copy next to the source ("<file>.cooked") keyed by the source's size, write time
+// and hash, so later runs map that instead of parsing text.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+///<summary>
+/// Positions, normals and triangle indices of a text model, plus its bounds.  Apps
+/// build their own vertex format from it.
+///</summary>
+struct ModelMesh
+{
+    std::string Filename;
+
+    std::vector<DirectX::XMFLOAT3> Positions;
+    std::vector<DirectX::XMFLOAT3> Normals;
+    std::vector<std::int32_t> Indices;
+
+    DirectX::BoundingBox Bounds;
+    DirectX::BoundingSphere Sphere;
+
+    // True if the mesh came from the cooked cache rather than the text file.
+    bool FromCache = false;
+
+    // Time the load took, in milliseconds.
+    double LoadMs = 0.0;
+};
+
+class ModelLibrary
+{
+public:
+    struct Stats
+    {
+        UINT TextLoads = 0;  // Parsed from the text file.
+        UINT CacheLoads = 0; // Read from an up-to-date cooked file.
+        UINT SharedHits = 0; // Already loaded by an earlier Load call.
+    };
+
+    ModelLibrary() = default;
+    ModelLibrary(const ModelLibrary& rhs) = delete;
+    ModelLibrary& operator=(const ModelLibrary& rhs) = delete;
+
+    // The library shared by everything in the process.
+    static ModelLibrary& Get();
+
+    // Returns the model, loading it the first time it is asked for.  Returns nullptr
+    // if the file is missing or malformed.  The mesh lives until Clear is called.
+    // Different models load in parallel; callers asking for one that is still
+    // loading wait for it.
+    const ModelMesh* Load(const std::string& filename);
+
+    // Drops every loaded model.
+    void Clear();
+
+    // With the cache off, models are always parsed from text and nothing is written.
+    void SetCacheEnabled(bool enabled);
+
+    Stats GetStats()const;
+
+private:
+    // What the cooked file is keyed by.
+    struct SourceKey
+    {
+        UINT64 Size = 0;
+        UINT64 WriteTime = 0;
+        UINT64 Hash = 0;
+    };
+
+    // One per requested file.  The first Load parses it under Once, without holding
+    // mMutex; Mesh stays null if the load failed.
+    struct Entry
+    {
+        std::once_flag Once;
+        std::unique_ptr<ModelMesh> Mesh;
+    };
+
+    std::unique_ptr<ModelMesh> LoadMesh(const std::string& filename, bool cacheEnabled);
+    bool LoadText(const std::string& filename, ModelMesh& mesh, UINT64& hash);
+    bool LoadCooked(const std::string& filename, const std::string& cookedFilename,
+        const SourceKey& source, ModelMesh& mesh);
+    bool SaveCooked(const std::string& cookedFilename, const SourceKey& source, const ModelMesh& mesh);
+
+    // Guards the map, the settings and the stats, but not the loads themselves.
+    mutable std::mutex mMutex;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> mModels;
+    bool mCacheEnabled = true;
+    Stats mStats;
+};
@@ -0,0 +1,547 @@
+//***************************************************************************************
+// OcclusionCuller.cpp
+//***************************************************************************************
+
+#include "OcclusionCuller.h"
+#include "FrustumCuller.h"
+#include "GeometryGenerator.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+    // Vertices closer to the eye plane than this cannot be projected; triangles
+    // with one are skipped, which only loses occlusion.
+    const float MinW = 1e-5f;
+
+    void GetCorners(const BoundingBox& box, XMVECTOR corners[8])
+    {
+        for(int k = 0; k < 8; ++k)
+        {
+            corners[k] = XMVectorSet(
+                box.Center.x + ((k & 1) ? box.Extents.x : -box.Extents.x),
+                box.Center.y + ((k & 2) ? box.Extents.y : -box.Extents.y),
+                box.Center.z + ((k & 4) ? box.Extents.z : -box.Extents.z), 1.0f);
+        }
+    }
+}
+
+OcclusionCuller::OcclusionCuller(UINT width, UINT height)
+{
+    XMStoreFloat4x4(&mViewProj, XMMatrixIdentity());
+    Resize(width, height);
+}
+
+void OcclusionCuller::Resize(UINT width, UINT height)
+{
+    mWidth = (std::max)((width + 3) & ~3u, 4u);
+    mHeight = (std::max)(height, 1u);
+
+    mPyramid.clear();
+    mLevelWidth.clear();
+    mLevelHeight.clear();
+
+    UINT w = mWidth;
+    UINT h = mHeight;
+    for(;;)
+    {
+        mLevelWidth.push_back(w);
+        mLevelHeight.push_back(h);
+        mPyramid.emplace_back(size_t(w)*h, 1.0f);
+
+        if(w == 1 && h == 1)
+            break;
+
+        w = (w + 1)/2;
+        h = (h + 1)/2;
+    }
+}
+
+UINT OcclusionCuller::GetWidth()const
+{
+    return mWidth;
+}
+
+UINT OcclusionCuller::GetHeight()const
+{
+    return mHeight;
+}
+
+UINT OcclusionCuller::AddMesh(const std::vector<XMFLOAT3>& positions, const std::vector<UINT>& indices)
+{
+    Mesh mesh;
+    mesh.Positions = positions;
+    mesh.Indices = indices;
+    mMeshes.push_back(std::move(mesh));
+    return (UINT)mMeshes.size() - 1;
+}
+
+void OcclusionCuller::BeginFrame(FXMMATRIX viewProj)
+{
+    XMStoreFloat4x4(&mViewProj, viewProj);
+    mOccluders.clear();
+}
+
+void OcclusionCuller::AddOccluder(UINT mesh, FXMMATRIX world)
+{
+    assert(mesh < mMeshes.size());
+
+    Occluder occluder;
+    occluder.Mesh = mesh;
+    XMStoreFloat4x4(&occluder.WorldViewProj, XMMatrixMultiply(world, XMLoadFloat4x4(&mViewProj)));
+    mOccluders.push_back(occluder);
+}
+
+void OcclusionCuller::SetupOccluder(const Occluder& occluder, std::vector<Triangle>& triangles)const
+{
+    const Mesh& mesh = mMeshes[occluder.Mesh];
+    XMMATRIX wvp = XMLoadFloat4x4(&occluder.WorldViewProj);
+
+    const float width = (float)mWidth;
+    const float height = (float)mHeight;
+
+    triangles.clear();
+    for(size_t i = 0; i + 2 < mesh.Indices.size(); i += 3)
+    {
+        float x[3], y[3], z[3];
+        bool projectable = true;
+        for(int k = 0; k < 3; ++k)
+        {
+            XMFLOAT4 clip;
+            XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&mesh.Positions[mesh.Indices[i + k]]), wvp));
+            if(clip.w < MinW)
+            {
+                projectable = false;
+                break;
+            }
+
+            float invW = 1.0f/clip.w;
+            x[k] = (0.5f + 0.5f*clip.x*invW)*width;
+            y[k] = (0.5f - 0.5f*clip.y*invW)*height;
+            z[k] = clip.z*invW;
+        }
+
+        if(!projectable)
+            continue;
+
+        // Clockwise on screen, with y down, is a positive area.  Back faces lie
+        // behind the front faces of a closed occluder, so they are skipped.
+        float area = (x[1] - x[0])*(y[2] - y[0]) - (x[2] - x[0])*(y[1] - y[0]);
+        if(!(area > 0.0f))
+            continue;
+
+        Triangle t;
+        t.MinX = (int)(std::max)(0.0f, std::floor((std::min)({ x[0], x[1], x[2] })));
+        t.MinY = (int)(std::max)(0.0f, std::floor((std::min)({ y[0], y[1], y[2] })));
+        t.MaxX = (int)(std::min)(width - 1.0f, std::ceil((std::max)({ x[0], x[1], x[2] })));
+        t.MaxY = (int)(std::min)(height - 1.0f, std::ceil((std::max)({ y[0], y[1], y[2] })));
+        if(t.MinX > t.MaxX || t.MinY > t.MaxY)
+            continue;
+
+        // Edge k runs from vertex k to vertex k+1 and is positive on the side of the
+        // third vertex.  C is moved to pixel centers, so pixel (px, py) tests
+        // A*px + B*py + C.
+        for(int k = 0; k < 3; ++k)
+        {
+            int k1 = (k + 1) % 3;
+            float a = y[k] - y[k1];
+            float b = x[k1] - x[k];
+            float c = -(a*x[k] + b*y[k]);
+            t.EdgeA[k] = a;
+            t.EdgeB[k] = b;
+            t.EdgeC[k] = c + 0.5f*a + 0.5f*b;
+        }
+
+        // z = DepthX*x + DepthY*y + c over the screen, written as the farthest the
+        // plane reaches within each pixel, but no farther than the triangle does.
+        float invArea = 1.0f/area;
+        float dz1 = z[1] - z[0];
+        float dz2 = z[2] - z[0];
+        float zx = (dz1*(y[2] - y[0]) - dz2*(y[1] - y[0]))*invArea;
+        float zy = (dz2*(x[1] - x[0]) - dz1*(x[2] - x[0]))*invArea;
+        float zc = z[0] - zx*x[0] - zy*y[0];
+        t.DepthX = zx;
+        t.DepthY = zy;
+        t.Depth0 = zc + 0.5f*(zx + zy) + 0.5f*(std::fabs(zx) + std::fabs(zy));
+        t.MaxDepth = (std::max)({ z[0], z[1], z[2] });
+
+        triangles.push_back(t);
+    }
+}
+
+void OcclusionCuller::RasterizeRows(int firstRow, int lastRow)
+{
+    float* depth = mPyramid[0].data();
+    const XMVECTOR steps = XMVectorSet(0.0f, 1.0f, 2.0f, 3.0f);
+    const XMVECTOR zero = XMVectorZero();
+
+    for(const Triangle& t : mTriangles)
+    {
+        const int y0 = (std::max)(t.MinY, firstRow);
+        const int y1 = (std::min)(t.MaxY, lastRow - 1);
+        if(y0 > y1)
+            continue;
+
+        const int x0 = t.MinX & ~3;
+
+        // Per-pixel steps along a row, four pixels at a time.
+        XMVECTOR edgeStep[3], edgeStep4[3];
+        for(int k = 0; k < 3; ++k)
+        {
+            edgeStep[k] = XMVectorScale(steps, t.EdgeA[k]);
+            edgeStep4[k] = XMVectorReplicate(4.0f*t.EdgeA[k]);
+        }
+        const XMVECTOR depthStep = XMVectorScale(steps, t.DepthX);
+        const XMVECTOR depthStep4 = XMVectorReplicate(4.0f*t.DepthX);
+        const XMVECTOR maxDepth = XMVectorReplicate(t.MaxDepth);
+
+        for(int y = y0; y <= y1; ++y)
+        {
+            XMVECTOR e[3];
+            for(int k = 0; k < 3; ++k)
+                e[k] = XMVectorAdd(XMVectorReplicate(t.EdgeA[k]*x0 + t.EdgeB[k]*y + t.EdgeC[k]), edgeStep[k]);
+            XMVECTOR z = XMVectorAdd(XMVectorReplicate(t.DepthX*x0 + t.DepthY*y + t.Depth0), depthStep);
+
+            float* row = depth + size_t(y)*mWidth;
+            for(int x = x0; x <= t.MaxX; x += 4)
+            {
+                XMVECTOR inside = XMVectorAndInt(
+                    XMVectorAndInt(XMVectorGreaterOrEqual(e[0], zero), XMVectorGreaterOrEqual(e[1], zero)),
+                    XMVectorGreaterOrEqual(e[2], zero));
+
+                XMVECTOR old = XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(row + x));
+                XMVECTOR nearer = XMVectorMin(old, XMVectorMin(z, maxDepth));
+                XMStoreFloat4(reinterpret_cast<XMFLOAT4*>(row + x), XMVectorSelect(old, nearer, inside));
+
+                for(int k = 0; k < 3; ++k)
+                    e[k] = XMVectorAdd(e[k], edgeStep4[k]);
+                z = XMVectorAdd(z, depthStep4);
+            }
+        }
+    }
+}
+
+void OcclusionCuller::BuildPyramid()
+{
+    for(size_t level = 1; level < mPyramid.size(); ++level)
+    {
+        const std::vector<float>& fine = mPyramid[level - 1];
+        std::vector<float>& coarse = mPyramid[level];
+        const UINT fineWidth = mLevelWidth[level - 1];
+        const UINT fineHeight = mLevelHeight[level - 1];
+        const UINT width = mLevelWidth[level];
+        const UINT height = mLevelHeight[level];
+
+        for(UINT y = 0; y < height; ++y)
+        {
+            const UINT fy0 = 2*y;
+            const UINT fy1 = (std::min)(2*y + 1, fineHeight - 1);
+            for(UINT x = 0; x < width; ++x)
+            {
+                const UINT fx0 = 2*x;
+                const UINT fx1 = (std::min)(2*x + 1, fineWidth - 1);
+                coarse[y*width + x] = (std::max)(
+                    (std::max)(fine[fy0*fineWidth + fx0], fine[fy0*fineWidth + fx1]),
+                    (std::max)(fine[fy1*fineWidth + fx0], fine[fy1*fineWidth + fx1]));
+            }
+        }
+    }
+}
+
+void OcclusionCuller::Rasterize(unsigned numThreads)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    auto start = Clock::now();
+
+    mOccluderTriangles.resize(mOccluders.size());
+    ParallelFor(mOccluders.size(), 8, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+            SetupOccluder(mOccluders[i], mOccluderTriangles[i]);
+    }, numThreads);
+
+    mTriangles.clear();
+    for(size_t i = 0; i < mOccluders.size(); ++i)
+        mTriangles.insert(mTriangles.end(), mOccluderTriangles[i].begin(), mOccluderTriangles[i].end());
+
+    std::fill(mPyramid[0].begin(), mPyramid[0].end(), 1.0f);
+
+    // Each band of rows belongs to one thread, so no two threads write a pixel.
+    const size_t bandCount = (mHeight + RowsPerBand - 1)/RowsPerBand;
+    ParallelFor(bandCount, 1, [&](size_t begin, size_t end)
+    {
+        RasterizeRows(int(begin*RowsPerBand), int(std::min<size_t>(end*RowsPerBand, mHeight)));
+    }, numThreads);
+
+    BuildPyramid();
+
+    mStats = Stats();
+    mStats.Occluders = (UINT)mOccluders.size();
+    mStats.Triangles = (UINT)mTriangles.size();
+    mStats.RasterizeMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+bool OcclusionCuller::IsOccluded(const BoundingBox& worldBox)const
+{
+    XMMATRIX viewProj = XMLoadFloat4x4(&mViewProj);
+    XMVECTOR corners[8];
+    GetCorners(worldBox, corners);
+
+    float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+    float maxX = -FLT_MAX, maxY = -FLT_MAX;
+    for(int k = 0; k < 8; ++k)
+    {
+        XMFLOAT4 clip;
+        XMStoreFloat4(&clip, XMVector4Transform(corners[k], viewProj));
+        if(clip.w < MinW)
+            return false;
+
+        float invW = 1.0f/clip.w;
+        float x = (0.5f + 0.5f*clip.x*invW)*mWidth;
+        float y = (0.5f - 0.5f*clip.y*invW)*mHeight;
+        minX = (std::min)(minX, x);
+        maxX = (std::max)(maxX, x);
+        minY = (std::min)(minY, y);
+        maxY = (std::max)(maxY, y);
+        minZ = (std::min)(minZ, clip.z*invW);
+    }
+
+    if(maxX < 0.0f || maxY < 0.0f || minX >= (float)mWidth || minY >= (float)mHeight)
+        return false;
+
+    // The pixels the rectangle touches and one more on each side, since a pixel
+    // whose center an occluder covers may still show a sliver of the box past its
+    // edge.  Then the first level where they span at most 2x2 texels.
+    const int x0 = (int)(std::max)(minX - 1.0f, 0.0f);
+    const int y0 = (int)(std::max)(minY - 1.0f, 0.0f);
+    const int x1 = (int)(std::min)(maxX + 1.0f, mWidth - 1.0f);
+    const int y1 = (int)(std::min)(maxY + 1.0f, mHeight - 1.0f);
+
+    size_t level = 0;
+    while(((x1 >> level) - (x0 >> level)) > 1 || ((y1 >> level) - (y0 >> level)) > 1)
+        ++level;
+
+    const std::vector<float>& depth = mPyramid[level];
+    const UINT width = mLevelWidth[level];
+    float farthest = 0.0f;
+    for(int y = y0 >> level; y <= (y1 >> level); ++y)
+    {
+        for(int x = x0 >> level; x <= (x1 >> level); ++x)
+            farthest = (std::max)(farthest, depth[y*width + x]);
+    }
+
+    return minZ > farthest;
+}
+
+UINT OcclusionCuller::Cull(const BoundingBox* boxes, const std::vector<UINT>& candidates,
+    std::vector<UINT>& visible, unsigned numThreads)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    auto start = Clock::now();
+
+    const size_t chunkCount = (candidates.size() + TestChunkSize - 1)/TestChunkSize;
+    mChunkVisible.resize(chunkCount);
+
+    ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t c = begin; c < end; ++c)
+        {
+            std::vector<UINT>& out = mChunkVisible[c];
+            out.clear();
+
+            const size_t last = (std::min)((c + 1)*TestChunkSize, candidates.size());
+            for(size_t i = c*TestChunkSize; i < last; ++i)
+            {
+                if(!IsOccluded(boxes[candidates[i]]))
+                    out.push_back(candidates[i]);
+            }
+        }
+    }, numThreads);
+
+    visible.clear();
+    for(size_t c = 0; c < chunkCount; ++c)
+        visible.insert(visible.end(), mChunkVisible[c].begin(), mChunkVisible[c].end());
+
+    mStats.Tested = (UINT)candidates.size();
+    mStats.Culled = (UINT)(candidates.size() - visible.size());
+    mStats.TestMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    return (UINT)visible.size();
+}
+
+const std::vector<float>& OcclusionCuller::GetDepth()const
+{
+    return mPyramid[0];
+}
+
+const OcclusionCuller::Stats& OcclusionCuller::GetStats()const
+{
+    return mStats;
+}
+
+bool OcclusionCuller::Benchmark(UINT objectCount, UINT iterations, BenchmarkResult& result)
+{
+    result = BenchmarkResult();
+    result.Objects = objectCount;
+    iterations = (std::max)(iterations, 1u);
+
+    // The camera at the origin looks down +z at two staggered walls of boxes with
+    // narrow gaps between them, at 15 and 40 units.
+    XMMATRIX view = XMMatrixLookToLH(XMVectorZero(), XMVectorSet(0.0f, 0.0f, 1.0f, 0.0f),
+        XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+    XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 2.0f, 0.5f, 200.0f);
+    XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+
+    std::vector<BoundingBox> walls;
+    for(int row = 0; row < 2; ++row)
+    {
+        const float z = row == 0 ? 15.0f : 40.0f;
+        const float shift = row == 0 ? 0.0f : 4.0f;
+        for(int i = -4; i <= 4; ++i)
+        {
+            for(int j = -1; j <= 1; ++j)
+                walls.push_back(BoundingBox(XMFLOAT3(i*8.0f + shift, j*5.5f, z), XMFLOAT3(3.5f, 2.5f, 0.25f)));
+        }
+    }
+
+    GeometryGenerator geoGen;
+    GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
+    std::vector<XMFLOAT3> positions(box.Vertices.size());
+    for(size_t i = 0; i < positions.size(); ++i)
+        positions[i] = box.Vertices[i].Position;
+    std::vector<UINT> indices(box.Indices32.begin(), box.Indices32.end());
+
+    std::mt19937 rng(99);
+    std::uniform_real_distribution<float> px(-40.0f, 40.0f);
+    std::uniform_real_distribution<float> py(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> pz(3.0f, 100.0f);
+    std::uniform_real_distribution<float> extent(0.2f, 1.0f);
+
+    std::vector<BoundingBox> objects(objectCount);
+    for(auto& b : objects)
+    {
+        b.Center.x = px(rng);
+        b.Center.y = py(rng);
+        b.Center.z = pz(rng);
+        b.Extents.x = extent(rng);
+        b.Extents.y = extent(rng);
+        b.Extents.z = extent(rng);
+    }
+
+    FrustumCuller frustumCuller;
+    frustumCuller.SetBoxes(objects);
+    std::vector<UINT> inFrustum;
+    result.FrustumVisible = frustumCuller.Cull(viewProj, inFrustum);
+
+    OcclusionCuller culler;
+    UINT mesh = culler.AddMesh(positions, indices);
+
+    std::vector<UINT> visible;
+    for(int pass = 0; pass < 2; ++pass)
+    {
+        const unsigned numThreads = pass == 0 ? 0 : 1;
+        double rasterizeMs = 0.0;
+        double testMs = 0.0;
+        for(UINT i = 0; i < iterations; ++i)
+        {
+            culler.BeginFrame(viewProj);
+            for(const auto& w : walls)
+            {
+                culler.AddOccluder(mesh, XMMatrixScaling(2.0f*w.Extents.x, 2.0f*w.Extents.y, 2.0f*w.Extents.z)*
+                    XMMatrixTranslation(w.Center.x, w.Center.y, w.Center.z));
+            }
+            culler.Rasterize(numThreads);
+            culler.Cull(objects.data(), inFrustum, visible, numThreads);
+
+            rasterizeMs += culler.GetStats().RasterizeMs;
+            testMs += culler.GetStats().TestMs;
+        }
+
+        if(pass == 0)
+        {
+            result.RasterizeMs = rasterizeMs/iterations;
+            result.TestMs = testMs/iterations;
+        }
+        else
+        {
+            result.SingleThreadRasterizeMs = rasterizeMs/iterations;
+        }
+    }
+    result.Culled = (UINT)(inFrustum.size() - visible.size());
+
+    // Rays from the eye to points on each object (its center, and its corners and
+    // face centers pulled slightly in); an object is seen if one of them is on
+    // screen and no wall is in the way.
+    std::vector<char> kept(objectCount, 0);
+    for(UINT i : visible)
+        kept[i] = 1;
+
+    for(UINT i : inFrustum)
+    {
+        const BoundingBox& b = objects[i];
+        bool seen = false;
+        for(int s = 0; s < 15 && !seen; ++s)
+        {
+            XMFLOAT3 offset(0.0f, 0.0f, 0.0f);
+            if(s < 8)
+            {
+                offset = XMFLOAT3((s & 1) ? 1.0f : -1.0f, (s & 2) ? 1.0f : -1.0f, (s & 4) ? 1.0f : -1.0f);
+            }
+            else if(s < 14)
+            {
+                float* axis = &offset.x;
+                axis[(s - 8)/2] = ((s - 8) & 1) ? 1.0f : -1.0f;
+            }
+
+            XMFLOAT3 p(b.Center.x + 0.98f*offset.x*b.Extents.x,
+                b.Center.y + 0.98f*offset.y*b.Extents.y,
+                b.Center.z + 0.98f*offset.z*b.Extents.z);
+
+            XMFLOAT4 clip;
+            XMStoreFloat4(&clip, XMVector3Transform(XMLoadFloat3(&p), viewProj));
+            if(clip.w <= 0.0f || std::fabs(clip.x) > clip.w || std::fabs(clip.y) > clip.w || clip.z < 0.0f)
+                continue;
+
+            // Along the ray t*p, a wall blocks the point if the ray enters it before t = 1.
+            bool blocked = false;
+            for(const auto& w : walls)
+            {
+                float tEnter = 0.0f;
+                float tExit = 1.0f;
+                const float* o = &w.Center.x;
+                const float* e = &w.Extents.x;
+                const float* d = &p.x;
+                for(int k = 0; k < 3; ++k)
+                {
+                    float t0 = (o[k] - e[k])/d[k];
+                    float t1 = (o[k] + e[k])/d[k];
+                    if(t0 > t1)
+                        std::swap(t0, t1);
+                    tEnter = (std::max)(tEnter, t0);
+                    tExit = (std::min)(tExit, t1);
+                }
+
+                if(tEnter <= tExit)
+                {
+                    blocked = true;
+                    break;
+                }
+            }
+
+            seen = !blocked;
+        }
+
+        if(!seen)
+            ++result.Hidden;
+        else if(!kept[i])
+            ++result.FalseCulls;
+    }
+
+    return result.FalseCulls == 0;
+}
@@ -0,0 +1,152 @@
+//***************************************************************************************
+// OcclusionCuller.h
+//
+// Software occlusion culling.  A few simple occluder meshes (boxes or low LODs that
+// lie inside the real geometry) are rasterized on the CPU into a small depth buffer,
+// which is reduced into a pyramid where each texel holds the farthest occluder depth
+// below it.  An object's world box is then projected to a screen rectangle and its
+// nearest depth; if that depth is behind the farthest occluder depth over the
+// rectangle, read from a pyramid level where the rectangle spans at most 2x2 texels,
+// the object is hidden.
+//
+// Triangles are set up once, then bands of rows are rasterized on worker threads,
+// four pixels at a time with DirectXMath vectors.  Coverage is sampled at pixel
+// centers, so the test widens each rectangle by a pixel to keep slivers past an
+// occluder's silhouette from being hidden; the depth written is the farthest the
+// triangle reaches within the pixel, which keeps it from hiding objects just
+// behind a sloped occluder.
+//
+// Nothing here touches D3D, so it runs and can be checked headless.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+class OcclusionCuller
+{
+public:
+    struct Stats
+    {
+        UINT Occluders = 0;
+        UINT Triangles = 0; // Left after near-plane, back-face and screen rejection.
+        UINT Tested = 0;
+        UINT Culled = 0;
+
+        double RasterizeMs = 0.0; // Setup, rasterization and the pyramid.
+        double TestMs = 0.0;
+    };
+
+    struct BenchmarkResult
+    {
+        UINT Objects = 0;
+        UINT FrustumVisible = 0;
+        UINT Culled = 0;
+
+        // By casting rays at points on each object against the occluder boxes:
+        // objects no ray reaches, and culled objects some ray does reach.
+        UINT Hidden = 0;
+        UINT FalseCulls = 0;
+
+        double RasterizeMs = 0.0;
+        double SingleThreadRasterizeMs = 0.0;
+        double TestMs = 0.0;
+    };
+
+    OcclusionCuller(UINT width = 256, UINT height = 128);
+    OcclusionCuller(const OcclusionCuller& rhs) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller& rhs) = delete;
+
+    // The width is rounded up to a multiple of 4.
+    void Resize(UINT width, UINT height);
+    UINT GetWidth()const;
+    UINT GetHeight()const;
+
+    // Registers an occluder mesh in its local space and returns its index.  The
+    // triangles should face outward with clockwise winding, as D3D draws them.
+    UINT AddMesh(const std::vector<DirectX::XMFLOAT3>& positions, const std::vector<UINT>& indices);
+
+    // Starts a frame: clears the occluders placed last frame.
+    void BeginFrame(DirectX::FXMMATRIX viewProj);
+    void AddOccluder(UINT mesh, DirectX::FXMMATRIX world);
+
+    // Rasterizes the occluders added since BeginFrame and builds the pyramid.
+    // numThreads = 0 uses one thread per hardware thread.
+    void Rasterize(unsigned numThreads = 0);
+
+    // True if the box is hidden behind what was rasterized.  Boxes that cross the
+    // near plane or lie off screen are never hidden; frustum culling handles those.
+    bool IsOccluded(const DirectX::BoundingBox& worldBox)const;
+
+    // Fills visible with the candidates (indices into boxes) that are not hidden,
+    // in the order given, and returns how many there are.
+    UINT Cull(const DirectX::BoundingBox* boxes, const std::vector<UINT>& candidates,
+        std::vector<UINT>& visible, unsigned numThreads = 0);
+
+    // Level 0 is the rasterized depth; 1 is far.
+    const std::vector<float>& GetDepth()const;
+
+    const Stats& GetStats()const;
+
+    // Culls objectCount random boxes against rows of wall boxes in front of the
+    // camera, checking the culled ones by ray casting.
+    static bool Benchmark(UINT objectCount, UINT iterations, BenchmarkResult& result);
+
+private:
+    struct Mesh
+    {
+        std::vector<DirectX::XMFLOAT3> Positions;
+        std::vector<UINT> Indices;
+    };
+
+    struct Occluder
+    {
+        UINT Mesh;
+        DirectX::XMFLOAT4X4 WorldViewProj;
+    };
+
+    // A triangle ready to rasterize: edge functions that are >= 0 inside, the depth
+    // plane, and its pixel bounds.
+    struct Triangle
+    {
+        float EdgeA[3];
+        float EdgeB[3];
+        float EdgeC[3];
+        float DepthX;
+        float DepthY;
+        float Depth0;
+        float MaxDepth;
+        int MinX, MinY, MaxX, MaxY;
+    };
+
+    void SetupOccluder(const Occluder& occluder, std::vector<Triangle>& triangles)const;
+    void RasterizeRows(int firstRow, int lastRow);
+    void BuildPyramid();
+
+    static const int RowsPerBand = 8;
+    static const size_t TestChunkSize = 1024;
+
+    UINT mWidth = 0;
+    UINT mHeight = 0;
+
+    DirectX::XMFLOAT4X4 mViewProj;
+
+    std::vector<Mesh> mMeshes;
+    std::vector<Occluder> mOccluders;
+
+    // Triangles set up per occluder, then gathered into one list.
+    std::vector<std::vector<Triangle>> mOccluderTriangles;
+    std::vector<Triangle> mTriangles;
+
+    // Level 0 is mWidth x mHeight; each further level halves both, rounding up.
+    std::vector<std::vector<float>> mPyramid;
+    std::vector<UINT> mLevelWidth;
+    std::vector<UINT> mLevelHeight;
+
+    std::vector<std::vector<UINT>> mChunkVisible;
+
+    Stats mStats;
+};
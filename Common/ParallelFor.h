@@ -0,0 +1,43 @@
+//***************************************************************************************
+// ParallelFor.h
+//
+// Splits an index range into contiguous chunks and runs them on worker threads.
+// The calling thread takes the first chunk, so a range that fits in one chunk
+// never starts a thread.
+//***************************************************************************************
+
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+// Calls func(begin, end) over consecutive chunks of [0, count) and returns once
+// every chunk is done.  Chunks hold at least minChunkSize indices.  numThreads = 0
+// uses one thread per hardware thread.
+template<typename Func>
+void ParallelFor(size_t count, size_t minChunkSize, Func func, unsigned numThreads = 0)
+{
+    if(count == 0)
+        return;
+
+    if(numThreads == 0)
+        numThreads = (std::max)(1u, std::thread::hardware_concurrency());
+
+    minChunkSize = std::max<size_t>(minChunkSize, 1);
+    size_t numChunks = std::min<size_t>(numThreads, (count + minChunkSize - 1) / minChunkSize);
+    size_t chunkSize = (count + numChunks - 1) / numChunks;
+
+    std::vector<std::thread> workers;
+    workers.reserve(numChunks - 1);
+    for(size_t begin = chunkSize; begin < count; begin += chunkSize)
+    {
+        size_t end = (std::min)(begin + chunkSize, count);
+        workers.emplace_back([&func, begin, end]() { func(begin, end); });
+    }
+
+    func(0, (std::min)(chunkSize, count));
+
+    for(auto& w : workers)
+        w.join();
+}
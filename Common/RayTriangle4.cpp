@@ -0,0 +1,331 @@
+//***************************************************************************************
+// RayTriangle4.cpp
+//***************************************************************************************
+
+#include "RayTriangle4.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+    // TriangleTests::Intersects treats determinants smaller than this as parallel.
+    const float RayEpsilon = 1e-20f;
+
+    // Sums and crosses in the order XMVector3Dot and XMVector3Cross use, without
+    // fused multiply-adds, so the lanes round as the scalar test does.
+    XMVECTOR Dot(const XMVECTOR a[3], const XMVECTOR b[3])
+    {
+        return XMVectorAdd(XMVectorAdd(XMVectorMultiply(a[0], b[0]), XMVectorMultiply(a[1], b[1])),
+            XMVectorMultiply(a[2], b[2]));
+    }
+
+    void Cross(const XMVECTOR a[3], const XMVECTOR b[3], XMVECTOR out[3])
+    {
+        out[0] = XMVectorSubtract(XMVectorMultiply(a[1], b[2]), XMVectorMultiply(a[2], b[1]));
+        out[1] = XMVectorSubtract(XMVectorMultiply(a[2], b[0]), XMVectorMultiply(a[0], b[2]));
+        out[2] = XMVectorSubtract(XMVectorMultiply(a[0], b[1]), XMVectorMultiply(a[1], b[0]));
+    }
+
+    // Moller-Trumbore on four lanes.  Returns the lanes that hit as bits.
+    int Kernel(const XMVECTOR origin[3], const XMVECTOR dir[3], const XMVECTOR v0[3],
+        const XMVECTOR e1[3], const XMVECTOR e2[3], XMVECTOR& distances)
+    {
+        const XMVECTOR zero = XMVectorZero();
+
+        XMVECTOR p[3];
+        Cross(dir, e2, p);
+        XMVECTOR det = Dot(e1, p);
+
+        XMVECTOR s[3] =
+        {
+            XMVectorSubtract(origin[0], v0[0]),
+            XMVectorSubtract(origin[1], v0[1]),
+            XMVectorSubtract(origin[2], v0[2])
+        };
+        XMVECTOR u = Dot(s, p);
+
+        XMVECTOR q[3];
+        Cross(s, e1, q);
+        XMVECTOR v = Dot(dir, q);
+        XMVECTOR t = Dot(e2, q);
+        XMVECTOR uv = XMVectorAdd(u, v);
+
+        // Lanes facing the ray need u, v and t at least 0 and u + v at most det;
+        // lanes facing away need the same with the signs flipped.  Lanes with det
+        // near 0 are parallel to the ray and miss.
+        XMVECTOR front = XMVectorGreaterOrEqual(det, XMVectorReplicate(RayEpsilon));
+        XMVECTOR frontMiss = XMVectorOrInt(XMVectorLess(u, zero), XMVectorGreater(u, det));
+        frontMiss = XMVectorOrInt(frontMiss, XMVectorLess(v, zero));
+        frontMiss = XMVectorOrInt(frontMiss, XMVectorGreater(uv, det));
+        frontMiss = XMVectorOrInt(frontMiss, XMVectorLess(t, zero));
+
+        XMVECTOR back = XMVectorLessOrEqual(det, XMVectorReplicate(-RayEpsilon));
+        XMVECTOR backMiss = XMVectorOrInt(XMVectorGreater(u, zero), XMVectorLess(u, det));
+        backMiss = XMVectorOrInt(backMiss, XMVectorGreater(v, zero));
+        backMiss = XMVectorOrInt(backMiss, XMVectorLess(uv, det));
+        backMiss = XMVectorOrInt(backMiss, XMVectorGreater(t, zero));
+
+        XMVECTOR hit = XMVectorOrInt(XMVectorAndCInt(front, frontMiss), XMVectorAndCInt(back, backMiss));
+        distances = XMVectorDivide(t, det);
+
+        uint32_t mask[4];
+        XMStoreInt4(mask, hit);
+        return (mask[0] ? 1 : 0) | (mask[1] ? 2 : 0) | (mask[2] ? 4 : 0) | (mask[3] ? 8 : 0);
+    }
+
+    void SetLane(XMFLOAT4& v, UINT lane, float value)
+    {
+        (&v.x)[lane] = value;
+    }
+}
+
+void RayTriangle4::PackTriangles(const XMFLOAT3* corners, UINT triangleCount,
+    std::vector<TriangleGroup4>& groups)
+{
+    const XMFLOAT4 zero(0.0f, 0.0f, 0.0f, 0.0f);
+    groups.assign((triangleCount + 3)/4, { zero, zero, zero, zero, zero, zero, zero, zero, zero });
+
+    for(UINT i = 0; i < triangleCount; ++i)
+    {
+        const XMFLOAT3& a = corners[3*i + 0];
+        const XMFLOAT3& b = corners[3*i + 1];
+        const XMFLOAT3& c = corners[3*i + 2];
+
+        TriangleGroup4& g = groups[i/4];
+        const UINT lane = i%4;
+        SetLane(g.V0X, lane, a.x);
+        SetLane(g.V0Y, lane, a.y);
+        SetLane(g.V0Z, lane, a.z);
+        SetLane(g.E1X, lane, b.x - a.x);
+        SetLane(g.E1Y, lane, b.y - a.y);
+        SetLane(g.E1Z, lane, b.z - a.z);
+        SetLane(g.E2X, lane, c.x - a.x);
+        SetLane(g.E2Y, lane, c.y - a.y);
+        SetLane(g.E2Z, lane, c.z - a.z);
+    }
+}
+
+void RayTriangle4::SetRay(RayGroup4& rays, UINT lane, FXMVECTOR origin, FXMVECTOR direction)
+{
+    XMFLOAT3 o, d;
+    XMStoreFloat3(&o, origin);
+    XMStoreFloat3(&d, direction);
+
+    SetLane(rays.OriginX, lane, o.x);
+    SetLane(rays.OriginY, lane, o.y);
+    SetLane(rays.OriginZ, lane, o.z);
+    SetLane(rays.DirectionX, lane, d.x);
+    SetLane(rays.DirectionY, lane, d.y);
+    SetLane(rays.DirectionZ, lane, d.z);
+}
+
+int RayTriangle4::Intersect(FXMVECTOR origin, FXMVECTOR direction, const TriangleGroup4& triangles,
+    XMVECTOR& distances)
+{
+    const XMVECTOR o[3] = { XMVectorSplatX(origin), XMVectorSplatY(origin), XMVectorSplatZ(origin) };
+    const XMVECTOR d[3] = { XMVectorSplatX(direction), XMVectorSplatY(direction), XMVectorSplatZ(direction) };
+    const XMVECTOR v0[3] = { XMLoadFloat4(&triangles.V0X), XMLoadFloat4(&triangles.V0Y), XMLoadFloat4(&triangles.V0Z) };
+    const XMVECTOR e1[3] = { XMLoadFloat4(&triangles.E1X), XMLoadFloat4(&triangles.E1Y), XMLoadFloat4(&triangles.E1Z) };
+    const XMVECTOR e2[3] = { XMLoadFloat4(&triangles.E2X), XMLoadFloat4(&triangles.E2Y), XMLoadFloat4(&triangles.E2Z) };
+
+    return Kernel(o, d, v0, e1, e2, distances);
+}
+
+int RayTriangle4::Intersect(const RayGroup4& rays, FXMVECTOR v0, FXMVECTOR v1, FXMVECTOR v2,
+    XMVECTOR& distances)
+{
+    const XMVECTOR o[3] = { XMLoadFloat4(&rays.OriginX), XMLoadFloat4(&rays.OriginY), XMLoadFloat4(&rays.OriginZ) };
+    const XMVECTOR d[3] = { XMLoadFloat4(&rays.DirectionX), XMLoadFloat4(&rays.DirectionY), XMLoadFloat4(&rays.DirectionZ) };
+
+    XMVECTOR edge1 = XMVectorSubtract(v1, v0);
+    XMVECTOR edge2 = XMVectorSubtract(v2, v0);
+    const XMVECTOR a[3] = { XMVectorSplatX(v0), XMVectorSplatY(v0), XMVectorSplatZ(v0) };
+    const XMVECTOR e1[3] = { XMVectorSplatX(edge1), XMVectorSplatY(edge1), XMVectorSplatZ(edge1) };
+    const XMVECTOR e2[3] = { XMVectorSplatX(edge2), XMVectorSplatY(edge2), XMVectorSplatZ(edge2) };
+
+    return Kernel(o, d, a, e1, e2, distances);
+}
+
+bool RayTriangle4::IntersectClosest(FXMVECTOR origin, FXMVECTOR direction, const TriangleGroup4* groups,
+    UINT groupCount, float maxDistance, float& distance, UINT& triangle)
+{
+    const XMVECTOR o[3] = { XMVectorSplatX(origin), XMVectorSplatY(origin), XMVectorSplatZ(origin) };
+    const XMVECTOR d[3] = { XMVectorSplatX(direction), XMVectorSplatY(direction), XMVectorSplatZ(direction) };
+
+    float closest = maxDistance;
+    bool found = false;
+    for(UINT g = 0; g < groupCount; ++g)
+    {
+        const TriangleGroup4& tri = groups[g];
+        const XMVECTOR v0[3] = { XMLoadFloat4(&tri.V0X), XMLoadFloat4(&tri.V0Y), XMLoadFloat4(&tri.V0Z) };
+        const XMVECTOR e1[3] = { XMLoadFloat4(&tri.E1X), XMLoadFloat4(&tri.E1Y), XMLoadFloat4(&tri.E1Z) };
+        const XMVECTOR e2[3] = { XMLoadFloat4(&tri.E2X), XMLoadFloat4(&tri.E2Y), XMLoadFloat4(&tri.E2Z) };
+
+        XMVECTOR distances;
+        int mask = Kernel(o, d, v0, e1, e2, distances);
+        if(mask == 0)
+            continue;
+
+        XMFLOAT4 t;
+        XMStoreFloat4(&t, distances);
+        const float* lanes = &t.x;
+        for(UINT k = 0; k < 4; ++k)
+        {
+            if((mask & (1 << k)) && lanes[k] < closest)
+            {
+                closest = lanes[k];
+                triangle = 4*g + k;
+                found = true;
+            }
+        }
+    }
+
+    if(found)
+        distance = closest;
+    return found;
+}
+
+bool RayTriangle4::Benchmark(UINT triangleCount, UINT rayCount, BenchmarkResult& result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    result = BenchmarkResult();
+    result.Triangles = triangleCount;
+    result.Rays = rayCount;
+
+    // Triangles up to 10 across scattered through a cube 100 across, and rays from
+    // outside it aimed at random points inside.
+    std::mt19937 rng(97531);
+    std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+    std::uniform_real_distribution<float> offset(-5.0f, 5.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<XMFLOAT3> corners(3*triangleCount);
+    for(UINT i = 0; i < triangleCount; ++i)
+    {
+        XMFLOAT3 c(position(rng), position(rng), position(rng));
+        for(UINT k = 0; k < 3; ++k)
+            corners[3*i + k] = XMFLOAT3(c.x + offset(rng), c.y + offset(rng), c.z + offset(rng));
+    }
+
+    std::vector<XMFLOAT3> origins(rayCount);
+    std::vector<XMFLOAT3> directions(rayCount);
+    for(UINT r = 0; r < rayCount; ++r)
+    {
+        XMVECTOR away = XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f));
+        XMVECTOR target = XMVectorSet(position(rng), position(rng), position(rng), 1.0f);
+        XMStoreFloat3(&origins[r], XMVectorAdd(target, XMVectorScale(away, 200.0f)));
+        XMStoreFloat3(&directions[r], XMVectorNegate(away));
+    }
+
+    const double tests = (double)triangleCount*rayCount;
+
+    // Every pair with the scalar test, keeping the hits to check the kernels.
+    std::vector<float> scalar((size_t)rayCount*triangleCount);
+    auto start = Clock::now();
+    for(UINT r = 0; r < rayCount; ++r)
+    {
+        XMVECTOR origin = XMLoadFloat3(&origins[r]);
+        XMVECTOR direction = XMLoadFloat3(&directions[r]);
+        for(UINT i = 0; i < triangleCount; ++i)
+        {
+            float t = 0.0f;
+            bool hit = TriangleTests::Intersects(origin, direction, XMLoadFloat3(&corners[3*i + 0]),
+                XMLoadFloat3(&corners[3*i + 1]), XMLoadFloat3(&corners[3*i + 2]), t);
+            scalar[(size_t)r*triangleCount + i] = hit ? t : -1.0f;
+        }
+    }
+    double scalarUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+    for(float t : scalar)
+        result.Hits += t >= 0.0f ? 1 : 0;
+
+    bool matches = true;
+
+    // One ray against four triangles.
+    std::vector<TriangleGroup4> groups;
+    PackTriangles(corners.data(), triangleCount, groups);
+
+    std::vector<float> packed((size_t)rayCount*triangleCount);
+    start = Clock::now();
+    for(UINT r = 0; r < rayCount; ++r)
+    {
+        XMVECTOR origin = XMLoadFloat3(&origins[r]);
+        XMVECTOR direction = XMLoadFloat3(&directions[r]);
+        for(UINT g = 0; g < (UINT)groups.size(); ++g)
+        {
+            XMVECTOR distances;
+            int mask = Intersect(origin, direction, groups[g], distances);
+
+            XMFLOAT4 t;
+            XMStoreFloat4(&t, distances);
+            const float* lanes = &t.x;
+            for(UINT k = 0; k < 4 && 4*g + k < triangleCount; ++k)
+                packed[(size_t)r*triangleCount + 4*g + k] = (mask & (1 << k)) ? lanes[k] : -1.0f;
+        }
+    }
+    double groupUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    matches = matches && packed == scalar;
+
+    // Four rays against one triangle.  A short last group repeats its first ray.
+    std::vector<RayGroup4> rays((rayCount + 3)/4);
+    for(UINT r = 0; r < 4*(UINT)rays.size(); ++r)
+    {
+        UINT source = r < rayCount ? r : r & ~3u;
+        SetRay(rays[r/4], r%4, XMLoadFloat3(&origins[source]), XMLoadFloat3(&directions[source]));
+    }
+
+    start = Clock::now();
+    for(UINT g = 0; g < (UINT)rays.size(); ++g)
+    {
+        for(UINT i = 0; i < triangleCount; ++i)
+        {
+            XMVECTOR distances;
+            int mask = Intersect(rays[g], XMLoadFloat3(&corners[3*i + 0]), XMLoadFloat3(&corners[3*i + 1]),
+                XMLoadFloat3(&corners[3*i + 2]), distances);
+
+            XMFLOAT4 t;
+            XMStoreFloat4(&t, distances);
+            const float* lanes = &t.x;
+            for(UINT k = 0; k < 4 && 4*g + k < rayCount; ++k)
+                packed[(size_t)(4*g + k)*triangleCount + i] = (mask & (1 << k)) ? lanes[k] : -1.0f;
+        }
+    }
+    double rayGroupUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+    matches = matches && packed == scalar;
+
+    // The closest hit agrees with the nearest of the scalar hits.
+    for(UINT r = 0; r < rayCount; ++r)
+    {
+        float nearest = FLT_MAX;
+        UINT nearestTriangle = 0;
+        for(UINT i = 0; i < triangleCount; ++i)
+        {
+            float t = scalar[(size_t)r*triangleCount + i];
+            if(t >= 0.0f && t < nearest)
+            {
+                nearest = t;
+                nearestTriangle = i;
+            }
+        }
+
+        float distance = 0.0f;
+        UINT triangle = 0;
+        bool hit = IntersectClosest(XMLoadFloat3(&origins[r]), XMLoadFloat3(&directions[r]), groups.data(),
+            (UINT)groups.size(), FLT_MAX, distance, triangle);
+        matches = matches && hit == (nearest < FLT_MAX) &&
+            (!hit || (distance == nearest && triangle == nearestTriangle));
+    }
+
+    result.ScalarRate = scalarUs > 0.0 ? tests/scalarUs : 0.0;
+    result.TriangleGroupRate = groupUs > 0.0 ? tests/groupUs : 0.0;
+    result.RayGroupRate = rayGroupUs > 0.0 ? tests/rayGroupUs : 0.0;
+
+    result.Matches = matches;
+    return matches;
+}
@@ -0,0 +1,84 @@
+//***************************************************************************************
+// RayTriangle4.h
+//
+// Ray/triangle tests four at a time, as leaf kernels for picking, visibility and
+// light baking.  One ray can be tested against a group of four triangles, or a group
+// of four rays against one triangle.  Groups are kept as structure-of-arrays, like
+// FrustumCuller's boxes, so each coordinate of four triangles or rays loads into one
+// DirectXMath vector and each lane runs its own Moller-Trumbore test.
+//
+// The arithmetic follows TriangleTests::Intersects step for step, so with the SSE2
+// paths each lane hits exactly when that test does, at the same distance; Benchmark
+// checks that.  A triangle group stores its first corner and two edges, which the
+// scalar test recomputes every call.  Padding lanes have zero edges and never hit.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+// Four triangles: V0X holds the first corner's x for each, and so on.
+struct TriangleGroup4
+{
+    DirectX::XMFLOAT4 V0X, V0Y, V0Z;
+    DirectX::XMFLOAT4 E1X, E1Y, E1Z;   // V1 - V0
+    DirectX::XMFLOAT4 E2X, E2Y, E2Z;   // V2 - V0
+};
+
+// Four rays, laid out the same way.  Directions must be unit length.
+struct RayGroup4
+{
+    DirectX::XMFLOAT4 OriginX, OriginY, OriginZ;
+    DirectX::XMFLOAT4 DirectionX, DirectionY, DirectionZ;
+};
+
+class RayTriangle4
+{
+public:
+    struct BenchmarkResult
+    {
+        UINT Triangles = 0;
+        UINT Rays = 0;
+        UINT Hits = 0;
+
+        // Millions of ray/triangle tests per second on one thread.
+        double ScalarRate = 0.0;        // TriangleTests::Intersects.
+        double TriangleGroupRate = 0.0; // One ray against four triangles.
+        double RayGroupRate = 0.0;      // Four rays against one triangle.
+
+        // Both kernels hit the same pairs as TriangleTests::Intersects, at the same
+        // distances.
+        bool Matches = false;
+    };
+
+    // Packs triangleCount triangles, given as three corners each, into groups of four
+    // in order, so triangle i is lane i%4 of group i/4.
+    static void PackTriangles(const DirectX::XMFLOAT3* corners, UINT triangleCount,
+        std::vector<TriangleGroup4>& groups);
+
+    // Sets one lane of a ray group.  Lanes not set should be given a valid ray, e.g.
+    // a copy of another lane, and their results ignored.
+    static void SetRay(RayGroup4& rays, UINT lane, DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction);
+
+    // Tests one ray against four triangles.  Returns a mask with bit i set if the ray
+    // hits triangle i; lane i of distances is then where along the ray.
+    static int Intersect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction,
+        const TriangleGroup4& triangles, DirectX::XMVECTOR& distances);
+
+    // Tests four rays against one triangle.  Returns a mask with bit i set if ray i
+    // hits; lane i of distances is then where along ray i.
+    static int Intersect(const RayGroup4& rays, DirectX::FXMVECTOR v0, DirectX::FXMVECTOR v1,
+        DirectX::FXMVECTOR v2, DirectX::XMVECTOR& distances);
+
+    // The closest hit nearer than maxDistance among groupCount groups.  triangle is
+    // the hit's index as packed; ties go to the lower index.
+    static bool IntersectClosest(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction,
+        const TriangleGroup4* groups, UINT groupCount, float maxDistance, float& distance, UINT& triangle);
+
+    // Tests rayCount rays through a cloud of triangleCount random triangles against
+    // every triangle with each kernel and with TriangleTests::Intersects.
+    static bool Benchmark(UINT triangleCount, UINT rayCount, BenchmarkResult& result);
+};
@@ -0,0 +1,721 @@
+//***************************************************************************************
+// SceneBVH.cpp
+//***************************************************************************************
+
+#include "SceneBVH.h"
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+    XMFLOAT3 BoxMin(const BoundingBox& b)
+    {
+        return XMFLOAT3(b.Center.x - b.Extents.x, b.Center.y - b.Extents.y, b.Center.z - b.Extents.z);
+    }
+
+    XMFLOAT3 BoxMax(const BoundingBox& b)
+    {
+        return XMFLOAT3(b.Center.x + b.Extents.x, b.Center.y + b.Extents.y, b.Center.z + b.Extents.z);
+    }
+
+    // Half the surface area, which is all the insertion cost needs.
+    float HalfArea(const XMFLOAT3& mn, const XMFLOAT3& mx)
+    {
+        float dx = mx.x - mn.x;
+        float dy = mx.y - mn.y;
+        float dz = mx.z - mn.z;
+        return dx*dy + dy*dz + dz*dx;
+    }
+
+    float HalfAreaOfUnion(const XMFLOAT3& mn0, const XMFLOAT3& mx0, const XMFLOAT3& mn1, const XMFLOAT3& mx1)
+    {
+        return HalfArea(
+            XMFLOAT3((std::min)(mn0.x, mn1.x), (std::min)(mn0.y, mn1.y), (std::min)(mn0.z, mn1.z)),
+            XMFLOAT3((std::max)(mx0.x, mx1.x), (std::max)(mx0.y, mx1.y), (std::max)(mx0.z, mx1.z)));
+    }
+
+    // Slab test.  On a hit, enter is where the ray enters the box, clamped to 0 for
+    // an origin inside it.
+    bool RayBox(const XMFLOAT3& origin, const XMFLOAT3& invDir, const XMFLOAT3& mn, const XMFLOAT3& mx,
+        float maxDistance, float& enter)
+    {
+        float tEnter = 0.0f;
+        float tExit = maxDistance;
+
+        const float o[3] = { origin.x, origin.y, origin.z };
+        const float inv[3] = { invDir.x, invDir.y, invDir.z };
+        const float lo[3] = { mn.x, mn.y, mn.z };
+        const float hi[3] = { mx.x, mx.y, mx.z };
+        for(int i = 0; i < 3; ++i)
+        {
+            float t0 = (lo[i] - o[i])*inv[i];
+            float t1 = (hi[i] - o[i])*inv[i];
+            if(t0 > t1)
+                std::swap(t0, t1);
+
+            tEnter = t0 > tEnter ? t0 : tEnter;
+            tExit = t1 < tExit ? t1 : tExit;
+        }
+
+        enter = tEnter;
+        return tEnter <= tExit;
+    }
+
+    // Returns -1 if the box is behind a plane, 1 if it is in front of all of them,
+    // and 0 if it straddles one.  The same arithmetic as FrustumCuller.
+    int ClassifyBox(const XMFLOAT4 planes[6], const XMFLOAT3& c, const XMFLOAT3& e)
+    {
+        int result = 1;
+        for(int p = 0; p < 6; ++p)
+        {
+            const XMFLOAT4& n = planes[p];
+            float d = c.x*n.x + (c.y*n.y + (c.z*n.z + n.w));
+            float r = e.x*std::fabs(n.x) + (e.y*std::fabs(n.y) + e.z*std::fabs(n.z));
+            if(d + r < 0.0f)
+                return -1;
+            if(d - r < 0.0f)
+                result = 0;
+        }
+        return result;
+    }
+}
+
+SceneBVH::SceneBVH(float margin) :
+    mMargin(margin)
+{
+}
+
+int SceneBVH::AllocateNode()
+{
+    int node = mFreeList;
+    if(node == NullProxy)
+    {
+        node = (int)mNodes.size();
+        mNodes.emplace_back();
+    }
+    else
+    {
+        mFreeList = mNodes[node].Parent;
+        mNodes[node] = Node();
+    }
+
+    mNodes[node].Height = 0;
+    return node;
+}
+
+void SceneBVH::FreeNode(int node)
+{
+    mNodes[node].Parent = mFreeList;
+    mNodes[node].Height = -1;
+    mFreeList = node;
+}
+
+void SceneBVH::SetLeafBox(int leaf, const BoundingBox& box)
+{
+    Node& n = mNodes[leaf];
+    n.Box = box;
+    n.Min = BoxMin(box);
+    n.Max = BoxMax(box);
+    n.Min.x -= mMargin; n.Min.y -= mMargin; n.Min.z -= mMargin;
+    n.Max.x += mMargin; n.Max.y += mMargin; n.Max.z += mMargin;
+}
+
+int SceneBVH::Insert(const BoundingBox& box, UINT userData)
+{
+    int leaf = AllocateNode();
+    mNodes[leaf].UserData = userData;
+    SetLeafBox(leaf, box);
+
+    InsertLeaf(leaf);
+    ++mObjectCount;
+    return leaf;
+}
+
+void SceneBVH::Remove(int proxy)
+{
+    assert(proxy >= 0 && proxy < (int)mNodes.size() && mNodes[proxy].IsLeaf() && mNodes[proxy].Height == 0);
+
+    RemoveLeaf(proxy);
+    FreeNode(proxy);
+    --mObjectCount;
+}
+
+bool SceneBVH::Update(int proxy, const BoundingBox& box)
+{
+    Node& n = mNodes[proxy];
+
+    XMFLOAT3 mn = BoxMin(box);
+    XMFLOAT3 mx = BoxMax(box);
+    if(mn.x >= n.Min.x && mn.y >= n.Min.y && mn.z >= n.Min.z &&
+       mx.x <= n.Max.x && mx.y <= n.Max.y && mx.z <= n.Max.z)
+    {
+        // Still inside the enlarged box, so no ancestor changes.
+        n.Box = box;
+        return false;
+    }
+
+    RemoveLeaf(proxy);
+    SetLeafBox(proxy, box);
+    InsertLeaf(proxy);
+    return true;
+}
+
+void SceneBVH::Clear()
+{
+    mNodes.clear();
+    mRoot = NullProxy;
+    mFreeList = NullProxy;
+    mObjectCount = 0;
+}
+
+void SceneBVH::Build(const std::vector<BoundingBox>& boxes, std::vector<int>& proxies)
+{
+    Clear();
+    proxies.assign(boxes.size(), int(NullProxy));
+    if(boxes.empty())
+        return;
+
+    std::vector<UINT> items(boxes.size());
+    for(UINT i = 0; i < (UINT)items.size(); ++i)
+        items[i] = i;
+
+    mNodes.reserve(2*boxes.size() - 1);
+    mRoot = BuildRange(boxes, items.data(), items.size(), NullProxy, proxies);
+    mObjectCount = (UINT)boxes.size();
+}
+
+int SceneBVH::BuildRange(const std::vector<BoundingBox>& boxes, UINT* items, size_t count,
+    int parent, std::vector<int>& proxies)
+{
+    const int node = AllocateNode();
+    mNodes[node].Parent = parent;
+
+    if(count == 1)
+    {
+        mNodes[node].UserData = items[0];
+        SetLeafBox(node, boxes[items[0]]);
+        proxies[items[0]] = node;
+        return node;
+    }
+
+    // Split at the median center along the axis the centers spread furthest.
+    XMFLOAT3 mn = boxes[items[0]].Center;
+    XMFLOAT3 mx = mn;
+    for(size_t i = 1; i < count; ++i)
+    {
+        const XMFLOAT3& c = boxes[items[i]].Center;
+        mn = XMFLOAT3((std::min)(mn.x, c.x), (std::min)(mn.y, c.y), (std::min)(mn.z, c.z));
+        mx = XMFLOAT3((std::max)(mx.x, c.x), (std::max)(mx.y, c.y), (std::max)(mx.z, c.z));
+    }
+
+    const float spread[3] = { mx.x - mn.x, mx.y - mn.y, mx.z - mn.z };
+    const int axis = spread[0] >= spread[1] && spread[0] >= spread[2] ? 0 : (spread[1] >= spread[2] ? 1 : 2);
+
+    const size_t half = count/2;
+    std::nth_element(items, items + half, items + count, [&](UINT a, UINT b)
+    {
+        const float* ca = &boxes[a].Center.x;
+        const float* cb = &boxes[b].Center.x;
+        return ca[axis] < cb[axis];
+    });
+
+    const int child1 = BuildRange(boxes, items, half, node, proxies);
+    const int child2 = BuildRange(boxes, items + half, count - half, node, proxies);
+    mNodes[node].Child1 = child1;
+    mNodes[node].Child2 = child2;
+    Refit(node);
+    return node;
+}
+
+UINT SceneBVH::GetUserData(int proxy)const
+{
+    return mNodes[proxy].UserData;
+}
+
+const BoundingBox& SceneBVH::GetBox(int proxy)const
+{
+    return mNodes[proxy].Box;
+}
+
+UINT SceneBVH::GetObjectCount()const
+{
+    return mObjectCount;
+}
+
+int SceneBVH::GetHeight()const
+{
+    return mRoot == NullProxy ? 0 : mNodes[mRoot].Height + 1;
+}
+
+void SceneBVH::Refit(int node)
+{
+    Node& n = mNodes[node];
+    const Node& a = mNodes[n.Child1];
+    const Node& b = mNodes[n.Child2];
+
+    n.Min = XMFLOAT3((std::min)(a.Min.x, b.Min.x), (std::min)(a.Min.y, b.Min.y), (std::min)(a.Min.z, b.Min.z));
+    n.Max = XMFLOAT3((std::max)(a.Max.x, b.Max.x), (std::max)(a.Max.y, b.Max.y), (std::max)(a.Max.z, b.Max.z));
+    n.Height = 1 + (std::max)(a.Height, b.Height);
+}
+
+void SceneBVH::InsertLeaf(int leaf)
+{
+    if(mRoot == NullProxy)
+    {
+        mRoot = leaf;
+        mNodes[leaf].Parent = NullProxy;
+        return;
+    }
+
+    // Walk down to the sibling that makes the tree's total area grow least.  Going
+    // down into a child costs what it adds to the node here (inheritance) plus what
+    // it adds to the child.
+    const XMFLOAT3 leafMin = mNodes[leaf].Min;
+    const XMFLOAT3 leafMax = mNodes[leaf].Max;
+
+    int index = mRoot;
+    while(!mNodes[index].IsLeaf())
+    {
+        const Node& n = mNodes[index];
+
+        float area = HalfArea(n.Min, n.Max);
+        float combinedArea = HalfAreaOfUnion(n.Min, n.Max, leafMin, leafMax);
+
+        // Cost of making a new parent for this node and the leaf.
+        float cost = 2.0f*combinedArea;
+        float inheritance = 2.0f*(combinedArea - area);
+
+        float childCost[2];
+        const int children[2] = { n.Child1, n.Child2 };
+        for(int i = 0; i < 2; ++i)
+        {
+            const Node& c = mNodes[children[i]];
+            float grown = HalfAreaOfUnion(c.Min, c.Max, leafMin, leafMax);
+            childCost[i] = (c.IsLeaf() ? grown : grown - HalfArea(c.Min, c.Max)) + inheritance;
+        }
+
+        if(cost < childCost[0] && cost < childCost[1])
+            break;
+
+        index = childCost[0] < childCost[1] ? children[0] : children[1];
+    }
+
+    const int sibling = index;
+    const int oldParent = mNodes[sibling].Parent;
+    const int newParent = AllocateNode();
+
+    mNodes[newParent].Parent = oldParent;
+    mNodes[newParent].Child1 = sibling;
+    mNodes[newParent].Child2 = leaf;
+    mNodes[sibling].Parent = newParent;
+    mNodes[leaf].Parent = newParent;
+
+    if(oldParent == NullProxy)
+        mRoot = newParent;
+    else if(mNodes[oldParent].Child1 == sibling)
+        mNodes[oldParent].Child1 = newParent;
+    else
+        mNodes[oldParent].Child2 = newParent;
+
+    for(index = newParent; index != NullProxy; index = mNodes[index].Parent)
+    {
+        index = Balance(index);
+        Refit(index);
+    }
+}
+
+void SceneBVH::RemoveLeaf(int leaf)
+{
+    if(leaf == mRoot)
+    {
+        mRoot = NullProxy;
+        return;
+    }
+
+    const int parent = mNodes[leaf].Parent;
+    const int grandParent = mNodes[parent].Parent;
+    const int sibling = mNodes[parent].Child1 == leaf ? mNodes[parent].Child2 : mNodes[parent].Child1;
+
+    // The sibling takes the parent's place.
+    mNodes[sibling].Parent = grandParent;
+    FreeNode(parent);
+
+    if(grandParent == NullProxy)
+    {
+        mRoot = sibling;
+        return;
+    }
+
+    if(mNodes[grandParent].Child1 == parent)
+        mNodes[grandParent].Child1 = sibling;
+    else
+        mNodes[grandParent].Child2 = sibling;
+
+    for(int index = grandParent; index != NullProxy; index = mNodes[index].Parent)
+    {
+        index = Balance(index);
+        Refit(index);
+    }
+}
+
+int SceneBVH::Balance(int a)
+{
+    if(mNodes[a].IsLeaf() || mNodes[a].Height < 2)
+        return a;
+
+    const int b = mNodes[a].Child1;
+    const int c = mNodes[a].Child2;
+    const int balance = mNodes[c].Height - mNodes[b].Height;
+    if(balance >= -1 && balance <= 1)
+        return a;
+
+    // The taller child takes a's place, a takes the shorter grandchild of the two
+    // under it, and the taller grandchild stays with the new root:
+    //
+    //       a                up
+    //     /   \             /  \
+    //   other  up   =>     a    tall
+    //         /  \        / \
+    //      tall  short  other short
+    const bool cIsTaller = balance > 1;
+    const int up = cIsTaller ? c : b;
+    const int g1 = mNodes[up].Child1;
+    const int g2 = mNodes[up].Child2;
+    const int tall = mNodes[g1].Height > mNodes[g2].Height ? g1 : g2;
+    const int shrt = tall == g1 ? g2 : g1;
+
+    const int aParent = mNodes[a].Parent;
+    mNodes[up].Parent = aParent;
+    if(aParent == NullProxy)
+        mRoot = up;
+    else if(mNodes[aParent].Child1 == a)
+        mNodes[aParent].Child1 = up;
+    else
+        mNodes[aParent].Child2 = up;
+
+    mNodes[up].Child1 = a;
+    mNodes[up].Child2 = tall;
+    mNodes[a].Parent = up;
+
+    if(cIsTaller)
+        mNodes[a].Child2 = shrt;
+    else
+        mNodes[a].Child1 = shrt;
+    mNodes[shrt].Parent = a;
+
+    Refit(a);
+    Refit(up);
+    return up;
+}
+
+void SceneBVH::QueryFrustum(FXMMATRIX viewProj, std::vector<UINT>& results)const
+{
+    XMFLOAT4 planes[6];
+    FrustumCuller::ExtractPlanes(viewProj, planes);
+    QueryFrustum(planes, results);
+}
+
+void SceneBVH::QueryFrustum(const XMFLOAT4 planes[6], std::vector<UINT>& results)const
+{
+    if(mRoot == NullProxy)
+        return;
+
+    std::vector<int> stack;
+    stack.reserve(64);
+    stack.push_back(mRoot);
+
+    // Subtrees wholly inside the frustum are emptied into results untested.
+    std::vector<int> inside;
+
+    while(!stack.empty())
+    {
+        const Node& n = mNodes[stack.back()];
+        stack.pop_back();
+
+        if(n.IsLeaf())
+        {
+            if(ClassifyBox(planes, n.Box.Center, n.Box.Extents) >= 0)
+                results.push_back(n.UserData);
+            continue;
+        }
+
+        XMFLOAT3 c((n.Min.x + n.Max.x)*0.5f, (n.Min.y + n.Max.y)*0.5f, (n.Min.z + n.Max.z)*0.5f);
+        XMFLOAT3 e((n.Max.x - n.Min.x)*0.5f, (n.Max.y - n.Min.y)*0.5f, (n.Max.z - n.Min.z)*0.5f);
+        int side = ClassifyBox(planes, c, e);
+        if(side < 0)
+            continue;
+
+        if(side == 0)
+        {
+            stack.push_back(n.Child1);
+            stack.push_back(n.Child2);
+            continue;
+        }
+
+        inside.push_back(n.Child1);
+        inside.push_back(n.Child2);
+        while(!inside.empty())
+        {
+            const Node& m = mNodes[inside.back()];
+            inside.pop_back();
+
+            if(m.IsLeaf())
+            {
+                results.push_back(m.UserData);
+            }
+            else
+            {
+                inside.push_back(m.Child1);
+                inside.push_back(m.Child2);
+            }
+        }
+    }
+}
+
+float SceneBVH::QueryRay(FXMVECTOR origin, FXMVECTOR direction, float maxDistance,
+    const std::function<float(UINT userData, float maxDistance)>& hit)const
+{
+    if(mRoot == NullProxy)
+        return maxDistance;
+
+    XMFLOAT3 o, inv;
+    XMStoreFloat3(&o, origin);
+    XMStoreFloat3(&inv, XMVectorReciprocal(direction));
+
+    float closest = maxDistance;
+
+    struct Entry
+    {
+        int Node;
+        float Enter;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+
+    float enter = 0.0f;
+    if(RayBox(o, inv, mNodes[mRoot].Min, mNodes[mRoot].Max, closest, enter))
+        stack.push_back({ mRoot, enter });
+
+    while(!stack.empty())
+    {
+        Entry top = stack.back();
+        stack.pop_back();
+
+        // A closer hit may have been found since this box was pushed.
+        if(top.Enter > closest)
+            continue;
+
+        const Node& n = mNodes[top.Node];
+        if(n.IsLeaf())
+        {
+            if(RayBox(o, inv, BoxMin(n.Box), BoxMax(n.Box), closest, enter))
+                closest = (std::min)(closest, hit(n.UserData, closest));
+            continue;
+        }
+
+        float enter1 = 0.0f;
+        float enter2 = 0.0f;
+        bool hit1 = RayBox(o, inv, mNodes[n.Child1].Min, mNodes[n.Child1].Max, closest, enter1);
+        bool hit2 = RayBox(o, inv, mNodes[n.Child2].Min, mNodes[n.Child2].Max, closest, enter2);
+
+        // Push the nearer child last so it is visited first.
+        if(hit1 && hit2)
+        {
+            if(enter1 < enter2)
+            {
+                stack.push_back({ n.Child2, enter2 });
+                stack.push_back({ n.Child1, enter1 });
+            }
+            else
+            {
+                stack.push_back({ n.Child1, enter1 });
+                stack.push_back({ n.Child2, enter2 });
+            }
+        }
+        else if(hit1)
+        {
+            stack.push_back({ n.Child1, enter1 });
+        }
+        else if(hit2)
+        {
+            stack.push_back({ n.Child2, enter2 });
+        }
+    }
+
+    return closest;
+}
+
+bool SceneBVH::Validate()const
+{
+    if(mRoot == NullProxy)
+        return mObjectCount == 0;
+
+    if(mNodes[mRoot].Parent != NullProxy)
+        return false;
+
+    UINT leaves = 0;
+    std::vector<int> stack(1, mRoot);
+    while(!stack.empty())
+    {
+        int index = stack.back();
+        stack.pop_back();
+        const Node& n = mNodes[index];
+
+        if(n.IsLeaf())
+        {
+            XMFLOAT3 mn = BoxMin(n.Box);
+            XMFLOAT3 mx = BoxMax(n.Box);
+            if(n.Height != 0 || mn.x < n.Min.x || mn.y < n.Min.y || mn.z < n.Min.z ||
+               mx.x > n.Max.x || mx.y > n.Max.y || mx.z > n.Max.z)
+                return false;
+            ++leaves;
+            continue;
+        }
+
+        const Node& a = mNodes[n.Child1];
+        const Node& b = mNodes[n.Child2];
+        if(a.Parent != index || b.Parent != index)
+            return false;
+        if(n.Height != 1 + (std::max)(a.Height, b.Height))
+            return false;
+        if(n.Min.x != (std::min)(a.Min.x, b.Min.x) || n.Min.y != (std::min)(a.Min.y, b.Min.y) || n.Min.z != (std::min)(a.Min.z, b.Min.z) ||
+           n.Max.x != (std::max)(a.Max.x, b.Max.x) || n.Max.y != (std::max)(a.Max.y, b.Max.y) || n.Max.z != (std::max)(a.Max.z, b.Max.z))
+            return false;
+
+        stack.push_back(n.Child1);
+        stack.push_back(n.Child2);
+    }
+
+    return leaves == mObjectCount;
+}
+
+bool SceneBVH::Benchmark(UINT objectCount, UINT iterations, BenchmarkResult& result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    result = BenchmarkResult();
+    result.Objects = objectCount;
+    iterations = (std::max)(iterations, 1u);
+
+    // A million boxes fill a cube 2000 across; fewer fill a smaller cube at the same
+    // density.  The camera sits in the middle and sees 200 units.
+    const float side = 2000.0f*std::cbrt(objectCount/1e6f);
+    std::mt19937 rng(4321);
+    std::uniform_real_distribution<float> position(-0.5f*side, 0.5f*side);
+    std::uniform_real_distribution<float> extent(0.5f, 5.0f);
+    std::uniform_real_distribution<float> offset(-2.0f, 2.0f);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    std::vector<BoundingBox> boxes(objectCount);
+    for(auto& b : boxes)
+    {
+        b.Center.x = position(rng);
+        b.Center.y = position(rng);
+        b.Center.z = position(rng);
+        b.Extents.x = extent(rng);
+        b.Extents.y = extent(rng);
+        b.Extents.z = extent(rng);
+    }
+
+    SceneBVH tree(1.0f);
+    std::vector<int> proxies;
+
+    auto start = Clock::now();
+    for(UINT i = 0; i < objectCount; ++i)
+        tree.Insert(boxes[i], i);
+    result.InsertMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    bool matches = tree.Validate();
+
+    start = Clock::now();
+    tree.Build(boxes, proxies);
+    result.BuildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    const UINT moves = (std::max)(objectCount/100, 1u);
+    std::uniform_int_distribution<UINT> pick(0, objectCount - 1);
+    start = Clock::now();
+    for(UINT i = 0; objectCount > 0 && i < moves; ++i)
+    {
+        UINT k = pick(rng);
+        boxes[k].Center.x += offset(rng);
+        boxes[k].Center.y += offset(rng);
+        boxes[k].Center.z += offset(rng);
+        tree.Update(proxies[k], boxes[k]);
+    }
+    result.UpdateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    result.Height = tree.GetHeight();
+    matches = matches && tree.Validate();
+
+    FrustumCuller culler;
+    culler.SetBoxes(boxes);
+
+    XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f/9.0f, 1.0f, 200.0f);
+    std::vector<UINT> linear, queried;
+    double linearMs = 0.0;
+    double treeMs = 0.0;
+    for(UINT i = 0; i < iterations; ++i)
+    {
+        XMVECTOR look = XMVectorSet(unit(rng), 0.5f*unit(rng), unit(rng), 0.0f);
+        XMMATRIX view = XMMatrixLookToLH(XMVectorZero(), look, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+
+        start = Clock::now();
+        culler.Cull(viewProj, linear);
+        linearMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        start = Clock::now();
+        queried.clear();
+        tree.QueryFrustum(viewProj, queried);
+        treeMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        std::sort(queried.begin(), queried.end());
+        matches = matches && queried == linear;
+        result.FrustumVisible = (UINT)queried.size();
+    }
+    result.LinearFrustumMs = linearMs/iterations;
+    result.FrustumMs = treeMs/iterations;
+
+    // Rays from the middle in random directions; each object is its own box, so the
+    // closest hit is the nearest box entry.
+    const UINT rayCount = 64*iterations;
+    double linearUs = 0.0;
+    double treeUs = 0.0;
+    for(UINT i = 0; i < rayCount; ++i)
+    {
+        XMVECTOR dir = XMVector3Normalize(XMVectorSet(unit(rng), unit(rng), unit(rng), 0.0f));
+        XMFLOAT3 o(0.0f, 0.0f, 0.0f);
+        XMFLOAT3 inv;
+        XMStoreFloat3(&inv, XMVectorReciprocal(dir));
+
+        start = Clock::now();
+        float linearClosest = side;
+        for(const auto& b : boxes)
+        {
+            float enter = 0.0f;
+            if(RayBox(o, inv, BoxMin(b), BoxMax(b), linearClosest, enter))
+                linearClosest = (std::min)(linearClosest, enter);
+        }
+        linearUs += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        start = Clock::now();
+        float treeClosest = tree.QueryRay(XMVectorZero(), dir, side, [&](UINT k, float maxDistance)
+        {
+            float enter = 0.0f;
+            return RayBox(o, inv, BoxMin(boxes[k]), BoxMax(boxes[k]), maxDistance, enter) ? enter : maxDistance;
+        });
+        treeUs += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        matches = matches && treeClosest == linearClosest;
+    }
+    result.LinearRayUs = linearUs/rayCount;
+    result.RayUs = treeUs/rayCount;
+
+    result.Matches = matches;
+    return matches;
+}
@@ -0,0 +1,145 @@
+//***************************************************************************************
+// SceneBVH.h
+//
+// A dynamic bounding volume hierarchy over world-space boxes, for culling and picking
+// without visiting every object.  Each object is a leaf holding its box and a user
+// value (e.g. an instance or render-item index).  Leaves are inserted next to the
+// sibling that grows the tree's surface area least, and the tree is kept balanced by
+// rotations on the way back up, so queries cost about log(n) plus the number of hits.
+//
+// Build makes a balanced tree from a whole set of boxes at once, splitting at the
+// median, with nodes laid out depth-first.  That is faster than inserting them one
+// at a time and gives a tree that queries faster; it suits scenes that are mostly
+// static.  Insert, Remove and Update work on either kind of tree.
+//
+// A leaf also keeps a box enlarged by a margin.  Moving an object within that box
+// only refits the leaf; moving it further removes and reinserts it.  Static scenes
+// can use a margin of 0.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <functional>
+#include <vector>
+
+class SceneBVH
+{
+public:
+    struct BenchmarkResult
+    {
+        UINT Objects = 0;
+        int Height = 0;
+
+        double BuildMs = 0.0;   // Build over every object.
+        double InsertMs = 0.0;  // Inserting every object one at a time.
+        double UpdateMs = 0.0;  // Moving one object in a hundred.
+
+        // Per query, averaged.
+        UINT FrustumVisible = 0;
+        double LinearFrustumMs = 0.0; // FrustumCuller over every box, all threads.
+        double FrustumMs = 0.0;
+        double LinearRayUs = 0.0;     // Every box tested against the ray.
+        double RayUs = 0.0;
+
+        // The tree found the same visible set and the same closest hits as the
+        // linear tests.
+        bool Matches = false;
+    };
+
+    static const int NullProxy = -1;
+
+    explicit SceneBVH(float margin = 0.0f);
+    SceneBVH(const SceneBVH& rhs) = delete;
+    SceneBVH& operator=(const SceneBVH& rhs) = delete;
+
+    // Returns a proxy that names the object until it is removed.
+    int Insert(const DirectX::BoundingBox& box, UINT userData);
+    void Remove(int proxy);
+
+    // Moves an object.  Returns true if it left its enlarged box and was reinserted.
+    bool Update(int proxy, const DirectX::BoundingBox& box);
+
+    void Clear();
+
+    // Replaces the tree with one over boxes.  Box i gets user value i and proxy
+    // proxies[i].
+    void Build(const std::vector<DirectX::BoundingBox>& boxes, std::vector<int>& proxies);
+
+    UINT GetUserData(int proxy)const;
+    const DirectX::BoundingBox& GetBox(int proxy)const;
+    UINT GetObjectCount()const;
+
+    // 0 for an empty tree, 1 for a single leaf.
+    int GetHeight()const;
+
+    // Appends the user values of the objects whose boxes are not wholly behind one
+    // of the planes, in no particular order.  The planes face inward, as from
+    // FrustumCuller::ExtractPlanes, and the test is the same as FrustumCuller's.
+    void QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<UINT>& results)const;
+    void QueryFrustum(DirectX::FXMMATRIX viewProj, std::vector<UINT>& results)const;
+
+    // Calls hit(userData, maxDistance) for the objects whose boxes the ray enters
+    // within maxDistance, nearest boxes first.  hit returns the distance of its own
+    // intersection with the object, or something >= maxDistance for a miss; boxes
+    // further than the closest hit so far are skipped.  Returns the closest hit
+    // distance, or maxDistance if nothing was hit.  direction need not be unit
+    // length; distances are in multiples of it.
+    float QueryRay(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxDistance,
+        const std::function<float(UINT userData, float maxDistance)>& hit)const;
+
+    // Checks parent links, heights and that every node contains its children.
+    bool Validate()const;
+
+    // Builds a tree of objectCount random boxes, with the density kept the same at
+    // every size so a fixed camera sees a similar number of them, moves some, and
+    // times queries against testing every box.
+    static bool Benchmark(UINT objectCount, UINT iterations, BenchmarkResult& result);
+
+private:
+    struct Node
+    {
+        // Enlarged by the margin for leaves; the union of the children otherwise.
+        DirectX::XMFLOAT3 Min;
+        DirectX::XMFLOAT3 Max;
+
+        // Leaves only: the box as given.
+        DirectX::BoundingBox Box;
+        UINT UserData = 0;
+
+        // The next free node while the node is free.
+        int Parent = NullProxy;
+        int Child1 = NullProxy;
+        int Child2 = NullProxy;
+
+        // 0 for a leaf, -1 for a free node.
+        int Height = -1;
+
+        bool IsLeaf()const { return Child1 == NullProxy; }
+    };
+
+    int AllocateNode();
+    void FreeNode(int node);
+
+    int BuildRange(const std::vector<DirectX::BoundingBox>& boxes, UINT* items, size_t count,
+        int parent, std::vector<int>& proxies);
+
+    void InsertLeaf(int leaf);
+    void RemoveLeaf(int leaf);
+
+    // Rotates the subtree at a if it is out of balance; returns its new root.
+    int Balance(int a);
+
+    // Recomputes a node's box and height from its children.
+    void Refit(int node);
+
+    void SetLeafBox(int leaf, const DirectX::BoundingBox& box);
+
+    std::vector<Node> mNodes;
+    int mRoot = NullProxy;
+    int mFreeList = NullProxy;
+    UINT mObjectCount = 0;
+    float mMargin = 0.0f;
+};
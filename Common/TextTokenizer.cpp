@@ -0,0 +1,310 @@
+//***************************************************************************************
+// TextTokenizer.cpp
+//***************************************************************************************
+
+#include "TextTokenizer.h"
+#include <algorithm>
+#include <fstream>
+
+using namespace DirectX;
+
+namespace
+{
+    // Treats every control character as whitespace, which covers ' ', \t, \r and \n
+    // with one compare.
+    bool IsSpace(char c)
+    {
+        return (unsigned char)c <= ' ';
+    }
+
+    bool IsDigit(char c)
+    {
+        return c >= '0' && c <= '9';
+    }
+
+    // Parses an optionally signed decimal integer at s and returns the end of it, or
+    // nullptr if there is no integer there.
+    const char* ParseInt(const char* s, const char* end, long long& value)
+    {
+        bool negative = false;
+        if(s != end && (*s == '-' || *s == '+'))
+            negative = (*s++ == '-');
+
+        if(s == end || !IsDigit(*s))
+            return nullptr;
+
+        long long v = 0;
+        for(; s != end && IsDigit(*s); ++s)
+        {
+            v = v*10 + (*s - '0');
+            if(v > 0x7fffffffLL)
+                return nullptr;
+        }
+
+        value = negative ? -v : v;
+        return s;
+    }
+
+    // Parses a decimal float ("-1.5", "3e-05", ".5") at s and returns the end of it, or
+    // nullptr if there is no number there.  Up to 19 significant digits are accumulated
+    // exactly and scaled once by a power of ten in double precision, which rounds to
+    // the same float as strtof for the model files.
+    const char* ParseFloat(const char* s, const char* end, float& value)
+    {
+        static const double powersOf10[] =
+        {
+            1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10,
+            1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+        };
+
+        bool negative = false;
+        if(s != end && (*s == '-' || *s == '+'))
+            negative = (*s++ == '-');
+
+        unsigned long long mantissa = 0;
+        int numDigits = 0;
+        int exponent = 0;
+        bool anyDigits = false;
+
+        for(; s != end && IsDigit(*s); ++s)
+        {
+            anyDigits = true;
+            if(numDigits < 19)
+            {
+                mantissa = mantissa*10 + (*s - '0');
+                if(mantissa != 0)
+                    ++numDigits;
+            }
+            else
+            {
+                ++exponent;
+            }
+        }
+
+        if(s != end && *s == '.')
+        {
+            for(++s; s != end && IsDigit(*s); ++s)
+            {
+                anyDigits = true;
+                if(numDigits < 19)
+                {
+                    mantissa = mantissa*10 + (*s - '0');
+                    if(mantissa != 0)
+                        ++numDigits;
+                    --exponent;
+                }
+            }
+        }
+
+        if(!anyDigits)
+            return nullptr;
+
+        if(s != end && (*s == 'e' || *s == 'E'))
+        {
+            long long e = 0;
+            s = ParseInt(s + 1, end, e);
+            if(s == nullptr)
+                return nullptr;
+
+            // Past +-400 every float mantissa is already infinity or zero, and the
+            // clamp keeps a huge exponent from wrapping the int or the scaling
+            // loops below from running long.
+            if(e > 400)
+                e = 400;
+            else if(e < -400)
+                e = -400;
+            exponent += (int)e;
+        }
+
+        double v = (double)mantissa;
+        while(exponent > 22)
+        {
+            v *= 1e22;
+            exponent -= 22;
+        }
+        while(exponent < -22)
+        {
+            v /= 1e22;
+            exponent += 22;
+        }
+        v = exponent >= 0 ? v*powersOf10[exponent] : v/powersOf10[-exponent];
+
+        value = (float)(negative ? -v : v);
+        return s;
+    }
+}
+
+TextTokenizer::TextTokenizer(const char* begin, const char* end)
+    : mBegin(begin), mPos(begin), mEnd(end)
+{
+}
+
+bool TextTokenizer::Open(const std::string& filename)
+{
+    std::ifstream fin(filename, std::ios::binary | std::ios::ate);
+    if(!fin)
+        return false;
+
+    std::streamoff size = fin.tellg();
+    fin.seekg(0, std::ios::beg);
+
+    mBuffer.resize((size_t)size);
+    if(size > 0 && !fin.read(mBuffer.data(), size))
+        return false;
+
+    mBegin = mBuffer.data();
+    mPos = mBegin;
+    mEnd = mPos + mBuffer.size();
+    mFailed = false;
+
+    return true;
+}
+
+bool TextTokenizer::Failed()const
+{
+    return mFailed;
+}
+
+bool TextTokenizer::AtEnd()
+{
+    return NextToken() == 0;
+}
+
+size_t TextTokenizer::Offset()
+{
+    SkipSpace();
+    return mPos - mBegin;
+}
+
+unsigned TextTokenizer::LineAt(size_t offset)const
+{
+    const char* end = mBegin + (std::min)(offset, (size_t)(mEnd - mBegin));
+    return 1 + (unsigned)std::count(mBegin, end, '\n');
+}
+
+void TextTokenizer::SkipSpace()
+{
+    while(mPos != mEnd && IsSpace(*mPos))
+        ++mPos;
+}
+
+size_t TextTokenizer::NextToken()
+{
+    SkipSpace();
+
+    const char* tokenEnd = mPos;
+    while(tokenEnd != mEnd && !IsSpace(*tokenEnd))
+        ++tokenEnd;
+
+    return tokenEnd - mPos;
+}
+
+bool TextTokenizer::EndNumber(const char* numberEnd)
+{
+    // The number has to be the whole token.
+    if(numberEnd == nullptr || (numberEnd != mEnd && !IsSpace(*numberEnd)))
+    {
+        mFailed = true;
+        return false;
+    }
+
+    mPos = numberEnd;
+    return true;
+}
+
+void TextTokenizer::SkipToken(unsigned count)
+{
+    if(mFailed)
+        return;
+
+    for(unsigned i = 0; i < count; ++i)
+    {
+        size_t length = NextToken();
+        if(length == 0)
+        {
+            mFailed = true;
+            return;
+        }
+        mPos += length;
+    }
+}
+
+std::string TextTokenizer::ReadString()
+{
+    size_t length = NextToken();
+    if(mFailed || length == 0)
+    {
+        mFailed = true;
+        return std::string();
+    }
+
+    std::string s(mPos, length);
+    mPos += length;
+    return s;
+}
+
+float TextTokenizer::ReadFloat()
+{
+    if(mFailed)
+        return 0.0f;
+
+    SkipSpace();
+
+    float value = 0.0f;
+    if(!EndNumber(ParseFloat(mPos, mEnd, value)))
+        return 0.0f;
+
+    return value;
+}
+
+int TextTokenizer::ReadInt()
+{
+    if(mFailed)
+        return 0;
+
+    SkipSpace();
+
+    long long value = 0;
+    if(!EndNumber(ParseInt(mPos, mEnd, value)))
+        return 0;
+
+    return (int)value;
+}
+
+unsigned TextTokenizer::ReadUInt()
+{
+    int value = ReadInt();
+    if(value < 0)
+    {
+        mFailed = true;
+        return 0;
+    }
+    return (unsigned)value;
+}
+
+XMFLOAT2 TextTokenizer::ReadFloat2()
+{
+    XMFLOAT2 v;
+    v.x = ReadFloat();
+    v.y = ReadFloat();
+    return v;
+}
+
+XMFLOAT3 TextTokenizer::ReadFloat3()
+{
+    XMFLOAT3 v;
+    v.x = ReadFloat();
+    v.y = ReadFloat();
+    v.z = ReadFloat();
+    return v;
+}
+
+XMFLOAT4 TextTokenizer::ReadFloat4()
+{
+    XMFLOAT4 v;
+    v.x = ReadFloat();
+    v.y = ReadFloat();
+    v.z = ReadFloat();
+    v.w = ReadFloat();
+    return v;
+}
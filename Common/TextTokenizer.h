@@ -0,0 +1,70 @@
+//***************************************************************************************
+// TextTokenizer.h
+//
+// Whitespace-delimited tokenizer for the book's text model formats (.m3d, skull.txt,
+// car.txt).  The whole file is read into memory up front and numbers are parsed in
+// place, without iostreams or the C locale, so a load costs one read plus one pass
+// over the characters.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+class TextTokenizer
+{
+public:
+    TextTokenizer() = default;
+
+    // Tokenizes [begin, end), which the caller keeps alive (e.g. part of a mapped file).
+    TextTokenizer(const char* begin, const char* end);
+
+    TextTokenizer(const TextTokenizer& rhs) = delete;
+    TextTokenizer& operator=(const TextTokenizer& rhs) = delete;
+
+    // Reads the whole file into an internal buffer.  Returns false if it cannot be read.
+    bool Open(const std::string& filename);
+
+    // True once a read has hit the end of the text or a malformed number.  Failed
+    // reads return 0 (or an empty string), and every later read fails too.
+    bool Failed()const;
+
+    // True if only whitespace is left.
+    bool AtEnd();
+
+    // Byte offset of the next token from the start of the text.  After a failed
+    // read this is the token that could not be read, for error messages.
+    size_t Offset();
+
+    // 1-based line number of a byte offset, e.g. one returned by Offset.
+    unsigned LineAt(size_t offset)const;
+
+    // Skips count tokens, such as the labels in front of values.
+    void SkipToken(unsigned count = 1);
+
+    std::string ReadString();
+    float ReadFloat();
+    int ReadInt();
+    unsigned ReadUInt();
+
+    DirectX::XMFLOAT2 ReadFloat2();
+    DirectX::XMFLOAT3 ReadFloat3();
+    DirectX::XMFLOAT4 ReadFloat4();
+
+private:
+    void SkipSpace();
+
+    // Skips whitespace and returns the length of the next token (0 at the end).
+    size_t NextToken();
+
+    // Moves past a parsed number, or fails if it was not a whole token.
+    bool EndNumber(const char* numberEnd);
+
+    std::vector<char> mBuffer;
+    const char* mBegin = nullptr;
+    const char* mPos = nullptr;
+    const char* mEnd = nullptr;
+    bool mFailed = false;
+};
@@ -0,0 +1,403 @@
+//***************************************************************************************
+// TexturePacker.cpp
+//***************************************************************************************
+
+#include "TexturePacker.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <tuple>
+
+using namespace DirectX;
+
+namespace
+{
+    size_t NextPow2(size_t x)
+    {
+        size_t p = 1;
+        while(p < x)
+            p <<= 1;
+        return p;
+    }
+
+    size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    // Bytes of one block (or texel, for formats without blocks).
+    size_t BlockBytes(DXGI_FORMAT format)
+    {
+        uint32_t bw = 1;
+        uint32_t bh = 1;
+        GetBlockSize(format, &bw, &bh);
+        return BitsPerPixel(format) * bw * bh / 8;
+    }
+
+    // An atlas entry, in texels of the top mip.
+    struct Placement
+    {
+        UINT Source = 0;
+        size_t X = 0;
+        size_t Y = 0;
+        size_t Width = 0;
+        size_t Height = 0;
+    };
+
+    // Copies the rectangle of blocks of a source mip into an atlas mip.  x and y are
+    // in blocks.
+    void CopyBlocks(uint8_t* atlas, size_t atlasRowBytes, size_t x, size_t y,
+        const DDSSubresource& src, size_t blockBytes)
+    {
+        for(size_t row = 0; row < src.NumRows; ++row)
+        {
+            memcpy(atlas + (y + row) * atlasRowBytes + x * blockBytes,
+                src.Data + row * src.RowBytes, src.RowBytes);
+        }
+    }
+}
+
+int TexturePacker::Add(const std::wstring& filename)
+{
+    MappedFile file;
+    if(!file.Open(filename) || file.Data() == nullptr)
+        return -1;
+
+    Source source;
+    source.Filename = filename;
+    source.Data.assign(file.Data(), file.Data() + file.Size());
+
+    DDSReader dds;
+    if(FAILED(dds.Parse(source.Data.data(), source.Data.size())))
+        return -1;
+
+    source.Desc = dds.GetDesc();
+    if(source.Desc.Dimension != DDS_DIMENSION_TEXTURE2D || source.Desc.ArraySize != 1 || source.Desc.IsCubeMap)
+        return -1;
+
+    // The subresources point into source.Data, whose buffer moves with it.
+    source.Subresources = dds.GetSubresources();
+    mSources.push_back(std::move(source));
+    return int(mSources.size() - 1);
+}
+
+bool TexturePacker::Pack(const TexturePackerOptions& options)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+
+    mTextures.clear();
+    mRefs.assign(mSources.size(), PackedTextureRef());
+    mStats = Stats();
+    if(mSources.empty() || options.MaxArraySize == 0)
+        return false;
+
+    // Textures that agree in everything but their texels can share an array.
+    typedef std::tuple<int, size_t, size_t, size_t> ArrayKey;
+    std::map<ArrayKey, std::vector<UINT>> groups;
+    for(UINT i = 0; i < mSources.size(); ++i)
+    {
+        const DDSTextureDesc& d = mSources[i].Desc;
+        groups[ArrayKey(int(d.Format), d.Width, d.Height, d.MipLevels)].push_back(i);
+    }
+
+    std::vector<UINT> leftovers;
+    for(auto& g : groups)
+    {
+        const std::vector<UINT>& members = g.second;
+        if(members.size() == 1 && options.AllowAtlas)
+        {
+            leftovers.push_back(members[0]);
+            continue;
+        }
+
+        for(size_t first = 0; first < members.size(); first += options.MaxArraySize)
+        {
+            size_t last = (std::min)(members.size(), first + options.MaxArraySize);
+            PackArray(std::vector<UINT>(members.begin() + first, members.begin() + last));
+        }
+    }
+
+    if(!leftovers.empty())
+        PackAtlases(leftovers, options);
+
+    for(const Source& s : mSources)
+    {
+        for(const DDSSubresource& sub : s.Subresources)
+            mStats.SourceBytes += sub.SliceBytes;
+    }
+    for(const PackedTexture& t : mTextures)
+    {
+        (t.IsAtlas ? mStats.Atlases : mStats.Arrays)++;
+
+        DDSReader dds;
+        if(SUCCEEDED(dds.Parse(t.DDSData.data(), t.DDSData.size())))
+            mStats.PackedBytes += dds.GetDataSize();
+    }
+    mStats.SourceTextures = UINT(mSources.size());
+    mStats.PackedTextures = UINT(mTextures.size());
+    mStats.Ms = std::chrono::duration<double, std::milli>(
+        std::chrono::high_resolution_clock::now() - start).count();
+
+    return true;
+}
+
+void TexturePacker::PackArray(const std::vector<UINT>& sources)
+{
+    PackedTexture texture;
+    texture.Desc = mSources[sources[0]].Desc;
+    texture.Desc.ArraySize = sources.size();
+    texture.Sources = sources;
+
+    // D3D12 subresource order is slice-major, the same order as the slices in a DDS
+    // file, so each source's mips go in whole.
+    std::vector<uint8_t> texels;
+    for(UINT slice = 0; slice < sources.size(); ++slice)
+    {
+        for(const DDSSubresource& sub : mSources[sources[slice]].Subresources)
+            texels.insert(texels.end(), sub.Data, sub.Data + sub.SliceBytes);
+
+        PackedTextureRef& ref = mRefs[sources[slice]];
+        ref.Texture = UINT(mTextures.size());
+        ref.Slice = slice;
+    }
+
+    WriteDDS(texture.Desc, texels.data(), texels.size(), texture.DDSData);
+    mTextures.push_back(std::move(texture));
+}
+
+void TexturePacker::PackAtlases(std::vector<UINT> sources, const TexturePackerOptions& options)
+{
+    // Too large to share an atlas: a one-slice array of its own.
+    auto tooLarge = [this, &options](UINT s)
+    {
+        return mSources[s].Desc.Width > options.MaxAtlasSize || mSources[s].Desc.Height > options.MaxAtlasSize;
+    };
+    for(UINT s : sources)
+    {
+        if(tooLarge(s))
+            PackArray(std::vector<UINT>(1, s));
+    }
+    sources.erase(std::remove_if(sources.begin(), sources.end(), tooLarge), sources.end());
+
+    // Shelf packing, tallest first, one format per atlas.
+    std::stable_sort(sources.begin(), sources.end(), [this](UINT a, UINT b)
+    {
+        const DDSTextureDesc& da = mSources[a].Desc;
+        const DDSTextureDesc& db = mSources[b].Desc;
+        if(da.Format != db.Format)
+            return da.Format < db.Format;
+        if(da.Height != db.Height)
+            return da.Height > db.Height;
+        return da.Width > db.Width;
+    });
+
+    size_t next = 0;
+    while(next < sources.size())
+    {
+        const DXGI_FORMAT format = mSources[sources[next]].Desc.Format;
+        uint32_t bw = 1;
+        uint32_t bh = 1;
+        GetBlockSize(format, &bw, &bh);
+
+        size_t end = next;
+        size_t area = 0;
+        size_t widest = 0;
+        while(end < sources.size() && mSources[sources[end]].Desc.Format == format)
+        {
+            const DDSTextureDesc& d = mSources[sources[end]].Desc;
+            area += d.Width * d.Height;
+            widest = (std::max)(widest, d.Width);
+            ++end;
+        }
+
+        const size_t atlasWidth = (std::min)(options.MaxAtlasSize,
+            (std::max)(NextPow2(widest), NextPow2(size_t(std::ceil(std::sqrt(double(area)))))));
+
+        // Each entry starts on a multiple of its own size (up to a power of two), so
+        // its lower mips stay block aligned within the atlas.
+        std::vector<Placement> placed;
+        size_t x = 0;
+        size_t y = 0;
+        size_t shelfHeight = 0;
+        size_t i = next;
+        for(; i < end; ++i)
+        {
+            const DDSTextureDesc& d = mSources[sources[i]].Desc;
+            const size_t alignX = (std::min)(NextPow2(d.Width), atlasWidth);
+            size_t px = AlignUp(x, alignX);
+            if(px + d.Width > atlasWidth)
+            {
+                y = AlignUp(y + shelfHeight, bh);
+                shelfHeight = 0;
+                px = 0;
+            }
+            if(y + d.Height > options.MaxAtlasSize)
+                break;
+
+            Placement p;
+            p.Source = sources[i];
+            p.X = px;
+            p.Y = y;
+            p.Width = d.Width;
+            p.Height = d.Height;
+            placed.push_back(p);
+
+            x = px + d.Width;
+            shelfHeight = (std::max)(shelfHeight, d.Height);
+        }
+        next = i;
+
+        const size_t atlasHeight = NextPow2(y + shelfHeight);
+
+        // Keep the mips where every entry is still whole blocks at a block boundary.
+        size_t mips = 16;
+        for(const Placement& p : placed)
+            mips = (std::min)(mips, mSources[p.Source].Desc.MipLevels);
+        while(mips > 1)
+        {
+            const size_t m = mips - 1;
+            bool aligned = true;
+            for(const Placement& p : placed)
+            {
+                const size_t mask = (size_t(1) << m) - 1;
+                if((p.X & mask) || (p.Y & mask) || (p.Width & mask) || (p.Height & mask) ||
+                   ((p.X >> m) % bw) || ((p.Y >> m) % bh) || ((p.Width >> m) % bw) || ((p.Height >> m) % bh))
+                {
+                    aligned = false;
+                    break;
+                }
+            }
+            if(aligned)
+                break;
+            --mips;
+        }
+
+        PackedTexture texture;
+        texture.IsAtlas = true;
+        texture.Desc = mSources[placed[0].Source].Desc;
+        texture.Desc.Width = atlasWidth;
+        texture.Desc.Height = atlasHeight;
+        texture.Desc.MipLevels = mips;
+        texture.Desc.ArraySize = 1;
+
+        const size_t blockBytes = BlockBytes(format);
+        std::vector<uint8_t> texels;
+        size_t w = atlasWidth;
+        size_t h = atlasHeight;
+        for(size_t m = 0; m < mips; ++m)
+        {
+            size_t numBytes = 0;
+            size_t rowBytes = 0;
+            GetSurfaceInfo(w, h, format, &numBytes, &rowBytes, nullptr);
+
+            const size_t base = texels.size();
+            texels.resize(base + numBytes, 0);
+            for(const Placement& p : placed)
+            {
+                CopyBlocks(texels.data() + base, rowBytes, (p.X >> m) / bw, (p.Y >> m) / bh,
+                    mSources[p.Source].Subresources[m], blockBytes);
+            }
+
+            w = std::max<size_t>(w >> 1, 1);
+            h = std::max<size_t>(h >> 1, 1);
+        }
+
+        size_t covered = 0;
+        for(const Placement& p : placed)
+        {
+            PackedTextureRef& ref = mRefs[p.Source];
+            ref.Texture = UINT(mTextures.size());
+            ref.Slice = 0;
+            ref.UVScale = XMFLOAT2(float(p.Width) / atlasWidth, float(p.Height) / atlasHeight);
+            ref.UVOffset = XMFLOAT2(float(p.X) / atlasWidth, float(p.Y) / atlasHeight);
+
+            texture.Sources.push_back(p.Source);
+            covered += p.Width * p.Height;
+        }
+        mStats.WastedBytes += (atlasWidth * atlasHeight - covered) / (bw * bh) * blockBytes;
+
+        WriteDDS(texture.Desc, texels.data(), texels.size(), texture.DDSData);
+        mTextures.push_back(std::move(texture));
+    }
+}
+
+const std::vector<PackedTexture>& TexturePacker::GetTextures()const
+{
+    return mTextures;
+}
+
+const PackedTextureRef& TexturePacker::GetRef(UINT source)const
+{
+    return mRefs[source];
+}
+
+bool TexturePacker::Save(UINT texture, const std::wstring& filename)const
+{
+    return SUCCEEDED(SaveDDSFile(filename, mTextures[texture].DDSData));
+}
+
+TexturePacker::Stats TexturePacker::GetStats()const
+{
+    return mStats;
+}
+
+XMFLOAT4X4 TexturePacker::RemapTransform(const XMFLOAT4X4& matTransform, const PackedTextureRef& ref)
+{
+    XMMATRIX remap = XMMatrixScaling(ref.UVScale.x, ref.UVScale.y, 1.0f) *
+        XMMatrixTranslation(ref.UVOffset.x, ref.UVOffset.y, 0.0f);
+
+    XMFLOAT4X4 result;
+    XMStoreFloat4x4(&result, XMLoadFloat4x4(&matTransform) * remap);
+    return result;
+}
+
+bool TexturePacker::Verify(std::string& error)const
+{
+    for(UINT s = 0; s < mSources.size(); ++s)
+    {
+        const Source& source = mSources[s];
+        const PackedTextureRef& ref = mRefs[s];
+        const PackedTexture& texture = mTextures[ref.Texture];
+
+        DDSReader dds;
+        if(FAILED(dds.Parse(texture.DDSData.data(), texture.DDSData.size())))
+        {
+            error = "packed texture " + std::to_string(ref.Texture) + " does not parse";
+            return false;
+        }
+
+        const DDSTextureDesc& desc = dds.GetDesc();
+        const std::vector<DDSSubresource>& subs = dds.GetSubresources();
+        const size_t mips = (std::min)(desc.MipLevels, source.Desc.MipLevels);
+
+        uint32_t bw = 1;
+        uint32_t bh = 1;
+        GetBlockSize(desc.Format, &bw, &bh);
+        const size_t blockBytes = BlockBytes(desc.Format);
+
+        for(size_t m = 0; m < mips; ++m)
+        {
+            const DDSSubresource& src = source.Subresources[m];
+            const DDSSubresource& dst = subs[m + ref.Slice * desc.MipLevels];
+
+            // Top-left of the entry in this mip, in blocks and in bytes.
+            const size_t x = size_t(std::lround(ref.UVOffset.x * desc.Width)) >> m;
+            const size_t y = size_t(std::lround(ref.UVOffset.y * desc.Height)) >> m;
+            const uint8_t* first = dst.Data + (y / bh) * dst.RowBytes + (x / bw) * blockBytes;
+
+            for(size_t row = 0; row < src.NumRows; ++row)
+            {
+                if(memcmp(first + row * dst.RowBytes, src.Data + row * src.RowBytes, src.RowBytes) != 0)
+                {
+                    error = "source " + std::to_string(s) + " mip " + std::to_string(m) +
+                        " row " + std::to_string(row) + " differs";
+                    return false;
+                }
+            }
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,120 @@
+//***************************************************************************************
+// TexturePacker.h
+//
+// Offline packing of material textures into fewer, larger ones, so a scene binds a
+// handful of SRVs instead of one per DDS file.  Textures of the same format, size
+// and mip count become slices of one texture array.  Optionally, what is left over
+// is packed by format into atlases.  Atlas entries cannot use wrap addressing,
+// so textures that tile (e.g. a ground texture scaled by TexTransform) should stay
+// in arrays.
+//
+// Everything works on DDS data alone, copying whole blocks for block-compressed
+// formats, so packing runs headless and the result can be saved as .dds files.
+//***************************************************************************************
+
+#pragma once
+
+#include "DDSReader.h"
+#include <DirectXMath.h>
+#include <string>
+#include <vector>
+
+struct TexturePackerOptions
+{
+    // Put textures that have no same-sized partner into atlases instead of
+    // one-slice arrays.
+    bool AllowAtlas = false;
+
+    // Largest atlas side; a texture larger than this keeps an array of its own.
+    size_t MaxAtlasSize = 4096;
+
+    // Arrays are split when they get longer than this (D3D12 allows 2048 slices).
+    UINT MaxArraySize = 256;
+};
+
+// Where one source texture ended up.  Sample Texture at (uv*UVScale + UVOffset)
+// in array slice Slice.  For an array entry, the scale is 1 and the offset is 0.
+struct PackedTextureRef
+{
+    UINT Texture = 0;
+    UINT Slice = 0;
+    DirectX::XMFLOAT2 UVScale = { 1.0f, 1.0f };
+    DirectX::XMFLOAT2 UVOffset = { 0.0f, 0.0f };
+};
+
+///<summary>
+/// One packed texture, held as a complete DDS file (with a DX10 header) so it can be
+/// handed to CreateDDSTextureFromMemory12 or written to disk as is.
+///</summary>
+struct PackedTexture
+{
+    DirectX::DDSTextureDesc Desc;
+    bool IsAtlas = false;
+
+    // Source indices, by array slice for an array, or in placement order for an atlas.
+    std::vector<UINT> Sources;
+
+    std::vector<uint8_t> DDSData;
+};
+
+class TexturePacker
+{
+public:
+    struct Stats
+    {
+        UINT SourceTextures = 0;
+        UINT PackedTextures = 0;
+        UINT Arrays = 0;
+        UINT Atlases = 0;
+
+        UINT64 SourceBytes = 0; // Texel bytes of the sources.
+        UINT64 PackedBytes = 0; // Texel bytes of the packed textures.
+        UINT64 WastedBytes = 0; // Atlas area no source covers.
+
+        double Ms = 0.0;
+    };
+
+    TexturePacker() = default;
+    TexturePacker(const TexturePacker& rhs) = delete;
+    TexturePacker& operator=(const TexturePacker& rhs) = delete;
+
+    // Adds a 2D texture to pack.  Returns its source index, or -1 if the file cannot
+    // be read or is a cube map, volume or array, which are left alone.
+    int Add(const std::wstring& filename);
+
+    bool Pack(const TexturePackerOptions& options);
+
+    const std::vector<PackedTexture>& GetTextures()const;
+
+    // Indexed by source.
+    const PackedTextureRef& GetRef(UINT source)const;
+
+    bool Save(UINT texture, const std::wstring& filename)const;
+
+    Stats GetStats()const;
+
+    // Folds the packing into a material's UV transform, so that transform*remap
+    // lands in the packed texture.  Apply it to transforms that do not tile.
+    static DirectX::XMFLOAT4X4 RemapTransform(const DirectX::XMFLOAT4X4& matTransform, const PackedTextureRef& ref);
+
+    // Reads every packed texture back and compares each source's texels, every mip,
+    // with the source file.  Returns false on the first mismatch.
+    bool Verify(std::string& error)const;
+
+private:
+    struct Source
+    {
+        std::wstring Filename;
+        DirectX::DDSTextureDesc Desc;
+        std::vector<uint8_t> Data; // The whole file.
+        std::vector<DirectX::DDSSubresource> Subresources; // Point into Data.
+    };
+
+    void PackArray(const std::vector<UINT>& sources);
+    void PackAtlases(std::vector<UINT> sources, const TexturePackerOptions& options);
+
+    std::vector<Source> mSources;
+    std::vector<PackedTexture> mTextures;
+    std::vector<PackedTextureRef> mRefs;
+    Stats mStats;
+};
@@ -0,0 +1,357 @@
+//***************************************************************************************
+// TextureResidency.cpp
+//***************************************************************************************
+
+#include "TextureResidency.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+TextureResidency::TextureResidency()
+{
+}
+
+TextureResidency::TextureResidency(const Options& options)
+    : mOptions(options)
+{
+}
+
+int TextureResidency::Register(const std::wstring& filename)
+{
+    // Only the header is looked at, so the mapping never pages in the texels.
+    DDSReader dds;
+    if(FAILED(dds.Open(filename)))
+        return -1;
+
+    return Register(filename, dds.GetDesc());
+}
+
+int TextureResidency::Register(const std::wstring& filename, const DDSTextureDesc& desc)
+{
+    if(desc.MipLevels == 0 || desc.ArraySize == 0 || BitsPerPixel(desc.Format) == 0)
+        return -1;
+
+    Entry e;
+    e.Filename = filename;
+    e.Desc = desc;
+
+    // Same walk as DDSReader::LayOutSubresources, so the sizes match what gets uploaded.
+    size_t w = desc.Width;
+    size_t h = desc.Height;
+    size_t d = desc.Depth;
+    e.LowTopMip = UINT(desc.MipLevels - 1);
+    for(size_t i = 0; i < desc.MipLevels; ++i)
+    {
+        size_t numBytes = 0;
+        GetSurfaceInfo(w, h, desc.Format, &numBytes, nullptr, nullptr);
+        e.MipBytes.push_back(UINT64(numBytes) * d * desc.ArraySize);
+
+        if(e.LowTopMip == desc.MipLevels - 1 &&
+           w <= mOptions.LowMipSize && h <= mOptions.LowMipSize && d <= mOptions.LowMipSize)
+            e.LowTopMip = UINT(i);
+
+        w = std::max<size_t>(w >> 1, 1);
+        h = std::max<size_t>(h >> 1, 1);
+        d = std::max<size_t>(d >> 1, 1);
+    }
+
+    // The loader ignores maxsize for a single-level texture, so all of it is the low mip.
+    if(desc.MipLevels == 1)
+        e.LowTopMip = 0;
+
+    e.ResidentTopMip = e.LowTopMip;
+    e.WantedTopMip = e.LowTopMip;
+    for(UINT i = e.LowTopMip; i < e.MipBytes.size(); ++i)
+        e.ResidentBytes += e.MipBytes[i];
+
+    const UINT index = UINT(mEntries.size());
+    e.LruPosition = mLru.insert(mLru.end(), index);
+    mEntries.push_back(e);
+
+    mStats.ResidentBytes += e.ResidentBytes;
+    mStats.PeakResidentBytes = (std::max)(mStats.PeakResidentBytes, mStats.ResidentBytes);
+
+    return int(index);
+}
+
+void TextureResidency::Request(UINT texture, UINT wantedTopMip)
+{
+    Entry& e = mEntries[texture];
+
+    // Asking again in the same frame keeps the sharpest request.
+    wantedTopMip = (std::min)(wantedTopMip, e.LowTopMip);
+    e.WantedTopMip = (e.LastUsedFrame == mFrame) ? (std::min)(e.WantedTopMip, wantedTopMip) : wantedTopMip;
+    e.LastUsedFrame = mFrame;
+
+    mLru.splice(mLru.end(), mLru, e.LruPosition);
+}
+
+UINT TextureResidency::MipForCoverage(UINT texture, float pixels)const
+{
+    const Entry& e = mEntries[texture];
+    const float size = float((std::max)(e.Desc.Width, e.Desc.Height));
+    if(pixels <= 0.0f)
+        return e.LowTopMip;
+
+    // One mip level per halving of the texels per pixel.
+    const float mip = std::floor(std::log2((std::max)(size / pixels, 1.0f)));
+    return (std::min)(UINT(mip), e.LowTopMip);
+}
+
+const std::vector<ResidencyChange>& TextureResidency::Update()
+{
+    mChanges.clear();
+
+    // The budget may have been lowered.  Unused mips go first, then those of textures
+    // in use, but never the low mips.
+    while(mStats.ResidentBytes > mOptions.BudgetBytes && EvictOne(false))
+        ;
+    while(mStats.ResidentBytes > mOptions.BudgetBytes && EvictOne(true))
+        ;
+
+    // Stream in for the textures used this frame, the ones furthest from what they
+    // want first.  One level per texture per round, so a big texture does not take
+    // every load.
+    std::vector<UINT> wanting;
+    for(UINT i = 0; i < mEntries.size(); ++i)
+    {
+        const Entry& e = mEntries[i];
+        if(e.LastUsedFrame == mFrame && e.ResidentTopMip > e.WantedTopMip)
+            wanting.push_back(i);
+    }
+
+    std::sort(wanting.begin(), wanting.end(), [this](UINT a, UINT b)
+    {
+        const Entry& ea = mEntries[a];
+        const Entry& eb = mEntries[b];
+        const UINT gapA = ea.ResidentTopMip - ea.WantedTopMip;
+        const UINT gapB = eb.ResidentTopMip - eb.WantedTopMip;
+        if(gapA != gapB)
+            return gapA > gapB;
+        return ea.MipBytes[ea.ResidentTopMip - 1] < eb.MipBytes[eb.ResidentTopMip - 1];
+    });
+
+    UINT loads = 0;
+    while(!wanting.empty() && loads < mOptions.MaxLoadsPerUpdate)
+    {
+        std::vector<UINT> stillWanting;
+        for(UINT texture : wanting)
+        {
+            if(loads == mOptions.MaxLoadsPerUpdate)
+                break;
+
+            Entry& e = mEntries[texture];
+            const UINT64 bytes = e.MipBytes[e.ResidentTopMip - 1];
+            while(mStats.ResidentBytes + bytes > mOptions.BudgetBytes && EvictOne(false))
+                ;
+
+            if(mStats.ResidentBytes + bytes > mOptions.BudgetBytes)
+            {
+                // Everything left is in use; evicting it would only bring it back.
+                ++mStats.DeferredLoads;
+                continue;
+            }
+
+            LoadOne(e, texture);
+            ++loads;
+
+            if(e.ResidentTopMip > e.WantedTopMip)
+                stillWanting.push_back(texture);
+        }
+        wanting.swap(stillWanting);
+    }
+
+    ++mFrame;
+    return mChanges;
+}
+
+bool TextureResidency::EvictOne(bool evictInUse)
+{
+    for(UINT texture : mLru)
+    {
+        Entry& e = mEntries[texture];
+        if(e.ResidentTopMip >= e.LowTopMip)
+            continue;
+
+        // A texture in use can still give back levels sharper than it asked for.
+        const bool inUse = e.LastUsedFrame == mFrame;
+        if(inUse && !evictInUse && e.ResidentTopMip >= e.WantedTopMip)
+            continue;
+
+        ResidencyChange change;
+        change.Texture = texture;
+        change.Action = ResidencyAction::Evict;
+        change.Mip = e.ResidentTopMip;
+        change.Bytes = e.MipBytes[e.ResidentTopMip];
+        mChanges.push_back(change);
+
+        ++e.ResidentTopMip;
+        e.ResidentBytes -= change.Bytes;
+        mStats.ResidentBytes -= change.Bytes;
+        mStats.BytesEvicted += change.Bytes;
+        ++mStats.Evictions;
+        return true;
+    }
+
+    return false;
+}
+
+void TextureResidency::LoadOne(Entry& e, UINT texture)
+{
+    --e.ResidentTopMip;
+
+    ResidencyChange change;
+    change.Texture = texture;
+    change.Action = ResidencyAction::Load;
+    change.Mip = e.ResidentTopMip;
+    change.Bytes = e.MipBytes[e.ResidentTopMip];
+    mChanges.push_back(change);
+
+    e.ResidentBytes += change.Bytes;
+    mStats.ResidentBytes += change.Bytes;
+    mStats.PeakResidentBytes = (std::max)(mStats.PeakResidentBytes, mStats.ResidentBytes);
+    mStats.BytesLoaded += change.Bytes;
+    ++mStats.Loads;
+}
+
+void TextureResidency::SetBudget(UINT64 budgetBytes)
+{
+    mOptions.BudgetBytes = budgetBytes;
+}
+
+UINT64 TextureResidency::GetBudget()const
+{
+    return mOptions.BudgetBytes;
+}
+
+UINT TextureResidency::GetTextureCount()const
+{
+    return UINT(mEntries.size());
+}
+
+const std::wstring& TextureResidency::GetFilename(UINT texture)const
+{
+    return mEntries[texture].Filename;
+}
+
+UINT TextureResidency::GetResidentTopMip(UINT texture)const
+{
+    return mEntries[texture].ResidentTopMip;
+}
+
+UINT TextureResidency::GetLowTopMip(UINT texture)const
+{
+    return mEntries[texture].LowTopMip;
+}
+
+UINT64 TextureResidency::GetResidentBytes(UINT texture)const
+{
+    return mEntries[texture].ResidentBytes;
+}
+
+size_t TextureResidency::GetMaxSize(UINT texture)const
+{
+    const Entry& e = mEntries[texture];
+    size_t size = (std::max)((std::max)(e.Desc.Width, e.Desc.Height), e.Desc.Depth);
+    return std::max<size_t>(size >> e.ResidentTopMip, 1);
+}
+
+TextureResidency::Stats TextureResidency::GetStats()const
+{
+    return mStats;
+}
+
+bool TextureResidency::CheckInvariants(std::string& error)const
+{
+    UINT64 total = 0;
+    UINT64 lowTotal = 0;
+    for(UINT i = 0; i < mEntries.size(); ++i)
+    {
+        const Entry& e = mEntries[i];
+        if(e.ResidentTopMip > e.LowTopMip)
+        {
+            error = "texture " + std::to_string(i) + " lost its low mips";
+            return false;
+        }
+
+        UINT64 bytes = 0;
+        for(UINT m = e.ResidentTopMip; m < e.MipBytes.size(); ++m)
+            bytes += e.MipBytes[m];
+        if(bytes != e.ResidentBytes)
+        {
+            error = "texture " + std::to_string(i) + " resident bytes do not match its mips";
+            return false;
+        }
+
+        total += bytes;
+        for(UINT m = e.LowTopMip; m < e.MipBytes.size(); ++m)
+            lowTotal += e.MipBytes[m];
+    }
+
+    if(total != mStats.ResidentBytes)
+    {
+        error = "resident bytes do not add up";
+        return false;
+    }
+
+    if(lowTotal <= mOptions.BudgetBytes && total > mOptions.BudgetBytes)
+    {
+        error = std::to_string(total) + " bytes resident over a budget of " + std::to_string(mOptions.BudgetBytes);
+        return false;
+    }
+
+    return true;
+}
+
+bool TextureResidency::Simulate(const std::vector<DDSTextureDesc>& textures, const Options& options,
+    UINT frames, UINT seed, SimulationReport& report)
+{
+    report = SimulationReport();
+
+    TextureResidency residency(options);
+    for(size_t i = 0; i < textures.size(); ++i)
+        residency.Register(L"simulated" + std::to_wstring(i), textures[i]);
+
+    const UINT count = residency.GetTextureCount();
+    if(count == 0)
+        return false;
+
+    // A camera sweeping through the library: each frame sees a window of textures
+    // that drifts along, plus a few at random, at random distances.
+    std::mt19937 rng(seed);
+    const UINT window = (std::max)(1u, count / 4);
+    for(UINT frame = 0; frame < frames; ++frame)
+    {
+        // Halfway through, take away half the budget, as when another app or a
+        // resize needs the memory.
+        if(frame == frames / 2)
+            residency.SetBudget(options.BudgetBytes / 2);
+
+        const UINT first = (frame / 8) % count;
+        for(UINT i = 0; i < window; ++i)
+        {
+            const UINT texture = (first + i) % count;
+            residency.Request(texture, UINT(rng() % (residency.GetLowTopMip(texture) + 1)));
+        }
+        for(UINT i = 0; i < 2; ++i)
+        {
+            const UINT texture = UINT(rng() % count);
+            residency.Request(texture, UINT(rng() % (residency.GetLowTopMip(texture) + 1)));
+        }
+
+        residency.Update();
+
+        std::string error;
+        if(!residency.CheckInvariants(error))
+        {
+            if(report.Violations++ == 0)
+                report.FirstViolation = "frame " + std::to_string(frame) + ": " + error;
+        }
+        ++report.Frames;
+    }
+
+    report.Final = residency.GetStats();
+    return report.Violations == 0;
+}
@@ -0,0 +1,150 @@
+//***************************************************************************************
+// TextureResidency.h
+//
+// Decides how many mip levels of each texture to keep in video memory under a byte
+// budget.  A texture starts with only its low mips resident (those no larger than
+// LowMipSize), and higher mips stream in one level at a time as the texture is asked
+// for them.  When a load would go over the budget, the least recently used textures
+// give back their largest mips first.
+//
+// The manager only makes the decisions.  The app applies them, e.g. by recreating
+// the texture with CreateDDSTextureFromFile12's maxsize set to GetMaxSize, so the
+// policy can be run headless against a simulated budget (see Simulate).
+//***************************************************************************************
+
+#pragma once
+
+#include "DDSReader.h"
+#include <list>
+#include <string>
+#include <vector>
+
+enum class ResidencyAction
+{
+    Load,  // One more mip level became resident.
+    Evict, // The largest resident mip level was dropped.
+};
+
+struct ResidencyChange
+{
+    UINT Texture = 0;
+    ResidencyAction Action = ResidencyAction::Load;
+    UINT Mip = 0;     // The level loaded or evicted.
+    UINT64 Bytes = 0; // Its size across all array slices.
+};
+
+class TextureResidency
+{
+public:
+    struct Options
+    {
+        UINT64 BudgetBytes = 64 * 1024 * 1024;
+
+        // Mips no larger than this on either side are loaded up front and never evicted.
+        size_t LowMipSize = 64;
+
+        // Caps the levels streamed in by one Update, to spread the copies over frames.
+        UINT MaxLoadsPerUpdate = 4;
+    };
+
+    struct Stats
+    {
+        UINT64 ResidentBytes = 0;
+        UINT64 PeakResidentBytes = 0;
+        UINT64 BytesLoaded = 0;
+        UINT64 BytesEvicted = 0;
+        UINT Loads = 0;
+        UINT Evictions = 0;
+
+        // Loads put off because the budget was full of textures in use this frame.
+        UINT DeferredLoads = 0;
+    };
+
+    // Result of Simulate.  Violations counts frames on which an invariant failed.
+    struct SimulationReport
+    {
+        UINT Frames = 0;
+        UINT Violations = 0;
+        Stats Final;
+        std::string FirstViolation;
+    };
+
+    TextureResidency();
+    explicit TextureResidency(const Options& options);
+    TextureResidency(const TextureResidency& rhs) = delete;
+    TextureResidency& operator=(const TextureResidency& rhs) = delete;
+
+    // Registers a texture from its DDS header, reading the mip sizes the same way the
+    // loader lays them out.  Returns the texture's index, or -1 if the file is not a
+    // texture the loader accepts.  Only the low mips are counted as resident.
+    int Register(const std::wstring& filename);
+    int Register(const std::wstring& filename, const DirectX::DDSTextureDesc& desc);
+
+    // Marks the texture as used this frame and asks for mips down to wantedTopMip
+    // (0 is the full-size level).
+    void Request(UINT texture, UINT wantedTopMip);
+
+    // The mip a texture needs to be sharp when it covers about pixels texels across.
+    UINT MipForCoverage(UINT texture, float pixels)const;
+
+    // Evicts down to the budget, then streams in requested mips.  The returned changes
+    // are valid until the next Update.
+    const std::vector<ResidencyChange>& Update();
+
+    void SetBudget(UINT64 budgetBytes);
+    UINT64 GetBudget()const;
+
+    UINT GetTextureCount()const;
+    const std::wstring& GetFilename(UINT texture)const;
+    UINT GetResidentTopMip(UINT texture)const;
+    UINT GetLowTopMip(UINT texture)const;
+    UINT64 GetResidentBytes(UINT texture)const;
+
+    // The maxsize that makes the DDS loader keep just the resident mips.
+    size_t GetMaxSize(UINT texture)const;
+
+    Stats GetStats()const;
+
+    // Registers the given textures, then plays frames of random requests against the
+    // budget and checks after each Update that the budget holds whenever the low mips
+    // fit, that low mips stay resident, and that the byte counts add up.
+    static bool Simulate(const std::vector<DirectX::DDSTextureDesc>& textures, const Options& options,
+        UINT frames, UINT seed, SimulationReport& report);
+
+private:
+    struct Entry
+    {
+        std::wstring Filename;
+        DirectX::DDSTextureDesc Desc;
+
+        // Bytes of each mip level, summed over the array slices.
+        std::vector<UINT64> MipBytes;
+
+        UINT LowTopMip = 0;
+        UINT ResidentTopMip = 0;
+        UINT WantedTopMip = 0;
+        UINT64 ResidentBytes = 0;
+
+        UINT64 LastUsedFrame = 0;
+        std::list<UINT>::iterator LruPosition;
+    };
+
+    // Drops the largest resident mip of the least recently used texture that has
+    // anything above its low mips, skipping textures used this frame unless
+    // evictInUse.  Returns false if there was nothing to evict.
+    bool EvictOne(bool evictInUse);
+
+    void LoadOne(Entry& e, UINT texture);
+
+    bool CheckInvariants(std::string& error)const;
+
+    Options mOptions;
+    std::vector<Entry> mEntries;
+
+    // Front is the least recently used.
+    std::list<UINT> mLru;
+
+    UINT64 mFrame = 1;
+    std::vector<ResidencyChange> mChanges;
+    Stats mStats;
+};
@@ -0,0 +1,699 @@
+//***************************************************************************************
+// TriangleBVH.cpp
+//***************************************************************************************
+
+#include "TriangleBVH.h"
+#include "ParallelFor.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+    // Triangles binned by one chunk of a parallel pass.
+    const UINT BinChunkSize = 16*1024;
+
+    struct Bounds
+    {
+        XMFLOAT3 Min = XMFLOAT3(FLT_MAX, FLT_MAX, FLT_MAX);
+        XMFLOAT3 Max = XMFLOAT3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+        void Grow(const XMFLOAT3& mn, const XMFLOAT3& mx)
+        {
+            Min = XMFLOAT3((std::min)(Min.x, mn.x), (std::min)(Min.y, mn.y), (std::min)(Min.z, mn.z));
+            Max = XMFLOAT3((std::max)(Max.x, mx.x), (std::max)(Max.y, mx.y), (std::max)(Max.z, mx.z));
+        }
+
+        void Grow(const Bounds& b)
+        {
+            Grow(b.Min, b.Max);
+        }
+
+        // Half the surface area, which is all the heuristic needs.
+        float HalfArea()const
+        {
+            float dx = Max.x - Min.x;
+            float dy = Max.y - Min.y;
+            float dz = Max.z - Min.z;
+            return dx*dy + dy*dz + dz*dx;
+        }
+    };
+
+    struct Bin
+    {
+        Bounds Box;
+        UINT Count = 0;
+    };
+
+    float Axis(const XMFLOAT3& v, int axis)
+    {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    // The slab distances round differently from a triangle's distance, so a ray
+    // through a triangle on a box's face can seem to just miss the box, or enter it
+    // just past the triangle's hit.  Box tests allow this much relative slack.
+    const float BoxSlack = 1e-5f;
+
+    // The same slab test as SceneBVH, with BoxSlack.  On a hit, enter is where the
+    // ray enters the box, clamped to 0 for an origin inside it.
+    bool RayBox(const XMFLOAT3& origin, const XMFLOAT3& invDir, const XMFLOAT3& mn, const XMFLOAT3& mx,
+        float maxDistance, float& enter)
+    {
+        float tEnter = 0.0f;
+        float tExit = maxDistance;
+
+        const float o[3] = { origin.x, origin.y, origin.z };
+        const float inv[3] = { invDir.x, invDir.y, invDir.z };
+        const float lo[3] = { mn.x, mn.y, mn.z };
+        const float hi[3] = { mx.x, mx.y, mx.z };
+        for(int i = 0; i < 3; ++i)
+        {
+            float t0 = (lo[i] - o[i])*inv[i];
+            float t1 = (hi[i] - o[i])*inv[i];
+            if(t0 > t1)
+                std::swap(t0, t1);
+
+            tEnter = t0 > tEnter ? t0 : tEnter;
+            tExit = t1 < tExit ? t1 : tExit;
+        }
+
+        enter = tEnter;
+        return tEnter <= tExit + tExit*BoxSlack;
+    }
+}
+
+void TriangleBVH::Build(const void* vertices, UINT vertexStride, const std::uint32_t* indices, UINT indexCount,
+    int baseVertex, unsigned numThreads)
+{
+    BuildTriangles(vertices, vertexStride, indices, indexCount, baseVertex, numThreads);
+    BuildTree(numThreads);
+}
+
+void TriangleBVH::Build(const void* vertices, UINT vertexStride, const std::uint16_t* indices, UINT indexCount,
+    int baseVertex, unsigned numThreads)
+{
+    BuildTriangles(vertices, vertexStride, indices, indexCount, baseVertex, numThreads);
+    BuildTree(numThreads);
+}
+
+template<typename Index>
+void TriangleBVH::BuildTriangles(const void* vertices, UINT vertexStride, const Index* indices, UINT indexCount,
+    int baseVertex, unsigned numThreads)
+{
+    const UINT triCount = indexCount/3;
+    const BYTE* base = (const BYTE*)vertices;
+
+    mTriangles.resize(triCount);
+    mMins.resize(triCount);
+    mMaxs.resize(triCount);
+    mCentroids.resize(triCount);
+
+    ParallelFor(triCount, BinChunkSize, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+        {
+            XMFLOAT3 v[3];
+            for(int k = 0; k < 3; ++k)
+                std::memcpy(&v[k], base + (size_t)((int)indices[3*i + k] + baseVertex)*vertexStride, sizeof(XMFLOAT3));
+
+            mTriangles[i].V0 = v[0];
+            mTriangles[i].V1 = v[1];
+            mTriangles[i].V2 = v[2];
+
+            XMVECTOR a = XMLoadFloat3(&v[0]);
+            XMVECTOR b = XMLoadFloat3(&v[1]);
+            XMVECTOR c = XMLoadFloat3(&v[2]);
+            XMVECTOR mn = XMVectorMin(XMVectorMin(a, b), c);
+            XMVECTOR mx = XMVectorMax(XMVectorMax(a, b), c);
+            XMStoreFloat3(&mMins[i], mn);
+            XMStoreFloat3(&mMaxs[i], mx);
+            XMStoreFloat3(&mCentroids[i], XMVectorScale(XMVectorAdd(mn, mx), 0.5f));
+        }
+    }, numThreads);
+}
+
+void TriangleBVH::BuildTree(unsigned numThreads)
+{
+    const UINT triCount = (UINT)mTriangles.size();
+
+    mNodes.clear();
+    mGroups.clear();
+    mGroupTriangles.clear();
+    mTriangleCount = triCount;
+    mDepth = 0;
+    mOrder.resize(triCount);
+    for(UINT i = 0; i < triCount; ++i)
+        mOrder[i] = i;
+
+    if(triCount == 0)
+        return;
+
+    // Split the top of the tree a level at a time.  The biggest nodes are binned
+    // on every thread, the rest each on one, and their children are numbered in
+    // the order of their parents so the tree does not depend on the threads.
+    mNodes.push_back(Node());
+    std::vector<Task> tasks = { { 0, 0, triCount, 0 } };
+    std::vector<Task> next;
+    std::vector<Node> splitNodes;
+    std::vector<UINT> splits;
+    for(;;)
+    {
+        bool anyLarge = false;
+        for(const Task& t : tasks)
+            anyLarge = anyLarge || t.Count > SubtreeSize;
+        if(!anyLarge)
+            break;
+
+        splitNodes.assign(tasks.size(), Node());
+        splits.assign(tasks.size(), 0);
+        for(size_t i = 0; i < tasks.size(); ++i)
+        {
+            if(tasks[i].Count > ParallelBinSize)
+                splits[i] = Split(splitNodes[i], tasks[i].First, tasks[i].Count, numThreads);
+        }
+
+        ParallelFor(tasks.size(), 1, [&](size_t begin, size_t end)
+        {
+            for(size_t i = begin; i < end; ++i)
+            {
+                if(tasks[i].Count > SubtreeSize && tasks[i].Count <= ParallelBinSize)
+                    splits[i] = Split(splitNodes[i], tasks[i].First, tasks[i].Count, 1);
+            }
+        }, numThreads);
+
+        next.clear();
+        for(size_t i = 0; i < tasks.size(); ++i)
+        {
+            const Task& t = tasks[i];
+            if(t.Count <= SubtreeSize)
+            {
+                next.push_back(t);
+                continue;
+            }
+
+            Node node = splitNodes[i];
+            mDepth = (std::max)(mDepth, t.Depth);
+            if(splits[i] == 0)
+            {
+                node.Index = t.First;
+                node.Count = t.Count;
+                mNodes[t.Node] = node;
+                continue;
+            }
+
+            node.Index = (UINT)mNodes.size();
+            node.Count = 0;
+            mNodes[t.Node] = node;
+            mNodes.push_back(Node());
+            mNodes.push_back(Node());
+            next.push_back({ node.Index, t.First, splits[i], t.Depth + 1 });
+            next.push_back({ node.Index + 1, t.First + splits[i], t.Count - splits[i], t.Depth + 1 });
+        }
+        tasks.swap(next);
+    }
+
+    // Build what is left a subtree per thread, then append the subtrees in order.
+    std::vector<std::vector<Node>> subtrees(tasks.size());
+    std::vector<UINT> depths(tasks.size());
+    ParallelFor(tasks.size(), 1, [&](size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; ++i)
+            depths[i] = BuildSubtree(tasks[i], subtrees[i]);
+    }, numThreads);
+
+    for(size_t i = 0; i < tasks.size(); ++i)
+    {
+        const std::vector<Node>& subtree = subtrees[i];
+        const UINT offset = (UINT)mNodes.size() - 1;
+        for(size_t k = 0; k < subtree.size(); ++k)
+        {
+            Node n = subtree[k];
+            if(n.Count == 0)
+                n.Index += offset;
+
+            if(k == 0)
+                mNodes[tasks[i].Node] = n;
+            else
+                mNodes.push_back(n);
+        }
+        mDepth = (std::max)(mDepth, depths[i]);
+    }
+
+    // Pack each leaf's triangles into groups of four, padding its last group with
+    // empty triangles, and point the leaf at its first group.  Within a leaf they
+    // go in index buffer order, so the kernel's lower-lane tie rule picks the
+    // triangle that comes first in the index buffer.
+    std::vector<XMFLOAT3> corners;
+    corners.reserve(3*(triCount + 3*mNodes.size()));
+    mGroupTriangles.reserve(triCount + 3*mNodes.size());
+    for(Node& n : mNodes)
+    {
+        if(n.Count == 0)
+            continue;
+
+        UINT* first = &mOrder[n.Index];
+        std::sort(first, first + n.Count);
+
+        n.Index = (UINT)mGroupTriangles.size()/4;
+        for(UINT i = 0; i < n.Count; ++i)
+        {
+            const Triangle& tri = mTriangles[first[i]];
+            corners.push_back(tri.V0);
+            corners.push_back(tri.V1);
+            corners.push_back(tri.V2);
+            mGroupTriangles.push_back(first[i]);
+        }
+
+        while(mGroupTriangles.size() % 4 != 0)
+        {
+            corners.insert(corners.end(), 3, XMFLOAT3(0.0f, 0.0f, 0.0f));
+            mGroupTriangles.push_back(first[0]); // Never hit.
+        }
+    }
+    RayTriangle4::PackTriangles(corners.data(), (UINT)mGroupTriangles.size(), mGroups);
+
+    // Drop the scratch.
+    mOrder.clear();
+    mTriangles.clear();
+    mMins.clear();
+    mMaxs.clear();
+    mCentroids.clear();
+    mOrder.shrink_to_fit();
+    mTriangles.shrink_to_fit();
+    mMins.shrink_to_fit();
+    mMaxs.shrink_to_fit();
+    mCentroids.shrink_to_fit();
+}
+
+UINT TriangleBVH::Split(Node& node, UINT first, UINT count, unsigned numThreads)
+{
+    const UINT chunkCount = count > ParallelBinSize ? (count + BinChunkSize - 1)/BinChunkSize : 1;
+    const UINT chunkSize = (count + chunkCount - 1)/chunkCount;
+
+    // The node's bounds and its centroids' bounds.
+    std::vector<Bounds> chunkBounds(2*chunkCount);
+    ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t c = begin; c < end; ++c)
+        {
+            const UINT last = (std::min)(first + (UINT)(c + 1)*chunkSize, first + count);
+            for(UINT i = first + (UINT)c*chunkSize; i < last; ++i)
+            {
+                UINT t = mOrder[i];
+                chunkBounds[2*c].Grow(mMins[t], mMaxs[t]);
+                chunkBounds[2*c + 1].Grow(mCentroids[t], mCentroids[t]);
+            }
+        }
+    }, numThreads);
+
+    Bounds box, centroids;
+    for(UINT c = 0; c < chunkCount; ++c)
+    {
+        box.Grow(chunkBounds[2*c]);
+        centroids.Grow(chunkBounds[2*c + 1]);
+    }
+    node.Min = box.Min;
+    node.Max = box.Max;
+
+    float lo[3], scale[3];
+    for(int a = 0; a < 3; ++a)
+    {
+        lo[a] = Axis(centroids.Min, a);
+        float extent = Axis(centroids.Max, a) - lo[a];
+        scale[a] = extent > 0.0f ? BinCount/extent : 0.0f;
+    }
+
+    auto binOf = [&](UINT t, int a)
+    {
+        UINT b = (UINT)((Axis(mCentroids[t], a) - lo[a])*scale[a]);
+        return (std::min)(b, BinCount - 1);
+    };
+
+    // Bin every axis at once.
+    std::vector<Bin> chunkBins(chunkCount*3*BinCount);
+    ParallelFor(chunkCount, 1, [&](size_t begin, size_t end)
+    {
+        for(size_t c = begin; c < end; ++c)
+        {
+            Bin* bins = &chunkBins[c*3*BinCount];
+            const UINT last = (std::min)(first + (UINT)(c + 1)*chunkSize, first + count);
+            for(UINT i = first + (UINT)c*chunkSize; i < last; ++i)
+            {
+                UINT t = mOrder[i];
+                for(int a = 0; a < 3; ++a)
+                {
+                    Bin& bin = bins[a*BinCount + binOf(t, a)];
+                    bin.Box.Grow(mMins[t], mMaxs[t]);
+                    ++bin.Count;
+                }
+            }
+        }
+    }, numThreads);
+
+    Bin bins[3*BinCount];
+    for(UINT c = 0; c < chunkCount; ++c)
+    {
+        for(UINT b = 0; b < 3*BinCount; ++b)
+        {
+            bins[b].Box.Grow(chunkBins[c*3*BinCount + b].Box);
+            bins[b].Count += chunkBins[c*3*BinCount + b].Count;
+        }
+    }
+
+    // The cost of a split, in leaf kernel calls per unit of the node's area, is one
+    // for the traversal step plus each side's groups of four triangles weighted by
+    // its area.
+    auto groups = [](UINT n) { return (float)((n + 3)/4); };
+    int bestAxis = -1;
+    UINT bestBin = 0;
+    float bestCost = FLT_MAX;
+    for(int a = 0; a < 3; ++a)
+    {
+        if(scale[a] == 0.0f)
+            continue;
+
+        const Bin* axisBins = &bins[a*BinCount];
+        float leftCost[BinCount];
+        Bounds left;
+        UINT leftCount = 0;
+        for(UINT b = 0; b + 1 < BinCount; ++b)
+        {
+            left.Grow(axisBins[b].Box);
+            leftCount += axisBins[b].Count;
+            leftCost[b] = leftCount > 0 ? groups(leftCount)*left.HalfArea() : 0.0f;
+        }
+
+        Bounds right;
+        UINT rightCount = 0;
+        for(UINT b = BinCount - 1; b > 0; --b)
+        {
+            right.Grow(axisBins[b].Box);
+            rightCount += axisBins[b].Count;
+
+            // Splitting before bin b.
+            float cost = leftCost[b - 1] + (rightCount > 0 ? groups(rightCount)*right.HalfArea() : 0.0f);
+            if(rightCount > 0 && rightCount < count && cost < bestCost)
+            {
+                bestAxis = a;
+                bestBin = b;
+                bestCost = cost;
+            }
+        }
+    }
+
+    const float area = box.HalfArea();
+    const bool worthSplitting = bestAxis >= 0 && area + bestCost < groups(count)*area;
+    if(!worthSplitting && count <= MaxLeafSize)
+        return 0;
+
+    if(bestAxis < 0)
+    {
+        // Every centroid is in the same place, so no plane separates them; halve
+        // the list to keep leaves small.
+        return count/2;
+    }
+
+    UINT* begin = &mOrder[first];
+    UINT* end = begin + count;
+    UINT* mid = std::partition(begin, end, [&](UINT t) { return binOf(t, bestAxis) < bestBin; });
+    return (UINT)(mid - begin);
+}
+
+UINT TriangleBVH::BuildSubtree(const Task& task, std::vector<Node>& nodes)
+{
+    nodes.assign(1, Node());
+
+    UINT depth = 0;
+    std::vector<Task> stack = { { 0, task.First, task.Count, task.Depth } };
+    while(!stack.empty())
+    {
+        Task t = stack.back();
+        stack.pop_back();
+
+        Node node;
+        UINT split = Split(node, t.First, t.Count, 1);
+        depth = (std::max)(depth, t.Depth);
+        if(split == 0)
+        {
+            node.Index = t.First;
+            node.Count = t.Count;
+            nodes[t.Node] = node;
+            continue;
+        }
+
+        node.Index = (UINT)nodes.size();
+        node.Count = 0;
+        nodes[t.Node] = node;
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+
+        // Push the second child first so the first is built first.
+        stack.push_back({ node.Index + 1, t.First + split, t.Count - split, t.Depth + 1 });
+        stack.push_back({ node.Index, t.First, split, t.Depth + 1 });
+    }
+
+    return depth;
+}
+
+bool TriangleBVH::Intersect(FXMVECTOR origin, FXMVECTOR direction, float maxDistance,
+    float& distance, UINT& triangle)const
+{
+    if(mNodes.empty())
+        return false;
+
+    XMFLOAT3 o, inv;
+    XMStoreFloat3(&o, origin);
+    XMStoreFloat3(&inv, XMVectorReciprocal(direction));
+
+    float closest = maxDistance;
+    bool found = false;
+    UINT best = 0;
+
+    struct Entry
+    {
+        UINT Node;
+        float Enter;
+    };
+    std::vector<Entry> stack;
+    stack.reserve(64);
+
+    float enter = 0.0f;
+    if(RayBox(o, inv, mNodes[0].Min, mNodes[0].Max, closest, enter))
+        stack.push_back({ 0, enter });
+
+    while(!stack.empty())
+    {
+        Entry top = stack.back();
+        stack.pop_back();
+
+        // A closer hit may have been found since this box was pushed.
+        if(top.Enter > closest + closest*BoxSlack)
+            continue;
+
+        const Node& n = mNodes[top.Node];
+        if(n.Count > 0)
+        {
+            // Ties go to the first triangle in the index buffer, as they would when
+            // testing every triangle in order.  Within the leaf the kernel already
+            // picks it, so only a tie with an earlier leaf's hit is left, which
+            // means also taking hits at exactly the closest distance.
+            const float limit = found ? std::nextafter(closest, FLT_MAX) : closest;
+            float t = 0.0f;
+            UINT lane = 0;
+            if(RayTriangle4::IntersectClosest(origin, direction, &mGroups[n.Index], (n.Count + 3)/4,
+                limit, t, lane))
+            {
+                const UINT index = mGroupTriangles[4*n.Index + lane];
+                if(t < closest || index < best)
+                {
+                    closest = t;
+                    best = index;
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        const Node& child1 = mNodes[n.Index];
+        const Node& child2 = mNodes[n.Index + 1];
+        float enter1 = 0.0f;
+        float enter2 = 0.0f;
+        bool hit1 = RayBox(o, inv, child1.Min, child1.Max, closest, enter1);
+        bool hit2 = RayBox(o, inv, child2.Min, child2.Max, closest, enter2);
+
+        // Push the nearer child last so it is visited first.
+        if(hit1 && hit2)
+        {
+            if(enter1 < enter2)
+            {
+                stack.push_back({ n.Index + 1, enter2 });
+                stack.push_back({ n.Index, enter1 });
+            }
+            else
+            {
+                stack.push_back({ n.Index, enter1 });
+                stack.push_back({ n.Index + 1, enter2 });
+            }
+        }
+        else if(hit1)
+        {
+            stack.push_back({ n.Index, enter1 });
+        }
+        else if(hit2)
+        {
+            stack.push_back({ n.Index + 1, enter2 });
+        }
+    }
+
+    if(found)
+    {
+        distance = closest;
+        triangle = best;
+    }
+    return found;
+}
+
+UINT TriangleBVH::GetTriangleCount()const
+{
+    return mTriangleCount;
+}
+
+UINT TriangleBVH::GetNodeCount()const
+{
+    return (UINT)mNodes.size();
+}
+
+UINT TriangleBVH::GetDepth()const
+{
+    return mDepth;
+}
+
+bool TriangleBVH::Benchmark(UINT triangleCount, UINT rayCount, BenchmarkResult& result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    result = BenchmarkResult();
+
+    // A grid of hills 1000 across, laid out like the samples' vertices so the
+    // positions are read with a stride.
+    struct Vertex
+    {
+        XMFLOAT3 Pos;
+        XMFLOAT3 Normal;
+        XMFLOAT2 TexC;
+    };
+
+    const UINT n = (std::max)(2u, (UINT)std::sqrt(triangleCount/2.0)) + 1;
+    const float size = 1000.0f;
+    std::vector<Vertex> vertices(n*n);
+    for(UINT i = 0; i < n; ++i)
+    {
+        for(UINT j = 0; j < n; ++j)
+        {
+            float x = size*j/(n - 1) - 0.5f*size;
+            float z = size*i/(n - 1) - 0.5f*size;
+            float y = 20.0f*std::sin(0.02f*x)*std::cos(0.03f*z) + 2.0f*std::sin(0.5f*x + 0.7f*z);
+
+            Vertex& v = vertices[i*n + j];
+            v.Pos = XMFLOAT3(x, y, z);
+            v.Normal = XMFLOAT3(0.0f, 1.0f, 0.0f);
+            v.TexC = XMFLOAT2(0.0f, 0.0f);
+        }
+    }
+
+    std::vector<std::uint32_t> indices;
+    indices.reserve(6*(n - 1)*(n - 1));
+    for(UINT i = 0; i + 1 < n; ++i)
+    {
+        for(UINT j = 0; j + 1 < n; ++j)
+        {
+            indices.push_back(i*n + j);
+            indices.push_back((i + 1)*n + j);
+            indices.push_back(i*n + j + 1);
+
+            indices.push_back(i*n + j + 1);
+            indices.push_back((i + 1)*n + j);
+            indices.push_back((i + 1)*n + j + 1);
+        }
+    }
+    const UINT indexCount = (UINT)indices.size();
+    result.Triangles = indexCount/3;
+
+    TriangleBVH single;
+    auto start = Clock::now();
+    single.Build(vertices.data(), sizeof(Vertex), indices.data(), indexCount, 0, 1);
+    result.SingleThreadBuildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    TriangleBVH tree;
+    start = Clock::now();
+    tree.Build(vertices.data(), sizeof(Vertex), indices.data(), indexCount);
+    result.BuildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+    result.Nodes = tree.GetNodeCount();
+    result.Depth = tree.GetDepth();
+
+    bool matches = single.mGroupTriangles == tree.mGroupTriangles && single.mNodes.size() == tree.mNodes.size() &&
+        std::memcmp(single.mNodes.data(), tree.mNodes.data(), tree.mNodes.size()*sizeof(Node)) == 0;
+
+    // Rays from above the hills, most looking down and some skimming across them.
+    std::mt19937 rng(2468);
+    std::uniform_real_distribution<float> position(-0.5f*size, 0.5f*size);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    // Testing every triangle is slow, so only some rays are checked that way.
+    const UINT bruteForceRays = (std::min)(rayCount, 32u);
+    double bruteUs = 0.0;
+    double treeUs = 0.0;
+    for(UINT r = 0; r < rayCount; ++r)
+    {
+        XMVECTOR origin = XMVectorSet(position(rng), 40.0f, position(rng), 1.0f);
+        float down = r % 4 == 0 ? -0.05f : -1.0f;
+        XMVECTOR dir = XMVector3Normalize(XMVectorSet(unit(rng), down, unit(rng), 0.0f));
+
+        float distance = 0.0f;
+        UINT triangle = 0;
+        start = Clock::now();
+        bool hit = tree.Intersect(origin, dir, FLT_MAX, distance, triangle);
+        treeUs += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        if(hit)
+            ++result.RaysHit;
+
+        if(r >= bruteForceRays)
+            continue;
+
+        start = Clock::now();
+        bool bruteHit = false;
+        float bruteDistance = FLT_MAX;
+        UINT bruteTriangle = 0;
+        for(UINT i = 0; i < indexCount/3; ++i)
+        {
+            XMVECTOR v0 = XMLoadFloat3(&vertices[indices[3*i + 0]].Pos);
+            XMVECTOR v1 = XMLoadFloat3(&vertices[indices[3*i + 1]].Pos);
+            XMVECTOR v2 = XMLoadFloat3(&vertices[indices[3*i + 2]].Pos);
+
+            float t = 0.0f;
+            if(TriangleTests::Intersects(origin, dir, v0, v1, v2, t) && t < bruteDistance)
+            {
+                bruteHit = true;
+                bruteDistance = t;
+                bruteTriangle = i;
+            }
+        }
+        bruteUs += std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        matches = matches && hit == bruteHit && (!hit || (distance == bruteDistance && triangle == bruteTriangle));
+    }
+
+    result.BruteForceUs = bruteForceRays > 0 ? bruteUs/bruteForceRays : 0.0;
+    result.RayUs = rayCount > 0 ? treeUs/rayCount : 0.0;
+
+    result.Matches = matches;
+    return matches;
+}
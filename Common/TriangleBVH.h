@@ -0,0 +1,143 @@
+//***************************************************************************************
+// TriangleBVH.h
+//
+// A static bounding volume hierarchy over the triangles of one mesh, for picking and
+// other ray casts that would otherwise test every triangle.  Build reads positions
+// straight from a vertex buffer with any stride, e.g. MeshGeometry::VertexBufferCPU,
+// and 16- or 32-bit indices, and keeps its own copy of each triangle's corners, so
+// the buffers need not outlive it.  Each leaf's triangles are packed four to a
+// TriangleGroup4, the leaf's last group padded with empty triangles.
+//
+// Nodes are split with the surface area heuristic over 16 bins per axis, costing
+// triangles in groups of four; a node becomes a leaf when no split is cheaper than
+// testing its groups.  The top of
+// the tree is split a level at a time, the largest nodes binned on every thread and
+// the rest spread one per thread; below a few thousand triangles each subtree is
+// built on its own thread.  The tree comes out the same whatever the thread count.
+//
+// Intersect finds the closest hit, visiting the nearer child first and skipping
+// boxes that start beyond the closest hit so far.  Leaves are tested with
+// RayTriangle4::IntersectClosest, which hits exactly where TriangleTests::Intersects
+// does, so it returns what testing every triangle would.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cstdint>
+#include <vector>
+#include "RayTriangle4.h"
+
+class TriangleBVH
+{
+public:
+    struct BenchmarkResult
+    {
+        UINT Triangles = 0;
+        UINT Nodes = 0;
+        UINT Depth = 0;
+
+        double SingleThreadBuildMs = 0.0;
+        double BuildMs = 0.0;          // All threads.
+
+        // Per ray, averaged.
+        double BruteForceUs = 0.0;     // Every triangle tested.
+        double RayUs = 0.0;
+        UINT RaysHit = 0;
+
+        // Both builds made the same tree, and it found the same closest hits as
+        // testing every triangle.
+        bool Matches = false;
+    };
+
+    TriangleBVH() = default;
+    TriangleBVH(const TriangleBVH& rhs) = delete;
+    TriangleBVH& operator=(const TriangleBVH& rhs) = delete;
+
+    // Builds over indexCount/3 triangles.  Vertex i's position is the first three
+    // floats at vertices + i*vertexStride, and baseVertex is added to every index as
+    // in DrawIndexedInstanced.  numThreads = 0 uses one thread per hardware thread.
+    void Build(const void* vertices, UINT vertexStride, const std::uint32_t* indices, UINT indexCount,
+        int baseVertex = 0, unsigned numThreads = 0);
+    void Build(const void* vertices, UINT vertexStride, const std::uint16_t* indices, UINT indexCount,
+        int baseVertex = 0, unsigned numThreads = 0);
+
+    // Finds the closest triangle the ray hits nearer than maxDistance.  On a hit,
+    // distance is where along the ray, and triangle is the triangle's position in
+    // the index buffer, i.e. its first index over 3.  direction must be unit length.
+    bool Intersect(DirectX::FXMVECTOR origin, DirectX::FXMVECTOR direction, float maxDistance,
+        float& distance, UINT& triangle)const;
+
+    UINT GetTriangleCount()const;
+    UINT GetNodeCount()const;
+    UINT GetDepth()const;
+
+    // Builds over a bumpy grid of about triangleCount triangles on one thread and on
+    // all of them, then casts rayCount rays with the tree and some of them by testing
+    // every triangle.
+    static bool Benchmark(UINT triangleCount, UINT rayCount, BenchmarkResult& result);
+
+private:
+    struct Node
+    {
+        DirectX::XMFLOAT3 Min;
+        UINT Index;   // A leaf's first group in mGroups, or an inner node's first child.
+        DirectX::XMFLOAT3 Max;
+        UINT Count;   // A leaf's triangle count; 0 for an inner node, whose children are adjacent.
+    };
+
+    struct Triangle
+    {
+        DirectX::XMFLOAT3 V0;
+        DirectX::XMFLOAT3 V1;
+        DirectX::XMFLOAT3 V2;
+    };
+
+    // A node whose triangles are mOrder[First, First + Count) and whose subtree is
+    // still to be built.
+    struct Task
+    {
+        UINT Node;
+        UINT First;
+        UINT Count;
+        UINT Depth;
+    };
+
+    template<typename Index>
+    void BuildTriangles(const void* vertices, UINT vertexStride, const Index* indices, UINT indexCount,
+        int baseVertex, unsigned numThreads);
+    void BuildTree(unsigned numThreads);
+
+    // Sets the node's bounds and, if splitting pays, partitions its triangles and
+    // returns how many go to the first child; returns 0 for a leaf.
+    UINT Split(Node& node, UINT first, UINT count, unsigned numThreads);
+
+    // Builds a task's subtree with nodes[0] as its root, numbering the nodes it adds
+    // from 1, and returns the depth of its deepest leaf.
+    UINT BuildSubtree(const Task& task, std::vector<Node>& nodes);
+
+    static const UINT BinCount = 16;
+    static const UINT MaxLeafSize = 16;
+
+    // Nodes with more triangles than this are binned on several threads, and the
+    // top of the tree is split until no node has more than SubtreeSize.
+    static const UINT ParallelBinSize = 64*1024;
+    static const UINT SubtreeSize = 4096;
+
+    std::vector<Node> mNodes;              // The root first.
+    std::vector<TriangleGroup4> mGroups;   // The leaves' triangles, in tree order.
+    std::vector<UINT> mGroupTriangles;     // Each lane's position in the index buffer, four per group.
+    UINT mTriangleCount = 0;
+
+    // Build scratch.  mOrder holds the triangles' positions in the index buffer in
+    // tree order; the rest are per triangle in the index buffer's order.
+    std::vector<UINT> mOrder;
+    std::vector<Triangle> mTriangles;
+    std::vector<DirectX::XMFLOAT3> mMins;
+    std::vector<DirectX::XMFLOAT3> mMaxs;
+    std::vector<DirectX::XMFLOAT3> mCentroids;
+
+    UINT mDepth = 0;
+};
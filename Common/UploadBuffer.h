@@ -56,6 +56,22 @@ public:
     memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
   }
 
+  // Copies count consecutive elements with one memcpy.  Constant buffer elements are
+  // padded to 256 bytes, so this is for structured buffers only.
+  void CopyData(int firstElementIndex, const T* data, UINT count)
+  {
+    assert(!mIsConstantBuffer);
+    memcpy(&mMappedData[firstElementIndex*mElementByteSize], data, sizeof(T)*count);
+  }
+
+  // Copies only the first byteSize bytes of an element, for constants whose tail
+  // the shaders do not read, e.g. bones past the model's bone count.
+  void CopyBytes(int elementIndex, const void* data, size_t byteSize)
+  {
+    assert(byteSize <= sizeof(T));
+    memcpy(&mMappedData[elementIndex*mElementByteSize], data, byteSize);
+  }
+
 private:
   Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
   BYTE* mMappedData = nullptr;
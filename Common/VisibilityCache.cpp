@@ -0,0 +1,376 @@
+//***************************************************************************************
+// VisibilityCache.cpp
+//***************************************************************************************
+
+#include "VisibilityCache.h"
+#include "FrustumCuller.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <random>
+
+using namespace DirectX;
+
+namespace
+{
+    const UINT NotVisible = ~0u;
+    const double MaxTurn = 0.1;
+}
+
+void VisibilityCache::Reset(UINT objectCount)
+{
+    mSlots.assign(objectCount, NotVisible);
+    mStamps.assign(objectCount, 0);
+    mVisible.clear();
+    mValid = false;
+}
+
+void VisibilityCache::Invalidate()
+{
+    mValid = false;
+}
+
+void VisibilityCache::SetVisible(UINT object, bool visible)
+{
+    UINT& slot = mSlots[object];
+    if(visible == (slot != NotVisible))
+        return;
+
+    if(visible)
+    {
+        slot = (UINT)mVisible.size();
+        mVisible.push_back(object);
+    }
+    else
+    {
+        // Move the last visible object into the hole.
+        UINT last = mVisible.back();
+        mVisible[slot] = last;
+        mSlots[last] = slot;
+        mVisible.pop_back();
+        slot = NotVisible;
+    }
+
+    ++mStats.Changed;
+}
+
+int VisibilityCache::Test(const BoundingBox& box, UINT object)
+{
+    const XMFLOAT3& c = box.Center;
+    const XMFLOAT3& e = box.Extents;
+
+    // The same arithmetic as FrustumCuller, so the two agree on boxes that touch a
+    // plane.  A visible box stays visible until its nearest plane reaches it; a
+    // hidden one stays hidden until the plane it is furthest behind does.
+    bool visible = true;
+    float inside = FLT_MAX;
+    float outside = 0.0f;
+    float scale = 0.0f;
+    for(int p = 0; p < 6; ++p)
+    {
+        const XMFLOAT4& n = mPlanes[p];
+        float d = c.x*n.x + (c.y*n.y + (c.z*n.z + n.w));
+        float r = e.x*std::fabs(n.x) + (e.y*std::fabs(n.y) + e.z*std::fabs(n.z));
+        float f = d + r;
+        if(f < 0.0f)
+        {
+            visible = false;
+            outside = (std::max)(outside, -f);
+        }
+        else
+        {
+            inside = (std::min)(inside, f);
+        }
+        scale = (std::max)(scale, std::fabs(n.w));
+    }
+    SetVisible(object, visible);
+
+    // Leave room for rounding in the distances above.
+    scale += 1.0f + std::fabs(c.x) + std::fabs(c.y) + std::fabs(c.z) + e.x + e.y + e.z;
+    float slack = (visible ? inside : outside) - 1e-5f*scale;
+
+    // A plane that turns by dn and shifts by dw at mOrigin moves by at most
+    // |dn|*|p - mOrigin| + dw at a point p of the box.
+    float dx = c.x - mOrigin.x;
+    float dy = c.y - mOrigin.y;
+    float dz = c.z - mOrigin.z;
+    float radius = std::sqrt(dx*dx + dy*dy + dz*dz) + std::sqrt(e.x*e.x + e.y*e.y + e.z*e.z);
+
+    int k = 0;
+    std::frexp(radius, &k);
+    if(k < 0)
+        k = 0;
+    if(k >= QueueCount)
+    {
+        // Absurdly far out; retest it every frame.
+        k = QueueCount - 1;
+        slack = 0.0f;
+    }
+
+    Entry entry;
+    entry.Due = mTurn*std::ldexp(1.0, k) + mShift + slack;
+    entry.Object = object;
+    entry.Stamp = ++mStamps[object];
+    mQueues[k].Heap.push_back(entry);
+    ++mEntryCount;
+
+    return k;
+}
+
+void VisibilityCache::FullUpdate(const BoundingBox* boxes)
+{
+    // Distances are measured from near the eye, where the left, right and bottom
+    // planes meet, since turning the camera moves the planes least there.  An
+    // orthographic frustum has no such point and uses the world origin.
+    XMVECTOR n0 = XMLoadFloat4(&mPlanes[0]);
+    XMVECTOR n1 = XMLoadFloat4(&mPlanes[1]);
+    XMVECTOR n2 = XMLoadFloat4(&mPlanes[2]);
+    XMVECTOR c12 = XMVector3Cross(n1, n2);
+    float det = XMVectorGetX(XMVector3Dot(n0, c12));
+    mOrigin = XMFLOAT3(0.0f, 0.0f, 0.0f);
+    if(std::fabs(det) > 1e-6f)
+    {
+        XMVECTOR o = XMVectorScale(c12, mPlanes[0].w);
+        o = XMVectorMultiplyAdd(XMVector3Cross(n2, n0), XMVectorReplicate(mPlanes[1].w), o);
+        o = XMVectorMultiplyAdd(XMVector3Cross(n0, n1), XMVectorReplicate(mPlanes[2].w), o);
+        XMStoreFloat3(&mOrigin, XMVectorScale(o, -1.0f/det));
+    }
+
+    for(UINT i : mVisible)
+        mSlots[i] = NotVisible;
+    mVisible.clear();
+
+    mTurn = 0.0;
+    mShift = 0.0;
+    for(auto& queue : mQueues)
+    {
+        queue.Sorted.clear();
+        queue.Next = 0;
+        queue.Heap.clear();
+    }
+    mEntryCount = 0;
+
+    for(UINT i = 0; i < (UINT)mSlots.size(); ++i)
+        Test(boxes[i], i);
+
+    // Most objects will wait in these sorted runs until their slack is used up;
+    // only retested ones go through the heaps.
+    for(auto& queue : mQueues)
+    {
+        queue.Sorted.swap(queue.Heap);
+        std::sort(queue.Sorted.begin(), queue.Sorted.end(),
+            [](const Entry& a, const Entry& b) { return a.Due < b.Due; });
+    }
+
+    mStats.FullUpdate = true;
+    mStats.Retested = (UINT)mSlots.size();
+}
+
+void VisibilityCache::Update(const BoundingBox* boxes, FXMMATRIX viewProj, const std::vector<UINT>& moved)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+    auto start = Clock::now();
+
+    mStats = Stats();
+
+    XMFLOAT4 planes[6];
+    FrustumCuller::ExtractPlanes(viewProj, planes);
+
+    // How far the planes moved since the last update, at worst.  The planes are
+    // normalized, so w is a distance.
+    double turn = 0.0;
+    double shift = 0.0;
+    const XMFLOAT3& o = mOrigin;
+    for(int p = 0; p < 6; ++p)
+    {
+        const XMFLOAT4& a = mPlanes[p];
+        const XMFLOAT4& b = planes[p];
+        double nx = (double)b.x - a.x;
+        double ny = (double)b.y - a.y;
+        double nz = (double)b.z - a.z;
+        double wa = (double)a.x*o.x + (double)a.y*o.y + (double)a.z*o.z + a.w;
+        double wb = (double)b.x*o.x + (double)b.y*o.y + (double)b.z*o.z + b.w;
+        turn = (std::max)(turn, std::sqrt(nx*nx + ny*ny + nz*nz));
+        shift = (std::max)(shift, std::fabs(wb - wa));
+    }
+    std::copy(planes, planes + 6, mPlanes);
+
+    // Start over if the cache is new, if stale entries left behind by moved objects
+    // have piled up, or if the camera turned so far (over 5 degrees or so) that
+    // most objects would be retested anyway.
+    if(!mValid || mEntryCount > 4*mSlots.size() + 64 || turn > MaxTurn)
+    {
+        FullUpdate(boxes);
+        mValid = true;
+
+        mStats.UpdateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        return;
+    }
+
+    mTurn += turn;
+    mShift += shift;
+
+    // Take every object whose slack is used up off its queue before retesting any,
+    // since a retest can put an object straight back at the front.
+    mDue.clear();
+    for(int k = 0; k < QueueCount; ++k)
+    {
+        Queue& queue = mQueues[k];
+        const double motion = mTurn*std::ldexp(1.0, k) + mShift;
+        for(; queue.Next < queue.Sorted.size() && queue.Sorted[queue.Next].Due <= motion; ++queue.Next)
+        {
+            const Entry& e = queue.Sorted[queue.Next];
+            if(e.Stamp == mStamps[e.Object])
+                mDue.push_back(e.Object);
+            --mEntryCount;
+        }
+
+        std::vector<Entry>& heap = queue.Heap;
+        while(!heap.empty() && heap.front().Due <= motion)
+        {
+            const Entry& top = heap.front();
+            if(top.Stamp == mStamps[top.Object])
+                mDue.push_back(top.Object);
+
+            std::pop_heap(heap.begin(), heap.end());
+            heap.pop_back();
+            --mEntryCount;
+        }
+    }
+
+    for(UINT i : mDue)
+    {
+        std::vector<Entry>& heap = mQueues[Test(boxes[i], i)].Heap;
+        std::push_heap(heap.begin(), heap.end());
+    }
+    for(UINT i : moved)
+    {
+        std::vector<Entry>& heap = mQueues[Test(boxes[i], i)].Heap;
+        std::push_heap(heap.begin(), heap.end());
+    }
+
+    mStats.Retested = (UINT)(mDue.size() + moved.size());
+    mStats.UpdateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+const std::vector<UINT>& VisibilityCache::GetVisible()const
+{
+    return mVisible;
+}
+
+bool VisibilityCache::IsVisible(UINT object)const
+{
+    return mSlots[object] != NotVisible;
+}
+
+const VisibilityCache::Stats& VisibilityCache::GetStats()const
+{
+    return mStats;
+}
+
+bool VisibilityCache::Benchmark(UINT objectCount, UINT frames, BenchmarkResult& result)
+{
+    typedef std::chrono::high_resolution_clock Clock;
+
+    result = BenchmarkResult();
+    result.Objects = objectCount;
+    result.Frames = frames = (std::max)(frames, 1u);
+
+    // The same scene as SceneBVH::Benchmark: a cube of boxes at a million-box
+    // density, with the camera starting in the middle and seeing 1000 units.
+    const float side = 2000.0f*std::cbrt(objectCount/1e6f);
+    std::mt19937 rng(2468);
+    std::uniform_real_distribution<float> position(-0.5f*side, 0.5f*side);
+    std::uniform_real_distribution<float> extent(0.5f, 5.0f);
+    std::uniform_real_distribution<float> offset(-0.5f, 0.5f);
+
+    std::vector<BoundingBox> boxes(objectCount);
+    for(auto& b : boxes)
+    {
+        b.Center.x = position(rng);
+        b.Center.y = position(rng);
+        b.Center.z = position(rng);
+        b.Extents.x = extent(rng);
+        b.Extents.y = extent(rng);
+        b.Extents.z = extent(rng);
+    }
+
+    FrustumCuller culler;
+    culler.SetBoxes(boxes);
+
+    VisibilityCache cache;
+    cache.Reset(objectCount);
+
+    // One object in a thousand drifts every frame.
+    std::vector<UINT> moved;
+    for(UINT i = 0; i < objectCount; i += 1000)
+        moved.push_back(i);
+    result.Moving = (UINT)moved.size();
+
+    XMMATRIX proj = XMMatrixPerspectiveFovLH(0.25f*XM_PI, 16.0f/9.0f, 1.0f, 2000.0f);
+    XMFLOAT3 eye(0.0f, 0.0f, 0.0f);
+    float yaw = 0.0f;
+
+    std::vector<UINT> linear, cached;
+    double linearMs = 0.0;
+    double cachedMs = 0.0;
+    double fullMs = 0.0;
+    double visible = 0.0;
+    double retested = 0.0;
+    double changed = 0.0;
+    bool matches = true;
+    for(UINT frame = 0; frame < frames; ++frame)
+    {
+        for(UINT i : moved)
+        {
+            boxes[i].Center.x += offset(rng);
+            boxes[i].Center.y += offset(rng);
+            boxes[i].Center.z += offset(rng);
+            culler.SetBox(i, boxes[i]);
+        }
+
+        // Walk forward while turning at about 7 degrees a second at 60 Hz, with a
+        // sharp turn now and then.
+        yaw += (frame % 100 == 99) ? 1.5f : 0.002f;
+        XMVECTOR look = XMVectorSet(std::sin(yaw), 0.0f, std::cos(yaw), 0.0f);
+        XMStoreFloat3(&eye, XMVectorMultiplyAdd(look, XMVectorReplicate(0.1f), XMLoadFloat3(&eye)));
+        XMMATRIX view = XMMatrixLookToLH(XMLoadFloat3(&eye), look, XMVectorSet(0.0f, 1.0f, 0.0f, 0.0f));
+        XMMATRIX viewProj = XMMatrixMultiply(view, proj);
+
+        auto start = Clock::now();
+        culler.Cull(viewProj, linear);
+        linearMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        cache.Update(boxes.data(), viewProj, moved);
+
+        // Full updates, on the first frame and after the sharp turns, are timed
+        // apart from the rest, which are what the cache is for.
+        if(cache.GetStats().FullUpdate)
+        {
+            fullMs += cache.GetStats().UpdateMs;
+            ++result.FullUpdates;
+        }
+        else
+        {
+            cachedMs += cache.GetStats().UpdateMs;
+            retested += cache.GetStats().Retested;
+            changed += cache.GetStats().Changed;
+        }
+
+        cached = cache.GetVisible();
+        std::sort(cached.begin(), cached.end());
+        matches = matches && cached == linear;
+        visible += (double)linear.size();
+    }
+
+    const UINT cachedFrames = (std::max)(frames - result.FullUpdates, 1u);
+    result.LinearMs = linearMs/frames;
+    result.CachedMs = cachedMs/cachedFrames;
+    result.FullUpdateMs = fullMs/(std::max)(result.FullUpdates, 1u);
+    result.AverageVisible = (UINT)(visible/frames);
+    result.AverageRetested = (UINT)(retested/cachedFrames);
+    result.AverageChanged = (UINT)(changed/cachedFrames);
+    result.Matches = matches;
+    return matches;
+}
@@ -0,0 +1,126 @@
+//***************************************************************************************
+// VisibilityCache.h
+//
+// Frustum culling that carries the visible set from one frame to the next.  When an
+// object is tested, the cache also notes its slack: how far the frustum planes would
+// have to move before the result could change.  Each frame it measures how far the
+// planes moved, and retests only the objects whose slack that motion may have used up,
+// plus the objects the caller says moved.  A still camera retests nothing, and a
+// moving one retests about the objects near the frustum's boundary, however many
+// objects there are.
+//
+// How far a plane moves at a point grows with the point's distance from where the
+// cache was filled, since turning swings distant points further.  Objects are queued
+// by that distance, rounded up to a power of two, each queue ordered by when the
+// motion so far will reach the objects' slack.  A queue is a run sorted when the
+// cache was filled plus a heap for the objects retested since, so most objects are
+// taken off a queue without touching a heap.
+//
+// The visible set is the one FrustumCuller finds from scratch; Benchmark checks that
+// along a camera path.
+//***************************************************************************************
+
+#pragma once
+
+#include <windows.h>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <vector>
+
+class VisibilityCache
+{
+public:
+    struct Stats
+    {
+        bool FullUpdate = false;
+        UINT Retested = 0;  // Including the objects that moved.
+        UINT Changed = 0;   // Objects that entered or left the view.
+        double UpdateMs = 0.0;
+    };
+
+    struct BenchmarkResult
+    {
+        UINT Objects = 0;
+        UINT Frames = 0;
+        UINT Moving = 0;          // Objects moved each frame.
+        UINT AverageVisible = 0;
+        UINT AverageRetested = 0;
+        UINT AverageChanged = 0;
+        UINT FullUpdates = 0;     // The first frame and the sharp turns.
+
+        // Per frame, averaged.
+        double LinearMs = 0.0;    // FrustumCuller over every box, all threads.
+        double CachedMs = 0.0;    // Frames without a full update.
+        double FullUpdateMs = 0.0;
+
+        // The cached set matched culling from scratch on every frame.
+        bool Matches = false;
+    };
+
+    // Sizes the cache for objectCount objects and invalidates it.
+    void Reset(UINT objectCount);
+
+    // Makes the next update test every object, e.g. after the camera jumps.  Turns
+    // of more than a few degrees between updates do the same by themselves.
+    void Invalidate();
+
+    // Brings the visible set up to date for viewProj.  boxes[i] is object i's box,
+    // and moved lists the objects whose boxes changed since the last update.
+    void Update(const DirectX::BoundingBox* boxes, DirectX::FXMMATRIX viewProj, const std::vector<UINT>& moved);
+
+    // In no particular order.
+    const std::vector<UINT>& GetVisible()const;
+    bool IsVisible(UINT object)const;
+
+    const Stats& GetStats()const;
+
+    // Moves a camera through objectCount random boxes, some of them moving, and
+    // compares the cached visible set with FrustumCuller's every frame.
+    static bool Benchmark(UINT objectCount, UINT frames, BenchmarkResult& result);
+
+private:
+    struct Entry
+    {
+        double Due;   // The queue's motion at which the object must be retested.
+        UINT Object;
+        UINT Stamp;   // Matches the object's stamp unless it was retested since.
+
+        bool operator<(const Entry& rhs)const { return Due > rhs.Due; }
+    };
+
+    // Tests an object against mPlanes, updates its visibility and appends its retest
+    // to a queue's heap, returning the queue; the caller restores the heap order.
+    int Test(const DirectX::BoundingBox& box, UINT object);
+    void SetVisible(UINT object, bool visible);
+    void FullUpdate(const DirectX::BoundingBox* boxes);
+
+    struct Queue
+    {
+        std::vector<Entry> Sorted;  // By Due, from Next on.
+        size_t Next = 0;
+        std::vector<Entry> Heap;
+    };
+
+    static const int QueueCount = 32;
+
+    // Per object, its position in mVisible, or ~0 if it is not visible.
+    std::vector<UINT> mSlots;
+    std::vector<UINT> mVisible;
+    std::vector<UINT> mStamps;
+
+    // Queue k holds the objects within 2^k of mOrigin; its motion is
+    // mTurn*2^k + mShift.  Entries left by moved or retested objects stay until
+    // they come due and are then skipped.
+    Queue mQueues[QueueCount];
+    size_t mEntryCount = 0;
+
+    DirectX::XMFLOAT4 mPlanes[6];
+    DirectX::XMFLOAT3 mOrigin;
+    double mTurn = 0.0;   // The sum over frames of the largest change in a plane's normal.
+    double mShift = 0.0;  // The same for the planes' distances from mOrigin.
+    bool mValid = false;
+
+    std::vector<UINT> mDue;
+
+    Stats mStats;
+};
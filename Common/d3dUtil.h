@@ -247,6 +247,9 @@ struct Material
 	// Index into SRV heap for diffuse texture.
 	int DiffuseSrvHeapIndex = -1;
 
+	// Array slice of the diffuse texture, for textures packed into arrays.
+	int DiffuseSrvSlice = 0;
+
 	// Index into SRV heap for normal texture.
 	int NormalSrvHeapIndex = -1;
 